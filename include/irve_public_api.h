@@ -63,6 +63,28 @@ namespace irve {//NOT irve::internal
          * @return True if logging is disabled, false otherwise
         */
         bool logging_disabled();
+
+        /**
+         * @brief Change which log() messages (from libirve and from you) are logged at runtime
+         * @param spec "all", "off" (the default), "<max indent>" (every subsystem), or
+         *             "<max indent>:<subsystem>[,<subsystem>...]" (just those subsystems). Subsystems are
+         *             other (which includes log()), memory, decode, execute, csr, uart, and gdbserver.
+         * @return False (leaving the current settings unchanged) if spec is invalid
+         * @note   This has no effect if logging_disabled()
+        */
+        bool configure(const char* spec);
+
+        /**
+         * @brief Receives an emulator_t's log messages (and guest output) instead of stderr/stdout
+         * @param context Whatever was passed to the emulator_t constructor along with the callback
+         * @param inst_num The instruction count when the message was logged (0 if not applicable)
+         * @param indent The indentation level of the message
+         * @param message The message, without a trailing newline
+         * @param guest_output True for output from the guest (which would otherwise go to stdout)
+         * @note May be called from any thread that is using the emulator_t, and from its helper
+         *  threads (ex. the UART's), so it must be thread-safe if context is shared
+        */
+        typedef void (*callback_t)(void* context, uint64_t inst_num, uint8_t indent, const char* message, bool guest_output);
     }
 
     /**
@@ -133,6 +155,19 @@ namespace irve {//NOT irve::internal
         bool fuzzish_build();
     }
 
+    /**
+     * @brief Contains functions to work with binary instruction traces (see emulator_t::start_trace())
+    */
+    namespace trace {
+        /**
+         * @brief Convert a binary trace to text, one instruction (or interrupt) per line
+         * @param trace_path The trace to convert
+         * @param text_path Where to write the text, or nullptr for stdout
+         * @return False if the trace couldn't be read or the text couldn't be written
+        */
+        bool decode(const char* trace_path, const char* text_path);
+    }
+
     //Things that depend on previous declarations
 
     //We have to do it this way to maintain ABI compatibility: https://en.cppreference.com/w/cpp/language/pimpl
@@ -142,9 +177,46 @@ namespace irve {//NOT irve::internal
      * @brief The namespace containing the actual emulator_t class
     */
     namespace emulator {
+        /**
+         * @brief Counters describing what an emulator_t has been doing (see emulator_t::get_stats())
+        */
+        struct stats_t {
+            uint64_t inst_count;//minstret
+            uint64_t insts_by_opcode[32];//Indexed by the major opcode (bits [6:2] of the instruction)
+            uint64_t icache_hits;
+            uint64_t icache_misses;
+            uint64_t icache_flushes;
+            uint64_t tlb_hits;//Always 0 since IRVE has no TLB
+            uint64_t tlb_misses;//Every access that needed translating
+            uint64_t page_table_reads;//PTEs read while walking page tables
+            uint64_t pte_ad_updates;//PTEs whose A/D bits were set in hardware (Svadu) instead of faulting
+            uint64_t exceptions_by_cause[16];
+            uint64_t interrupts_by_cause[16];
+            uint64_t aclint_reads;
+            uint64_t aclint_writes;
+            uint64_t uart_reads;
+            uint64_t uart_writes;
+            uint64_t debug_writes;//To the RVDEBUGADDR debug output address
+            uint64_t peripheral_updates;
+            uint64_t peripheral_update_time_ns;//Total host time spent updating the timer and peripherals
+            uint64_t wfi_sleeps;//Times a WFI put the host thread to sleep
+            uint64_t wfi_sleep_time_ns;//Total host time spent asleep in WFI
+            uint64_t native_sbi_calls;//SBI calls handled by the emulator instead of the firmware
+            uint64_t misaligned_accesses;//Misaligned loads and stores performed by the emulator instead of trapping
+        };
+
         //We have to do it this way to maintain ABI compatibility: https://en.cppreference.com/w/cpp/language/pimpl
         /**
          * @brief The main IRVE emulator class
+         *
+         * Everything an emulator_t needs is owned by it, so independent instances can be created, run
+         * and destroyed on separate threads at the same time without any shared locks (the only
+         * process-wide state is the logging configuration, which is read atomically, and stdin,
+         * which only one "stdio" UART reads at a time). A single instance must only be used by one
+         * thread at a time (though with more than one hart, it uses more threads internally).
+         *
+         * Give each instance its own logging::callback_t to keep their log messages (and guest
+         * output) apart; otherwise they are all written to stderr/stdout a whole line at a time.
         */
         class emulator_t {//TODO provide read-only access to the CPU state at the end for integration testing
         public:
@@ -157,21 +229,89 @@ namespace irve {//NOT irve::internal
             */
             emulator_t(int imagec, const char* const* imagev);
 
+            /**
+             * @brief Construct a new emulator_t with a particular UART backend
+             * @param imagec The number of images to load into memory
+             * @param imagev The names of the images to load into memory (array of char*)
+             * @param uart_backend_spec Where the UART's input comes from and its output goes to: "stdio" (the
+             *  default), "file:<output path>[,<input path>]", "pty", or "unix:<socket path>"
+            */
+            emulator_t(int imagec, const char* const* imagev, const char* uart_backend_spec);
+
+            /**
+             * @brief Construct a new emulator_t whose log messages go to a callback
+             * @param imagec The number of images to load into memory
+             * @param imagev The names of the images to load into memory (array of char*)
+             * @param uart_backend_spec Where the UART's input comes from and its output goes to (see above)
+             * @param log_callback Receives everything this emulator_t logs (including while it is being
+             *  constructed and destroyed), or nullptr for stderr/stdout
+             * @param log_context Passed to log_callback
+            */
+            emulator_t(int imagec, const char* const* imagev, const char* uart_backend_spec, logging::callback_t log_callback, void* log_context);
+
             /**
              * @brief Destroy an emulator_t and free up its resources
             */
             ~emulator_t();
 
             /**
-             * @brief Emulate one instruction
+             * @brief Emulate more than one hart, all sharing the same memory and peripherals
+             * @param hart_count How many harts there should be in total (1 to 4095). Each one starts from
+             *  the same PC with mhartid set to its number, and gets its own ACLINT msip and mtimecmp
+             *  registers (msip at 4 * mhartid and mtimecmp at 0x4000 + 8 * mhartid)
+             * @note Must be called before anything is run, and only once
+             * @return False if hart_count is out of range, this was already called, or virtual time is on
+            */
+            bool set_hart_count(uint32_t hart_count);
+
+            /**
+             * @brief Make mtime count instructions rather than host time, so runs are reproducible
+             * @param insts_per_tick How many instructions it takes for mtime to increment. WFI and idle
+             *  loops (jumps to the same instruction) skip straight to mtimecmp instead of waiting for it
+             * @note Must be called before anything is run, and only with a single hart
+             * @return False if insts_per_tick is 0 or there are several harts
+            */
+            bool set_virtual_time(uint64_t insts_per_tick);
+
+            /**
+             * @brief Change how many times per second mtime increments (1000 by default)
+             * @param frequency Should match timebase-frequency in the guest's device tree
+             * @note Has no effect in virtual time, and must be called before anything is run
+             * @return False if frequency is 0
+            */
+            bool set_timebase_frequency(uint64_t frequency);
+
+            /**
+             * @brief Choose whether SBI calls from S-mode are handled by the emulator rather than the firmware
+             * @param enable True to handle the TIME, IPI, RFENCE and DBCN extensions (and the legacy calls
+             *  for the same things) natively, skipping the trip through M-mode. The firmware still handles
+             *  everything else, including probe_extension(), so it should advertise what the guest may use
+             * @note Off by default
+            */
+            void set_native_sbi(bool enable);
+
+            /**
+             * @brief Choose whether misaligned loads and stores to RAM are performed by the emulator
+             * @param enable True to perform them directly (even if they cross a page boundary) rather than
+             *  raising address-misaligned exceptions for the guest to emulate in a trap handler. Misaligned
+             *  accesses to peripherals, and misaligned AMOs, still raise exceptions
+             * @note Off by default
+            */
+            void set_misaligned_access(bool enable);
+
+            /**
+             * @brief Emulate one instruction (on each hart, one after another)
+             * @note A WFI puts the calling thread to sleep until an interrupt is pending, but only for a
+             *  few milliseconds at most (and not at all if there are several harts)
             */
             bool tick();//Returns true if the emulator should continue running
 
             /**
              * @brief Repeatedly emulate instructions
-             * @param inst_count The value of minstret at which to stop
+             * @param inst_count The value of hart 0's minstret at which to stop
              * Runs the emulator until the given instruction count is reached or an exit request is made
              * For dynamic linking to libirve, this is more efficient than calling tick() in a loop
+             * Every hart other than hart 0 runs on a host thread of its own while this is running
              *
             */
             void run_until(uint64_t inst_count);
@@ -185,10 +325,70 @@ namespace irve {//NOT irve::internal
 
             /**
              * @brief Get the current instruction count
-             * @return minstret
+             * @return Hart 0's minstret
             */
             uint64_t get_inst_count() const;
 
+            /**
+             * @brief Get counters describing what the emulator has been doing, to help understand why
+             *  a workload runs slowly
+             * @return A snapshot of the counters (hart 0's, if there are several harts)
+            */
+            stats_t get_stats() const;
+
+            /**
+             * @brief Start writing a compact binary trace of every instruction executed
+             * @param trace_path Where to write the trace (use irve::trace::decode() to read it)
+             * @return False if the trace file couldn't be created
+            */
+            bool start_trace(const char* trace_path);
+
+            /**
+             * @brief Stop tracing and finish writing out the trace (also happens on destruction)
+            */
+            void stop_trace();
+
+            /**
+             * @brief Start sampling the guest PC (and privilege mode) every period instructions
+             * @param output_path Where to write the profile, in the folded-stack format flamegraph.pl
+             *  and similar tools read; samples are resolved using the symbols from any ELF images loaded
+             * @param period How many instructions between samples (must be nonzero)
+             * @return False if the profile file couldn't be created
+            */
+            bool start_profiling(const char* output_path, uint32_t period);
+
+            /**
+             * @brief Stop profiling and write out the profile (also happens on destruction)
+            */
+            void stop_profiling();
+
+            /**
+             * @brief Start counting every instruction executed and following calls and returns, for an
+             *  exact profile with inclusive costs per call that KCachegrind/callgrind_annotate can read
+             * @param output_path Where to write the callgrind profile; instructions are grouped into
+             *  functions using the symbols from any ELF images loaded
+             * @return False if the profile file couldn't be created
+            */
+            bool start_callgraph_profiling(const char* output_path);
+
+            /**
+             * @brief Stop callgrind profiling and write out the profile (also happens on destruction)
+            */
+            void stop_callgraph_profiling();
+
+            /**
+             * @brief Start measuring IRVE itself with the host's hardware performance counters
+             *        (Linux perf_event_open) whenever run_until() is running
+             * @note Must be called from the thread that will call run_until()
+             * @return False if none of the counters could be opened
+            */
+            bool start_host_perf();
+
+            /**
+             * @brief Stop measuring the host and print a report (also happens on destruction)
+            */
+            void stop_host_perf();
+
         private:
             /**
              * @brief The pointer to the internal emulator_t
@@ -5,7 +5,8 @@
  *  Copyright (C) 2024 John Jekel\n
  *  See the LICENSE file at the root of the project for licensing info.
  * 
- * Bare-bones, only implementing the timer portion and only one mtimecmp register.
+ * Implements an MSWI (msip) and an MTIMER (mtimecmp) register for each hart, plus the shared mtime.
+ * The registers themselves live in each hart's Csr.
  *
 */
 
@@ -21,25 +22,34 @@
 
 using namespace irve::internal;
 
-Aclint::Aclint(Csr& csrs) : m_csrs(csrs) {}
+Aclint::Aclint(Csr& csrs) : m_csrs{&csrs} {}
+
+void Aclint::add_hart(Csr& csrs) {
+    assert((csrs.hart_id() == this->m_csrs.size()) && "Harts must be added in order");
+    this->m_csrs.push_back(&csrs);
+}
 
 Word Aclint::read(Aclint::Address register_address) {
     assert(((static_cast<uint16_t>(register_address) & 0b11) == 0) && "Unaligned access to ACLINT");
 
     irvelog(10, "ACLINT read from offset 0x%04X\n", register_address);
 
-    //TODO other ACLINT features if they are needed by the kernel
-
-    Csr::Address csr_addr;
+    uint16_t offset = static_cast<uint16_t>(register_address);
     switch (register_address) {
-        case Address::MTIME:        csr_addr = Csr::Address::MTIME; break;
-        case Address::MTIMEH:       csr_addr = Csr::Address::MTIMEH; break;
-        case Address::MTIMECMP:     csr_addr = Csr::Address::MTIMECMP; break;
-        case Address::MTIMECMPH:    csr_addr = Csr::Address::MTIMECMPH; break;
-        default: return 0;//All other mtimecmp registers are read as 0 (also the MSWI isn't implemented)
+        case Address::MTIME:        return this->m_csrs[0]->implicit_read(Csr::Address::MTIME);//mtime is shared, so any hart's will do
+        case Address::MTIMEH:       return this->m_csrs[0]->implicit_read(Csr::Address::MTIMEH);
+        case Address::MSWI_BEGIN ... Address::MSWI_END: {
+            std::size_t hart = (offset - static_cast<uint16_t>(Address::MSWI_BEGIN)) / 4;
+            return (hart < this->m_csrs.size()) ? this->m_csrs[hart]->msip() : 0;//msip of harts that don't exist reads as 0
+        }
+        default: {//One of the mtimecmp registers
+            std::size_t hart = (offset - static_cast<uint16_t>(Address::MTIMECMP)) / 8;
+            if (hart >= this->m_csrs.size()) {
+                return 0;//mtimecmp of harts that don't exist reads as 0
+            }
+            return this->m_csrs[hart]->implicit_read((offset & 0b100) ? Csr::Address::MTIMECMPH : Csr::Address::MTIMECMP);
+        }
     }
-
-    return this->m_csrs.implicit_read(csr_addr);
 }
 
 void Aclint::write(Aclint::Address register_address, Word data) {
@@ -47,16 +57,23 @@ void Aclint::write(Aclint::Address register_address, Word data) {
 
     irvelog(10, "ACLINT write to offset 0x%04X with data 0x%08X\n", register_address, data.u);
 
-    //TODO other ACLINT features if they are needed by the kernel
-
-    Csr::Address csr_addr;
+    uint16_t offset = static_cast<uint16_t>(register_address);
     switch (register_address) {
-        case Address::MTIME:        csr_addr = Csr::Address::MTIME; break;
-        case Address::MTIMEH:       csr_addr = Csr::Address::MTIMEH; break;
-        case Address::MTIMECMP:     csr_addr = Csr::Address::MTIMECMP; break;
-        case Address::MTIMECMPH:    csr_addr = Csr::Address::MTIMECMPH; break;
-        default: return;//Ignore writes to other timecmp registers (also the MSWI isn't implemented)
+        case Address::MTIME:        this->m_csrs[0]->implicit_write(Csr::Address::MTIME, data); return;
+        case Address::MTIMEH:       this->m_csrs[0]->implicit_write(Csr::Address::MTIMEH, data); return;
+        case Address::MSWI_BEGIN ... Address::MSWI_END: {//This is how harts send each other IPIs
+            std::size_t hart = (offset - static_cast<uint16_t>(Address::MSWI_BEGIN)) / 4;
+            if (hart < this->m_csrs.size()) {
+                this->m_csrs[hart]->set_msip(data.bit(0).u);//The upper bits are hardwired to 0
+            }
+            return;
+        }
+        default: {//One of the mtimecmp registers
+            std::size_t hart = (offset - static_cast<uint16_t>(Address::MTIMECMP)) / 8;
+            if (hart < this->m_csrs.size()) {
+                this->m_csrs[hart]->implicit_write((offset & 0b100) ? Csr::Address::MTIMECMPH : Csr::Address::MTIMECMP, data);
+            }
+            return;
+        }
     }
-
-    this->m_csrs.implicit_write(csr_addr, data);
 }
@@ -14,6 +14,7 @@
  * --------------------------------------------------------------------------------------------- */
 
 #include <stdint.h>
+#include <vector>
 
 #include "common.h"
 #include "csr.h"
@@ -36,14 +37,18 @@ public:
 
         MTIME        = 0xBFF8,
         MTIMEH       = 0xBFFC,
-        MTIMECMP     = 0x4000,
+        MTIMECMP     = 0x4000, // Hart 0's; each hart's mtimecmp is 8 bytes after the previous one's
         MTIMECMPH    = 0x4004
-        // No other timecmp registers are implemented.
+        // Similarly, each hart's msip register is 4 bytes after the previous one's, from MSWI_BEGIN
     };
 
     Aclint(Csr& csr);
 
     Aclint() = delete;
+
+    // Give another hart an msip and an mtimecmp register (harts are numbered in the order they are
+    // added, starting from 1). Must be done before anything accesses the ACLINT.
+    void add_hart(Csr& csr);
     
     Word read(Aclint::Address register_address);
 
@@ -51,7 +56,7 @@ public:
 
 private:
 
-    Csr& m_csrs; // Reference to the CSRs since some operations depend on them.
+    std::vector<Csr*> m_csrs; // Each hart's CSRs (indexed by mhartid), since some operations depend on them.
 
 };
 
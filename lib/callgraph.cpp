@@ -0,0 +1,162 @@
+/**
+ * @brief   Exact per-instruction and call graph profiling of guest code (callgrind format)
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * See callgraph.h for how this works
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "callgraph.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "symbols.h"
+
+#define INST_COUNT 0
+#include "logging.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+static bool is_link_register(uint8_t reg);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+callgraph::CallGraphProfiler::CallGraphProfiler(const char* output_path, const SymbolTable& symbols) :
+    m_file(std::fopen(output_path, "w")),
+    m_symbols(symbols)
+{
+    if (!this->m_file) {
+        irvelog_always(0, "Failed to create callgrind profile file \"%s\"", output_path);
+        throw std::runtime_error("Failed to create callgrind profile file");
+    }
+
+    if (this->m_symbols.empty()) {
+        irvelog_always(0, "No symbols were loaded, so every instruction will be attributed to \"unknown\"");
+    }
+}
+
+callgraph::CallGraphProfiler::~CallGraphProfiler() {
+    //Group everything by function (std::map so the output is deterministic)
+    struct Function {
+        std::map<uint32_t, uint64_t> inst_counts;
+        std::vector<std::tuple<uint32_t, uint32_t, Edge>> calls;//Call site, callee, edge
+    };
+    std::map<std::string, Function> functions;
+    auto function_name = [this](uint32_t pc) {
+        const std::string* symbol = this->m_symbols.lookup(pc);
+        return symbol ? *symbol : std::string("unknown");
+    };
+
+    uint64_t total_inst_count = 0;
+    for (const auto& [pc, count] : this->m_inst_counts) {
+        functions[function_name(pc)].inst_counts[pc] = count;
+        total_inst_count += count;
+    }
+    for (const auto& [key, edge] : this->m_edges) {
+        uint32_t call_site = static_cast<uint32_t>(key >> 32);
+        uint32_t callee = static_cast<uint32_t>(key);
+        functions[function_name(call_site)].calls.emplace_back(call_site, callee, edge);
+    }
+
+    std::fprintf(this->m_file, "# callgrind format\n");
+    std::fprintf(this->m_file, "version: 1\n");
+    std::fprintf(this->m_file, "creator: irve\n");
+    std::fprintf(this->m_file, "positions: instr\n");
+    std::fprintf(this->m_file, "events: Ir\n");
+    std::fprintf(this->m_file, "summary: %" PRIu64 "\n", total_inst_count);
+
+    for (auto& [name, function] : functions) {
+        std::fprintf(this->m_file, "\nfn=%s\n", name.c_str());
+        for (const auto& [pc, count] : function.inst_counts) {
+            std::fprintf(this->m_file, "0x%08X %" PRIu64 "\n", pc, count);
+        }
+
+        std::sort(function.calls.begin(), function.calls.end(), [](const auto& a, const auto& b) {
+            return std::tie(std::get<0>(a), std::get<1>(a)) < std::tie(std::get<0>(b), std::get<1>(b));
+        });
+        for (const auto& [call_site, callee, edge] : function.calls) {
+            std::fprintf(this->m_file, "cfn=%s\n", function_name(callee).c_str());
+            std::fprintf(this->m_file, "calls=%" PRIu64 " 0x%08X\n", edge.calls, callee);
+            std::fprintf(this->m_file, "0x%08X %" PRIu64 "\n", call_site, edge.inclusive_cost);
+        }
+    }
+
+    std::fclose(this->m_file);
+
+    irvelog_always(0, "Wrote a callgrind profile of %" PRIu64 " instructions in %zu functions", total_inst_count, functions.size());
+}
+
+void callgraph::CallGraphProfiler::jump(uint8_t rd, uint8_t rs1, uint32_t return_addr, uint32_t target, uint64_t inst_count) {
+    //See Table 2.1 "Return-address stack prediction hints encoded in the register operands of a JALR
+    //instruction" in the unprivileged spec
+    if (is_link_register(rs1) && (!is_link_register(rd) || (rd != rs1))) {
+        this->ret(target, inst_count);
+    }
+    if (is_link_register(rd)) {
+        this->call(return_addr, target, inst_count);
+    }
+}
+
+void callgraph::CallGraphProfiler::finish(uint64_t inst_count) {
+    while (!this->m_stack.empty()) {
+        this->close_frame(this->m_stack.back(), inst_count);
+        this->m_stack.pop_back();
+    }
+}
+
+void callgraph::CallGraphProfiler::call(uint32_t return_addr, uint32_t target, uint64_t inst_count) {
+    if (this->m_stack.size() == MAX_STACK_DEPTH) [[unlikely]] {
+        //Forget the oldest call; it will simply be missing from the call graph
+        this->m_stack.erase(this->m_stack.begin());
+    }
+    this->m_stack.push_back({return_addr - 4, target, return_addr, inst_count});
+}
+
+void callgraph::CallGraphProfiler::ret(uint32_t target, uint64_t inst_count) {
+    //Usually this is the innermost call, but if some calls never returned normally (ex. longjmp) they
+    //are closed too. If we never saw the call (ex. profiling started partway through), ignore it.
+    for (std::size_t depth = this->m_stack.size(); depth > 0; --depth) {
+        if (this->m_stack[depth - 1].return_addr == target) {
+            while (this->m_stack.size() >= depth) {
+                this->close_frame(this->m_stack.back(), inst_count);
+                this->m_stack.pop_back();
+            }
+            return;
+        }
+    }
+}
+
+void callgraph::CallGraphProfiler::close_frame(const Frame& frame, uint64_t inst_count) {
+    Edge& edge = this->m_edges[(static_cast<uint64_t>(frame.call_site) << 32) | frame.callee];
+    ++edge.calls;
+    edge.inclusive_cost += inst_count - frame.start_inst_count;
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static bool is_link_register(uint8_t reg) {
+    return (reg == 1) || (reg == 5);
+}
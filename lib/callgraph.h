@@ -0,0 +1,112 @@
+/**
+ * @brief   Exact per-instruction and call graph profiling of guest code (callgrind format)
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Unlike the sampling profiler (profiler.h), this counts every instruction executed, and follows
+ * calls and returns to find the inclusive cost of each call. Execution counts are kept in the
+ * emulator's instruction cache entries and handed to the profiler with add_inst_count() whenever the
+ * cache is flushed, so the only per-instruction work is one increment.
+ *
+ * Calls and returns are recognized the way the RISC-V spec suggests return-address stacks do it:
+ * a JAL/JALR that writes a link register (x1 or x5) is a call, and a JALR that jumps through a link
+ * register (without linking to the same one) is a return.
+ *
+ * The profile is written in the callgrind format (with instruction addresses as positions) when the
+ * profiler is destroyed, so it can be opened with KCachegrind, QCachegrind or callgrind_annotate.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+#include "symbols.h"
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal::callgraph {
+
+/**
+ * @brief Accumulates instruction counts and call edges, and writes them out when destroyed
+*/
+class CallGraphProfiler {
+public:
+    /**
+     * @brief Create the output file
+     * @param output_path Where to write the callgrind profile
+     * @param symbols Used to group instructions into functions; must outlive the CallGraphProfiler
+     * @note Throws std::runtime_error if the file couldn't be created
+    */
+    CallGraphProfiler(const char* output_path, const SymbolTable& symbols);
+
+    /**
+     * @brief Close any calls still in progress, write out the profile and close the file
+     * @note Everything in the instruction cache must already have been passed to add_inst_count()
+    */
+    ~CallGraphProfiler();
+
+    /**
+     * @brief Account for executions of an instruction
+     * @param pc The PC of the instruction
+     * @param count How many times it was executed since last time
+    */
+    void add_inst_count(uint32_t pc, uint64_t count) {
+        this->m_inst_counts[pc] += count;
+    }
+
+    /**
+     * @brief Called after a JAL or JALR has executed, to follow calls and returns
+     * @param rd The JAL/JALR's rd
+     * @param rs1 The JALR's rs1 (0 for JAL)
+     * @param return_addr The value written to rd (the JAL/JALR's PC + 4)
+     * @param target The PC jumped to
+     * @param inst_count minstret, to measure inclusive costs
+    */
+    void jump(uint8_t rd, uint8_t rs1, uint32_t return_addr, uint32_t target, uint64_t inst_count);
+
+    /**
+     * @brief Called when profiling stops, so calls still in progress can be charged up until now
+     * @param inst_count minstret
+    */
+    void finish(uint64_t inst_count);
+
+private:
+    static constexpr std::size_t MAX_STACK_DEPTH = 4096;//In case the guest never returns (ex. longjmp)
+
+    struct Frame {
+        uint32_t call_site;
+        uint32_t callee;
+        uint32_t return_addr;
+        uint64_t start_inst_count;
+    };
+
+    struct Edge {
+        uint64_t calls;
+        uint64_t inclusive_cost;
+    };
+
+    void call(uint32_t return_addr, uint32_t target, uint64_t inst_count);
+    void ret(uint32_t target, uint64_t inst_count);
+    void close_frame(const Frame& frame, uint64_t inst_count);
+
+    std::FILE* m_file;
+    const SymbolTable& m_symbols;
+
+    std::unordered_map<uint32_t, uint64_t> m_inst_counts;//PC -> Times executed
+    std::vector<Frame> m_stack;//Shadow call stack
+    std::unordered_map<uint64_t, Edge> m_edges;//(Call site << 32) | Callee -> Edge
+};
+
+} // namespace irve::internal::callgraph
@@ -30,6 +30,10 @@
 #define DT_UNSIGNED_BYTE        ((uint8_t)0b100)
 #define DT_UNSIGNED_HALFWORD    ((uint8_t)0b101)
 
+//The width of each vector register, in bits and in bytes (Zve32x with Zvl128b)
+#define VLEN                    128
+#define VLEN_BYTES              (VLEN / 8)
+
 /* ------------------------------------------------------------------------------------------------
  * Type/Class Declarations
  * --------------------------------------------------------------------------------------------- */
@@ -14,6 +14,7 @@
 
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 
 #define INST_COUNT 0
 #include "logging.h"
@@ -30,7 +31,9 @@ using namespace irve::internal;
 
 CpuState::CpuState() :
     m_pc(0),
-    m_atomic_reservation_set_valid(false)//At reset, no LR has been executed yet
+    m_atomic_reservation_set_valid(false),//At reset, no LR has been executed yet
+    m_atomic_reservation_addr(0),
+    m_atomic_reservation_value(0)
 {
     irvelog(1, "Created new CpuState instance");
 
@@ -38,6 +41,10 @@ CpuState::CpuState() :
     for (uint8_t i = 0; i < 31; ++i) {
         this->m_regs[i] = irve_fuzzish_rand();
     }
+    for (uint8_t i = 0; i < 32; ++i) {
+        this->m_fregs[i] = ((uint64_t)irve_fuzzish_rand() << 32) | irve_fuzzish_rand();
+    }
+    irve_fuzzish_meminit(this->m_vregs, sizeof(this->m_vregs));
 
     this->log(2);
 }
@@ -66,6 +73,26 @@ void CpuState::set_r(uint8_t reg_num, Reg new_val) {
     }
 }
 
+uint64_t CpuState::get_f(uint8_t reg_num) const {
+    assert(reg_num < 32 && "Attempt to get invalid floating point register");
+    return this->m_fregs[reg_num];
+}
+
+void CpuState::set_f(uint8_t reg_num, uint64_t new_val) {
+    assert(reg_num < 32 && "Attempt to set invalid floating point register");
+    this->m_fregs[reg_num] = new_val;
+}
+
+uint8_t* CpuState::get_v(uint8_t reg_num) {
+    assert(reg_num < 32 && "Attempt to get invalid vector register");
+    return &this->m_vregs[reg_num * VLEN_BYTES];
+}
+
+const uint8_t* CpuState::get_v(uint8_t reg_num) const {
+    assert(reg_num < 32 && "Attempt to get invalid vector register");
+    return &this->m_vregs[reg_num * VLEN_BYTES];
+}
+
 void CpuState::log([[maybe_unused]] uint8_t indent) const {
     //irvelog(indent, "Inst Count: %lu", this->get_inst_count());
     irvelog(indent, "PC:\t\t0x%08x", this->get_pc());
@@ -94,8 +121,10 @@ void CpuState::log([[maybe_unused]] uint8_t indent) const {
     */
 }
 
-void CpuState::validate_reservation_set() {
+void CpuState::validate_reservation_set(Word addr, Word value) {
     this->m_atomic_reservation_set_valid = true;
+    this->m_atomic_reservation_addr = addr;
+    this->m_atomic_reservation_value = value;
 }
 
 void CpuState::invalidate_reservation_set() {
@@ -106,6 +135,14 @@ bool CpuState::reservation_set_valid() const {
     return this->m_atomic_reservation_set_valid;
 }
 
+Word CpuState::reservation_addr() const {
+    return this->m_atomic_reservation_addr;
+}
+
+Word CpuState::reservation_value() const {
+    return this->m_atomic_reservation_value;
+}
+
 void CpuState::goto_next_sequential_pc() {
     this->m_pc += 4;
     irvelog(3, "Going to next sequential PC: 0x%08X", this->m_pc);
@@ -61,6 +61,29 @@ public:
     */
     void set_r(uint8_t reg_num, Reg new_val);
 
+    /**
+     * @brief       Get the current value of a floating point register.
+     * @param[in]   reg_num The register number to get the value of (between 0 and 31 inclusive).
+     * @return      The raw bits of the register (single precision values are NaN-boxed).
+    */
+    uint64_t get_f(uint8_t reg_num) const;
+
+    /**
+     * @brief       Set the value of a floating point register.
+     * @param[in]   reg_num The register number to set the value of (between 0 and 31 inclusive).
+     * @param[in]   new_val The new raw bits of the register.
+    */
+    void set_f(uint8_t reg_num, uint64_t new_val);
+
+    /**
+     * @brief       Get the bytes of a vector register.
+     * @param[in]   reg_num The register number (between 0 and 31 inclusive).
+     * @return      A pointer to VLEN_BYTES bytes, followed directly by those of the next registers (so
+     *              register groups with LMUL > 1 are contiguous too).
+    */
+    uint8_t* get_v(uint8_t reg_num);
+    const uint8_t* get_v(uint8_t reg_num) const;
+
     /**
      * @brief       TODO
      * @param[in]   indent TODO
@@ -69,8 +92,13 @@ public:
 
     /**
      * @brief       Set a load reservation (LR should call this).
+     * @note        Other harts' stores don't invalidate the reservation directly. Instead, SC
+     *              only succeeds if the word still holds the value LR loaded, which it checks with
+     *              an atomic compare-and-swap (see Memory::compare_and_swap()).
+     * @param[in]   addr The address LR loaded from.
+     * @param[in]   value The value LR loaded.
     */
-    void validate_reservation_set();
+    void validate_reservation_set(Word addr, Word value);
 
     /**
      * @brief       Invalidate a load reservation (SC should call this; it should also be called on
@@ -84,6 +112,18 @@ public:
     */
     bool reservation_set_valid() const;
 
+    /**
+     * @brief       Get the address of the load reservation.
+     * @return      The address LR loaded from (only meaningful if the reservation is valid).
+    */
+    Word reservation_addr() const;
+
+    /**
+     * @brief       Get the value LR loaded when it set the load reservation.
+     * @return      The value (only meaningful if the reservation is valid).
+    */
+    Word reservation_value() const;
+
     /**
      * @brief       Increment the current PC by 4.
     */
@@ -103,10 +143,26 @@ private:
     */
     Reg m_regs[31];
 
+    /**
+     * @brief       The floating point register file (F and D extensions; f0 is a normal register).
+    */
+    uint64_t m_fregs[32];
+
+    /**
+     * @brief       The vector register file (element i of a register is at byte i * SEW / 8).
+    */
+    alignas(VLEN_BYTES) uint8_t m_vregs[32 * VLEN_BYTES];
+
     /**
      * @brief       True if the hart has a valid atomic reseravtion, false othersise.
     */
     bool m_atomic_reservation_set_valid;
+
+    /**
+     * @brief       The address and value from the LR that set the reservation.
+    */
+    Word m_atomic_reservation_addr;
+    Word m_atomic_reservation_value;
 };
 
 } // namespace irve::internal
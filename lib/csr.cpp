@@ -13,18 +13,26 @@
 
 #include "csr.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
 
 #include "common.h"
+#include "host_clock.h"
 
 #include "rv_trap.h"
 
 #include "fuzzish.h"
 
+#define LOG_SUBSYSTEM CSR
+#define INST_COUNT this->minstret
+#include "logging.h"
+
 using namespace irve::internal;
 
 /* ------------------------------------------------------------------------------------------------
@@ -36,6 +44,11 @@ using namespace irve::internal;
 #define SIP_MASK        0b00000000'00000000'00000010'00100010
 #define SIE_MASK        0b00000000'00000000'00000010'00100010
 #define SATP_MASK       0b1'000000000'1111111111111111111111
+#define MENVCFGH_STCE   0b10000000'00000000'00000000'00000000
+#define MENVCFGH_ADUE   0b00100000'00000000'00000000'00000000
+//What the device trees we ship say in timebase-frequency
+#define DEFAULT_TIMEBASE_FREQUENCY 1000
+
 //TODO actually implement MISA and friends at some point
 //                                   ABCDEFGHIJKLMNOPQRSTUVWXYZ
 //#define MISA_CONTENTS Word(0b01000010000000100010000010100100)
@@ -44,8 +57,70 @@ using namespace irve::internal;
  * Function Implementations
  * --------------------------------------------------------------------------------------------- */
 
+Mtime::Mtime() :
+    m_epoch(host_clock::now()),
+    m_offset(0),
+    m_frequency(DEFAULT_TIMEBASE_FREQUENCY),
+    m_cycles_per_tick(0)
+{}
+
+void Mtime::set_frequency(uint64_t frequency) {
+    assert((frequency != 0) && "mtime must tick at some rate");
+    if (this->virtual_time()) {//The frequency doesn't matter then
+        this->m_frequency = frequency;
+        return;
+    }
+
+    uint64_t value = this->read(0);
+    this->m_frequency = frequency;
+    this->write(value, 0);
+}
+
+uint64_t Mtime::frequency() const {
+    return this->m_frequency;
+}
+
+void Mtime::use_virtual_time(uint64_t cycles_per_tick, uint64_t cycles) {
+    assert((cycles_per_tick != 0) && "Virtual time needs at least one cycle per tick");
+    uint64_t value = this->read(cycles);
+    this->m_cycles_per_tick = cycles_per_tick;
+    this->write(value, cycles);
+}
+
+bool Mtime::virtual_time() const {
+    return this->m_cycles_per_tick != 0;
+}
+
+uint64_t Mtime::read(uint64_t cycles) const {
+    if (this->m_cycles_per_tick) {
+        return this->m_offset.load(std::memory_order_relaxed) + (cycles / this->m_cycles_per_tick);
+    }
+
+    uint64_t elapsed = host_clock::now() - this->m_epoch;
+    return this->m_offset.load(std::memory_order_relaxed) + host_clock::convert(elapsed, this->m_frequency, host_clock::frequency());
+}
+
+void Mtime::write(uint64_t value, uint64_t cycles) {
+    if (this->m_cycles_per_tick) {
+        this->m_offset.store(value - (cycles / this->m_cycles_per_tick), std::memory_order_relaxed);
+        return;
+    }
+
+    uint64_t elapsed = host_clock::now() - this->m_epoch;
+    this->m_offset.store(value - host_clock::convert(elapsed, this->m_frequency, host_clock::frequency()), std::memory_order_relaxed);
+}
+
+Csr::Csr() : Csr(0, std::make_shared<Mtime>(), std::make_shared<Doorbell>()) {}
+
+Csr::Csr(uint32_t hart_id, const Csr& hart0_CSR) : Csr(hart_id, hart0_CSR.m_mtime, hart0_CSR.m_doorbell) {}
+
 //See Volume 2 Section 3.4
-Csr::Csr() :
+Csr::Csr(uint32_t hart_id, std::shared_ptr<Mtime> mtime, std::shared_ptr<Doorbell> doorbell) :
+    fcsr(0),                        //Round to nearest, ties to even with no exceptions accrued
+    vstart(0),                      //Only needs to be initialized for implicit_read() guarantees
+    vcsr(0),                        //Only needs to be initialized for implicit_read() guarantees
+    vl(0),                          //Only needs to be initialized for implicit_read() guarantees
+    vtype(VTYPE_VILL),              //Recommended by the spec so vector code must use vsetvli first
     stvec(0),                       //Only needs to be initialized for implicit_read() guarantees
     scounteren(0),                  //Only needs to be initialized for implicit_read() guarantees
     senvcfg(0),                     //Only needs to be initialized for implicit_read() guarantees
@@ -59,6 +134,7 @@ Csr::Csr() :
     mie(0),                         //Only needs to be initialized for implicit_read() guarantees (also good to have interrupts disabled by default)
     mtvec(0x00000004 | 0b01),       //Doesn't need to be initialized, but this is convenient for RVSW
     menvcfg(0),                     //Only needs to be initialized for implicit_read() guarantees
+    menvcfgh(0),                    //Sstc and Svadu are off until M-mode turns them on
     mscratch(irve_fuzzish_rand()),  //We don't need to initialize this since all states are valid, but sanitizers could complain otherwise
     mepc(0),                        //Only needs to be initialized for implicit_read() guarantees
     mcause(0),                      //MUST BE INITIALIZED ACCORDING TO THE SPEC (we don't distinguish reset conditions, so we just use 0 here)
@@ -66,28 +142,47 @@ Csr::Csr() :
     //PMPCFG and PMPADDR registers done in the constructor's body
     minstret(0),                    //Implied it should be initialized according to the spec
     mcycle(0),                      //Implied it should be initialized according to the spec
-    mtime(0),                       //Implied it should be initialized according to the spec
+    mcountinhibit(0),               //Only needs to be initialized for implicit_read() guarantees
+    //mhpmcounter and mhpmevent registers done in the constructor's body
+    m_active_hpm_events(0),
+    m_mtime(std::move(mtime)),      //Implied it should be initialized according to the spec (Mtime starts at 0)
+    m_mcycle_bias(0),
     mtimecmp(0xFFFFFFFFFFFFFFFF),   //Implied it should be initialized according to the spec
-    m_last_time_update(std::chrono::steady_clock::now()),
+    stimecmp(0xFFFFFFFFFFFFFFFF),   //Never, until S-mode asks for a timer interrupt
+    m_aclint_mip(0),
+    m_doorbell(std::move(doorbell)),
+    m_running(false),               //Until run_until() gives the hart its own thread
+    m_hart_id(hart_id),
     m_privilege_mode(PrivilegeMode::MACHINE_MODE) //MUST BE INITIALIZED ACCORDING TO THE SPEC
 {
     std::memset(this->pmpcfg, 0x00, sizeof(this->pmpcfg)); // We need the A and L bits to be 0
 
     // We don't need to initialize this since all states are valid, but sanitizers could complain otherwise
     irve_fuzzish_meminit(this->pmpaddr, sizeof(this->pmpaddr));
+
+    // Counting nothing to begin with keeps the hot paths fast
+    std::fill_n(this->mhpmcounter, NUM_HPM_COUNTERS, 0);
+    std::fill_n(this->mhpmevent, NUM_HPM_COUNTERS, HpmEvent::NONE);
+    this->update_active_hpm_events();
 }
 
 Reg Csr::explicit_read(Csr::Address csr) {//Performs privilege checks
-    if (!this->current_privilege_mode_can_explicitly_read(csr))
+    if (!this->current_privilege_mode_can_explicitly_read(csr)) {
+        irvelog(4, "CSR 0x%03X can't be read in the current privilege mode", (uint32_t)csr);
         rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
-    
-    return this->implicit_read(csr);
+    }
+
+    Reg value = this->implicit_read(csr);
+    irvelog(4, "Read 0x%08X from CSR 0x%03X", value.u, (uint32_t)csr);
+    return value;
 }
 
 void Csr::explicit_write(Csr::Address csr, Word data) {//Performs privilege checks
     if (!this->current_privilege_mode_can_explicitly_write(csr)) {
+        irvelog(4, "CSR 0x%03X can't be written in the current privilege mode", (uint32_t)csr);
         rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
     } else {
+        irvelog(4, "Writing 0x%08X to CSR 0x%03X", data.u, (uint32_t)csr);
         this->implicit_write(csr, data);
     }
 }
@@ -95,6 +190,13 @@ void Csr::explicit_write(Csr::Address csr, Word data) {//Performs privilege chec
 //We assume the CSRs within the class are "safe" for the purposes of reads
 Reg Csr::implicit_read(Csr::Address csr) {//Does not perform any privilege checks
     switch (csr) {
+        case Csr::Address::FFLAGS:           return this->fcsr & 0b11111;
+        case Csr::Address::FRM:              return (this->fcsr.u >> 5) & 0b111;
+        case Csr::Address::FCSR:             return this->fcsr;
+        case Csr::Address::VSTART:           return this->vstart;
+        case Csr::Address::VXSAT:            return this->vcsr & 0b1;
+        case Csr::Address::VXRM:             return (this->vcsr.u >> 1) & 0b11;
+        case Csr::Address::VCSR:             return this->vcsr;
         case Csr::Address::SSTATUS:          return this->mstatus & SSTATUS_MASK;//Only some bits of mstatus are accessible in S-mode
         case Csr::Address::SIE:              return this->mie & SIE_MASK;//Only some bits of mie are accessible in S-mode
         case Csr::Address::STVEC:            return this->stvec;
@@ -104,7 +206,9 @@ Reg Csr::implicit_read(Csr::Address csr) {//Does not perform any privilege check
         case Csr::Address::SEPC:             return this->sepc;
         case Csr::Address::SCAUSE:           return this->scause;
         case Csr::Address::STVAL:            return this->stval;
-        case Csr::Address::SIP:              return this->mip & SIP_MASK;//Only some bits of mip are accessible in S-mode
+        case Csr::Address::SIP:              return (this->mip | this->m_aclint_mip.load(std::memory_order_acquire)) & SIP_MASK;//Only some bits of mip are accessible in S-mode
+        case Csr::Address::STIMECMP:         return (uint32_t)(this->stimecmp           & 0xFFFFFFFF);
+        case Csr::Address::STIMECMPH:        return (uint32_t)((this->stimecmp  >> 32) & 0xFFFFFFFF);
         case Csr::Address::SATP:             return this->satp;
         case Csr::Address::MSTATUS:          return this->mstatus;
         case Csr::Address::MISA:             return 0;
@@ -115,16 +219,16 @@ Reg Csr::implicit_read(Csr::Address csr) {//Does not perform any privilege check
         case Csr::Address::MCOUNTEREN:       return 0;//Since we chose to make this 0, we don't need to implement any user-mode-facing counters
         case Csr::Address::MENVCFG:          return this->menvcfg;
         case Csr::Address::MSTATUSH:         return 0;//We only support little-endian
-        case Csr::Address::MENVCFGH:         return 0;
-        case Csr::Address::MCOUNTINHIBIT:    return 0;
+        case Csr::Address::MENVCFGH:         return this->menvcfgh;
+        case Csr::Address::MCOUNTINHIBIT:    return this->mcountinhibit;
 
-        case Csr::Address::MHPMEVENT_START ... Csr::Address::MHPMEVENT_END: return 0;
+        case Csr::Address::MHPMEVENT_START ... Csr::Address::MHPMEVENT_END: return static_cast<uint32_t>(this->mhpmevent[static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::MHPMEVENT_START)]);
 
         case Csr::Address::MSCRATCH:         return this->mscratch;
         case Csr::Address::MEPC:             return this->mepc;
         case Csr::Address::MCAUSE:           return this->mcause;
         case Csr::Address::MTVAL:            return 0;
-        case Csr::Address::MIP:              return this->mip;
+        case Csr::Address::MIP:              return this->mip | this->m_aclint_mip.load(std::memory_order_acquire);
 
         case Csr::Address::PMPCFG_START  ... Csr::Address::PMPCFG_END:    return this->pmpcfg [static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::PMPCFG_START)];
         case Csr::Address::PMPADDR_START ... Csr::Address::PMPADDR_END:   return this->pmpaddr[static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::PMPADDR_START)];
@@ -132,34 +236,38 @@ Reg Csr::implicit_read(Csr::Address csr) {//Does not perform any privilege check
         case Csr::Address::MCYCLE:           return (uint32_t)(this->mcycle      & 0xFFFFFFFF);
         case Csr::Address::MINSTRET:         return (uint32_t)(this->minstret    & 0xFFFFFFFF);
 
-        case Csr::Address::MHPMCOUNTER_START ... Csr::Address::MHPMCOUNTER_END: return 0;
+        case Csr::Address::MHPMCOUNTER_START ... Csr::Address::MHPMCOUNTER_END: return (uint32_t)(this->mhpmcounter[static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::MHPMCOUNTER_START)] & 0xFFFFFFFF);
 
         case Csr::Address::MCYCLEH:          return (uint32_t)((this->mcycle     >> 32) & 0xFFFFFFFF);
         case Csr::Address::MINSTRETH:        return (uint32_t)((this->minstret   >> 32) & 0xFFFFFFFF);
 
-        case Csr::Address::MHPMCOUNTERH_START ... Csr::Address::MHPMCOUNTERH_END: return 0;
+        case Csr::Address::MHPMCOUNTERH_START ... Csr::Address::MHPMCOUNTERH_END: return (uint32_t)((this->mhpmcounter[static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::MHPMCOUNTERH_START)] >> 32) & 0xFFFFFFFF);
 
-        case Csr::Address::MTIME:            this->update_timer(); return (uint32_t)(this->mtime            & 0xFFFFFFFF);//Custom
-        case Csr::Address::MTIMEH:           this->update_timer(); return (uint32_t)((this->mtime    >> 32) & 0xFFFFFFFF);//Custom
-        case Csr::Address::MTIMECMP:         return (uint32_t)(this->mtimecmp         & 0xFFFFFFFF);//Custom
-        case Csr::Address::MTIMECMPH:        return (uint32_t)((this->mtimecmp >> 32) & 0xFFFFFFFF);//Custom
+        case Csr::Address::MTIME:            this->update_timer(); return (uint32_t)(this->read_mtime()          & 0xFFFFFFFF);//Custom
+        case Csr::Address::MTIMEH:           this->update_timer(); return (uint32_t)((this->read_mtime()  >> 32) & 0xFFFFFFFF);//Custom
+        case Csr::Address::MTIMECMP:         return (uint32_t)(this->mtimecmp.load(std::memory_order_relaxed)         & 0xFFFFFFFF);//Custom
+        case Csr::Address::MTIMECMPH:        return (uint32_t)((this->mtimecmp.load(std::memory_order_relaxed) >> 32) & 0xFFFFFFFF);//Custom
 
         case Csr::Address::CYCLE:            return this->implicit_read(Csr::Address::MCYCLE);
         case Csr::Address::TIME:             return this->implicit_read(Csr::Address::MTIME);
         case Csr::Address::INSTRET:          return this->implicit_read(Csr::Address::MINSTRET);
 
-        case Csr::Address::HPMCOUNTER_START ... Csr::Address::HPMCOUNTER_END: return 0;
+        case Csr::Address::HPMCOUNTER_START ... Csr::Address::HPMCOUNTER_END: return this->implicit_read(static_cast<Csr::Address>(static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::HPMCOUNTER_START) + static_cast<uint16_t>(Csr::Address::MHPMCOUNTER_START)));
+
+        case Csr::Address::VL:               return this->vl;
+        case Csr::Address::VTYPE:            return this->vtype;
+        case Csr::Address::VLENB:            return VLEN_BYTES;
 
         case Csr::Address::CYCLEH:           return this->implicit_read(Csr::Address::MCYCLEH);
         case Csr::Address::TIMEH:            return this->implicit_read(Csr::Address::MTIMEH);
         case Csr::Address::INSTRETH:         return this->implicit_read(Csr::Address::MINSTRETH);
 
-        case Csr::Address::HPMCOUNTERH_START ... Csr::Address::HPMCOUNTERH_END: return 0;
+        case Csr::Address::HPMCOUNTERH_START ... Csr::Address::HPMCOUNTERH_END: return this->implicit_read(static_cast<Csr::Address>(static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::HPMCOUNTERH_START) + static_cast<uint16_t>(Csr::Address::MHPMCOUNTERH_START)));
 
         case Csr::Address::MVENDORID:        return 0;
         case Csr::Address::MARCHID:          return 0; 
         case Csr::Address::MIMPID:           return 0; 
-        case Csr::Address::MHARTID:          return 0;
+        case Csr::Address::MHARTID:          return this->m_hart_id;
         case Csr::Address::MCONFIGPTR:       return 0;
 
         default: rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
@@ -174,7 +282,7 @@ Csr::InterruptRegs Csr::fast_implicit_read_interrupt_regs() const {
         .mstatus        = this->mstatus,
         .privilege_mode = this->m_privilege_mode,
         .mcause         = this->mcause,
-        .mip            = this->mip,
+        .mip            = this->mip | this->m_aclint_mip.load(std::memory_order_acquire),
         .mie            = this->mie,
         .mideleg        = this->mideleg
     };
@@ -185,7 +293,17 @@ void Csr::implicit_write(Csr::Address csr, Word data) {//Does not perform any pr
     //FIXME handle WARL in this function
 
     switch (csr) {
-        case Csr::Address::SSTATUS:          this->mstatus = (this->mstatus & ~SSTATUS_MASK) | (data & SSTATUS_MASK); return;//Only some parts of mstatus are writable from sstatus
+        case Csr::Address::FFLAGS:           this->fcsr = (this->fcsr & ~0b11111) | (data & 0b11111); this->set_fp_dirty(); return;
+        case Csr::Address::FRM:              this->fcsr = (this->fcsr & 0b11111) | ((data & 0b111) << 5); this->set_fp_dirty(); return;
+        case Csr::Address::FCSR:             this->fcsr = data & 0xFF; this->set_fp_dirty(); return;
+        case Csr::Address::VSTART:           this->vstart = data & (VLEN - 1); this->set_vector_dirty(); return;//Only enough bits to hold any element index
+        case Csr::Address::VXSAT:            this->vcsr = (this->vcsr & ~0b1) | (data & 0b1); this->set_vector_dirty(); return;
+        case Csr::Address::VXRM:             this->vcsr = (this->vcsr & 0b1) | ((data & 0b11) << 1); this->set_vector_dirty(); return;
+        case Csr::Address::VCSR:             this->vcsr = data & 0b111; this->set_vector_dirty(); return;
+        case Csr::Address::SSTATUS://Only some parts of mstatus are writable from sstatus
+            this->mstatus = (this->mstatus & ~SSTATUS_MASK) | (data & SSTATUS_MASK);
+            this->update_mstatus_sd();
+            return;
         case Csr::Address::SIE:              this->mie = (this->mie & ~SIE_MASK) | (data & SIE_MASK); return;//Only some parts of mie are writable from sie
         case Csr::Address::STVEC:            this->stvec = data; return;//FIXME WARL
         case Csr::Address::SCOUNTEREN:       this->scounteren = data; return;//FIXME WARL
@@ -194,9 +312,17 @@ void Csr::implicit_write(Csr::Address csr, Word data) {//Does not perform any pr
         case Csr::Address::SEPC:             this->sepc = data & 0xFFFFFFFC; return;//IALIGN=32
         case Csr::Address::SCAUSE:           this->scause = data; return;//FIXME WARL
         case Csr::Address::STVAL:            this->stval = data; return;//FIXME WARL
-        case Csr::Address::SIP:              this->mip = (this->mip & ~SIP_MASK) | (data & SIP_MASK); return;//Only some parts of mip are writable from sip
+        case Csr::Address::SIP: {
+            //Only some parts of mip are writable from sip, and with Sstc, STIP only follows stimecmp
+            uint32_t writable = this->sstc_enabled() ? (SIP_MASK & ~(1U << 5)) : SIP_MASK;
+            this->mip = (this->mip & ~writable) | (data & writable);
+            this->m_aclint_mip.fetch_and(~(1U << 1), std::memory_order_acq_rel);//The written SSIP replaces any from set_ssip()
+            return;
+        }
+        case Csr::Address::STIMECMP:         this->set_stimecmp((this->stimecmp & 0xFFFFFFFF00000000) | ((uint64_t)  data.u)); return;
+        case Csr::Address::STIMECMPH:        this->set_stimecmp((this->stimecmp & 0x00000000FFFFFFFF) | (((uint64_t) data.u) << 32)); return;
         case Csr::Address::SATP:             this->satp = data & SATP_MASK; return;//ASIDs are unsupported
-        case Csr::Address::MSTATUS:          this->mstatus = data; return;//FIXME WARL (less critical assuming safe M-mode code)
+        case Csr::Address::MSTATUS:          this->mstatus = data; this->update_mstatus_sd(); return;//FIXME WARL (less critical assuming safe M-mode code)
         case Csr::Address::MISA:             return;//We simply ignore writes to MISA, NOT throw an exception
         case Csr::Address::MEDELEG:          this->medeleg = data & 0b0000000000000000'1011001111111111; return;//Note it dosn't make sense to delegate ECALL from M-mode since we can never delagte to high levels
         case Csr::Address::MIDELEG:          this->mideleg = data & 0b00000000000000000000'1010'1010'1010; return;
@@ -204,50 +330,88 @@ void Csr::implicit_write(Csr::Address csr, Word data) {//Does not perform any pr
         case Csr::Address::MTVEC:            this->mtvec   = data; return;//FIXME WARL
         case Csr::Address::MENVCFG:          this->menvcfg = data & 0b1; return;//Only lowest bit is RW
         case Csr::Address::MSTATUSH:         return;//We simply ignore writes to mstatush, NOT throw an exception
-        case Csr::Address::MENVCFGH:         return;//We simply ignore writes to menvcfgh, NOT throw an exception
-        case Csr::Address::MCOUNTINHIBIT:    return;//We simply ignore writes to mcountinhibit, NOT throw an exception
+        case Csr::Address::MENVCFGH://Only STCE and ADUE are RW
+            this->menvcfgh = data & (MENVCFGH_STCE | MENVCFGH_ADUE);
+            this->update_timer();//STIP starts (or stops) following stimecmp right away
+            return;
+        case Csr::Address::MCOUNTINHIBIT://CY and IR are read-only zero so mcycle and minstret stay as cheap as possible
+            this->mcountinhibit = data & 0xFFFFFFF8;
+            this->update_active_hpm_events();
+            return;
+
+        case Csr::Address::MHPMEVENT_START ... Csr::Address::MHPMEVENT_END://WARL: Unsupported events become NONE
+            this->mhpmevent[static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::MHPMEVENT_START)] = (data.u < static_cast<uint32_t>(HpmEvent::COUNT)) ? static_cast<HpmEvent>(data.u) : HpmEvent::NONE;
+            this->update_active_hpm_events();
+            return;
 
         case Csr::Address::HPMCOUNTER_START ... Csr::Address::HPMCOUNTER_END: return;//We simply ignore writes to the HPMCOUNTER CSRs, NOT throw exceptions
 
+        //Read-only to software, but the vector unit sets them (and makes sure vtype is legal)
+        case Csr::Address::VL:               this->vl = data; this->set_vector_dirty(); return;
+        case Csr::Address::VTYPE:            this->vtype = data; this->set_vector_dirty(); return;
+
         case Csr::Address::MSCRATCH:         this->mscratch  = data;                 return;
         case Csr::Address::MEPC:             this->mepc      = data & 0xFFFFFFFC;    return;//IALIGN=32
         case Csr::Address::MCAUSE:           this->mcause    = data;                 return;//FIXME WARL
         case Csr::Address::MTVAL:                                                    return;//We simply ignore writes to MTVAL, NOT throw an exception
-        case Csr::Address::MIP:              this->mip       = data & 0b00000000000000000000'0010'0010'0010; return;//Note ALL interrupt pending bits for M-mode are READ ONLY
+        case Csr::Address::MIP: {
+            //Note ALL interrupt pending bits for M-mode are READ ONLY, and with Sstc, so is STIP
+            uint32_t stip = this->sstc_enabled() ? (this->mip.u & (1U << 5)) : 0;
+            uint32_t writable = this->sstc_enabled() ? 0b00000000000000000000'0010'0000'0010 : 0b00000000000000000000'0010'0010'0010;
+            this->mip = (data & writable) | stip;
+            this->m_aclint_mip.fetch_and(~(1U << 1), std::memory_order_acq_rel);//The written SSIP replaces any from set_ssip()
+            return;
+        }
 
         //FIXME when locked, ignore (not throw exception) on writes to the relevant PMP CSRs
         case Csr::Address::PMPCFG_START  ... Csr::Address::PMPCFG_END:    this->pmpcfg [static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::PMPCFG_START)] = data; return;//FIXME WARL
         case Csr::Address::PMPADDR_START ... Csr::Address::PMPADDR_END:   this->pmpaddr[static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::PMPADDR_START)] = data; return;//FIXME WARL
 
-        case Csr::Address::MCYCLE:           this->mcycle    = (this->mcycle   & 0xFFFFFFFF00000000) | ((uint64_t) data.u); return;
+        case Csr::Address::MCYCLE: {
+            uint64_t new_mcycle = (this->mcycle & 0xFFFFFFFF00000000) | ((uint64_t) data.u);
+            this->m_mcycle_bias += new_mcycle - this->mcycle;//So virtual time keeps counting cycles actually run
+            this->mcycle = new_mcycle;
+            return;
+        }
         case Csr::Address::MINSTRET:         this->minstret  = (this->minstret & 0xFFFFFFFF00000000) | ((uint64_t) data.u); return;
 
-        case Csr::Address::MHPMCOUNTER_START ... Csr::Address::MHPMCOUNTER_END: return;//We simply ignore writes to the HPMCOUNTER CSRs, NOT throw exceptions
+        case Csr::Address::MHPMCOUNTER_START ... Csr::Address::MHPMCOUNTER_END: {
+            uint64_t& counter = this->mhpmcounter[static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::MHPMCOUNTER_START)];
+            counter = (counter & 0xFFFFFFFF00000000) | ((uint64_t) data.u);
+            return;
+        }
 
-        case Csr::Address::MCYCLEH:          this->mcycle    = (this->mcycle   & 0x00000000FFFFFFFF) | (((uint64_t) data.u) << 32); return;
+        case Csr::Address::MCYCLEH: {
+            uint64_t new_mcycle = (this->mcycle & 0x00000000FFFFFFFF) | (((uint64_t) data.u) << 32);
+            this->m_mcycle_bias += new_mcycle - this->mcycle;
+            this->mcycle = new_mcycle;
+            return;
+        }
         case Csr::Address::MINSTRETH:        this->minstret  = (this->minstret & 0x00000000FFFFFFFF) | (((uint64_t) data.u) << 32); return;
 
-        case Csr::Address::MHPMCOUNTERH_START ... Csr::Address::MHPMCOUNTERH_END: return;//We simply ignore writes to the HPMCOUNTERH CSRs, NOT throw exceptions
-
-        case Csr::Address::MTIME: {//Custom
-            this->mtime     = (this->mtime    & 0xFFFFFFFF00000000) | ((uint64_t)  data.u);
-            std::chrono::time_point<std::chrono::steady_clock> now = std::chrono::steady_clock::now();
-            this->m_last_time_update = now;
+        case Csr::Address::MHPMCOUNTERH_START ... Csr::Address::MHPMCOUNTERH_END: {
+            uint64_t& counter = this->mhpmcounter[static_cast<uint16_t>(csr) - static_cast<uint16_t>(Csr::Address::MHPMCOUNTERH_START)];
+            counter = (counter & 0x00000000FFFFFFFF) | (((uint64_t) data.u) << 32);
             return;
         }
-        case Csr::Address::MTIMEH: {//Custom
-            this->mtime     = (this->mtime    & 0x00000000FFFFFFFF) | (((uint64_t) data.u) << 32);
-            std::chrono::time_point<std::chrono::steady_clock> now = std::chrono::steady_clock::now();
-            this->m_last_time_update = now;
+
+        case Csr::Address::MTIME://Custom
+            this->write_mtime((this->read_mtime() & 0xFFFFFFFF00000000) | ((uint64_t)  data.u));
+            this->m_doorbell->ring();//Any hart in WFI needs to recalculate when its timer expires
+            return;
+        case Csr::Address::MTIMEH://Custom
+            this->write_mtime((this->read_mtime() & 0x00000000FFFFFFFF) | (((uint64_t) data.u) << 32));
+            this->m_doorbell->ring();
             return;
-        }
         case Csr::Address::MTIMECMP://Custom
-            this->mtimecmp  = (this->mtimecmp & 0xFFFFFFFF00000000) | ((uint64_t)  data.u);
-            this->mip &= ~(1 << 7);//Clear mip.MTIP on writes to mtimecmp (which would normally be in memory, but we made it a CSR so might as well handle it here)
+            this->mtimecmp.store((this->mtimecmp.load(std::memory_order_relaxed) & 0xFFFFFFFF00000000) | ((uint64_t)  data.u), std::memory_order_relaxed);
+            this->m_aclint_mip.fetch_and(~(1U << 7), std::memory_order_acq_rel);//Clear mip.MTIP on writes to mtimecmp (which would normally be in memory, but we made it a CSR so might as well handle it here)
+            this->m_doorbell->ring();
             return;
         case Csr::Address::MTIMECMPH://Custom
-            this->mtimecmp  = (this->mtimecmp & 0x00000000FFFFFFFF) | (((uint64_t) data.u) << 32);
-            this->mip &= ~(1 << 7);//Clear mip.MTIP on writes to mtimecmp (which would normally be in memory, but we made it a CSR so might as well handle it here)
+            this->mtimecmp.store((this->mtimecmp.load(std::memory_order_relaxed) & 0x00000000FFFFFFFF) | (((uint64_t) data.u) << 32), std::memory_order_relaxed);
+            this->m_aclint_mip.fetch_and(~(1U << 7), std::memory_order_acq_rel);//Clear mip.MTIP on writes to mtimecmp (which would normally be in memory, but we made it a CSR so might as well handle it here)
+            this->m_doorbell->ring();
             return;
 
         default: rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
@@ -258,6 +422,7 @@ void Csr::implicit_write(Csr::Address csr, Word data) {//Does not perform any pr
 }
 
 void Csr::set_privilege_mode(PrivilegeMode new_privilege_mode) {
+    irvelog(3, "Privilege mode 0b%02X -> 0b%02X", (uint32_t)this->m_privilege_mode, (uint32_t)new_privilege_mode);
     this->m_privilege_mode = new_privilege_mode;
 }
 
@@ -270,34 +435,209 @@ void Csr::increment_perf_counters() {
     ++this->mcycle;//We don't really have clock cycles, so this will do
 }
 
-void Csr::update_timer() {
-    //This is really, really slow. Like, we couldn't even run at 1MHz if we did this every time
-    //TODO make this function faster
-    std::chrono::time_point<std::chrono::steady_clock> now = std::chrono::steady_clock::now();
-    double time_since_last_update_us = std::chrono::duration_cast<std::chrono::microseconds>(now - this->m_last_time_update).count();
-    if (time_since_last_update_us > 1000.0) {//1ms
-        this->m_last_time_update = now;
-        //++(this->mtime);
-        this->mtime += (uint32_t)(time_since_last_update_us / 1000.0);//FIXME is it okay to skip values like this if we're behind?
+void Csr::count_hpm_trap_event(rv_trap::Cause cause) {
+    uint32_t cause_number = static_cast<uint32_t>(cause);
+    bool is_interrupt = cause_number & 0x80000000;
+    cause_number &= 0x7FFFFFFF;
+    assert((cause_number < 16) && "Unsupported cause value!");
+
+    if (is_interrupt) {
+        this->count_hpm_event(HpmEvent::INTERRUPT);
+        this->count_hpm_event(static_cast<HpmEvent>(static_cast<uint8_t>(HpmEvent::INTERRUPT_CAUSE_0) + cause_number));
+    } else {
+        this->count_hpm_event(HpmEvent::EXCEPTION);
+        this->count_hpm_event(static_cast<HpmEvent>(static_cast<uint8_t>(HpmEvent::EXCEPTION_CAUSE_0) + cause_number));
     }
+}
 
+void Csr::update_timer() {
+    //Reading mtime is just rdtsc and a multiply on most hosts, but it isn't free, so we're still
+    //only called every so often (see emulator.cpp)
     //If the timer has passed the comparison value, cause an interrupt
-    if (this->mtime >= this->mtimecmp) {
-        this->mip |= 1 << 7;//Set the machine timer interrupt as pending
+    uint64_t mtime = this->read_mtime();
+    if (mtime >= this->mtimecmp.load(std::memory_order_relaxed)) {
+        this->m_aclint_mip.fetch_or(1U << 7, std::memory_order_acq_rel);//Set the machine timer interrupt as pending
+    }
+    if (this->sstc_enabled()) {//Only with Sstc does STIP follow stimecmp (even if mtime was moved back)
+        if (mtime >= this->stimecmp) {
+            this->mip |= 1 << 5;//Set the supervisor timer interrupt as pending
+        } else {
+            this->mip &= ~(1U << 5);
+        }
     }
 }
 
+void Csr::set_stimecmp(uint64_t value) {
+    this->stimecmp = value;
+    this->mip &= ~(1U << 5);//Until the new deadline
+    this->update_timer();
+}
+
 void Csr::set_exti_pending() {
     this->mip |= 1 << 11;//Set the machine external interrupt as pending
 }
 
+void Csr::set_msip(bool pending) {
+    if (pending) {
+        this->m_aclint_mip.fetch_or(1U << 3, std::memory_order_acq_rel);
+        this->m_doorbell->ring();//In case this hart is in WFI
+    } else {
+        this->m_aclint_mip.fetch_and(~(1U << 3), std::memory_order_acq_rel);
+    }
+}
+
+void Csr::set_ssip() {
+    this->m_aclint_mip.fetch_or(1U << 1, std::memory_order_acq_rel);
+    this->m_doorbell->ring();//In case this hart is in WFI
+}
+
+bool Csr::msip() const {
+    return this->m_aclint_mip.load(std::memory_order_acquire) & (1U << 3);
+}
+
+uint32_t Csr::hart_id() const {
+    return this->m_hart_id;
+}
+
+Doorbell& Csr::doorbell() {
+    return *this->m_doorbell;
+}
+
+bool Csr::set_running(bool running) {
+    return this->m_running.exchange(running);//Sequentially consistent, see SbiHandler::remote_fence()
+}
+
+bool Csr::running() const {
+    return this->m_running.load();
+}
+
+std::chrono::nanoseconds Csr::time_until_timer_interrupt(std::chrono::nanoseconds limit) const {
+    if (this->m_mtime->virtual_time()) {//No amount of host time will make virtual time pass
+        return limit;
+    }
+
+    uint64_t mtime    = this->read_mtime();
+    uint64_t deadline = this->next_timer_deadline();
+    if (mtime >= deadline) {
+        return std::chrono::nanoseconds(0);
+    }
+
+    //The deadline is usually the maximum value ("never"), which is too far away for chrono to represent
+    uint64_t frequency = this->m_mtime->frequency();
+    uint64_t limit_ticks = host_clock::convert(limit.count(), frequency, 1000000000) + 1;
+    uint64_t remaining = std::min<uint64_t>(deadline - mtime, limit_ticks);
+
+    //Round up so we don't wake up just before the interrupt and have to go back to sleep
+    uint64_t remaining_ns = host_clock::convert(remaining, 1000000000, frequency) + 1;
+    return std::chrono::nanoseconds(std::min<uint64_t>(remaining_ns, limit.count()));
+}
+
+void Csr::set_timebase_frequency(uint64_t frequency) {
+    this->m_mtime->set_frequency(frequency);
+}
+
+void Csr::use_virtual_time(uint64_t cycles_per_tick) {
+    this->m_mtime->use_virtual_time(cycles_per_tick, this->mcycle - this->m_mcycle_bias);
+}
+
+bool Csr::virtual_time() const {
+    return this->m_mtime->virtual_time();
+}
+
+bool Csr::skip_to_timer_interrupt() {
+    uint64_t deadline = this->next_timer_deadline();
+    if (!this->m_mtime->virtual_time() || (deadline == 0xFFFFFFFFFFFFFFFF)) {
+        return false;
+    }
+
+    if (this->read_mtime() < deadline) {
+        this->write_mtime(deadline);
+    }
+    this->update_timer();
+    return true;
+}
+
+void Csr::update_mstatus_sd() {
+    //SD is read-only; XS is always Off, so only FS and VS can make it Dirty
+    if (((this->mstatus.u & MSTATUS_FS) == MSTATUS_FS) || ((this->mstatus.u & MSTATUS_VS) == MSTATUS_VS)) {
+        this->mstatus |= MSTATUS_SD;
+    } else {
+        this->mstatus &= ~MSTATUS_SD;
+    }
+}
+
+bool Csr::sstc_enabled() const {
+    return (this->menvcfgh.u & MENVCFGH_STCE) != 0;
+}
+
+uint64_t Csr::next_timer_deadline() const {
+    //A timer that isn't enabled in mie can't wake anyone up
+    uint64_t deadline = 0xFFFFFFFFFFFFFFFF;
+    if (this->mie.bit(7) == 1) {
+        deadline = this->mtimecmp.load(std::memory_order_relaxed);
+    }
+    if ((this->mie.bit(5) == 1) && this->sstc_enabled()) {
+        deadline = std::min(deadline, this->stimecmp);
+    }
+    return deadline;
+}
+
+uint64_t Csr::read_mtime() const {
+    return this->m_mtime->read(this->mcycle - this->m_mcycle_bias);
+}
+
+void Csr::write_mtime(uint64_t value) {
+    this->m_mtime->write(value, this->mcycle - this->m_mcycle_bias);
+}
+
 bool Csr::current_privilege_mode_can_explicitly_read(Csr::Address csr) const {
     //FIXME special checks for cycle, instret, time, and hpmcounters
+    //(which is also why stimecmp doesn't check mcounteren.TM, only menvcfg.STCE)
+    bool is_stimecmp = (csr == Csr::Address::STIMECMP) || (csr == Csr::Address::STIMECMPH);
+    if (is_stimecmp && (this->m_privilege_mode != PrivilegeMode::MACHINE_MODE) && !this->sstc_enabled()) {
+        return false;
+    }
+
+    //The floating point CSRs are off limits (at any privilege) while mstatus.FS is Off
+    bool is_fp_csr = (csr == Csr::Address::FFLAGS) || (csr == Csr::Address::FRM) || (csr == Csr::Address::FCSR);
+    if (is_fp_csr && !this->fp_enabled()) {
+        return false;
+    }
+
+    //Likewise for the vector CSRs while mstatus.VS is Off
+    bool is_vector_csr =
+        (csr == Csr::Address::VSTART) || (csr == Csr::Address::VXSAT) || (csr == Csr::Address::VXRM) ||
+        (csr == Csr::Address::VCSR) || (csr == Csr::Address::VL) || (csr == Csr::Address::VTYPE) ||
+        (csr == Csr::Address::VLENB);
+    if (is_vector_csr && !this->vector_enabled()) {
+        return false;
+    }
 
     uint32_t min_privilege_required = (static_cast<uint16_t>(csr) >> 8) & 0b11;
     return (uint32_t)(m_privilege_mode) >= min_privilege_required;
 }
 
+void Csr::increment_hpm_counters(HpmEvent event) {
+    uint32_t counters = this->m_hpm_event_counters[static_cast<uint8_t>(event)];
+    while (counters) {
+        ++this->mhpmcounter[__builtin_ctz(counters)];
+        counters &= counters - 1;
+    }
+}
+
+void Csr::update_active_hpm_events() {
+    std::fill_n(this->m_hpm_event_counters, static_cast<std::size_t>(HpmEvent::COUNT), 0);
+    this->m_active_hpm_events = 0;
+
+    for (std::size_t i = 0; i < NUM_HPM_COUNTERS; ++i) {
+        bool inhibited = this->mcountinhibit.bit(static_cast<uint32_t>(i + 3)).u;
+        if (!inhibited && (this->mhpmevent[i] != HpmEvent::NONE)) {
+            this->m_hpm_event_counters[static_cast<uint8_t>(this->mhpmevent[i])] |= 1U << i;
+            this->m_active_hpm_events |= 1ULL << static_cast<uint8_t>(this->mhpmevent[i]);
+        }
+    }
+}
+
 bool Csr::current_privilege_mode_can_explicitly_write(Csr::Address csr) const {
     if (((static_cast<uint16_t>(csr) >> 10) & 0b11) == 0b11) {//If top 2 bits are 1, then it's a read only CSR
         return false;
@@ -15,17 +15,36 @@
 
 #ifdef private//Unit tests define this but this dosn't play nicely with chrono
 #undef private
+#include <atomic>
 #include <chrono>
+#include <memory>
+#include "doorbell.h"
 #define private public
 #else
+#include <atomic>
 #include <chrono>
+#include <memory>
+#include "doorbell.h"
 #endif
 
+#include <cstddef>
 #include <cstdint>
 
 #include "common.h"
 #include "rv_trap.h"
 
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+//mstatus.FS (floating point state), mstatus.VS (vector state), and mstatus.SD (set when either is Dirty)
+#define MSTATUS_FS  0b00000000'00000000'01100000'00000000
+#define MSTATUS_VS  0b00000000'00000000'00000110'00000000
+#define MSTATUS_SD  0b10000000'00000000'00000000'00000000
+
+//vtype.vill (set when vtype was given an unsupported configuration)
+#define VTYPE_VILL  0b10000000'00000000'00000000'00000000
+
 /* ------------------------------------------------------------------------------------------------
  * Type/Class Declarations
  * --------------------------------------------------------------------------------------------- */
@@ -42,6 +61,65 @@ enum class PrivilegeMode : uint8_t {
     MACHINE_MODE    = 0b11
 };
 
+/**
+ * @brief       The machine timer (mtime), which unlike the CSRs is shared by every hart.
+ * @note        mtime counts host time at the timebase frequency (see host_clock.h), or in virtual
+ *              time, every so many cycles of hart 0 (which makes runs reproducible). It is safe to
+ *              use from any thread.
+*/
+class Mtime {
+public:
+    /**
+     * @brief       Construct a new Mtime, starting from 0 and counting host time.
+    */
+    Mtime();
+
+    /**
+     * @brief       Change how fast mtime counts host time, keeping its current value.
+     * @param[in]   frequency Ticks per second; should match timebase-frequency in the device tree.
+    */
+    void set_frequency(uint64_t frequency);
+
+    /**
+     * @brief       Get how fast mtime counts host time.
+     * @return      Ticks per second
+    */
+    uint64_t frequency() const;
+
+    /**
+     * @brief       Switch to virtual time, keeping the current value of mtime.
+     * @param[in]   cycles_per_tick How many cycles of hart 0 it takes for mtime to increment.
+     * @param[in]   cycles How many cycles hart 0 has run so far.
+    */
+    void use_virtual_time(uint64_t cycles_per_tick, uint64_t cycles);
+
+    /**
+     * @brief       Determine if mtime counts cycles rather than host time.
+     * @return      True in virtual time.
+    */
+    bool virtual_time() const;
+
+    /**
+     * @brief       Read the current value of mtime.
+     * @param[in]   cycles How many cycles hart 0 has run so far (ignored unless in virtual time).
+     * @return      mtime
+    */
+    uint64_t read(uint64_t cycles) const;
+
+    /**
+     * @brief       Set mtime, which keeps counting up from the new value.
+     * @param[in]   value The new value of mtime.
+     * @param[in]   cycles How many cycles hart 0 has run so far (ignored unless in virtual time).
+    */
+    void write(uint64_t value, uint64_t cycles);
+
+private:
+    uint64_t m_epoch;//When we started counting, according to host_clock::now()
+    std::atomic<uint64_t> m_offset;//mtime is this plus the number of ticks since m_epoch (or of virtual time)
+    uint64_t m_frequency;
+    uint64_t m_cycles_per_tick;//0 unless in virtual time
+};
+
 /**
  * @brief       Class containing RISC-V CSR's.
 */
@@ -50,6 +128,13 @@ public:
 
     // The addresses of the CSR's that are implemented by IRVE.
     enum class Address : uint16_t {
+        FFLAGS               = 0x001,
+        FRM                  = 0x002,
+        FCSR                 = 0x003,
+        VSTART               = 0x008,
+        VXSAT                = 0x009,
+        VXRM                 = 0x00A,
+        VCSR                 = 0x00F,
         SSTATUS              = 0x100,
         SIE                  = 0x104,
         STVEC                = 0x105,
@@ -60,6 +145,8 @@ public:
         SCAUSE               = 0x142,
         STVAL                = 0x143,
         SIP                  = 0x144,
+        STIMECMP             = 0x14D,
+        STIMECMPH            = 0x15D,
         SATP                 = 0x180,
         MSTATUS              = 0x300,
         MISA                 = 0x301,
@@ -113,6 +200,10 @@ public:
         HPMCOUNTER_START     = 0xC03, // Inclusive
         HPMCOUNTER_END       = 0xC1F, // Inclusive
 
+        VL                   = 0xC20,
+        VTYPE                = 0xC21,
+        VLENB                = 0xC22,
+
         CYCLEH               = 0xC80,
         TIMEH                = 0xC81,
         INSTRETH             = 0xC82,
@@ -127,12 +218,39 @@ public:
         MCONFIGPTR           = 0xF15,
     };
 
+    /**
+     * @brief       Events the mhpmcounters can count (the values written to the mhpmevent CSRs).
+     * @note        Any other value written to an mhpmevent CSR reads back as NONE.
+    */
+    enum class HpmEvent : uint8_t {
+        NONE                = 0x00,
+        ICACHE_MISS         = 0x01,
+        TLB_MISS            = 0x02,//IRVE has no TLB, so this is every access that needed translating
+        PAGE_TABLE_READ     = 0x03,//Each PTE read while walking page tables
+        LOAD                = 0x04,
+        STORE               = 0x05,
+        TAKEN_BRANCH        = 0x06,//Conditional branches only
+        AMO                 = 0x07,//Including LR and SC
+        EXCEPTION           = 0x08,//Of any cause
+        INTERRUPT           = 0x09,//Of any cause
+        EXCEPTION_CAUSE_0   = 0x10,//Add the cause to count a particular exception (0x10 to 0x1F)
+        INTERRUPT_CAUSE_0   = 0x20,//Add the cause to count a particular interrupt (0x20 to 0x2F)
+        COUNT               = 0x30
+    };
+
     /**
      * @brief       The default Csr constructor. 
      * @note        Only guaranteed to initialize CSRs that must be according to the RISC-V spec.
     */
     Csr();
 
+    /**
+     * @brief       The constructor for the CSRs of any hart other than hart 0.
+     * @param[in]   hart_id The value of mhartid.
+     * @param[in]   hart0_CSR Hart 0's CSRs, to share mtime with.
+    */
+    Csr(uint32_t hart_id, const Csr& hart0_CSR);
+
     /**
      * @brief       Reads a CSR explicitly (checks for adequate privilege and readablity).
      * @note        Invokes an illegal instruction exception if the CSR cannot be explicitly read
@@ -200,15 +318,213 @@ public:
 
     void increment_perf_counters();//Increments mcycle and minstret
 
+    /**
+     * @brief       Increment the mhpmcounters (if any) that are counting an event.
+     * @note        This is cheap when no counter is counting the event, so it can be called from
+     *              hot paths.
+     * @param[in]   event The event that occurred.
+    */
+    void count_hpm_event(HpmEvent event) {
+        if (this->m_active_hpm_events & (1ULL << static_cast<uint8_t>(event))) [[unlikely]] {
+            this->increment_hpm_counters(event);
+        }
+    }
+
+    /**
+     * @brief       Count the HPM events corresponding to a trap being taken.
+     * @param[in]   cause The cause of the trap.
+    */
+    void count_hpm_trap_event(rv_trap::Cause cause);
+
+    /**
+     * @brief       Check if floating point instructions and CSRs may be used (mstatus.FS isn't Off).
+     * @return      True if the F and D extensions are enabled.
+    */
+    bool fp_enabled() const {
+        return (this->mstatus.u & MSTATUS_FS) != 0;
+    }
+
+    /**
+     * @brief       Mark the floating point state as modified (mstatus.FS = Dirty, and so mstatus.SD).
+    */
+    void set_fp_dirty() {
+        this->mstatus |= MSTATUS_FS | MSTATUS_SD;
+    }
+
+    /**
+     * @brief       Get the dynamic rounding mode (fcsr.frm).
+     * @return      The rounding mode (which may be invalid, in which case using it is illegal).
+    */
+    uint8_t get_frm() const {
+        return (this->fcsr.u >> 5) & 0b111;
+    }
+
+    /**
+     * @brief       Accrue floating point exception flags (into fcsr.fflags).
+     * @param[in]   flags The flags to set (NV, DZ, OF, UF, NX from bit 4 down to bit 0).
+    */
+    void accrue_fflags(uint8_t flags) {
+        if (flags) {
+            this->fcsr |= flags & 0b11111;
+            this->set_fp_dirty();
+        }
+    }
+
+    /**
+     * @brief       Check if vector instructions and CSRs may be used (mstatus.VS isn't Off).
+     * @return      True if the vector extension is enabled.
+    */
+    bool vector_enabled() const {
+        return (this->mstatus.u & MSTATUS_VS) != 0;
+    }
+
+    /**
+     * @brief       Mark the vector state as modified (mstatus.VS = Dirty, and so mstatus.SD).
+    */
+    void set_vector_dirty() {
+        this->mstatus |= MSTATUS_VS | MSTATUS_SD;
+    }
+
     /**
      * @brief       Updates the RISC-V CPU's mtime timer based on the host system's time.
      *              May also set a timer interrupt as pending in the mip CSR.
     */
     void update_timer();
 
+    /**
+     * @brief       Set when mip.STIP next becomes pending (for SBI set_timer and writes to the
+     *              stimecmp CSR), clearing it until then.
+     * @param[in]   value The value of mtime at which the supervisor timer interrupt becomes pending.
+     * @note        Has no effect on mip.STIP unless menvcfg.STCE is set (the native SBI sets it).
+    */
+    void set_stimecmp(uint64_t value);
+
     void set_exti_pending();
+
+    /**
+     * @brief       Set or clear mip.MSIP (the ACLINT's msip register for this hart).
+     * @note        Unlike everything else here, this (and writes to mtimecmp) can be done from
+     *              another hart's thread.
+     * @param[in]   pending True to set mip.MSIP, false to clear it.
+    */
+    void set_msip(bool pending);
+
+    /**
+     * @brief       Set mip.SSIP (for SBI IPIs), which like set_msip() can be done from another
+     *              hart's thread.
+    */
+    void set_ssip();
+
+    /**
+     * @brief       Check if mip.MSIP is set.
+     * @return      True if a machine software interrupt is pending.
+    */
+    bool msip() const;
+
+    /**
+     * @brief       Get which hart these CSRs belong to.
+     * @return      mhartid
+    */
+    uint32_t hart_id() const;
+
+    /**
+     * @brief       Get the doorbell harts in WFI wait on, which is shared by every hart.
+     * @note        Rung whenever mtime, mtimecmp or msip is written.
+     * @return      The doorbell
+    */
+    Doorbell& doorbell();
+
+    /**
+     * @brief       Record whether the hart is executing instructions on its own thread, so remote
+     *              fences know whether they have to wait for it.
+     * @note        Cleared while it sleeps in WFI, since it will see the fence before its next instruction.
+     * @param[in]   running True if it is.
+     * @return      Whether it was before.
+    */
+    bool set_running(bool running);
+
+    /**
+     * @brief       Check whether the hart is executing instructions on its own thread.
+     * @note        Like msip(), this can be done from another hart's thread.
+     * @return      True if it is.
+    */
+    bool running() const;
+
+    /**
+     * @brief       Get how long until mtime reaches mtimecmp (or stimecmp), if that interrupt is enabled.
+     * @param[in]   limit The most that will be returned.
+     * @return      How long until the timer interrupt becomes pending (0 if it already is).
+    */
+    std::chrono::nanoseconds time_until_timer_interrupt(std::chrono::nanoseconds limit) const;
+
+    /**
+     * @brief       Change how many times per second mtime increments (in host time).
+     * @note        Affects every hart, so only call this before they start running.
+     * @param[in]   frequency Should match timebase-frequency in the device tree.
+    */
+    void set_timebase_frequency(uint64_t frequency);
+
+    /**
+     * @brief       Make mtime count this hart's cycles instead of host time, so runs are reproducible.
+     * @note        Only makes sense with a single hart, since other harts' threads can't see our cycles.
+     * @param[in]   cycles_per_tick How many cycles it takes for mtime to increment.
+    */
+    void use_virtual_time(uint64_t cycles_per_tick);
+
+    /**
+     * @brief       Determine if mtime counts cycles rather than host time.
+     * @return      True in virtual time.
+    */
+    bool virtual_time() const;
+
+    /**
+     * @brief       Fast-forward virtual time to when the timer interrupt becomes pending, since a
+     *              hart that is idle until then would otherwise just burn through cycles.
+     * @note        Does nothing unless in virtual time with a timer interrupt enabled in mie and
+     *              its mtimecmp/stimecmp set to something other than its maximum value (which
+     *              means "never").
+     * @return      True if mip.MTIP or mip.STIP is now set.
+    */
+    bool skip_to_timer_interrupt();
 private:
 
+    /**
+     * @brief       Check if S-mode may use stimecmp (menvcfg.STCE), making mip.STIP read-only.
+     * @return      True if Sstc is enabled.
+    */
+    bool sstc_enabled() const;
+
+    /**
+     * @brief       Make mstatus.SD reflect whether mstatus.FS or mstatus.VS is Dirty (after mstatus is written).
+    */
+    void update_mstatus_sd();
+
+    /**
+     * @brief       Get the soonest value of mtime at which an enabled timer interrupt becomes pending.
+     * @return      mtimecmp or stimecmp (or the maximum value if neither interrupt is enabled).
+    */
+    uint64_t next_timer_deadline() const;
+
+    /**
+     * @brief       Read mtime.
+     * @return      mtime
+    */
+    uint64_t read_mtime() const;
+
+    /**
+     * @brief       Write mtime.
+     * @param[in]   value The new value of mtime.
+    */
+    void write_mtime(uint64_t value);
+
+    /**
+     * @brief       The constructor both of the public constructors delegate to.
+     * @param[in]   hart_id The value of mhartid.
+     * @param[in]   mtime The machine timer, shared by every hart.
+     * @param[in]   doorbell The doorbell for WFI, shared by every hart.
+    */
+    Csr(uint32_t hart_id, std::shared_ptr<Mtime> mtime, std::shared_ptr<Doorbell> doorbell);
+
     /**
      * @brief       Checks if the current privilege mode can read a CSR.
      * @param[in]   csr The CSR to check.
@@ -223,6 +539,22 @@ private:
     */
     bool current_privilege_mode_can_explicitly_write(Csr::Address csr) const;
 
+    /**
+     * @brief       Increment each uninhibited mhpmcounter that is counting an event.
+     * @param[in]   event The event that occurred.
+    */
+    void increment_hpm_counters(HpmEvent event);
+
+    /**
+     * @brief       Recompute which events are being counted after mhpmevent or mcountinhibit changes.
+    */
+    void update_active_hpm_events();
+
+    Reg fcsr;//Handles fflags and frm too
+    Reg vstart;
+    Reg vcsr;//Handles vxsat and vxrm too
+    Reg vl;
+    Reg vtype;
     Reg stvec;
     Reg scounteren;
     Reg senvcfg;
@@ -239,7 +571,7 @@ private:
     Reg mtvec;
     Reg menvcfg;
     //mstatush is NOT here
-    //menvcfgh is NOT here
+    Reg menvcfgh;
     Reg mscratch;
     Reg mepc;
     Reg mcause;
@@ -252,14 +584,29 @@ private:
     uint64_t minstret;//Handles both minstret and minstreth
     uint64_t mcycle;//Handles both mcycle and mcycleh
 
+    static constexpr std::size_t NUM_HPM_COUNTERS = 29;//mhpmcounter3 through mhpmcounter31
+
+    Reg mcountinhibit;
+    uint64_t mhpmcounter[NUM_HPM_COUNTERS];//Handles both mhpmcounter and mhpmcounterh
+    HpmEvent mhpmevent[NUM_HPM_COUNTERS];
+
+    uint64_t m_active_hpm_events;//Bit i is set if an uninhibited counter is counting HpmEvent i
+    uint32_t m_hpm_event_counters[static_cast<std::size_t>(HpmEvent::COUNT)];//Bit i is set if mhpmcounter(i + 3) counts the event
+
     //NOTE: According to the spec, mtime and mtimecmp must be in memory, not in CSR's. However,
     //      that would mean Csr would need a reference to memory, which is not ideal. Instead we
     //      keep them here, and memory will have to redirect writes to their addresses into
     //      implicit writes to these CSR's.
 
-    uint64_t mtime;//Handles both time and timeh
-    uint64_t mtimecmp;//Handles both time and timeh
-    std::chrono::time_point<std::chrono::steady_clock> m_last_time_update;
+    std::shared_ptr<Mtime> m_mtime;//Handles both time and timeh
+    uint64_t m_mcycle_bias;//How much writes have moved mcycle, so virtual time only counts cycles actually run
+    std::atomic<uint64_t> mtimecmp;//Handles both mtimecmp and mtimecmph; other harts can write it through the ACLINT
+    uint64_t stimecmp;//Handles both stimecmp and stimecmph (ignored unless menvcfg.STCE is set)
+    std::atomic<uint32_t> m_aclint_mip;//mip.MSIP and mip.MTIP, which other harts can change through the ACLINT (and mip.SSIP through SBI IPIs)
+    std::shared_ptr<Doorbell> m_doorbell;
+    std::atomic<bool> m_running;//See set_running()
+
+    const uint32_t m_hart_id;
 
     /**
      * @brief       The current privilege mode of the hart.
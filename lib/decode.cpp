@@ -25,6 +25,7 @@
 
 #include "rv_trap.h"
 
+#define LOG_SUBSYSTEM DECODE
 #define INST_COUNT inst_count
 #include "logging.h"
 
@@ -39,6 +40,7 @@ using namespace irve::internal;
  * --------------------------------------------------------------------------------------------- */
 
 decode::DecodedInst::DecodedInst(Word instruction) :
+    m_raw(instruction),
     m_opcode((Opcode)instruction.bits(6, 2).u),
     m_funct3(instruction.bits(14, 12).u),
     m_funct5(instruction.bits(31, 27).u),
@@ -87,10 +89,17 @@ decode::DecodedInst::DecodedInst(Word instruction) :
         case Opcode::OP:
         case Opcode::CUSTOM_0://We implement this opcode with some custom instructions!
         case Opcode::AMO:
+        case Opcode::OP_FP:
+        case Opcode::OP_V:
+        case Opcode::MADD:
+        case Opcode::MSUB:
+        case Opcode::NMSUB:
+        case Opcode::NMADD:
             this->m_format = InstFormat::R_TYPE;
             break;
         //I-type
         case Opcode::LOAD:
+        case Opcode::LOAD_FP:
         case Opcode::OP_IMM:
         case Opcode::JALR:
         case Opcode::SYSTEM:
@@ -99,6 +108,7 @@ decode::DecodedInst::DecodedInst(Word instruction) :
             break;
         //S-type
         case Opcode::STORE:
+        case Opcode::STORE_FP:
             this->m_format = InstFormat::S_TYPE;
             break;
         //B-type
@@ -210,8 +220,8 @@ uint8_t decode::DecodedInst::get_funct3() const {
 }
 
 uint8_t decode::DecodedInst::get_funct5() const {
-    assert((this->get_opcode() == Opcode::AMO) &&
-            "Attempt to get funct5 of non-AMO instruction!");
+    assert(((this->get_opcode() == Opcode::AMO) || (this->get_opcode() == Opcode::OP_FP)) &&
+            "Attempt to get funct5 of non-AMO/OP-FP instruction!");
     return this->m_funct5;
 }
 
@@ -245,6 +255,17 @@ uint8_t decode::DecodedInst::get_rs2() const {
     return this->m_rs2;
 }
 
+uint8_t decode::DecodedInst::get_rs3() const {
+    assert(
+        (
+            (this->get_opcode() == Opcode::MADD) || (this->get_opcode() == Opcode::MSUB) ||
+            (this->get_opcode() == Opcode::NMSUB) || (this->get_opcode() == Opcode::NMADD)
+        ) &&
+        "Attempt to get rs3 of non-fused multiply-add instruction!"
+    );
+    return this->m_funct5;//rs3 occupies the same bits as funct5
+}
+
 Word decode::DecodedInst::get_imm() const {
     switch (this->get_format()) {
         case InstFormat::R_TYPE:
@@ -271,6 +292,10 @@ Word decode::DecodedInst::get_imm() const {
     __builtin_unreachable();
 }
 
+Word decode::DecodedInst::get_raw() const {
+    return this->m_raw;
+}
+
 std::string decode::DecodedInst::disassemble() const {
 #if IRVE_INTERNAL_CONFIG_RUST
     disassemble::DecodedInst rust_decoded_inst = {
@@ -36,7 +36,7 @@ enum class Opcode : uint8_t {
     STORE = 0b01000     , STORE_FP = 0b01001  , CUSTOM_1 = 0b01010  , AMO = 0b01011       ,
     OP = 0b01100        , LUI = 0b01101       , OP_32 = 0b01110     , B64 = 0b01111       ,
     MADD = 0b10000      , MSUB = 0b10001      , NMSUB = 0b10010     , NMADD = 0b10011     ,
-    OP_FP = 0b10100     , RESERVED_0 = 0b10101, CUSTOM_2 = 0b10110  , B48_1 = 0b10111     ,
+    OP_FP = 0b10100     , OP_V = 0b10101      , CUSTOM_2 = 0b10110  , B48_1 = 0b10111     ,
     BRANCH = 0b11000    , JALR = 0b11001      , RESERVED_1 = 0b11010, JAL = 0b11011       ,
     SYSTEM = 0b11100    , RESERVED_3 = 0b11101, CUSTOM_3 = 0b11110  , BGE80 = 0b11111,
 };
@@ -90,10 +90,18 @@ public:
     uint8_t get_rd() const;
     uint8_t get_rs1() const;//Also uimm//TODO how should we expose uimm?
     uint8_t get_rs2() const;
+    uint8_t get_rs3() const;//Only for MADD/MSUB/NMSUB/NMADD
     Word get_imm() const;
 
+    /**
+     * @brief       Get the instruction as it was before being decoded.
+     * @return      The raw instruction.
+    */
+    Word get_raw() const;
+
 private:
     std::string disassemble() const;
+    Word m_raw;
     Opcode m_opcode;//Bits [6:2]
 
     uint8_t m_funct3;
@@ -63,7 +63,7 @@ pub enum Opcode {
     //TODO documentations of these
     Load = 0b00000,     LoadFp = 0b00001,  Custom0 = 0b00010,     MiscMem = 0b00011, OpImm = 0b00100,   AuiPc= 0b00101,        OpImm32 = 0b00110,    B480 = 0b00111,
     Store = 0b01000,    StoreFp = 0b01001, Custom1 = 0b01010,     Amo = 0b01011,      Op = 0b01100,       Lui = 0b01101,          Op32 = 0b01110,        B64 = 0b01111,
-    MAdd = 0b10000,     MSub = 0b10001,     NMSub = 0b10010,        NMAdd = 0b10011,    OpFp = 0b10100,    Reserved0 = 0b10101,   Custom2 = 0b10110,     B481 = 0b10111,
+    MAdd = 0b10000,     MSub = 0b10001,     NMSub = 0b10010,        NMAdd = 0b10011,    OpFp = 0b10100,    OpV = 0b10101,         Custom2 = 0b10110,     B481 = 0b10111,
     Branch = 0b11000,   Jalr = 0b11001,     Reserved1 = 0b11010,   Jal = 0b11011,      System = 0b11100,   Reserved3 = 0b11101,   Custom3 = 0b11110,     BGE80 = 0b11111
 }
 
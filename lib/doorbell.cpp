@@ -0,0 +1,42 @@
+/**
+ * @brief   Lets harts sleep in WFI until something that could wake them happens
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "doorbell.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+Doorbell::Doorbell() : m_rings(0) {}
+
+void Doorbell::ring() {
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        ++this->m_rings;
+    }
+    this->m_condition_variable.notify_all();
+}
+
+uint64_t Doorbell::rings() const {
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    return this->m_rings;
+}
+
+bool Doorbell::wait_until(uint64_t seen_rings, std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+    return this->m_condition_variable.wait_until(lock, deadline, [&]() {
+        return this->m_rings != seen_rings;
+    });
+}
@@ -0,0 +1,63 @@
+/**
+ * @brief   Lets harts sleep in WFI until something that could wake them happens
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Anything that can make an interrupt pending from outside the sleeping hart's thread (the UART's
+ * receive thread, another hart writing msip or mtimecmp) rings the doorbell. A hart in WFI checks
+ * for interrupts, and if there are none, waits for the doorbell to ring (or for the next timer
+ * deadline). Since it remembers how many times the doorbell had rung *before* it checked, a ring in
+ * between checking and waiting can't be missed.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal {
+
+class Doorbell {
+public:
+    Doorbell();
+
+    /**
+     * @brief Wake up everyone waiting on the doorbell
+     * @note Safe to call from any thread
+    */
+    void ring();
+
+    /**
+     * @brief Get how many times the doorbell has rung, to pass to wait_until() later
+     * @return The number of rings so far
+    */
+    uint64_t rings() const;
+
+    /**
+     * @brief Sleep until the doorbell rings more than seen_rings times, or until the deadline
+     * @param seen_rings What rings() returned before checking whatever we are waiting for
+     * @param deadline When to give up waiting
+     * @return True if the doorbell rang, false if we reached the deadline
+    */
+    bool wait_until(uint64_t seen_rings, std::chrono::steady_clock::time_point deadline);
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition_variable;
+    uint64_t m_rings;
+};
+
+} // namespace irve::internal
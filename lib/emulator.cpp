@@ -16,15 +16,27 @@
 #include <cassert>
 #include <cstdint>
 
+#include "callgraph.h"
 #include "common.h"
 #include "cpu_state.h"
 #include "csr.h"
 #include "decode.h"
 #include "gdbserver.h"
 #include "execute.h"
+#include "hostperf.h"
 #include "memory.h"
+#include "profiler.h"
 #include "rv_trap.h"
 #include "semihosting.h"
+#include "trace.h"
+#include "vector.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 #define INST_COUNT this->m_CSR.implicit_read(Csr::Address::MINSTRET).u
 #include "logging.h"
@@ -37,50 +49,205 @@ using namespace irve::internal;
 
 constexpr uint32_t MAX_PERIPHERAL_UPDATE_DELAY_COUNTER_VALUE = 65535;
 
+constexpr uint32_t MAX_HARTS = 4095;//As many as the ACLINT has room for mtimecmp registers
+
 /* ------------------------------------------------------------------------------------------------
  * Function Implementations
  * --------------------------------------------------------------------------------------------- */
 
-emulator::emulator_t::emulator_t(int imagec, const char* const* imagev):
+emulator::emulator_t::emulator_t(int imagec, const char* const* imagev, const char* uart_backend_spec):
     m_CSR(),
-    m_memory(imagec, imagev, m_CSR),
+    m_memory(imagec, imagev, m_CSR, uart_backend_spec),
     m_cpu_state(),
+    m_icache_flush_requested(false),
     m_intercept_breakpoints(false),
-    m_peripheral_update_delay_counter(MAX_PERIPHERAL_UPDATE_DELAY_COUNTER_VALUE)
+    m_peripheral_update_delay_counter(MAX_PERIPHERAL_UPDATE_DELAY_COUNTER_VALUE),
+    m_peripheral_update_interval(MAX_PERIPHERAL_UPDATE_DELAY_COUNTER_VALUE),
+    m_stats(),
+    m_host_phase(hostperf::Phase::OTHER),
+    m_log_sink(logging::current_thread_sink())
 {
     irvelog(0, "Created new emulator instance");
 }
 
+emulator::emulator_t::emulator_t(emulator_t& hart0, uint32_t hart_id):
+    m_CSR(hart_id, hart0.m_CSR),
+    m_memory(hart0.m_memory, m_CSR),
+    m_cpu_state(),
+    m_icache_flush_requested(false),
+    m_intercept_breakpoints(false),
+    m_peripheral_update_delay_counter(MAX_PERIPHERAL_UPDATE_DELAY_COUNTER_VALUE),
+    m_peripheral_update_interval(MAX_PERIPHERAL_UPDATE_DELAY_COUNTER_VALUE),
+    m_stats(),
+    m_host_phase(hostperf::Phase::OTHER),
+    m_log_sink(hart0.m_log_sink)
+{
+    irvelog(0, "Created hart %u", hart_id);
+}
+
+emulator::emulator_t::~emulator_t() {
+    //The instruction counts in the icache need to be handed over before the profile is written
+    this->stop_callgraph_profiling();
+}
+
+bool emulator::emulator_t::set_hart_count(uint32_t hart_count) {
+    if ((hart_count == 0) || (hart_count > MAX_HARTS) || !this->m_other_harts.empty() || this->m_CSR.virtual_time()) {
+        return false;
+    }
+
+    for (uint32_t hart_id = 1; hart_id < hart_count; ++hart_id) {
+        this->m_other_harts.emplace_back(new emulator_t(*this, hart_id));//The constructor is private, so no make_unique
+    }
+
+    if (this->m_sbi) {//The new harts need to be reachable by IPIs and remote fences too
+        this->set_native_sbi(true);
+    }
+
+    //tick() steps every hart on the same thread, where a hart sleeping in WFI would hold up the
+    //one that could wake it. run_until() lets them sleep while they have their own threads.
+    this->set_sleep_in_wfi(false);
+    return true;
+}
+
+bool emulator::emulator_t::set_virtual_time(uint64_t insts_per_tick) {
+    //Other harts' threads can't see how many instructions we've run, nor would they be reproducible
+    if ((insts_per_tick == 0) || !this->m_other_harts.empty()) {
+        return false;
+    }
+
+    this->m_CSR.use_virtual_time(insts_per_tick);
+
+    //Check the timer as mtime ticks, so a timer interrupt isn't taken later than it should be
+    this->m_peripheral_update_interval = (uint32_t)std::min<uint64_t>(insts_per_tick, MAX_PERIPHERAL_UPDATE_DELAY_COUNTER_VALUE);
+    this->m_peripheral_update_delay_counter = this->m_peripheral_update_interval;
+    return true;
+}
+
+bool emulator::emulator_t::set_timebase_frequency(uint64_t frequency) {
+    if (frequency == 0) {
+        return false;
+    }
+
+    this->m_CSR.set_timebase_frequency(frequency);//mtime is shared, so this covers every hart
+    return true;
+}
+
+void emulator::emulator_t::set_native_sbi(bool enable) {
+    std::shared_ptr<SbiHandler> sbi;
+    if (enable) {
+        sbi = std::make_shared<SbiHandler>();
+        sbi->add_hart(this->m_CSR, this->m_icache_flush_requested);
+        for (std::unique_ptr<emulator_t>& hart : this->m_other_harts) {
+            sbi->add_hart(hart->m_CSR, hart->m_icache_flush_requested);
+        }
+    } else if (this->m_sbi) {//Leave the harts how the firmware would expect to find them
+        this->m_sbi->remove_harts();
+    }
+
+    this->m_sbi = sbi;
+    for (std::unique_ptr<emulator_t>& hart : this->m_other_harts) {
+        hart->m_sbi = sbi;
+    }
+}
+
+void emulator::emulator_t::set_misaligned_access(bool enable) {
+    this->m_memory.set_emulate_misaligned(enable);
+    for (std::unique_ptr<emulator_t>& hart : this->m_other_harts) {
+        hart->m_memory.set_emulate_misaligned(enable);
+    }
+}
+
+void emulator::emulator_t::set_sleep_in_wfi(bool sleep) {
+    this->m_memory.set_sleep_in_wfi(sleep);
+    for (std::unique_ptr<emulator_t>& hart : this->m_other_harts) {
+        hart->m_memory.set_sleep_in_wfi(sleep);
+    }
+}
+
 bool emulator::emulator_t::tick() {
+    bool keep_running = this->tick_hart();
+    for (std::unique_ptr<emulator_t>& hart : this->m_other_harts) {
+        keep_running = hart->tick_hart() && keep_running;
+    }
+    return keep_running;
+}
+
+bool emulator::emulator_t::tick_hart() {
     this->m_CSR.increment_perf_counters();
     irvelog(0, "Tick %lu begins", this->get_inst_count());
 
+    if (this->m_icache_flush_requested.load()) [[unlikely]] {//Sequentially consistent, see SbiHandler::remote_fence()
+        this->flush_icache();
+    }
+
+    if (this->m_profiler) [[unlikely]] {
+        this->m_profiler->tick(this->m_cpu_state.get_pc().u, this->m_CSR.get_privilege_mode());
+    }
+
+    if (this->m_tracer) [[unlikely]] {
+        this->m_tracer->begin(this->m_cpu_state.get_pc().u);
+    }
+
     //Any of these could lead to exceptions (ex. faults, illegal instructions, etc.)
     try {
+        this->set_host_phase(hostperf::Phase::DECODE);
         decode::DecodedInst decoded_inst = this->fetch_and_decode();
-        this->execute(decoded_inst);
+        if (this->m_tracer) [[unlikely]] {
+            this->trace_before_execute(decoded_inst);
+            this->execute(decoded_inst);
+            this->trace_after_execute(decoded_inst);
+        } else {
+            this->execute(decoded_inst);
+        }
+
+        if (this->m_callgraph) [[unlikely]] {
+            decode::Opcode opcode = decoded_inst.get_opcode();
+            if ((opcode == decode::Opcode::JAL) || (opcode == decode::Opcode::JALR)) {
+                uint8_t rd = decoded_inst.get_rd();
+                uint8_t rs1 = (opcode == decode::Opcode::JALR) ? decoded_inst.get_rs1() : 0;
+                uint32_t return_addr = this->m_cpu_state.get_r(rd).u;//Only meaningful if rd is a link register
+                this->m_callgraph->jump(rd, rs1, return_addr, this->m_cpu_state.get_pc().u, this->get_inst_count());
+            }
+        }
     } catch (const rv_trap::RvException& e) {
+        this->set_host_phase(hostperf::Phase::TRAP);
         assert(((uint32_t)e.cause() < 32) && "Unsuppored cause value!");
         irvelog(1, "Handling exception: Cause: %u", (uint32_t)e.cause());
+        if (this->m_tracer) [[unlikely]] {
+            this->m_tracer->trap((uint32_t)e.cause(), e.tval().u);
+        }
         this->handle_trap(e.cause(), e.tval());
     } catch (const rv_trap::IrveExitRequest&) {
         irvelog(0, "Recieved exit request from emulated guest");
+        if (this->m_tracer) [[unlikely]] {
+            this->m_tracer->end();
+        }
         return false;
     }
 
+    if (this->m_tracer) [[unlikely]] {
+        this->m_tracer->end();
+    }
+
+    this->set_host_phase(hostperf::Phase::OTHER);
+
     //Only actually update the timer and peripherals every once in a while, rather than each time
     //this function is called. This is since chrono (used by the timer) and the read syscall
     //(used by the UART) are REALLY REALLY REALLY slow.
     --this->m_peripheral_update_delay_counter;
     if (this->m_peripheral_update_delay_counter == 0) {
         //Reset the delay counter
-        this->m_peripheral_update_delay_counter = MAX_PERIPHERAL_UPDATE_DELAY_COUNTER_VALUE;
+        this->m_peripheral_update_delay_counter = this->m_peripheral_update_interval;
+        auto peripheral_update_start_time = std::chrono::steady_clock::now();
 
         //May or may not set the timer interrupt pending bit depending on if the timer has expired
         this->m_CSR.update_timer();
 
         //Update peripherals and potentially set the external interrupt pending bit
         this->m_memory.update_peripherals();
+
+        ++this->m_stats.peripheral_updates;
+        this->m_stats.peripheral_update_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - peripheral_update_start_time).count();
     }
 
     //May need to deal with interrupt if they were set by one of the above functions,
@@ -92,13 +259,53 @@ bool emulator::emulator_t::tick() {
 }
 
 void emulator::emulator_t::run_until(uint64_t inst_count) {
-    if (inst_count) {
+    if (this->m_hostperf) [[unlikely]] {
+        this->m_hostperf->begin(this->get_inst_count());
+    }
+
+    if (!this->m_other_harts.empty()) {
+        //Each of the other harts gets its own host thread, and they all stop as soon as any of
+        //them (or this one) stops
+        std::atomic<bool> stop = false;
+        std::vector<std::thread> threads;
+        this->set_sleep_in_wfi(true);
+        for (std::unique_ptr<emulator_t>& hart : this->m_other_harts) {
+            threads.emplace_back([&stop, &hart = *hart]() {
+                logging::ScopedThreadSink sink_scope(hart.log_sink());
+                hart.m_CSR.set_running(true);
+                while (!stop.load(std::memory_order_relaxed)) {
+                    if (!hart.tick_hart()) {
+                        stop = true;
+                    }
+                }
+                hart.m_CSR.set_running(false);//So remote fences from the harts still running don't wait for us
+            });
+        }
+
+        this->m_CSR.set_running(true);
+        while (!stop.load(std::memory_order_relaxed) && (!inst_count || (this->get_inst_count() < inst_count))) {
+            if (!this->tick_hart()) {
+                break;
+            }
+        }
+        this->m_CSR.set_running(false);
+
+        stop = true;
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        this->set_sleep_in_wfi(false);
+    } else if (inst_count) {
         //Run until the given instruction count is reached or an exit request is made
-        while ((this->get_inst_count() < inst_count) && this->tick());
+        while ((this->get_inst_count() < inst_count) && this->tick_hart());
     }
     else {
         //The only exit criteria is an exit request
-        while (this->tick());
+        while (this->tick_hart());
+    }
+
+    if (this->m_hostperf) [[unlikely]] {
+        this->m_hostperf->end(this->get_inst_count());
     }
 }
 
@@ -112,6 +319,13 @@ uint64_t emulator::emulator_t::get_inst_count() {
     return INST_COUNT;
 }
 
+Stats emulator::emulator_t::get_stats() {
+    Stats stats = this->m_stats;
+    stats.inst_count = this->get_inst_count();
+    stats.memory = this->m_memory.stats();
+    return stats;
+}
+
 bool emulator::emulator_t::test_and_clear_breakpoint_encountered_flag() {
     bool breakpoint_encountered = this->m_encountered_breakpoint;
     this->m_encountered_breakpoint = false;
@@ -119,7 +333,84 @@ bool emulator::emulator_t::test_and_clear_breakpoint_encountered_flag() {
 }
 
 void emulator::emulator_t::flush_icache() {
+    ++this->m_stats.icache_flushes;
+    if (this->m_callgraph) [[unlikely]] {
+        for (const auto& [pc, cached_inst] : this->m_icache) {
+            this->m_callgraph->add_inst_count(pc, cached_inst.exec_count);
+        }
+    }
     this->m_icache.clear();
+    this->m_icache_flush_requested.store(false);//Lets a hart waiting on a remote fence continue
+}
+
+bool emulator::emulator_t::start_trace(const char* trace_path) {
+    this->stop_trace();
+    try {
+        this->m_tracer = std::make_unique<trace::TraceWriter>(trace_path);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    irvelog_always(0, "Tracing to \"%s\"", trace_path);
+    return true;
+}
+
+void emulator::emulator_t::stop_trace() {
+    this->m_tracer.reset();
+}
+
+bool emulator::emulator_t::start_profiling(const char* output_path, uint32_t period) {
+    this->stop_profiling();
+    try {
+        this->m_profiler = std::make_unique<profiler::Profiler>(output_path, period, this->m_memory.symbols());
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    irvelog_always(0, "Profiling to \"%s\" (sampling every %u instructions)", output_path, period);
+    return true;
+}
+
+void emulator::emulator_t::stop_profiling() {
+    this->m_profiler.reset();
+}
+
+bool emulator::emulator_t::start_callgraph_profiling(const char* output_path) {
+    this->stop_callgraph_profiling();
+    try {
+        this->m_callgraph = std::make_unique<callgraph::CallGraphProfiler>(output_path, this->m_memory.symbols());
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    this->flush_icache();//Start counting from zero
+    irvelog_always(0, "Writing a callgrind profile to \"%s\"", output_path);
+    return true;
+}
+
+void emulator::emulator_t::stop_callgraph_profiling() {
+    if (this->m_callgraph) {
+        this->flush_icache();//Hand over the instruction counts that are still in the icache
+        this->m_callgraph->finish(this->get_inst_count());
+        this->m_callgraph.reset();
+    }
+}
+
+bool emulator::emulator_t::start_host_perf() {
+    this->stop_host_perf();
+    this->m_host_phase = hostperf::Phase::OTHER;//Not updated while we weren't measuring
+    this->m_hostperf = std::make_unique<hostperf::HostPerf>(this->m_host_phase);
+    if (!this->m_hostperf->available()) {
+        this->m_hostperf.reset();
+        return false;
+    }
+    irvelog_always(0, "Measuring the host with hardware performance counters");
+    return true;
+}
+
+void emulator::emulator_t::stop_host_perf() {
+    this->m_hostperf.reset();
+}
+
+logging::Sink emulator::emulator_t::log_sink() const {
+    return this->m_log_sink;
 }
 
 decode::DecodedInst emulator::emulator_t::fetch_and_decode() {
@@ -129,11 +420,20 @@ decode::DecodedInst emulator::emulator_t::fetch_and_decode() {
     //Note: Using exceptions instead to catch misses is (very slightly) faster when using the same
     //      few instructions over and over again. (ex in nouveau_stress_test). But it tanks
     //      performance in other scenarios so we do compare-and-branch instead.
-    if (this->m_icache.contains(pc.u)) {
+    auto cached_inst = this->m_icache.find(pc.u);
+    if (cached_inst != this->m_icache.end()) {
         irvelog(1, "Cache hit");
-        return this->m_icache.at(pc.u);
+        ++this->m_stats.icache_hits;
+        ++cached_inst->second.exec_count;//Cheaper to always count than to check if we're profiling
+        const decode::DecodedInst& decoded_inst = cached_inst->second.decoded_inst;
+        if (this->m_tracer) [[unlikely]] {
+            this->m_tracer->inst(decoded_inst.get_raw().u);
+        }
+        return decoded_inst;
     } else {
         irvelog(1, "Cache miss");
+        ++this->m_stats.icache_misses;
+        this->m_CSR.count_hpm_event(Csr::HpmEvent::ICACHE_MISS);
 
         //Read a word from memory at the PC
         //NOTE: It may throw an exception for various reasons
@@ -141,6 +441,9 @@ decode::DecodedInst emulator::emulator_t::fetch_and_decode() {
 
         //Log what we fetched and return it
         irvelog(1, "Fetched 0x%08x from 0x%08x", inst, pc);
+        if (this->m_tracer) [[unlikely]] {//Before decoding, in case it's illegal
+            this->m_tracer->inst(inst.u);
+        }
 
         irvelog(1, "Decoding instruction 0x%08X", inst);
         decode::DecodedInst decoded_inst(inst);
@@ -153,7 +456,13 @@ decode::DecodedInst emulator::emulator_t::fetch_and_decode() {
         } else if (decoded_inst.get_opcode() == decode::Opcode::SYSTEM) {//To catch satp changes, SFENCE.VMA
             this->flush_icache();
         } else {//There is no need to clear the cache
-            this->m_icache.emplace(pc.u, decoded_inst);
+            this->m_icache.emplace(pc.u, CachedInst{decoded_inst, 1});
+            return decoded_inst;
+        }
+
+        //This instruction isn't cached, so it has to be counted directly
+        if (this->m_callgraph) [[unlikely]] {
+            this->m_callgraph->add_inst_count(pc.u, 1);
         }
 
         return decoded_inst;
@@ -163,12 +472,22 @@ decode::DecodedInst emulator::emulator_t::fetch_and_decode() {
 //TODO move this to a separate file maybe?
 void emulator::emulator_t::execute(const decode::DecodedInst &decoded_inst) {
     irvelog(1, "Executing instruction");
+    this->set_host_phase(hostperf::Phase::EXECUTE);
+    ++this->m_stats.insts_by_opcode[static_cast<uint8_t>(decoded_inst.get_opcode())];
 
     //We can assume the opcode exists since the instruction is valid
     switch (decoded_inst.get_opcode()) {
         case decode::Opcode::LOAD:
             assert((decoded_inst.get_format() == decode::InstFormat::I_TYPE) && "Instruction with LOAD opcode had a non-I format!");
+            this->set_host_phase(hostperf::Phase::MEMORY);
             execute::load(decoded_inst, this->m_cpu_state, this->m_memory, this->m_CSR);
+            this->m_CSR.count_hpm_event(Csr::HpmEvent::LOAD);
+            break;
+        case decode::Opcode::LOAD_FP:
+            assert((decoded_inst.get_format() == decode::InstFormat::I_TYPE) && "Instruction with LOAD_FP opcode had a non-I format!");
+            this->set_host_phase(hostperf::Phase::MEMORY);
+            execute::load_fp(decoded_inst, this->m_cpu_state, this->m_memory, this->m_CSR);
+            this->m_CSR.count_hpm_event(Csr::HpmEvent::LOAD);
             break;
         case decode::Opcode::CUSTOM_0:
             assert((decoded_inst.get_format() == decode::InstFormat::R_TYPE) && "Instruction with CUSTOM_0 opcode had a non-R format!");
@@ -188,11 +507,21 @@ void emulator::emulator_t::execute(const decode::DecodedInst &decoded_inst) {
             break;
         case decode::Opcode::STORE:
             assert((decoded_inst.get_format() == decode::InstFormat::S_TYPE) && "Instruction with STORE opcode had a non-S format!");
+            this->set_host_phase(hostperf::Phase::MEMORY);
             execute::store(decoded_inst, this->m_cpu_state, this->m_memory, this->m_CSR);
+            this->m_CSR.count_hpm_event(Csr::HpmEvent::STORE);
+            break;
+        case decode::Opcode::STORE_FP:
+            assert((decoded_inst.get_format() == decode::InstFormat::S_TYPE) && "Instruction with STORE_FP opcode had a non-S format!");
+            this->set_host_phase(hostperf::Phase::MEMORY);
+            execute::store_fp(decoded_inst, this->m_cpu_state, this->m_memory, this->m_CSR);
+            this->m_CSR.count_hpm_event(Csr::HpmEvent::STORE);
             break;
         case decode::Opcode::AMO:
             //TODO assertion
+            this->set_host_phase(hostperf::Phase::MEMORY);
             execute::amo(decoded_inst, this->m_cpu_state, this->m_memory, this->m_CSR);
+            this->m_CSR.count_hpm_event(Csr::HpmEvent::AMO);
             break;
         case decode::Opcode::OP:
             assert((decoded_inst.get_format() == decode::InstFormat::R_TYPE) && "Instruction with OP opcode had a non-R format!");
@@ -202,6 +531,21 @@ void emulator::emulator_t::execute(const decode::DecodedInst &decoded_inst) {
             assert((decoded_inst.get_format() == decode::InstFormat::U_TYPE) && "Instruction with LUI opcode had a non-U format!");
             execute::lui(decoded_inst, this->m_cpu_state, this->m_CSR);
             break;
+        case decode::Opcode::MADD:
+        case decode::Opcode::MSUB:
+        case decode::Opcode::NMSUB:
+        case decode::Opcode::NMADD:
+            assert((decoded_inst.get_format() == decode::InstFormat::R_TYPE) && "Fused multiply-add instruction had a non-R format!");
+            execute::fused_multiply_add(decoded_inst, this->m_cpu_state, this->m_CSR);
+            break;
+        case decode::Opcode::OP_FP:
+            assert((decoded_inst.get_format() == decode::InstFormat::R_TYPE) && "Instruction with OP_FP opcode had a non-R format!");
+            execute::op_fp(decoded_inst, this->m_cpu_state, this->m_CSR);
+            break;
+        case decode::Opcode::OP_V:
+            assert((decoded_inst.get_format() == decode::InstFormat::R_TYPE) && "Instruction with OP_V opcode had a non-R format!");
+            execute::op_v(decoded_inst, this->m_cpu_state, this->m_CSR);
+            break;
         case decode::Opcode::BRANCH:
             assert((decoded_inst.get_format() == decode::InstFormat::B_TYPE) && "Instruction with BRANCH opcode had a non-B format!");
             execute::branch(decoded_inst, this->m_cpu_state, this->m_CSR);
@@ -216,7 +560,7 @@ void emulator::emulator_t::execute(const decode::DecodedInst &decoded_inst) {
             break;
         case decode::Opcode::SYSTEM:
             assert((decoded_inst.get_format() == decode::InstFormat::I_TYPE) && "Instruction with SYSTEM opcode had a non-I format!");
-            execute::system(decoded_inst, this->m_cpu_state, this->m_CSR);
+            execute::system(decoded_inst, this->m_cpu_state, this->m_memory, this->m_CSR);
             break;
         default:
             assert(false && "Instruction with either invalid opcode, or that is implemented in decode but not in execute yet!");
@@ -244,6 +588,12 @@ void emulator::emulator_t::check_and_handle_interrupts() {
 
     auto interrupt_regs = this->m_CSR.fast_implicit_read_interrupt_regs();
 
+    //Nearly every tick nothing is both pending and enabled, so skip all of the below
+    if ((interrupt_regs.mip.u & interrupt_regs.mie.u) == 0) [[likely]] {
+        irvelog(1, "No interrupts \"interrupting\" at this time.");
+        return;
+    }
+
     Reg mstatus = interrupt_regs.mstatus;
     bool in_m_mode = interrupt_regs.privilege_mode == PrivilegeMode::MACHINE_MODE;
     bool in_s_mode = interrupt_regs.privilege_mode == PrivilegeMode::SUPERVISOR_MODE;
@@ -296,10 +646,22 @@ void emulator::emulator_t::check_and_handle_interrupts() {
     //If we make it here, we have an interrupt to handle (specifically the one in `cause)
 
     irvelog(1, "Handling interrupt: Cause: 0x%X", (uint32_t)cause);
+    this->set_host_phase(hostperf::Phase::TRAP);
+    if (this->m_tracer) [[unlikely]] {
+        this->m_tracer->interrupt((uint32_t)cause);
+    }
     this->handle_trap(cause, 0);
 }
 
 void emulator::emulator_t::handle_trap(rv_trap::Cause cause, Word tval) {
+    //Skip the firmware entirely if we can handle the SBI call ourselves
+    //(no need to flush the icache first, since fetching the ECALL already did)
+    if ((cause == rv_trap::Cause::SMODE_ECALL_EXCEPTION) && this->m_sbi && this->m_sbi->handle(this->m_cpu_state, this->m_CSR, this->m_memory)) {
+        ++this->m_stats.native_sbi_calls;
+        this->m_cpu_state.goto_next_sequential_pc();
+        return;
+    }
+
     this->flush_icache();
 
     //TODO better logging
@@ -351,6 +713,14 @@ void emulator::emulator_t::handle_trap(rv_trap::Cause cause, Word tval) {
         //Otherwise, let RISC-V code handle the EBREAK
     }
 
+    //Only count traps the guest actually sees
+    this->m_CSR.count_hpm_trap_event(cause);
+    if ((uint32_t)cause & 0x80000000) {
+        ++this->m_stats.interrupts_by_cause[(uint32_t)cause & 0xF];
+    } else {
+        ++this->m_stats.exceptions_by_cause[(uint32_t)cause & 0xF];
+    }
+
     Word raw_cause = (uint32_t)cause;
     assert((raw_cause.bits(30, 0).u < 32) && "Unsupported cause!");
 
@@ -420,3 +790,82 @@ void emulator::emulator_t::handle_trap(rv_trap::Cause cause, Word tval) {
         }
     }
 }
+
+void emulator::emulator_t::trace_before_execute(const decode::DecodedInst& decoded_inst) {
+    //Registers may be overwritten by the instruction, so work out the address (and store value) now
+    switch (decoded_inst.get_opcode()) {
+        case decode::Opcode::LOAD_FP:
+        case decode::Opcode::STORE_FP:
+            if (vector::is_vector_width(decoded_inst.get_funct3())) {//Just the base address, since there's no single value
+                this->m_tracer->mem(this->m_cpu_state.get_r(decoded_inst.get_rs1()).u, 0);
+                break;
+            }
+            if (decoded_inst.get_opcode() == decode::Opcode::STORE_FP) {//Only the low word of an FSD
+                this->m_tracer->mem(
+                    (this->m_cpu_state.get_r(decoded_inst.get_rs1()) + decoded_inst.get_imm()).u,
+                    (uint32_t)this->m_cpu_state.get_f(decoded_inst.get_rs2())
+                );
+                break;
+            }
+            [[fallthrough]];
+        case decode::Opcode::LOAD://The loaded value is filled in afterwards
+            this->m_tracer->mem((this->m_cpu_state.get_r(decoded_inst.get_rs1()) + decoded_inst.get_imm()).u, 0);
+            break;
+        case decode::Opcode::STORE:
+            this->m_tracer->mem(
+                (this->m_cpu_state.get_r(decoded_inst.get_rs1()) + decoded_inst.get_imm()).u,
+                this->m_cpu_state.get_r(decoded_inst.get_rs2()).u
+            );
+            break;
+        case decode::Opcode::AMO:
+            this->m_tracer->mem(this->m_cpu_state.get_r(decoded_inst.get_rs1()).u, this->m_cpu_state.get_r(decoded_inst.get_rs2()).u);
+            break;
+        default:
+            break;
+    }
+}
+
+void emulator::emulator_t::trace_after_execute(const decode::DecodedInst& decoded_inst) {
+    decode::InstFormat format = decoded_inst.get_format();
+    bool writes_rd = (format != decode::InstFormat::S_TYPE) && (format != decode::InstFormat::B_TYPE) && (decoded_inst.get_rd() != 0);
+    switch (decoded_inst.get_opcode()) {//Most F/D instructions write an f register instead of an x register
+        case decode::Opcode::LOAD_FP:
+            if (!vector::is_vector_width(decoded_inst.get_funct3())) {
+                this->m_tracer->mem_value((uint32_t)this->m_cpu_state.get_f(decoded_inst.get_rd()));
+            }
+            writes_rd = false;
+            break;
+        case decode::Opcode::MADD:
+        case decode::Opcode::MSUB:
+        case decode::Opcode::NMSUB:
+        case decode::Opcode::NMADD:
+            writes_rd = false;
+            break;
+        case decode::Opcode::OP_FP: {//Only comparisons, FCVT.W[U], FMV.X.W, and FCLASS write x registers
+            uint8_t funct5 = decoded_inst.get_funct5();
+            writes_rd = writes_rd && ((funct5 == 0b10100) || (funct5 == 0b11000) || (funct5 == 0b11100));
+            break;
+        }
+        case decode::Opcode::OP_V: {//Only vset*, VMV.X.S, VCPOP.M, and VFIRST.M write x registers
+            uint8_t funct3 = decoded_inst.get_funct3();
+            uint8_t funct6 = decoded_inst.get_funct7() >> 1;
+            writes_rd = writes_rd && ((funct3 == 0b111) || ((funct3 == 0b010) && (funct6 == 0b010000)));
+            break;
+        }
+        default:
+            break;
+    }
+    if (writes_rd) {
+        Reg rd_value = this->m_cpu_state.get_r(decoded_inst.get_rd());
+        this->m_tracer->rd(decoded_inst.get_rd(), rd_value.u);
+        if (decoded_inst.get_opcode() == decode::Opcode::LOAD) {
+            this->m_tracer->mem_value(rd_value.u);
+        }
+    }
+}
+
+void emulator::emulator_t::set_host_phase(hostperf::Phase phase) {
+    if (this->m_hostperf) [[unlikely]] {
+        this->m_host_phase = phase;
+    }
+}
@@ -15,15 +15,25 @@
 
 #include <cstdint>
 
+#include "callgraph.h"
 #include "common.h"
 #include "cpu_state.h"
 #include "decode.h"
 #include "gdbserver.h"
+#include "hostperf.h"
+#include "log_sink.h"
 #include "memory.h"
+#include "profiler.h"
 #include "rv_trap.h"
+#include "sbi.h"
 #include "semihosting.h"
+#include "stats.h"
+#include "trace.h"
 
+#include <atomic>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 /* ------------------------------------------------------------------------------------------------
  * Type/Class Declarations
@@ -48,11 +58,63 @@ namespace irve::internal::emulator {
          * @brief       The constructor for emulator_t.
          * @param[in]   imagec The number of memory image files to load.
          * @param[in]   imagev Vector of memory image file names.
+         * @param[in]   uart_backend_spec Where the UART's input and output go (see Uart::Uart()).
+         * @note        The emulator's log messages go wherever the constructing thread's are going
+         *              (see logging::ScopedThreadSink), including from its helper threads.
         */
-        emulator_t(int imagec, const char* const* imagev);
+        emulator_t(int imagec, const char* const* imagev, const char* uart_backend_spec = "stdio");
 
         /**
-         * @brief       Emulate one instruction.
+         * @brief       The destructor for emulator_t.
+        */
+        ~emulator_t();
+
+        /**
+         * @brief       Add more harts, which share this one's memory and peripherals.
+         * @details     The emulator itself is hart 0; the others are numbered from 1. They all start
+         *              from the same PC (so the guest should check mhartid) and each gets its own
+         *              ACLINT msip and mtimecmp registers. Must be done before anything is run.
+         * @param[in]   hart_count How many harts there should be in total.
+         * @return      False if hart_count is 0 or too large, there are already other harts, or
+         *              virtual time is on.
+        */
+        bool set_hart_count(uint32_t hart_count);
+
+        /**
+         * @brief       Make mtime count instructions instead of host time, so runs are reproducible.
+         * @details     WFI and jumps to the same instruction (idle loops) fast-forward mtime to
+         *              mtimecmp rather than waiting for it. The timer is also checked once per
+         *              tick of mtime (up to a point) so timer interrupts arrive on time.
+         * @param[in]   insts_per_tick How many instructions it takes for mtime to increment.
+         * @return      False if insts_per_tick is 0 or there are several harts.
+        */
+        bool set_virtual_time(uint64_t insts_per_tick);
+
+        /**
+         * @brief       Change how many times per second mtime increments in host time.
+         * @param[in]   frequency Should match timebase-frequency in the guest's device tree.
+         * @return      False if frequency is 0.
+        */
+        bool set_timebase_frequency(uint64_t frequency);
+
+        /**
+         * @brief       Choose whether SBI calls from S-mode are serviced by the emulator itself.
+         * @details     See sbi.h for which calls are handled; everything else still traps into the
+         *              M-mode firmware as usual.
+         * @param[in]   enable True to handle SBI calls natively, false to leave them all to the firmware.
+        */
+        void set_native_sbi(bool enable);
+
+        /**
+         * @brief       Choose whether misaligned RAM accesses are performed instead of trapping.
+         * @param[in]   enable True to emulate them on every hart (see Memory::set_emulate_misaligned()).
+        */
+        void set_misaligned_access(bool enable);
+
+        /**
+         * @brief       Emulate one instruction (on each hart, one after another).
+         * @note        WFI sleeps for a short while at most if there is only one hart, and doesn't
+         *              sleep at all if there are several.
          * @return      True if the emulator should continue running, false otherwise.
         */
         bool tick();
@@ -61,8 +123,9 @@ namespace irve::internal::emulator {
          * @brief       Repeatedly emulate instructions.
          * @details     Runs the emulator until the given instruction count is reached or an exit
          *              request is made. For dynamic linking to libirve, this is more efficient
-         *              than calling tick() in a loop.
-         * @param[in]   inst_count The value of minstret at which to stop.
+         *              than calling tick() in a loop. Every hart other than hart 0 runs on its own
+         *              host thread until hart 0 stops or one of them makes an exit request.
+         * @param[in]   inst_count The value of hart 0's minstret at which to stop.
         */
         void run_until(uint64_t inst_count);
 
@@ -74,10 +137,16 @@ namespace irve::internal::emulator {
 
         /**
          * @brief       Get the current instruction count.
-         * @return      minstret
+         * @return      Hart 0's minstret
         */
         uint64_t get_inst_count();
 
+        /**
+         * @brief       Get counters describing what the emulator has been doing.
+         * @return      A snapshot of the counters (hart 0's, if there are several harts).
+        */
+        Stats get_stats();
+
         /**
          * @brief       Determine if a breakpoint was encountered and clear the flag indicating so
          *              if it was.
@@ -90,8 +159,85 @@ namespace irve::internal::emulator {
         */
         void flush_icache();
 
+        /**
+         * @brief       Start writing a binary trace of every instruction executed (see trace.h).
+         * @param[in]   trace_path Where to write the trace. Any trace already in progress is stopped.
+         * @return      False if the trace file couldn't be created.
+        */
+        bool start_trace(const char* trace_path);
+
+        /**
+         * @brief       Stop tracing, if we were, and finish writing out the trace.
+        */
+        void stop_trace();
+
+        /**
+         * @brief       Start sampling the PC to find out where the guest spends its time.
+         * @param[in]   output_path Where to write the folded-stack profile (see profiler.h) once
+         *              profiling stops. Any profiling already in progress is stopped.
+         * @param[in]   period How many instructions between samples (must be nonzero).
+         * @return      False if the profile file couldn't be created.
+        */
+        bool start_profiling(const char* output_path, uint32_t period);
+
+        /**
+         * @brief       Stop profiling, if we were, and write out the profile.
+        */
+        void stop_profiling();
+
+        /**
+         * @brief       Start counting every instruction executed and following calls and returns.
+         * @param[in]   output_path Where to write the callgrind profile (see callgraph.h) once
+         *              profiling stops. Any callgrind profiling already in progress is stopped.
+         * @return      False if the profile file couldn't be created.
+        */
+        bool start_callgraph_profiling(const char* output_path);
+
+        /**
+         * @brief       Stop callgrind profiling, if we were, and write out the profile.
+        */
+        void stop_callgraph_profiling();
+
+        /**
+         * @brief       Start measuring the host with hardware performance counters (see hostperf.h)
+         *              whenever run_until() is running. Must be called from the thread that will
+         *              call run_until().
+         * @return      False if none of the counters could be opened.
+        */
+        bool start_host_perf();
+
+        /**
+         * @brief       Stop measuring the host, if we were, and print a report.
+        */
+        void stop_host_perf();
+
+        /**
+         * @brief       Get where the emulator's log messages go.
+         * @return      The Sink that was current when the emulator was constructed.
+        */
+        logging::Sink log_sink() const;
+
     private:
 
+        /**
+         * @brief       The constructor for any hart other than hart 0 (see set_hart_count()).
+         * @param[in]   hart0 Hart 0, whose memory and peripherals are shared.
+         * @param[in]   hart_id The value of this hart's mhartid.
+        */
+        emulator_t(emulator_t& hart0, uint32_t hart_id);
+
+        /**
+         * @brief       Emulate one instruction on this hart only.
+         * @return      True if the emulator should continue running, false otherwise.
+        */
+        bool tick_hart();
+
+        /**
+         * @brief       Choose whether WFI puts the host thread to sleep, for every hart.
+         * @param[in]   sleep False to make WFI a NOP instead.
+        */
+        void set_sleep_in_wfi(bool sleep);
+
         /**
          * @brief       Fetches and decodes the instruciton specified by the current PC.
          * @return      Information about the decoded instruciton.
@@ -115,17 +261,56 @@ namespace irve::internal::emulator {
          * @param[in]   tval Extra information about the trap (mtval or stval).
         */
         void handle_trap(rv_trap::Cause cause, Word tval);
+
+        /**
+         * @brief       Record the memory access an instruction is about to make (if any) in the trace.
+         * @param[in]   decoded_inst The instruction about to be executed.
+        */
+        void trace_before_execute(const decode::DecodedInst& decoded_inst);
+
+        /**
+         * @brief       Record an instruction's results in the trace.
+         * @param[in]   decoded_inst The instruction that was just executed.
+        */
+        void trace_after_execute(const decode::DecodedInst& decoded_inst);
+
+        /**
+         * @brief       Tell the host perf sampler what the emulator is doing now.
+         * @param[in]   phase The phase being entered.
+         * @note        A no-op unless the host is being measured, so the hot loop doesn't pay for it.
+        */
+        void set_host_phase(hostperf::Phase phase);
         
         Csr m_CSR;
         Memory m_memory;
         CpuState m_cpu_state;
 
         SemihostingHandler m_semihosting_handler;
-        std::unordered_map<uint32_t, decode::DecodedInst> m_icache;//uint32_t to avoid needing to implement hash for Word
+        std::shared_ptr<SbiHandler> m_sbi;//Null unless native SBI is on (shared by every hart)
+        struct CachedInst {
+            decode::DecodedInst decoded_inst;
+            uint64_t exec_count;//Only meaningful when callgraph profiling; handed to the profiler on flushes
+        };
+        std::unordered_map<uint32_t, CachedInst> m_icache;//uint32_t to avoid needing to implement hash for Word
+        std::atomic<bool> m_icache_flush_requested;//By other harts (for remote fences), and checked every tick
         bool m_intercept_breakpoints;
         bool m_encountered_breakpoint;
 
         //It is expensive to update peripherals each tick, so we only update them every so often
         uint32_t m_peripheral_update_delay_counter;
+        uint32_t m_peripheral_update_interval;//What the above is reset to
+
+        Stats m_stats;//Memory keeps its own, which get_stats() merges in
+
+        std::unique_ptr<trace::TraceWriter> m_tracer;//Null unless we're tracing
+        std::unique_ptr<profiler::Profiler> m_profiler;//Null unless we're profiling
+        std::unique_ptr<callgraph::CallGraphProfiler> m_callgraph;//Null unless we're callgraph profiling
+
+        volatile hostperf::Phase m_host_phase;//Only kept up to date while m_hostperf is non-null
+        std::unique_ptr<hostperf::HostPerf> m_hostperf;//Null unless we're measuring the host
+
+        logging::Sink m_log_sink;
+
+        std::vector<std::unique_ptr<emulator_t>> m_other_harts;//Empty unless this is hart 0 of several
     };
 }
@@ -15,21 +15,60 @@
 
 #include "execute.h"
 
+#include <atomic>
+#include <bit>
 #include <cassert>
 #include <cstdint>
+#include <type_traits>
 
 #include "common.h"
 #include "csr.h"
 #include "cpu_state.h"
 #include "decode.h"
+#include "fpu.h"
 #include "memory.h"
 #include "rv_trap.h"
+#include "vector.h"
 
+#define LOG_SUBSYSTEM EXECUTE
 #define INST_COUNT CSR.implicit_read(Csr::Address::MINSTRET).u
 #include "logging.h"
 
 using namespace irve::internal;
 
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Get the rounding mode an F/D instruction should use (raising an exception if it's invalid)
+*/
+static fpu::RoundingMode fp_rounding_mode(const decode::DecodedInst& decoded_inst, Csr& CSR);
+
+/**
+ * @brief Read an f register as a float (unboxing it) or a double
+*/
+template<typename T>
+static T get_fp(const CpuState& cpu_state, uint8_t reg_num);
+
+/**
+ * @brief Write an f register with a float (boxing it) or a double, marking the FP state as dirty
+*/
+template<typename T>
+static void set_fp(CpuState& cpu_state, Csr& CSR, uint8_t reg_num, T value);
+
+/**
+ * @brief Execute an OP-FP instruction once its format (precision) is known
+*/
+template<typename T>
+static void op_fp_fmt(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Csr& CSR);
+
+/**
+ * @brief Execute a MADD, MSUB, NMSUB, or NMADD instruction once its format (precision) is known
+*/
+template<typename T>
+static void fused_multiply_add_fmt(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Csr& CSR);
+
 /* ------------------------------------------------------------------------------------------------
  * Function Implementations
  * --------------------------------------------------------------------------------------------- */
@@ -82,6 +121,68 @@ void execute::load(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
     cpu_state.goto_next_sequential_pc();
 }
 
+void execute::load_fp(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
+                        Memory& memory, Csr& CSR) {
+    irvelog(2, "Executing LOAD-FP instruction");
+
+    assert(
+        (decoded_inst.get_opcode() == decode::Opcode::LOAD_FP) &&
+        "load_fp instruction must have opcode LOAD_FP"
+    );
+    assert(
+        (decoded_inst.get_format() == decode::InstFormat::I_TYPE) &&
+        "load_fp instruction must be I_TYPE"
+    );
+
+    if (vector::is_vector_width(decoded_inst.get_funct3())) {
+        if (!CSR.vector_enabled()) {
+            irvelog(3, "mstatus.VS is Off, so vector instructions are illegal");
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+        }
+        vector::load(decoded_inst, cpu_state, memory, CSR);
+        cpu_state.goto_next_sequential_pc();
+        return;
+    }
+
+    if (!CSR.fp_enabled()) {
+        irvelog(3, "mstatus.FS is Off, so floating point instructions are illegal");
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+
+    Word addr = cpu_state.get_r(decoded_inst.get_rs1()) + decoded_inst.get_imm();
+    uint64_t loaded;
+    switch (decoded_inst.get_funct3()) {
+        case 0b010://FLW
+            irvelog(3, "Mnemonic: FLW");
+            //This could cause an exception
+            loaded = fpu::box(std::bit_cast<float>(memory.load(addr, DT_WORD).u));
+            break;
+        case 0b011: {//FLD
+            irvelog(3, "Mnemonic: FLD");
+            //Done as two word loads; requiring 8 byte alignment keeps both in the same page, so
+            //the second can't fault if the first didn't. If misaligned accesses are being
+            //emulated, each half goes through Memory's misaligned path instead.
+            if ((addr.u & 0b111) && !memory.emulate_misaligned()) {
+                rv_trap::invoke_exception(rv_trap::Cause::LOAD_ADDRESS_MISALIGNED_EXCEPTION);
+            }
+            uint64_t low  = memory.load(addr,     DT_WORD).u;
+            uint64_t high = memory.load(addr + 4, DT_WORD).u;
+            loaded = (high << 32) | low;
+            break;
+        }
+        default:
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            break;
+    }
+
+    irvelog(3, "Loaded 0x%016lX from 0x%08X", loaded, addr.u);
+    cpu_state.set_f(decoded_inst.get_rd(), loaded);
+    CSR.set_fp_dirty();
+
+    //Increment PC
+    cpu_state.goto_next_sequential_pc();
+}
+
 void execute::custom_0(const decode::DecodedInst& decoded_inst, CpuState& /* cpu_state */,
                         Memory& /* memory */, Csr& CSR) {
     irvelog(2, "Executing custom-0 instruction");
@@ -123,14 +224,17 @@ void execute::misc_mem(const decode::DecodedInst& decoded_inst, CpuState& cpu_st
 
     if (decoded_inst.get_funct3() == 0b000) {//FENCE
         irvelog(3, "Mnemonic: FENCE");
+        //Other harts may be running on other host cores, so order this hart's accesses as the
+        //host sees them too (we don't bother being more precise than the predecessor and successor
+        //sets ask for)
+        std::atomic_thread_fence(std::memory_order_seq_cst);
     } else if (decoded_inst.get_funct3() == 0b001) {//FENCE.I
         irvelog(3, "Mnemonic: FENCE.I");
+        irvelog(3, "Nothing to do here since the emulator flushes this hart's icache for us");
     } else {
         rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
     }
 
-    irvelog(3, "Nothing to do since the emulated system dosn't have a cache or multiple harts");
-
     //Increment PC
     cpu_state.goto_next_sequential_pc();
 }
@@ -161,10 +265,46 @@ void execute::op_imm(const decode::DecodedInst& decoded_inst, CpuState& cpu_stat
             result = r1 + imm;
             irvelog(3, "0x%08X + 0x%08X = 0x%08X", r1.u, imm.u, result.u);
             break;
-        case 0b001://SLLI
-            irvelog(3, "Mnemonic: SLLI");
-            result = r1 << imm.bits(4, 0);
-            irvelog(3, "0x%08X << 0x%08X = 0x%08X", r1.u, imm.u, result.u);
+        case 0b001://SLLI, CLZ, CTZ, CPOP, SEXT.B, SEXT.H, BCLRI, BINVI, or BSETI
+            if (funct7 == 0b0000000) {//SLLI
+                irvelog(3, "Mnemonic: SLLI");
+                result = r1 << imm.bits(4, 0);
+                irvelog(3, "0x%08X << 0x%08X = 0x%08X", r1.u, imm.u, result.u);
+            } else if (imm.bits(11, 0) == 0b0110000'00000) {//CLZ
+                irvelog(3, "Mnemonic: CLZ");
+                result = r1.u ? (uint32_t)__builtin_clz(r1.u) : 32;
+                irvelog(3, "clz(0x%08X) = 0x%08X", r1.u, result.u);
+            } else if (imm.bits(11, 0) == 0b0110000'00001) {//CTZ
+                irvelog(3, "Mnemonic: CTZ");
+                result = r1.u ? (uint32_t)__builtin_ctz(r1.u) : 32;
+                irvelog(3, "ctz(0x%08X) = 0x%08X", r1.u, result.u);
+            } else if (imm.bits(11, 0) == 0b0110000'00010) {//CPOP
+                irvelog(3, "Mnemonic: CPOP");
+                result = (uint32_t)__builtin_popcount(r1.u);
+                irvelog(3, "cpop(0x%08X) = 0x%08X", r1.u, result.u);
+            } else if (imm.bits(11, 0) == 0b0110000'00100) {//SEXT.B
+                irvelog(3, "Mnemonic: SEXT.B");
+                result = (int32_t)(int8_t)r1.u;
+                irvelog(3, "sext.b(0x%08X) = 0x%08X", r1.u, result.u);
+            } else if (imm.bits(11, 0) == 0b0110000'00101) {//SEXT.H
+                irvelog(3, "Mnemonic: SEXT.H");
+                result = (int32_t)(int16_t)r1.u;
+                irvelog(3, "sext.h(0x%08X) = 0x%08X", r1.u, result.u);
+            } else if (funct7 == 0b0100100) {//BCLRI
+                irvelog(3, "Mnemonic: BCLRI");
+                result = r1.u & ~(1U << imm.bits(4, 0).u);
+                irvelog(3, "0x%08X with bit 0x%08X cleared = 0x%08X", r1.u, imm.bits(4, 0).u, result.u);
+            } else if (funct7 == 0b0110100) {//BINVI
+                irvelog(3, "Mnemonic: BINVI");
+                result = r1.u ^ (1U << imm.bits(4, 0).u);
+                irvelog(3, "0x%08X with bit 0x%08X inverted = 0x%08X", r1.u, imm.bits(4, 0).u, result.u);
+            } else if (funct7 == 0b0010100) {//BSETI
+                irvelog(3, "Mnemonic: BSETI");
+                result = r1.u | (1U << imm.bits(4, 0).u);
+                irvelog(3, "0x%08X with bit 0x%08X set = 0x%08X", r1.u, imm.bits(4, 0).u, result.u);
+            } else {
+                rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            }
             break;
         case 0b010://SLTI
             irvelog(3, "Mnemonic: SLTI");
@@ -181,7 +321,7 @@ void execute::op_imm(const decode::DecodedInst& decoded_inst, CpuState& cpu_stat
             result = r1 ^ imm;
             irvelog(3, "0x%08X ^ 0x%08X = 0x%08X", r1.u, imm.u, result.u);
             break;
-        case 0b101://SRLI or SRAI
+        case 0b101://SRLI, SRAI, RORI, BEXTI, ORC.B, or REV8
             if (funct7 == 0b0000000) {//SRLI
                 irvelog(3, "Mnemonic: SRLI");
                 result = r1.srl(imm.bits(4, 0));
@@ -190,6 +330,24 @@ void execute::op_imm(const decode::DecodedInst& decoded_inst, CpuState& cpu_stat
                 irvelog(3, "Mnemonic: SRAI");
                 result = r1.sra(imm.bits(4, 0));
                 irvelog(3, "0x%08X >> 0x%08X arithmetic = 0x%08X", r1.u, imm.u, result.u);
+            } else if (funct7 == 0b0110000) {//RORI
+                irvelog(3, "Mnemonic: RORI");
+                result = std::rotr(r1.u, (int)imm.bits(4, 0).u);
+                irvelog(3, "0x%08X rotated right by 0x%08X = 0x%08X", r1.u, imm.bits(4, 0).u, result.u);
+            } else if (funct7 == 0b0100100) {//BEXTI
+                irvelog(3, "Mnemonic: BEXTI");
+                result = r1.bit(imm.bits(4, 0).u);
+                irvelog(3, "Bit 0x%08X of 0x%08X = 0x%08X", imm.bits(4, 0).u, r1.u, result.u);
+            } else if (imm.bits(11, 0) == 0b0010100'00111) {//ORC.B
+                irvelog(3, "Mnemonic: ORC.B");
+                //Each byte becomes 0xFF if any of its bits are set, or 0x00 otherwise
+                uint32_t nonzero_bytes = (((r1.u & 0x7F7F7F7F) + 0x7F7F7F7F) | r1.u) & 0x80808080;
+                result = (nonzero_bytes >> 7) * 0xFF;
+                irvelog(3, "orc.b(0x%08X) = 0x%08X", r1.u, result.u);
+            } else if (imm.bits(11, 0) == 0b0110100'11000) {//REV8
+                irvelog(3, "Mnemonic: REV8");
+                result = __builtin_bswap32(r1.u);
+                irvelog(3, "rev8(0x%08X) = 0x%08X", r1.u, result.u);
             } else {
                 rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
             }
@@ -281,6 +439,64 @@ void execute::store(const decode::DecodedInst& decoded_inst, CpuState& cpu_state
     cpu_state.goto_next_sequential_pc();
 }
 
+void execute::store_fp(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
+                        Memory& memory, Csr& CSR) {
+    irvelog(2, "Executing STORE-FP instruction");
+
+    assert(
+        (decoded_inst.get_opcode() == decode::Opcode::STORE_FP) &&
+        "store_fp instruction must have opcode STORE_FP"
+    );
+    assert(
+        (decoded_inst.get_format() == decode::InstFormat::S_TYPE) &&
+        "store_fp instruction must be S_TYPE"
+    );
+
+    if (vector::is_vector_width(decoded_inst.get_funct3())) {
+        if (!CSR.vector_enabled()) {
+            irvelog(3, "mstatus.VS is Off, so vector instructions are illegal");
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+        }
+        vector::store(decoded_inst, cpu_state, memory, CSR);
+        cpu_state.goto_next_sequential_pc();
+        return;
+    }
+
+    if (!CSR.fp_enabled()) {
+        irvelog(3, "mstatus.FS is Off, so floating point instructions are illegal");
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+
+    Word addr = cpu_state.get_r(decoded_inst.get_rs1()) + decoded_inst.get_imm();
+    uint64_t f2 = cpu_state.get_f(decoded_inst.get_rs2());
+    switch (decoded_inst.get_funct3()) {
+        case 0b010://FSW
+            irvelog(3, "Mnemonic: FSW");
+            irvelog(3, "Storing 0x%08X in 0x%08X", (uint32_t)f2, addr.u);
+            //The bits are stored as-is, even if they aren't a properly NaN-boxed single
+            //This could raise an exception
+            memory.store(addr, DT_WORD, (uint32_t)f2);
+            break;
+        case 0b011://FSD
+            irvelog(3, "Mnemonic: FSD");
+            irvelog(3, "Storing 0x%016lX in 0x%08X", f2, addr.u);
+            //See FLD for why this must be aligned. A misaligned one can have its first half written
+            //before the second faults, but misaligned accesses needn't be atomic, so that's allowed.
+            if ((addr.u & 0b111) && !memory.emulate_misaligned()) {
+                rv_trap::invoke_exception(rv_trap::Cause::STORE_OR_AMO_ADDRESS_MISALIGNED_EXCEPTION);
+            }
+            memory.store(addr,     DT_WORD, (uint32_t)f2);
+            memory.store(addr + 4, DT_WORD, (uint32_t)(f2 >> 32));
+            break;
+        default:
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            break;
+    }
+
+    //Increment PC
+    cpu_state.goto_next_sequential_pc();
+}
+
 void execute::amo(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
                     Memory& memory, [[maybe_unused]] Csr& CSR) {
     irvelog(2, "Executing AMO instruction");
@@ -303,6 +519,7 @@ void execute::amo(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
     Reg r2 = cpu_state.get_r(decoded_inst.get_rs2());
 
     Word loaded_word = 0;
+    AmoOp op;
     switch (decoded_inst.get_funct5()) {
         case 0b00010://LR.W
             irvelog(3, "Mnemonic: LR.W");
@@ -345,7 +562,7 @@ void execute::amo(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
 
             //If we get here, the load was successful; the "reservation set" is valid
             //It will stay valid until an exception occurs or a SC.W instruction is executed
-            cpu_state.validate_reservation_set();
+            cpu_state.validate_reservation_set(r1, loaded_word);
 
             cpu_state.goto_next_sequential_pc();
             return;
@@ -360,9 +577,10 @@ void execute::amo(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
                 rv_trap::invoke_exception(rv_trap::Cause::STORE_OR_AMO_ADDRESS_MISALIGNED_EXCEPTION);
             }
 
-            //Check if the reservation set is valid
-            if (!cpu_state.reservation_set_valid()) {
+            //Check if the reservation set is valid (and for the same address)
+            if (!cpu_state.reservation_set_valid() || (cpu_state.reservation_addr() != r1)) {
                 //If not, write a non-zero value to rd and go to the next instruction
+                cpu_state.invalidate_reservation_set();
                 cpu_state.set_r(decoded_inst.get_rd(), 1);
                 cpu_state.goto_next_sequential_pc();
                 return;
@@ -372,64 +590,53 @@ void execute::amo(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
             //We are now performing the store, so the reservation set is no longer valid
             cpu_state.invalidate_reservation_set();
 
-            //Attempt to store the value in rs2 to the address in rs1
-            try {
-                memory.store(r1, DT_WORD, r2);
-            } catch (const rv_trap::RvException& e) {
-                // If we get an exception, we need to rethrow a different one to indicate this is
-                // due to an AMO instruction
-                switch (e.cause()) {//TODO ensure this is correct
-                    case rv_trap::Cause::LOAD_ADDRESS_MISALIGNED_EXCEPTION:
-                        assert(
-                            false &&
-                            "Got a misaligned address exception when reading from memory, but we "
-                            " already checked that the address was aligned!"
-                        );
-                        break;
-                    case rv_trap::Cause::LOAD_ACCESS_FAULT_EXCEPTION:
-                        rv_trap::invoke_exception(rv_trap::Cause::STORE_OR_AMO_ACCESS_FAULT_EXCEPTION);
-                        break;
-                    case rv_trap::Cause::LOAD_PAGE_FAULT_EXCEPTION:
-                        rv_trap::invoke_exception(rv_trap::Cause::STORE_OR_AMO_PAGE_FAULT_EXCEPTION);
-                        break;
-                    default:
-                        assert(false && "Unexpected exception when reading from memory");
-                        break;
-                }
+            //Attempt to store the value in rs2 to the address in rs1, which only happens if no
+            //other hart has changed the word since the LR.W
+            //NOTE: Exceptions are already the store/AMO ones, so there's nothing to translate
+            if (memory.compare_and_swap(r1, cpu_state.reservation_value(), r2)) {
+                cpu_state.set_r(decoded_inst.get_rd(), 0);//The store was successful; write 0 to rd
+            } else {
+                cpu_state.set_r(decoded_inst.get_rd(), 1);
             }
 
-            //If we get here, the store was successful; write 0 to rd
-            cpu_state.set_r(decoded_inst.get_rd(), 0);
-
             //And we're done!
             cpu_state.goto_next_sequential_pc();
             return;
         case 0b00001://AMOSWAP.W
             irvelog(3, "Mnemonic: AMOSWAP.W");
+            op = AmoOp::SWAP;
             break;
         case 0b00000://AMOADD.W
             irvelog(3, "Mnemonic: AMOADD.W");
+            op = AmoOp::ADD;
             break;
         case 0b00100://AMOXOR.W
             irvelog(3, "Mnemonic: AMOXOR.W");
+            op = AmoOp::XOR;
             break;
         case 0b01100://AMOAND.W
             irvelog(3, "Mnemonic: AMOAND.W");
+            op = AmoOp::AND;
             break;
         case 0b01000://AMOOR.W
             irvelog(3, "Mnemonic: AMOOR.W");
+            op = AmoOp::OR;
             break;
         case 0b10000://AMOMIN.W
             irvelog(3, "Mnemonic: AMOMIN.W");
+            op = AmoOp::MIN;
             break;
         case 0b10100://AMOMAX.W
             irvelog(3, "Mnemonic: AMOMAX.W");
+            op = AmoOp::MAX;
             break;
         case 0b11000://AMOMINU.W
             irvelog(3, "Mnemonic: AMOMINU.W");
+            op = AmoOp::MINU;
             break;
         case 0b11100://AMOMAXU.W
             irvelog(3, "Mnemonic: AMOMAXU.W");
+            op = AmoOp::MAXU;
             break;
         default:
             rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
@@ -445,71 +652,14 @@ void execute::amo(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
         rv_trap::invoke_exception(rv_trap::Cause::STORE_OR_AMO_ADDRESS_MISALIGNED_EXCEPTION);
     }
 
-    //Read the word at the address in rs1
-    try {
-        loaded_word = memory.load(r1, DT_WORD);
-    } catch (const rv_trap::RvException& e) {
-        // If we get an exception, we need to rethrow a different one to indicate this is due to an
-        // AMO instruction
-        switch (e.cause()) {//TODO ensure this is correct
-            case rv_trap::Cause::LOAD_ADDRESS_MISALIGNED_EXCEPTION:
-                assert(
-                    false &&
-                    "Got a misaligned address exception when reading from memory, but we already "
-                    "checked that the address was aligned!"
-                );
-                break;
-            case rv_trap::Cause::LOAD_ACCESS_FAULT_EXCEPTION:
-                rv_trap::invoke_exception(rv_trap::Cause::STORE_OR_AMO_ACCESS_FAULT_EXCEPTION);
-                break;
-            case rv_trap::Cause::LOAD_PAGE_FAULT_EXCEPTION:
-                rv_trap::invoke_exception(rv_trap::Cause::STORE_OR_AMO_PAGE_FAULT_EXCEPTION);
-                break;
-            default:
-                assert(false && "Unexpected exception when reading from memory");
-                break;
-        }
-    }
+    //Atomically read the word at the address in rs1, perform the operation (instruction-specific),
+    //and write the result back; other harts can't access the word in between
+    //NOTE: Exceptions are already the store/AMO ones, so there's nothing to translate
+    loaded_word = memory.amo(r1, op, r2);
 
-    //Save it into rd
+    //Save the original word into rd
     cpu_state.set_r(decoded_inst.get_rd(), loaded_word);
 
-    //Perform the operation (instruction-specific)
-    Word word_to_write;
-    switch (decoded_inst.get_funct5()) {
-        case 0b00001://AMOSWAP.W
-            word_to_write = r2;
-            break;
-        case 0b00000://AMOADD.W
-            word_to_write = loaded_word + r2;
-            break;
-        case 0b00100://AMOXOR.W
-            word_to_write = loaded_word ^ r2;
-            break;
-        case 0b01100://AMOAND.W
-            word_to_write = loaded_word & r2;
-            break;
-        case 0b01000://AMOOR.W
-            word_to_write = loaded_word | r2;
-            break;
-        case 0b10000://AMOMIN.W
-            word_to_write = std::min(loaded_word.s, r2.s);
-            break;
-        case 0b10100://AMOMAX.W
-            word_to_write = std::max(loaded_word.s, r2.s);
-            break;
-        case 0b11000://AMOMINU.W
-            word_to_write = std::min(loaded_word.u, r2.u);
-            break;
-        case 0b11100://AMOMAXU.W
-            word_to_write = std::max(loaded_word.u, r2.u);
-            break;
-        default:
-            assert(false && "Invalid funct5 for AMO instruction, but we already checked this!");
-            break;
-    }
-    memory.store(r1, DT_WORD, word_to_write);
-
     cpu_state.goto_next_sequential_pc();
 }
 
@@ -637,7 +787,7 @@ void execute::op(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
                 break;
         }
     }
-    else {//Others (base spec)
+    else {//Others (base spec, Zba, Zbb and Zbs)
         switch (decoded_inst.get_funct3()) {
             case 0b000://ADD or SUB
                 if (decoded_inst.get_funct7() == 0b0000000) {//ADD
@@ -654,27 +804,50 @@ void execute::op(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
                     rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
                 }
                 break;
-            case 0b001://SLL
-                irvelog(3, "Mnemonic: SLL");
-
-                if (decoded_inst.get_funct7() != 0b0000000) {
+            case 0b001://SLL, ROL, BCLR, BINV, or BSET
+                if (decoded_inst.get_funct7() == 0b0000000) {//SLL
+                    irvelog(3, "Mnemonic: SLL");
+                    result = r1 << r2.bits(4, 0);
+                    irvelog(3, "0x%08X << 0x%08X logical = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0110000) {//ROL
+                    irvelog(3, "Mnemonic: ROL");
+                    result = std::rotl(r1.u, (int)r2.bits(4, 0).u);
+                    irvelog(3, "0x%08X rotated left by 0x%08X = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0100100) {//BCLR
+                    irvelog(3, "Mnemonic: BCLR");
+                    result = r1.u & ~(1U << r2.bits(4, 0).u);
+                    irvelog(3, "0x%08X with bit 0x%08X cleared = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0110100) {//BINV
+                    irvelog(3, "Mnemonic: BINV");
+                    result = r1.u ^ (1U << r2.bits(4, 0).u);
+                    irvelog(3, "0x%08X with bit 0x%08X inverted = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0010100) {//BSET
+                    irvelog(3, "Mnemonic: BSET");
+                    result = r1.u | (1U << r2.bits(4, 0).u);
+                    irvelog(3, "0x%08X with bit 0x%08X set = 0x%08X", r1.u, r2.u, result);
+                }
+                else {
                     rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
                 }
-
-                result = r1 << r2.bits(4, 0);
-
-                irvelog(3, "0x%08X << 0x%08X logical = 0x%08X", r1.u, r2.u, result);
                 break;
-            case 0b010://SLT
-                irvelog(3, "Mnemonic: SLT");
-
-                if (decoded_inst.get_funct7() != 0b0000000) {
+            case 0b010://SLT or SH1ADD
+                if (decoded_inst.get_funct7() == 0b0000000) {//SLT
+                    irvelog(3, "Mnemonic: SLT");
+                    result = (r1.s < r2.s) ? 1 : 0;
+                    irvelog(3, "(0x%08X signed < 0x%08X signed) = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0010000) {//SH1ADD
+                    irvelog(3, "Mnemonic: SH1ADD");
+                    result = r2 + (r1 << 1);
+                    irvelog(3, "0x%08X + (0x%08X << 1) = 0x%08X", r2.u, r1.u, result);
+                }
+                else {
                     rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
                 }
-
-                result = (r1.s < r2.s) ? 1 : 0;
-
-                irvelog(3, "(0x%08X signed < 0x%08X signed) = 0x%08X", r1.u, r2.u, result);
                 break;
             case 0b011://SLTU
                 irvelog(3, "Mnemonic: SLTU");
@@ -687,18 +860,37 @@ void execute::op(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
 
                 irvelog(3, "(0x%08X unsigned < 0x%08X unsigned) = 0x%08X", r1.u, r2, result);
                 break;
-            case 0b100://XOR
-                irvelog(3, "Mnemonic: XOR");
-
-                if (decoded_inst.get_funct7() != 0b0000000) {
+            case 0b100://XOR, XNOR, MIN, SH2ADD, or ZEXT.H
+                if (decoded_inst.get_funct7() == 0b0000000) {//XOR
+                    irvelog(3, "Mnemonic: XOR");
+                    result = r1 ^ r2;
+                    irvelog(3, "0x%08X ^ 0x%08X = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0100000) {//XNOR
+                    irvelog(3, "Mnemonic: XNOR");
+                    result = ~(r1 ^ r2);
+                    irvelog(3, "~(0x%08X ^ 0x%08X) = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0000101) {//MIN
+                    irvelog(3, "Mnemonic: MIN");
+                    result = (r1.s < r2.s) ? r1 : r2;
+                    irvelog(3, "min(0x%08X signed, 0x%08X signed) = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0010000) {//SH2ADD
+                    irvelog(3, "Mnemonic: SH2ADD");
+                    result = r2 + (r1 << 2);
+                    irvelog(3, "0x%08X + (0x%08X << 2) = 0x%08X", r2.u, r1.u, result);
+                }
+                else if ((decoded_inst.get_funct7() == 0b0000100) && (decoded_inst.get_rs2() == 0b00000)) {//ZEXT.H
+                    irvelog(3, "Mnemonic: ZEXT.H");
+                    result = r1.u & 0xFFFF;
+                    irvelog(3, "zext.h(0x%08X) = 0x%08X", r1.u, result);
+                }
+                else {
                     rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
                 }
-
-                result = r1 ^ r2;
-
-                irvelog(3, "0x%08X ^ 0x%08X = 0x%08X", r1.u, r2.u, result);
                 break;
-            case 0b101://SRL or SRA
+            case 0b101://SRL, SRA, ROR, BEXT, or MINU
                 if (decoded_inst.get_funct7() == 0b0000000) {//SRL
                     irvelog(3, "Mnemonic: SRL");
                     result = r1.srl(r2.bits(4, 0));
@@ -709,31 +901,69 @@ void execute::op(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
                     result = r1.sra(r2.bits(4, 0));
                     irvelog(3, "0x%08X >> 0x%08X arithmetic = 0x%08X", r1.u, r2.u, result.u);
                 }
+                else if (decoded_inst.get_funct7() == 0b0110000) {//ROR
+                    irvelog(3, "Mnemonic: ROR");
+                    result = std::rotr(r1.u, (int)r2.bits(4, 0).u);
+                    irvelog(3, "0x%08X rotated right by 0x%08X = 0x%08X", r1.u, r2.u, result.u);
+                }
+                else if (decoded_inst.get_funct7() == 0b0100100) {//BEXT
+                    irvelog(3, "Mnemonic: BEXT");
+                    result = r1.bit(r2.bits(4, 0).u);
+                    irvelog(3, "Bit 0x%08X of 0x%08X = 0x%08X", r2.u, r1.u, result.u);
+                }
+                else if (decoded_inst.get_funct7() == 0b0000101) {//MINU
+                    irvelog(3, "Mnemonic: MINU");
+                    result = (r1.u < r2.u) ? r1 : r2;
+                    irvelog(3, "min(0x%08X unsigned, 0x%08X unsigned) = 0x%08X", r1.u, r2.u, result.u);
+                }
                 else {
                     rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
                 }
                 break;
-            case 0b110://OR
-                irvelog(3, "Mnemonic: OR");
-
-                if (decoded_inst.get_funct7() != 0b0000000) {
+            case 0b110://OR, ORN, MAX, or SH3ADD
+                if (decoded_inst.get_funct7() == 0b0000000) {//OR
+                    irvelog(3, "Mnemonic: OR");
+                    result = r1 | r2;
+                    irvelog(3, "0x%08X | 0x%08X = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0100000) {//ORN
+                    irvelog(3, "Mnemonic: ORN");
+                    result = r1 | ~r2;
+                    irvelog(3, "0x%08X | ~0x%08X = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0000101) {//MAX
+                    irvelog(3, "Mnemonic: MAX");
+                    result = (r1.s > r2.s) ? r1 : r2;
+                    irvelog(3, "max(0x%08X signed, 0x%08X signed) = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0010000) {//SH3ADD
+                    irvelog(3, "Mnemonic: SH3ADD");
+                    result = r2 + (r1 << 3);
+                    irvelog(3, "0x%08X + (0x%08X << 3) = 0x%08X", r2.u, r1.u, result);
+                }
+                else {
                     rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
                 }
-
-                result = r1 | r2;
-
-                irvelog(3, "0x%08X | 0x%08X = 0x%08X", r1.u, r2.u, result);
                 break;
-            case 0b111://AND
-                irvelog(3, "Mnemonic: AND");
-
-                if (decoded_inst.get_funct7() != 0b0000000) {
+            case 0b111://AND, ANDN, or MAXU
+                if (decoded_inst.get_funct7() == 0b0000000) {//AND
+                    irvelog(3, "Mnemonic: AND");
+                    result = r1 & r2;
+                    irvelog(3, "0x%08X & 0x%08X = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0100000) {//ANDN
+                    irvelog(3, "Mnemonic: ANDN");
+                    result = r1 & ~r2;
+                    irvelog(3, "0x%08X & ~0x%08X = 0x%08X", r1.u, r2.u, result);
+                }
+                else if (decoded_inst.get_funct7() == 0b0000101) {//MAXU
+                    irvelog(3, "Mnemonic: MAXU");
+                    result = (r1.u > r2.u) ? r1 : r2;
+                    irvelog(3, "max(0x%08X unsigned, 0x%08X unsigned) = 0x%08X", r1.u, r2.u, result);
+                }
+                else {
                     rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
                 }
-
-                result = r1 & r2;
-
-                irvelog(3, "0x%08X & 0x%08X = 0x%08X", r1.u, r2.u, result);
                 break;
             default:
                 assert(false && "We should never get here");
@@ -770,8 +1000,106 @@ void execute::lui(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
     cpu_state.goto_next_sequential_pc();
 }
 
+void execute::fused_multiply_add(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Csr& CSR) {
+    irvelog(2, "Executing MADD/MSUB/NMSUB/NMADD instruction");
+
+    assert(
+        (
+            (decoded_inst.get_opcode() == decode::Opcode::MADD) ||
+            (decoded_inst.get_opcode() == decode::Opcode::MSUB) ||
+            (decoded_inst.get_opcode() == decode::Opcode::NMSUB) ||
+            (decoded_inst.get_opcode() == decode::Opcode::NMADD)
+        ) &&
+        "fused_multiply_add instruction must have opcode MADD, MSUB, NMSUB, or NMADD"
+    );
+    assert(
+        (decoded_inst.get_format() == decode::InstFormat::R_TYPE) &&
+        "fused_multiply_add instruction must be R_TYPE"
+    );
+
+    if (!CSR.fp_enabled()) {
+        irvelog(3, "mstatus.FS is Off, so floating point instructions are illegal");
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+
+    switch (decoded_inst.get_funct7() & 0b11) {//fmt
+        case 0b00:
+            fused_multiply_add_fmt<float>(decoded_inst, cpu_state, CSR);
+            break;
+        case 0b01:
+            fused_multiply_add_fmt<double>(decoded_inst, cpu_state, CSR);
+            break;
+        default://Half and quad precision aren't supported
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            break;
+    }
+
+    //Increment PC
+    cpu_state.goto_next_sequential_pc();
+}
+
+void execute::op_fp(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Csr& CSR) {
+    irvelog(2, "Executing OP-FP instruction");
+
+    assert(
+        (decoded_inst.get_opcode() == decode::Opcode::OP_FP) &&
+        "op_fp instruction must have opcode OP_FP"
+    );
+    assert(
+        (decoded_inst.get_format() == decode::InstFormat::R_TYPE) &&
+        "op_fp instruction must be R_TYPE"
+    );
+
+    if (!CSR.fp_enabled()) {
+        irvelog(3, "mstatus.FS is Off, so floating point instructions are illegal");
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+
+    switch (decoded_inst.get_funct7() & 0b11) {//fmt
+        case 0b00:
+            op_fp_fmt<float>(decoded_inst, cpu_state, CSR);
+            break;
+        case 0b01:
+            op_fp_fmt<double>(decoded_inst, cpu_state, CSR);
+            break;
+        default://Half and quad precision aren't supported
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            break;
+    }
+
+    //Increment PC
+    cpu_state.goto_next_sequential_pc();
+}
+
+void execute::op_v(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Csr& CSR) {
+    irvelog(2, "Executing OP-V instruction");
+
+    assert(
+        (decoded_inst.get_opcode() == decode::Opcode::OP_V) &&
+        "op_v instruction must have opcode OP_V"
+    );
+    assert(
+        (decoded_inst.get_format() == decode::InstFormat::R_TYPE) &&
+        "op_v instruction must be R_TYPE"
+    );
+
+    if (!CSR.vector_enabled()) {
+        irvelog(3, "mstatus.VS is Off, so vector instructions are illegal");
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+
+    if (decoded_inst.get_funct3() == 0b111) {//OPCFG
+        vector::vset(decoded_inst, cpu_state, CSR);
+    } else {
+        vector::arithmetic(decoded_inst, cpu_state, CSR);
+    }
+
+    //Increment PC
+    cpu_state.goto_next_sequential_pc();
+}
+
 void execute::branch(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
-                        [[maybe_unused]] Csr& CSR) {
+                        Csr& CSR) {
     irvelog(2, "Executing BRANCH instruction");
 
     assert(
@@ -835,6 +1163,7 @@ void execute::branch(const decode::DecodedInst& decoded_inst, CpuState& cpu_stat
         }
         else {
             cpu_state.set_pc(target_addr);
+            CSR.count_hpm_event(Csr::HpmEvent::TAKEN_BRANCH);
             irvelog(3, "Branching to 0x%08X", target_addr);
         }
     }
@@ -874,7 +1203,7 @@ void execute::jalr(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
 }
 
 void execute::jal(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
-                    [[maybe_unused]] Csr& CSR) {
+                    Csr& CSR) {
     irvelog(2, "Executing JAL instruction");
 
     assert(
@@ -895,10 +1224,16 @@ void execute::jal(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
 
     //The "link" part of jump and link
     cpu_state.set_r(decoded_inst.get_rd(), old_pc + 4);//Critically we use old_pc here
+
+    //A jump to itself is an idle loop that only an interrupt can get us out of
+    if (decoded_inst.get_imm().u == 0) [[unlikely]] {
+        irvelog(3, "Idle loop");
+        CSR.skip_to_timer_interrupt();
+    }
 }
 
 void execute::system(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,
-                        Csr& CSR) {
+                        Memory& memory, Csr& CSR) {
     irvelog(2, "Executing SYSTEM instruction");
 
     assert(
@@ -974,8 +1309,21 @@ void execute::system(const decode::DecodedInst& decoded_inst, CpuState& cpu_stat
             }
             else if (imm == 0b000100000101) {//WFI//FIXME techincally this is a funct7 plus rs2, but this does work
                 irvelog(3, "Mnemonic: WFI");
-                irvelog(4, "It is legal \"to simply implement WFI as a NOP\", so we will do that");
+
+                //mstatus.TW makes WFI illegal outside of M-mode (we use a time limit of 0)
+                if ((privilege_mode != PrivilegeMode::MACHINE_MODE) && (CSR.implicit_read(Csr::Address::MSTATUS).bit(21) == 1)) {
+                    rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+                }
+
+                //Interrupts are taken after WFI, so mepc/sepc must point to the next instruction
                 cpu_state.goto_next_sequential_pc();
+
+                //In U-mode WFI must complete in a bounded time, and it is legal "to simply implement
+                //WFI as a NOP", so we only sleep in M-mode and S-mode
+                if (privilege_mode != PrivilegeMode::USER_MODE) {
+                    irvelog(4, "Sleeping until an interrupt is pending");
+                    memory.wait_for_interrupt();
+                }
             }
             else if ((funct7 == 0b0011000) && (decoded_inst.get_rs2() == 0b00010)) {//MRET
                 irvelog(3, "Mnemonic: MRET");
@@ -1110,3 +1458,249 @@ void execute::system(const decode::DecodedInst& decoded_inst, CpuState& cpu_stat
 
     cpu_state.goto_next_sequential_pc();
 }
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static fpu::RoundingMode fp_rounding_mode(const decode::DecodedInst& decoded_inst, Csr& CSR) {
+    uint8_t rm = decoded_inst.get_funct3();
+    if (rm == 0b111) {//Dynamic
+        rm = CSR.get_frm();
+    }
+
+    if (rm > static_cast<uint8_t>(fpu::RoundingMode::RMM)) {
+        irvelog(3, "Invalid rounding mode 0b%u%u%u", (rm >> 2) & 1, (rm >> 1) & 1, rm & 1);
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+    return static_cast<fpu::RoundingMode>(rm);
+}
+
+template<typename T>
+static T get_fp(const CpuState& cpu_state, uint8_t reg_num) {
+    if constexpr (std::is_same_v<T, float>) {
+        return fpu::unbox(cpu_state.get_f(reg_num));
+    } else {
+        return std::bit_cast<double>(cpu_state.get_f(reg_num));
+    }
+}
+
+template<typename T>
+static void set_fp(CpuState& cpu_state, Csr& CSR, uint8_t reg_num, T value) {
+    if constexpr (std::is_same_v<T, float>) {
+        cpu_state.set_f(reg_num, fpu::box(value));
+    } else {
+        cpu_state.set_f(reg_num, std::bit_cast<uint64_t>(value));
+    }
+    CSR.set_fp_dirty();
+}
+
+template<typename T>
+static void op_fp_fmt(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Csr& CSR) {
+    using Bits = std::conditional_t<std::is_same_v<T, float>, uint32_t, uint64_t>;
+    constexpr bool SINGLE = std::is_same_v<T, float>;
+    constexpr Bits SIGN_BIT = (Bits)1 << ((sizeof(Bits) * 8) - 1);
+
+    uint8_t rd  = decoded_inst.get_rd();
+    uint8_t rs1 = decoded_inst.get_rs1();
+    uint8_t rs2 = decoded_inst.get_rs2();
+    uint8_t funct3 = decoded_inst.get_funct3();
+    T f1 = get_fp<T>(cpu_state, rs1);
+    T f2 = get_fp<T>(cpu_state, rs2);
+    uint8_t fflags = 0;
+
+    switch (decoded_inst.get_funct5()) {
+        case 0b00000://FADD
+            irvelog(3, "Mnemonic: FADD.%c", SINGLE ? 'S' : 'D');
+            set_fp<T>(cpu_state, CSR, rd, fpu::add(f1, f2, fp_rounding_mode(decoded_inst, CSR), fflags));
+            break;
+        case 0b00001://FSUB
+            irvelog(3, "Mnemonic: FSUB.%c", SINGLE ? 'S' : 'D');
+            set_fp<T>(cpu_state, CSR, rd, fpu::sub(f1, f2, fp_rounding_mode(decoded_inst, CSR), fflags));
+            break;
+        case 0b00010://FMUL
+            irvelog(3, "Mnemonic: FMUL.%c", SINGLE ? 'S' : 'D');
+            set_fp<T>(cpu_state, CSR, rd, fpu::mul(f1, f2, fp_rounding_mode(decoded_inst, CSR), fflags));
+            break;
+        case 0b00011://FDIV
+            irvelog(3, "Mnemonic: FDIV.%c", SINGLE ? 'S' : 'D');
+            set_fp<T>(cpu_state, CSR, rd, fpu::div(f1, f2, fp_rounding_mode(decoded_inst, CSR), fflags));
+            break;
+        case 0b01011://FSQRT
+            irvelog(3, "Mnemonic: FSQRT.%c", SINGLE ? 'S' : 'D');
+            if (rs2 != 0) {
+                rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            }
+            set_fp<T>(cpu_state, CSR, rd, fpu::sqrt(f1, fp_rounding_mode(decoded_inst, CSR), fflags));
+            break;
+        case 0b00100: {//FSGNJ, FSGNJN, or FSGNJX
+            //Just bit manipulation; NaNs aren't canonicalized
+            Bits b1 = std::bit_cast<Bits>(f1);
+            Bits b2 = std::bit_cast<Bits>(f2);
+            Bits sign;
+            switch (funct3) {
+                case 0b000://FSGNJ
+                    irvelog(3, "Mnemonic: FSGNJ.%c", SINGLE ? 'S' : 'D');
+                    sign = b2 & SIGN_BIT;
+                    break;
+                case 0b001://FSGNJN
+                    irvelog(3, "Mnemonic: FSGNJN.%c", SINGLE ? 'S' : 'D');
+                    sign = ~b2 & SIGN_BIT;
+                    break;
+                case 0b010://FSGNJX
+                    irvelog(3, "Mnemonic: FSGNJX.%c", SINGLE ? 'S' : 'D');
+                    sign = (b1 ^ b2) & SIGN_BIT;
+                    break;
+                default:
+                    rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+                    break;
+            }
+            set_fp<T>(cpu_state, CSR, rd, std::bit_cast<T>((b1 & ~SIGN_BIT) | sign));
+            break;
+        }
+        case 0b00101://FMIN or FMAX
+            if (funct3 == 0b000) {//FMIN
+                irvelog(3, "Mnemonic: FMIN.%c", SINGLE ? 'S' : 'D');
+                set_fp<T>(cpu_state, CSR, rd, fpu::min(f1, f2, fflags));
+            } else if (funct3 == 0b001) {//FMAX
+                irvelog(3, "Mnemonic: FMAX.%c", SINGLE ? 'S' : 'D');
+                set_fp<T>(cpu_state, CSR, rd, fpu::max(f1, f2, fflags));
+            } else {
+                rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            }
+            break;
+        case 0b01000://FCVT.S.D or FCVT.D.S (fmt is the destination format, rs2 is the source format)
+            if constexpr (SINGLE) {
+                irvelog(3, "Mnemonic: FCVT.S.D");
+                if (rs2 != 0b00001) {
+                    rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+                }
+                set_fp<float>(
+                    cpu_state, CSR, rd,
+                    fpu::to_single(get_fp<double>(cpu_state, rs1), fp_rounding_mode(decoded_inst, CSR), fflags)
+                );
+            } else {
+                irvelog(3, "Mnemonic: FCVT.D.S");
+                if (rs2 != 0b00000) {
+                    rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+                }
+                fp_rounding_mode(decoded_inst, CSR);//Unused since this is always exact, but must still be valid
+                set_fp<double>(cpu_state, CSR, rd, fpu::to_double(get_fp<float>(cpu_state, rs1), fflags));
+            }
+            break;
+        case 0b10100: {//FEQ, FLT, or FLE
+            bool result;
+            switch (funct3) {
+                case 0b010://FEQ
+                    irvelog(3, "Mnemonic: FEQ.%c", SINGLE ? 'S' : 'D');
+                    result = fpu::eq(f1, f2, fflags);
+                    break;
+                case 0b001://FLT
+                    irvelog(3, "Mnemonic: FLT.%c", SINGLE ? 'S' : 'D');
+                    result = fpu::lt(f1, f2, fflags);
+                    break;
+                case 0b000://FLE
+                    irvelog(3, "Mnemonic: FLE.%c", SINGLE ? 'S' : 'D');
+                    result = fpu::le(f1, f2, fflags);
+                    break;
+                default:
+                    rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+                    break;
+            }
+            cpu_state.set_r(rd, result ? 1 : 0);
+            break;
+        }
+        case 0b11000://FCVT.W or FCVT.WU
+            if (rs2 == 0b00000) {//FCVT.W
+                irvelog(3, "Mnemonic: FCVT.W.%c", SINGLE ? 'S' : 'D');
+                cpu_state.set_r(rd, fpu::to_int32(f1, fp_rounding_mode(decoded_inst, CSR), fflags));
+            } else if (rs2 == 0b00001) {//FCVT.WU
+                irvelog(3, "Mnemonic: FCVT.WU.%c", SINGLE ? 'S' : 'D');
+                cpu_state.set_r(rd, fpu::to_uint32(f1, fp_rounding_mode(decoded_inst, CSR), fflags));
+            } else {
+                rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            }
+            break;
+        case 0b11010: {//FCVT from W or WU
+            Reg r1 = cpu_state.get_r(rs1);
+            if (rs2 == 0b00000) {//FCVT from W
+                irvelog(3, "Mnemonic: FCVT.%c.W", SINGLE ? 'S' : 'D');
+                set_fp<T>(cpu_state, CSR, rd, fpu::from_int32<T>(r1.s, fp_rounding_mode(decoded_inst, CSR), fflags));
+            } else if (rs2 == 0b00001) {//FCVT from WU
+                irvelog(3, "Mnemonic: FCVT.%c.WU", SINGLE ? 'S' : 'D');
+                set_fp<T>(cpu_state, CSR, rd, fpu::from_uint32<T>(r1.u, fp_rounding_mode(decoded_inst, CSR), fflags));
+            } else {
+                rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            }
+            break;
+        }
+        case 0b11100://FMV.X.W or FCLASS
+            if (rs2 != 0) {
+                rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            }
+            if ((funct3 == 0b000) && SINGLE) {//FMV.X.W (FMV.X.D only exists on RV64)
+                irvelog(3, "Mnemonic: FMV.X.W");
+                //The raw bits, whether or not they're properly NaN-boxed
+                cpu_state.set_r(rd, (uint32_t)cpu_state.get_f(rs1));
+            } else if (funct3 == 0b001) {//FCLASS
+                irvelog(3, "Mnemonic: FCLASS.%c", SINGLE ? 'S' : 'D');
+                cpu_state.set_r(rd, fpu::classify(f1));
+            } else {
+                rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            }
+            break;
+        case 0b11110://FMV.W.X (FMV.D.X only exists on RV64)
+            if (!SINGLE || (rs2 != 0) || (funct3 != 0b000)) {
+                rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            }
+            irvelog(3, "Mnemonic: FMV.W.X");
+            cpu_state.set_f(rd, 0xFFFFFFFF00000000 | cpu_state.get_r(rs1).u);
+            CSR.set_fp_dirty();
+            break;
+        default:
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            break;
+    }
+
+    irvelog(3, "Accrued fflags: 0x%02X", fflags);
+    CSR.accrue_fflags(fflags);
+}
+
+template<typename T>
+static void fused_multiply_add_fmt(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Csr& CSR) {
+    [[maybe_unused]] constexpr bool SINGLE = std::is_same_v<T, float>;
+
+    T f1 = get_fp<T>(cpu_state, decoded_inst.get_rs1());
+    T f2 = get_fp<T>(cpu_state, decoded_inst.get_rs2());
+    T f3 = get_fp<T>(cpu_state, decoded_inst.get_rs3());
+    fpu::RoundingMode rm = fp_rounding_mode(decoded_inst, CSR);
+    uint8_t fflags = 0;
+
+    //Negation is exact (just flips the sign bit), so it's fine to do it beforehand
+    T result;
+    switch (decoded_inst.get_opcode()) {
+        case decode::Opcode::MADD://f1 * f2 + f3
+            irvelog(3, "Mnemonic: FMADD.%c", SINGLE ? 'S' : 'D');
+            result = fpu::fma(f1, f2, f3, rm, fflags);
+            break;
+        case decode::Opcode::MSUB://f1 * f2 - f3
+            irvelog(3, "Mnemonic: FMSUB.%c", SINGLE ? 'S' : 'D');
+            result = fpu::fma(f1, f2, -f3, rm, fflags);
+            break;
+        case decode::Opcode::NMSUB://-(f1 * f2) + f3
+            irvelog(3, "Mnemonic: FNMSUB.%c", SINGLE ? 'S' : 'D');
+            result = fpu::fma(-f1, f2, f3, rm, fflags);
+            break;
+        case decode::Opcode::NMADD://-(f1 * f2) - f3
+            irvelog(3, "Mnemonic: FNMADD.%c", SINGLE ? 'S' : 'D');
+            result = fpu::fma(-f1, f2, -f3, rm, fflags);
+            break;
+        default:
+            assert(false && "We should never get here");
+            break;
+    }
+
+    set_fp<T>(cpu_state, CSR, decoded_inst.get_rd(), result);
+    irvelog(3, "Accrued fflags: 0x%02X", fflags);
+    CSR.accrue_fflags(fflags);
+}
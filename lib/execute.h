@@ -29,16 +29,21 @@
 */
 namespace irve::internal::execute {
     void load    (const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Memory& memory, Csr& CSR);
+    void load_fp (const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Memory& memory, Csr& CSR);
     void custom_0(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Memory& memory, Csr& CSR);
     void misc_mem(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,                 Csr& CSR);
     void op_imm  (const decode::DecodedInst& decoded_inst, CpuState& cpu_state,                 Csr& CSR);
     void auipc   (const decode::DecodedInst& decoded_inst, CpuState& cpu_state,                 Csr& CSR);
     void store   (const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Memory& memory, Csr& CSR);
+    void store_fp(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Memory& memory, Csr& CSR);
     void amo     (const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Memory& memory, Csr& CSR);
     void op      (const decode::DecodedInst& decoded_inst, CpuState& cpu_state,                 Csr& CSR);
     void lui     (const decode::DecodedInst& decoded_inst, CpuState& cpu_state,                 Csr& CSR);
+    void fused_multiply_add(const decode::DecodedInst& decoded_inst, CpuState& cpu_state,       Csr& CSR);//MADD, MSUB, NMSUB, and NMADD
+    void op_fp   (const decode::DecodedInst& decoded_inst, CpuState& cpu_state,                 Csr& CSR);
+    void op_v    (const decode::DecodedInst& decoded_inst, CpuState& cpu_state,                 Csr& CSR);
     void branch  (const decode::DecodedInst& decoded_inst, CpuState& cpu_state,                 Csr& CSR);
     void jalr    (const decode::DecodedInst& decoded_inst, CpuState& cpu_state,                 Csr& CSR);
     void jal     (const decode::DecodedInst& decoded_inst, CpuState& cpu_state,                 Csr& CSR);
-    void system  (const decode::DecodedInst& decoded_inst, CpuState& cpu_state,                 Csr& CSR);
+    void system  (const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Memory& memory, Csr& CSR);
 }
@@ -0,0 +1,547 @@
+/**
+ * @brief   Floating point arithmetic for the F and D extensions
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * This file is compiled with -frounding-math so the compiler doesn't assume the host is always
+ * rounding to nearest. The volatiles keep it from moving arithmetic out from between changing the
+ * host's rounding mode and reading back its exception flags.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "fpu.h"
+
+#include <bit>
+#include <cassert>
+#include <cfenv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+using namespace irve::internal;
+using namespace irve::internal::fpu;
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+template<typename T>
+struct FpTraits;
+
+template<>
+struct FpTraits<float> {
+    using Bits = uint32_t;
+    using Wide = double;//Used to emulate RMM
+    static constexpr Bits CANONICAL_NAN = 0x7FC00000;
+    static constexpr Bits QUIET_BIT     = 0x00400000;
+};
+
+template<>
+struct FpTraits<double> {
+    using Bits = uint64_t;
+    using Wide = long double;//Used to emulate RMM, if it is actually wider (see rounded())
+    static constexpr Bits CANONICAL_NAN = 0x7FF8000000000000;
+    static constexpr Bits QUIET_BIT     = 0x0008000000000000;
+};
+
+/**
+ * @brief Sets the host's rounding mode and clears its exception flags for as long as it exists
+*/
+class HostFpEnv {
+public:
+    HostFpEnv(int host_rounding_mode) {
+        std::fesetround(host_rounding_mode);
+        std::feclearexcept(FE_ALL_EXCEPT);
+    }
+
+    ~HostFpEnv() {
+        std::fesetround(FE_TONEAREST);//What the rest of IRVE expects
+    }
+
+    uint8_t flags() const {
+        uint8_t fflags = 0;
+        if (std::fetestexcept(FE_INVALID))      { fflags |= FFLAG_NV; }
+        if (std::fetestexcept(FE_DIVBYZERO))    { fflags |= FFLAG_DZ; }
+        if (std::fetestexcept(FE_OVERFLOW))     { fflags |= FFLAG_OF; }
+        if (std::fetestexcept(FE_UNDERFLOW))    { fflags |= FFLAG_UF; }
+        if (std::fetestexcept(FE_INEXACT))      { fflags |= FFLAG_NX; }
+        return fflags;
+    }
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+static int host_rounding_mode(RoundingMode rm);
+
+template<typename T>
+static T canonical_nan();
+
+template<typename T>
+static bool is_signaling_nan(T a);
+
+/**
+ * @brief Add a and b, rounding to nearest, along with the (exactly representable) error
+ * @return The rounded sum and the error, so a + b = first + second exactly
+*/
+template<typename T>
+static std::pair<T, T> two_sum(T a, T b);
+
+template<typename T>
+static bool cannot_tie(T result, T half_ulp);
+
+template<typename T, typename Op, typename IsTie = bool (*)(T, T)>
+static T rounded(RoundingMode rm, uint8_t& fflags, Op op, IsTie is_tie = cannot_tie<T>);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+template<typename T>
+T fpu::add(T a, T b, RoundingMode rm, uint8_t& fflags) {
+    return rounded<T>(rm, fflags, [&](auto zero) {
+        using U = decltype(zero);
+        return (U)a + (U)b;
+    }, [&](T, T half_ulp) {
+        return two_sum(a, b).second == half_ulp;//two_sum() rounds to the same sum
+    });
+}
+
+template<typename T>
+T fpu::sub(T a, T b, RoundingMode rm, uint8_t& fflags) {
+    return rounded<T>(rm, fflags, [&](auto zero) {
+        using U = decltype(zero);
+        return (U)a - (U)b;
+    }, [&](T, T half_ulp) {
+        return two_sum(a, -b).second == half_ulp;
+    });
+}
+
+template<typename T>
+T fpu::mul(T a, T b, RoundingMode rm, uint8_t& fflags) {
+    return rounded<T>(rm, fflags, [&](auto zero) {
+        using U = decltype(zero);
+        return (U)a * (U)b;
+    }, [&](T product, T half_ulp) {
+        return std::fma(a, b, -product) == half_ulp;//The error of a product is exactly representable
+    });
+}
+
+template<typename T>
+T fpu::div(T a, T b, RoundingMode rm, uint8_t& fflags) {
+    return rounded<T>(rm, fflags, [&](auto zero) {
+        using U = decltype(zero);
+        return (U)a / (U)b;
+    }, [&](T quotient, T half_ulp) {
+        //a / b = quotient + remainder / b, and both the remainder and half_ulp * b (half_ulp is a
+        //power of two) are exactly representable
+        return std::fma(-quotient, b, a) == (half_ulp * b);
+    });
+}
+
+template<typename T>
+T fpu::sqrt(T a, RoundingMode rm, uint8_t& fflags) {
+    //No need for a tie check: a value halfway between two Ts has one more significant bit than
+    //a T, so its square has too many to be a T
+    return rounded<T>(rm, fflags, [&](auto zero) {
+        using U = decltype(zero);
+        return std::sqrt((U)a);
+    });
+}
+
+template<typename T>
+T fpu::fma(T a, T b, T c, RoundingMode rm, uint8_t& fflags) {
+    //IEEE 754 leaves it up to the implementation whether inf * 0 + qNaN is invalid; RISC-V says it is
+    if ((std::isinf(a) && (b == 0)) || ((a == 0) && std::isinf(b))) {
+        fflags |= FFLAG_NV;
+    }
+
+    return rounded<T>(rm, fflags, [&](auto zero) {
+        using U = decltype(zero);
+        return std::fma((U)a, (U)b, (U)c);
+    }, [&](T result, T half_ulp) {
+        //Boldo and Muller's ErrFma: a * b + c = result + error_hi + error_lo exactly, where
+        //error_hi = error_hi + error_lo rounded to nearest
+        T product_hi = a * b;
+        T product_lo = std::fma(a, b, -product_hi);
+        auto [alpha_hi, alpha_lo] = two_sum(c, product_lo);
+        auto [beta_hi, beta_lo] = two_sum(product_hi, alpha_hi);
+        T gamma = (beta_hi - result) + beta_lo;
+        auto [error_hi, error_lo] = two_sum(gamma, alpha_lo);
+        return (error_hi == half_ulp) && (error_lo == 0);//half_ulp can only be hit with no error left
+    });
+}
+
+template<typename T>
+T fpu::min(T a, T b, uint8_t& fflags) {
+    if (is_signaling_nan(a) || is_signaling_nan(b)) {
+        fflags |= FFLAG_NV;
+    }
+
+    if (std::isnan(a) && std::isnan(b)) {
+        return canonical_nan<T>();
+    } else if (std::isnan(a)) {
+        return b;
+    } else if (std::isnan(b)) {
+        return a;
+    } else if ((a == 0) && (b == 0)) {
+        return std::signbit(a) ? a : b;
+    } else {
+        return (a < b) ? a : b;
+    }
+}
+
+template<typename T>
+T fpu::max(T a, T b, uint8_t& fflags) {
+    if (is_signaling_nan(a) || is_signaling_nan(b)) {
+        fflags |= FFLAG_NV;
+    }
+
+    if (std::isnan(a) && std::isnan(b)) {
+        return canonical_nan<T>();
+    } else if (std::isnan(a)) {
+        return b;
+    } else if (std::isnan(b)) {
+        return a;
+    } else if ((a == 0) && (b == 0)) {
+        return std::signbit(a) ? b : a;
+    } else {
+        return (a > b) ? a : b;
+    }
+}
+
+template<typename T>
+bool fpu::eq(T a, T b, uint8_t& fflags) {
+    if (is_signaling_nan(a) || is_signaling_nan(b)) {
+        fflags |= FFLAG_NV;
+    }
+    return a == b;//False if either is NaN
+}
+
+template<typename T>
+bool fpu::lt(T a, T b, uint8_t& fflags) {
+    if (std::isnan(a) || std::isnan(b)) {
+        fflags |= FFLAG_NV;
+        return false;
+    }
+    return a < b;
+}
+
+template<typename T>
+bool fpu::le(T a, T b, uint8_t& fflags) {
+    if (std::isnan(a) || std::isnan(b)) {
+        fflags |= FFLAG_NV;
+        return false;
+    }
+    return a <= b;
+}
+
+template<typename T>
+uint32_t fpu::classify(T a) {
+    bool negative = std::signbit(a);
+    switch (std::fpclassify(a)) {
+        case FP_INFINITE:   return negative ? (1 << 0) : (1 << 7);
+        case FP_NORMAL:     return negative ? (1 << 1) : (1 << 6);
+        case FP_SUBNORMAL:  return negative ? (1 << 2) : (1 << 5);
+        case FP_ZERO:       return negative ? (1 << 3) : (1 << 4);
+        case FP_NAN:        return is_signaling_nan(a) ? (1 << 8) : (1 << 9);
+        default:
+            assert(false && "We should never get here");
+            return 0;
+    }
+}
+
+template<typename T>
+int32_t fpu::to_int32(T a, RoundingMode rm, uint8_t& fflags) {
+    if (std::isnan(a)) {
+        fflags |= FFLAG_NV;
+        return std::numeric_limits<int32_t>::max();
+    }
+
+    //All 32 bit integers are exactly representable as doubles, so nothing is lost here
+    double rounded_a;
+    if (rm == RoundingMode::RMM) {
+        rounded_a = std::round((double)a);
+    } else {
+        HostFpEnv env(host_rounding_mode(rm));
+        volatile double result = std::nearbyint((double)a);
+        rounded_a = result;
+    }
+
+    //Only NV is set when the result is out of range, not NX
+    if (rounded_a < (double)std::numeric_limits<int32_t>::min()) {
+        fflags |= FFLAG_NV;
+        return std::numeric_limits<int32_t>::min();
+    } else if (rounded_a > (double)std::numeric_limits<int32_t>::max()) {
+        fflags |= FFLAG_NV;
+        return std::numeric_limits<int32_t>::max();
+    }
+
+    if (rounded_a != (double)a) {
+        fflags |= FFLAG_NX;
+    }
+    return (int32_t)rounded_a;
+}
+
+template<typename T>
+uint32_t fpu::to_uint32(T a, RoundingMode rm, uint8_t& fflags) {
+    if (std::isnan(a)) {
+        fflags |= FFLAG_NV;
+        return std::numeric_limits<uint32_t>::max();
+    }
+
+    double rounded_a;
+    if (rm == RoundingMode::RMM) {
+        rounded_a = std::round((double)a);
+    } else {
+        HostFpEnv env(host_rounding_mode(rm));
+        volatile double result = std::nearbyint((double)a);
+        rounded_a = result;
+    }
+
+    //Note that something like -0.25 rounds to -0, which is in range
+    if (rounded_a < 0) {
+        fflags |= FFLAG_NV;
+        return 0;
+    } else if (rounded_a > (double)std::numeric_limits<uint32_t>::max()) {
+        fflags |= FFLAG_NV;
+        return std::numeric_limits<uint32_t>::max();
+    }
+
+    if (rounded_a != (double)a) {
+        fflags |= FFLAG_NX;
+    }
+    return (uint32_t)rounded_a;
+}
+
+template<typename T>
+T fpu::from_int32(int32_t a, RoundingMode rm, uint8_t& fflags) {
+    return rounded<T>(rm, fflags, [&](auto zero) {
+        using U = decltype(zero);
+        return (U)a;
+    });
+}
+
+template<typename T>
+T fpu::from_uint32(uint32_t a, RoundingMode rm, uint8_t& fflags) {
+    return rounded<T>(rm, fflags, [&](auto zero) {
+        using U = decltype(zero);
+        return (U)a;
+    });
+}
+
+float fpu::to_single(double a, RoundingMode rm, uint8_t& fflags) {
+    return rounded<float>(rm, fflags, [&](auto zero) {
+        using U = decltype(zero);
+        return (U)a;
+    });
+}
+
+double fpu::to_double(float a, uint8_t& fflags) {
+    //Always exact, so the rounding mode doesn't matter
+    return rounded<double>(RoundingMode::RNE, fflags, [&](auto zero) {
+        using U = decltype(zero);
+        return (U)a;
+    });
+}
+
+uint64_t fpu::box(float a) {
+    return 0xFFFFFFFF00000000 | std::bit_cast<uint32_t>(a);
+}
+
+float fpu::unbox(uint64_t bits) {
+    if ((bits >> 32) != 0xFFFFFFFF) {
+        return canonical_nan<float>();
+    }
+    return std::bit_cast<float>((uint32_t)bits);
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static int host_rounding_mode(RoundingMode rm) {
+    switch (rm) {
+        case RoundingMode::RNE: return FE_TONEAREST;
+        case RoundingMode::RTZ: return FE_TOWARDZERO;
+        case RoundingMode::RDN: return FE_DOWNWARD;
+        case RoundingMode::RUP: return FE_UPWARD;
+        default:
+            assert(false && "The host has no equivalent of this rounding mode");
+            return FE_TONEAREST;
+    }
+}
+
+template<typename T>
+static T canonical_nan() {
+    return std::bit_cast<T>(FpTraits<T>::CANONICAL_NAN);
+}
+
+template<typename T>
+static bool is_signaling_nan(T a) {
+    return std::isnan(a) && !(std::bit_cast<typename FpTraits<T>::Bits>(a) & FpTraits<T>::QUIET_BIT);
+}
+
+template<typename T>
+static std::pair<T, T> two_sum(T a, T b) {
+    //Knuth's TwoSum, which unlike Fast2Sum doesn't care which of a and b is bigger
+    T sum = a + b;
+    T b_part = sum - a;
+    T a_part = sum - b_part;
+    return {sum, (a - a_part) + (b - b_part)};
+}
+
+template<typename T>
+static bool cannot_tie(T, T) {
+    return false;
+}
+
+/**
+ * @brief Evaluate op (which is passed a zero of the type it should compute in) rounded to T
+ * @note is_tie(result, half_ulp) must say whether the exact result is result + half_ulp, for RMM on
+ *  hosts where Wide isn't actually wider than T. It is only called with round to nearest in effect,
+ *  and can be left out for operations that can't land exactly between two Ts (like conversions to
+ *  double).
+*/
+template<typename T, typename Op, typename IsTie>
+static T rounded(RoundingMode rm, uint8_t& fflags, Op op, IsTie is_tie) {
+    if (rm != RoundingMode::RMM) {//The easy case: the host can do it all for us
+        HostFpEnv env(host_rounding_mode(rm));
+        volatile T result = op(T{});
+        fflags |= env.flags();
+        return std::isnan(result) ? canonical_nan<T>() : result;
+    }
+
+    using Wide = typename FpTraits<T>::Wide;
+    if constexpr (std::numeric_limits<Wide>::digits <= std::numeric_limits<T>::digits) {
+        //No wider type to work in (ex. long double is just double with MSVC or on Apple AArch64).
+        //RMM only differs from RNE when the exact result is halfway between two Ts, where RNE
+        //picks the even one and RMM the one further from zero, so fix up the RNE result in that
+        //case. is_tie() relies on error terms that can't be represented once they are subnormal,
+        //so ties between the very smallest Ts aren't caught.
+        T result;
+        uint8_t rne_flags;
+        {
+            HostFpEnv env(FE_TONEAREST);
+            volatile T rne_result = op(T{});
+            result = rne_result;
+            rne_flags = env.flags();
+        }
+        //The flags are right as is: RMM overflows and is tiny in the same cases as RNE, since
+        //both round ties at those boundaries up in magnitude
+        fflags |= rne_flags;
+
+        if (std::isnan(result)) {
+            return canonical_nan<T>();
+        } else if (!(rne_flags & FFLAG_NX) || std::isinf(result)) {
+            return result;
+        }
+
+        for (T direction : {-std::numeric_limits<T>::infinity(), std::numeric_limits<T>::infinity()}) {
+            T neighbour = std::nextafter(result, direction);
+            if (std::isinf(neighbour) || (std::fabs(neighbour) < std::fabs(result))) {
+                continue;
+            }
+            T half_ulp = (neighbour - result) / 2;//Adjacent Ts are a power of two apart
+            if ((half_ulp != 0) && is_tie(result, half_ulp)) {
+                return neighbour;
+            }
+        }
+        return result;
+    }
+
+    //For RMM, compute the result at a wider precision, truncated. Since the point halfway between
+    //any two adjacent Ts is exactly representable as a Wide, truncating can't move the result from
+    //one side of it to the other, so comparing against it gives the correctly rounded result.
+    Wide wide;
+    T lo;
+    bool inexact;
+    {
+        HostFpEnv env(FE_TOWARDZERO);
+        volatile Wide wide_result = op(Wide{});
+        wide = wide_result;
+        uint8_t wide_flags = env.flags();
+        fflags |= wide_flags & (FFLAG_NV | FFLAG_DZ);
+        inexact = wide_flags & FFLAG_NX;
+
+        if (std::isnan(wide)) {
+            return canonical_nan<T>();
+        } else if (std::isinf(wide)) {//Exact (ex. from an infinite operand or dividing by zero)
+            return (T)wide;
+        }
+
+        volatile T lo_result = (T)wide;
+        lo = lo_result;
+    }
+
+    T result = lo;
+    if ((Wide)lo != wide) {
+        inexact = true;
+
+        T max = std::numeric_limits<T>::max();
+        Wide halfway;
+        if (std::fabs(lo) == max) {//The next T away from zero is infinity, so pretend it isn't
+            halfway = (Wide)lo + (((Wide)lo - (Wide)std::nextafter(lo, (T)0)) / 2);
+        } else {
+            T hi = std::nextafter(lo, std::signbit(wide) ? -max : max);
+            halfway = ((Wide)lo + (Wide)hi) / 2;
+        }
+
+        if (std::fabs(wide) >= std::fabs(halfway)) {//Ties go away from zero
+            result = std::nextafter(lo, std::signbit(wide) ? -std::numeric_limits<T>::infinity()
+                                                           :  std::numeric_limits<T>::infinity());
+        }
+    }
+
+    if (inexact) {
+        fflags |= FFLAG_NX;
+
+        if (std::isinf(result)) {
+            fflags |= FFLAG_OF;
+        }
+
+        //Tininess is detected after rounding: would the result be subnormal if the exponent range
+        //were unbounded? That is the case below the point halfway between the smallest normal and
+        //the largest number with one more significant bit than T has below it.
+        Wide min_normal = std::numeric_limits<T>::min();
+        Wide tiny_threshold = min_normal - std::ldexp(min_normal, -(std::numeric_limits<T>::digits + 1));
+        if (std::fabs(wide) < tiny_threshold) {
+            fflags |= FFLAG_UF;
+        }
+    }
+
+    return result;
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Explicit Instantiations
+ * --------------------------------------------------------------------------------------------- */
+
+#define INSTANTIATE(T) \
+    template T fpu::add<T>(T, T, RoundingMode, uint8_t&); \
+    template T fpu::sub<T>(T, T, RoundingMode, uint8_t&); \
+    template T fpu::mul<T>(T, T, RoundingMode, uint8_t&); \
+    template T fpu::div<T>(T, T, RoundingMode, uint8_t&); \
+    template T fpu::sqrt<T>(T, RoundingMode, uint8_t&); \
+    template T fpu::fma<T>(T, T, T, RoundingMode, uint8_t&); \
+    template T fpu::min<T>(T, T, uint8_t&); \
+    template T fpu::max<T>(T, T, uint8_t&); \
+    template bool fpu::eq<T>(T, T, uint8_t&); \
+    template bool fpu::lt<T>(T, T, uint8_t&); \
+    template bool fpu::le<T>(T, T, uint8_t&); \
+    template uint32_t fpu::classify<T>(T); \
+    template int32_t fpu::to_int32<T>(T, RoundingMode, uint8_t&); \
+    template uint32_t fpu::to_uint32<T>(T, RoundingMode, uint8_t&); \
+    template T fpu::from_int32<T>(int32_t, RoundingMode, uint8_t&); \
+    template T fpu::from_uint32<T>(uint32_t, RoundingMode, uint8_t&);
+
+INSTANTIATE(float)
+INSTANTIATE(double)
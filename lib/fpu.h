@@ -0,0 +1,115 @@
+/**
+ * @brief   Floating point arithmetic for the F and D extensions
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Everything is done with the host's FPU, under whatever rounding mode the instruction asks for,
+ * and the exceptions it raises are translated into RISC-V fflags. The host has no equivalent of
+ * round to nearest, ties to max magnitude (RMM), so that mode is emulated by computing the result
+ * at a wider precision and rounding it by hand.
+ *
+ * Results that are NaN are always the canonical NaN, as the ISA requires.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal::fpu {
+
+//fflags bits
+constexpr uint8_t FFLAG_NV = 1 << 4;//Invalid operation
+constexpr uint8_t FFLAG_DZ = 1 << 3;//Divide by zero
+constexpr uint8_t FFLAG_OF = 1 << 2;//Overflow
+constexpr uint8_t FFLAG_UF = 1 << 1;//Underflow
+constexpr uint8_t FFLAG_NX = 1 << 0;//Inexact
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief       RISC-V rounding modes (the encoding of an instruction's rm field and of frm).
+*/
+enum class RoundingMode : uint8_t {
+    RNE = 0b000,//Round to nearest, ties to even
+    RTZ = 0b001,//Round towards zero
+    RDN = 0b010,//Round down (towards -infinity)
+    RUP = 0b011,//Round up (towards +infinity)
+    RMM = 0b100,//Round to nearest, ties to max magnitude
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+//These are only instantiated for float and double.
+//Any exceptions that occur are ORed into fflags; it is never cleared.
+
+template<typename T> T add (T a, T b,      RoundingMode rm, uint8_t& fflags);
+template<typename T> T sub (T a, T b,      RoundingMode rm, uint8_t& fflags);
+template<typename T> T mul (T a, T b,      RoundingMode rm, uint8_t& fflags);
+template<typename T> T div (T a, T b,      RoundingMode rm, uint8_t& fflags);
+template<typename T> T sqrt(T a,           RoundingMode rm, uint8_t& fflags);
+template<typename T> T fma (T a, T b, T c, RoundingMode rm, uint8_t& fflags);//a * b + c, rounded once
+
+/**
+ * @brief       IEEE 754-2019 minimumNumber/maximumNumber (-0 is considered less than +0).
+*/
+template<typename T> T min(T a, T b, uint8_t& fflags);
+template<typename T> T max(T a, T b, uint8_t& fflags);
+
+/**
+ * @brief       Comparisons. eq is quiet (only signaling NaNs are invalid); lt and le are
+ *              signaling (any NaN is invalid). All are false if either operand is NaN.
+*/
+template<typename T> bool eq(T a, T b, uint8_t& fflags);
+template<typename T> bool lt(T a, T b, uint8_t& fflags);
+template<typename T> bool le(T a, T b, uint8_t& fflags);
+
+/**
+ * @brief       Get the FCLASS mask of a value (exactly one of the low 10 bits is set).
+*/
+template<typename T> uint32_t classify(T a);
+
+/**
+ * @brief       Convert to an integer. Out of range values (and NaN) saturate and are invalid.
+*/
+template<typename T> int32_t  to_int32 (T a, RoundingMode rm, uint8_t& fflags);
+template<typename T> uint32_t to_uint32(T a, RoundingMode rm, uint8_t& fflags);
+
+/**
+ * @brief       Convert from an integer.
+*/
+template<typename T> T from_int32 (int32_t  a, RoundingMode rm, uint8_t& fflags);
+template<typename T> T from_uint32(uint32_t a, RoundingMode rm, uint8_t& fflags);
+
+/**
+ * @brief       Convert between single and double precision (FCVT.S.D and FCVT.D.S).
+*/
+float  to_single(double a, RoundingMode rm, uint8_t& fflags);
+double to_double(float a, uint8_t& fflags);
+
+/**
+ * @brief       NaN-box a single precision value so it can be put in a 64 bit f register.
+*/
+uint64_t box(float a);
+
+/**
+ * @brief       Get the single precision value in a 64 bit f register.
+ * @return      The value, or the canonical NaN if the register isn't a properly NaN-boxed single.
+*/
+float unbox(uint64_t bits);
+
+} // namespace irve::internal::fpu
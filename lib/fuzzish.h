@@ -18,28 +18,55 @@
 
 #include "config.h"
 
+#include <cstddef>
 #include <cstdint>
-
-#if IRVE_FUZZISH
 #include <cstdlib>
-#else
 #include <cstring>
-#endif
 
 /* ------------------------------------------------------------------------------------------------
  * Constants/Defines
  * --------------------------------------------------------------------------------------------- */
 
 #if IRVE_INTERNAL_CONFIG_FUZZISH
-//TODO be more efficient (use all 32 bits)
 #define irve_fuzzish_meminit(ptr, size_bytes) do { \
     uint8_t* byte_ptr = (uint8_t*)ptr; \
-    for (size_t i = 0; i < size_bytes; ++i) { \
-        byte_ptr[i] = std::rand(); \
+    size_t i = 0; \
+    for (; (i + 4) <= (size_t)(size_bytes); i += 4) { \
+        uint32_t random_word = irve::internal::fuzzish::rand(); \
+        std::memcpy(byte_ptr + i, &random_word, 4); \
+    } \
+    for (; i < (size_t)(size_bytes); ++i) { \
+        byte_ptr[i] = static_cast<uint8_t>(irve::internal::fuzzish::rand()); \
     } \
 } while (0)
-#define irve_fuzzish_rand() std::rand()
+#define irve_fuzzish_rand() irve::internal::fuzzish::rand()
 #else
 #define irve_fuzzish_meminit(ptr, size_bytes) do { std::memset(ptr, 0, size_bytes); } while (0)
 #define irve_fuzzish_rand() 0
 #endif
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal::fuzzish {
+
+/**
+ * @brief Get a random number
+ * @return 32 random bits
+ *
+ * Each thread has its own generator (so emulators on different threads don't contend for
+ * std::rand()'s lock), seeded from std::rand() the first time it is used, so srand() still
+ * determines what a single-threaded program sees.
+*/
+inline uint32_t rand() {
+    static thread_local uint64_t state = (static_cast<uint64_t>(std::rand()) << 32) | static_cast<uint64_t>(std::rand()) | 1;
+
+    //xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return static_cast<uint32_t>((state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+} // namespace irve::internal::fuzzish
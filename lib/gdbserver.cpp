@@ -24,6 +24,7 @@
 #include "memory.h"
 #include "gdbserver.h"
 
+#define LOG_SUBSYSTEM GDBSERVER
 #define INST_COUNT 0
 #include "logging.h"
 
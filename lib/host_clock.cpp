@@ -0,0 +1,110 @@
+/**
+ * @brief   The cheapest monotonic clock the host has
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "host_clock.h"
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants
+ * --------------------------------------------------------------------------------------------- */
+
+//Long enough that the error in the two steady_clock readings is only a few parts per million
+constexpr std::chrono::milliseconds CALIBRATION_TIME(5);
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+struct Calibration {
+    bool use_tsc;
+    uint64_t frequency;
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+static const Calibration& calibration();
+static Calibration calibrate();
+static uint64_t steady_clock_ns();
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+uint64_t host_clock::now() {
+#if defined(__x86_64__)
+    if (calibration().use_tsc) {
+        return __rdtsc();
+    }
+#endif
+    return steady_clock_ns();
+}
+
+uint64_t host_clock::frequency() {
+    return calibration().frequency;
+}
+
+uint64_t host_clock::convert(uint64_t value, uint64_t to_frequency, uint64_t from_frequency) {
+    return (uint64_t)(((unsigned __int128)value * to_frequency) / from_frequency);
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static const Calibration& calibration() {
+    static const Calibration s_calibration = calibrate();//Only once per process, and thread-safe
+    return s_calibration;
+}
+
+static Calibration calibrate() {
+#if defined(__x86_64__)
+    //CPUID.80000007H:EDX[8] means the TSC ticks at a constant rate regardless of power states
+    unsigned int eax, ebx, ecx, edx;
+    bool invariant_tsc = __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1U << 8));
+    if (invariant_tsc) {
+        uint64_t start_ns  = steady_clock_ns();
+        uint64_t start_tsc = __rdtsc();
+        std::this_thread::sleep_for(CALIBRATION_TIME);
+        uint64_t end_ns    = steady_clock_ns();
+        uint64_t end_tsc   = __rdtsc();
+
+        if ((end_tsc > start_tsc) && (end_ns > start_ns)) {
+            return Calibration {
+                .use_tsc = true,
+                .frequency = host_clock::convert(end_tsc - start_tsc, 1000000000, end_ns - start_ns)
+            };
+        }
+    }
+#endif
+
+    return Calibration {
+        .use_tsc = false,
+        .frequency = 1000000000
+    };
+}
+
+static uint64_t steady_clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,49 @@
+/**
+ * @brief   The cheapest monotonic clock the host has
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * On x86-64 hosts with an invariant TSC, this is just rdtsc (calibrated against steady_clock the
+ * first time it is used). Everywhere else it falls back to steady_clock in nanoseconds, which is
+ * still a vDSO call rather than a real syscall on Linux.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal::host_clock {
+
+/**
+ * @brief Read the clock
+ * @return The number of ticks since some arbitrary point in the past
+*/
+uint64_t now();
+
+/**
+ * @brief Get how fast the clock ticks
+ * @return Ticks per second
+*/
+uint64_t frequency();
+
+/**
+ * @brief Convert between two rates without overflowing
+ * @param value The value to convert
+ * @param to_frequency The rate to convert to (ex. mtime's frequency)
+ * @param from_frequency The rate value is in (ex. frequency())
+ * @return value * to_frequency / from_frequency, rounded down
+*/
+uint64_t convert(uint64_t value, uint64_t to_frequency, uint64_t from_frequency);
+
+} // namespace irve::internal::host_clock
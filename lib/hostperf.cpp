@@ -0,0 +1,339 @@
+/**
+ * @brief   Host hardware performance counters around the emulator (Linux perf_event_open)
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * See hostperf.h for how this works
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "hostperf.h"
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <signal.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define INST_COUNT 0
+#include "logging.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+#define SAMPLE_SIGNAL SIGPROF
+
+static constexpr uint64_t CYCLES_SAMPLE_PERIOD      = 1000000;//~1-4 kHz, depending on the host
+static constexpr uint64_t TASK_CLOCK_SAMPLE_PERIOD  = 250000;//ns, so 4 kHz
+
+static constexpr const char* COUNTER_NAMES[static_cast<uint8_t>(hostperf::Counter::COUNT)] = {
+    "cycles",
+    "instructions",
+    "branch-misses",
+    "L1D read misses",
+    "LLC read misses",
+    "dTLB read misses",
+    "task-clock (ns)"
+};
+
+static constexpr const char* PHASE_NAMES[static_cast<uint8_t>(hostperf::Phase::COUNT)] = {
+    "other",
+    "decode",
+    "execute",
+    "memory",
+    "trap"
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Variables
+ * --------------------------------------------------------------------------------------------- */
+
+static thread_local hostperf::HostPerf* t_active_host_perf = nullptr;//For handle_sample()
+
+//The signal handler is process-wide, so it is installed while any HostPerf (on any thread) is sampling
+static std::mutex s_handler_mutex;
+static uint32_t s_handler_users = 0;
+static struct sigaction s_old_action;
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+static int open_counter(hostperf::Counter counter, uint64_t sample_period);
+static uint64_t read_counter(int fd);
+static void enable_counter(int fd, bool enable);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+hostperf::HostPerf::HostPerf(const volatile Phase& phase) :
+    m_phase(phase),
+    m_totals(),
+    m_sampling_fd(-1),
+    m_sampling_cycles(false),
+    m_phase_samples(),
+    m_begin_inst_count(0),
+    m_guest_inst_count(0)
+{
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Counter::COUNT); ++i) {
+        this->m_fds[i] = open_counter(static_cast<Counter>(i), 0);
+    }
+
+    this->m_sampling_fd = open_counter(Counter::CYCLES, CYCLES_SAMPLE_PERIOD);
+    this->m_sampling_cycles = this->m_sampling_fd != -1;
+    if (!this->m_sampling_cycles) {
+        this->m_sampling_fd = open_counter(Counter::TASK_CLOCK, TASK_CLOCK_SAMPLE_PERIOD);
+    }
+
+#if defined(__linux__)
+    if (this->m_sampling_fd != -1) {
+        {
+            std::lock_guard<std::mutex> lock(s_handler_mutex);
+            if (s_handler_users++ == 0) {
+                struct sigaction action = {};
+                action.sa_sigaction = handle_sample;
+                action.sa_flags = SA_SIGINFO | SA_RESTART;
+                sigemptyset(&action.sa_mask);
+                sigaction(SAMPLE_SIGNAL, &action, &s_old_action);
+            }
+        }
+
+        //Have the kernel signal this thread (not just any thread in the process) on each overflow
+        struct f_owner_ex owner = {F_OWNER_TID, static_cast<pid_t>(syscall(SYS_gettid))};
+        fcntl(this->m_sampling_fd, F_SETOWN_EX, &owner);
+        fcntl(this->m_sampling_fd, F_SETSIG, SAMPLE_SIGNAL);
+        fcntl(this->m_sampling_fd, F_SETFL, O_ASYNC);
+    }
+#endif
+
+    if (!this->available()) {
+        irvelog_always(0, "Couldn't open any host performance counters (is perf_event_open allowed?)");
+    }
+}
+
+hostperf::HostPerf::~HostPerf() {
+    if (t_active_host_perf == this) {
+        t_active_host_perf = nullptr;
+    }
+
+#if defined(__linux__)
+    for (int fd : this->m_fds) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    if (this->m_sampling_fd != -1) {
+        close(this->m_sampling_fd);
+
+        std::lock_guard<std::mutex> lock(s_handler_mutex);
+        if (--s_handler_users == 0) {
+            sigaction(SAMPLE_SIGNAL, &s_old_action, nullptr);
+        }
+    }
+#endif
+
+    if (!this->available()) {
+        return;
+    }
+
+    uint64_t guest_insts = this->m_guest_inst_count ? this->m_guest_inst_count : 1;//Avoid dividing by zero
+    irvelog_always(0, "Host performance counters (%" PRIu64 " guest instructions):", this->m_guest_inst_count);
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Counter::COUNT); ++i) {
+        if (this->m_fds[i] == -1) {
+            irvelog_always(1, "%-18s unavailable", COUNTER_NAMES[i]);
+        } else {
+            irvelog_always(1, "%-18s %16" PRIu64 " %12.3f per guest instruction",
+                COUNTER_NAMES[i], this->m_totals[i], static_cast<double>(this->m_totals[i]) / guest_insts);
+        }
+    }
+
+    uint64_t cycles = this->total(Counter::CYCLES);
+    if (cycles && this->total(Counter::INSTRUCTIONS)) {
+        irvelog_always(1, "Host IPC: %.3f", static_cast<double>(this->total(Counter::INSTRUCTIONS)) / cycles);
+    }
+
+    uint64_t total_samples = 0;
+    for (uint64_t samples : this->m_phase_samples) {
+        total_samples += samples;
+    }
+    if (!total_samples) {
+        return;
+    }
+
+    //Split the total cost between the phases in proportion to their samples
+    Counter sampled_counter = this->m_sampling_cycles ? Counter::CYCLES : Counter::TASK_CLOCK;
+    const char* unit = this->m_sampling_cycles ? "cycles" : "ns";
+    double cost_per_guest_inst = static_cast<double>(this->total(sampled_counter)) / guest_insts;
+    irvelog_always(0, "Host time by phase (%" PRIu64 " samples):", total_samples);
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Phase::COUNT); ++i) {
+        double fraction = static_cast<double>(this->m_phase_samples[i]) / total_samples;
+        irvelog_always(1, "%-8s %6.2f%% %12.3f %s per guest instruction",
+            PHASE_NAMES[i], fraction * 100, fraction * cost_per_guest_inst, unit);
+    }
+}
+
+bool hostperf::HostPerf::available() const {
+    for (int fd : this->m_fds) {
+        if (fd != -1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void hostperf::HostPerf::begin(uint64_t inst_count) {
+    this->m_begin_inst_count = inst_count;
+    t_active_host_perf = this;
+    for (int fd : this->m_fds) {
+        enable_counter(fd, true);
+    }
+    enable_counter(this->m_sampling_fd, true);
+}
+
+void hostperf::HostPerf::end(uint64_t inst_count) {
+    enable_counter(this->m_sampling_fd, false);
+    for (int fd : this->m_fds) {
+        enable_counter(fd, false);
+    }
+    t_active_host_perf = nullptr;
+
+    //The counters are never reset, so their values are already totals
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Counter::COUNT); ++i) {
+        this->m_totals[i] = read_counter(this->m_fds[i]);
+    }
+    this->m_guest_inst_count += inst_count - this->m_begin_inst_count;
+}
+
+uint64_t hostperf::HostPerf::total(Counter counter) const {
+    return this->m_totals[static_cast<uint8_t>(counter)];
+}
+
+uint64_t hostperf::HostPerf::phase_samples(Phase phase) const {
+    return this->m_phase_samples[static_cast<uint8_t>(phase)];
+}
+
+uint64_t hostperf::HostPerf::guest_inst_count() const {
+    return this->m_guest_inst_count;
+}
+
+void hostperf::HostPerf::handle_sample(int, siginfo_t*, void*) {
+    HostPerf* host_perf = t_active_host_perf;
+    if (host_perf) {
+        uint8_t phase = static_cast<uint8_t>(host_perf->m_phase);
+        if (phase < static_cast<uint8_t>(Phase::COUNT)) {
+            host_perf->m_phase_samples[phase] = host_perf->m_phase_samples[phase] + 1;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static int open_counter(hostperf::Counter counter, uint64_t sample_period) {
+#if defined(__linux__)
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+
+    auto cache_miss = [](uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    };
+    switch (counter) {
+        case hostperf::Counter::CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case hostperf::Counter::INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case hostperf::Counter::BRANCH_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case hostperf::Counter::L1D_READ_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache_miss(PERF_COUNT_HW_CACHE_L1D);
+            break;
+        case hostperf::Counter::LLC_READ_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache_miss(PERF_COUNT_HW_CACHE_LL);
+            break;
+        case hostperf::Counter::DTLB_READ_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache_miss(PERF_COUNT_HW_CACHE_DTLB);
+            break;
+        case hostperf::Counter::TASK_CLOCK:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_TASK_CLOCK;
+            break;
+        default:
+            return -1;
+    }
+
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;//Also means we need fewer privileges
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    if (sample_period) {
+        attr.sample_period = sample_period;
+        attr.wakeup_events = 1;
+    }
+
+    //This thread only, on any CPU
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+#else
+    (void)counter;
+    (void)sample_period;
+    return -1;
+#endif
+}
+
+static uint64_t read_counter(int fd) {
+#if defined(__linux__)
+    uint64_t values[3];//Value, time enabled, time running
+    if ((fd == -1) || (read(fd, values, sizeof(values)) != sizeof(values)) || !values[2]) {
+        return 0;
+    }
+
+    //If there were more counters than the host has, the kernel multiplexed them; scale to make up for it
+    if (values[1] == values[2]) {
+        return values[0];
+    } else {
+        return static_cast<uint64_t>(static_cast<double>(values[0]) * values[1] / values[2]);
+    }
+#else
+    (void)fd;
+    return 0;
+#endif
+}
+
+static void enable_counter(int fd, bool enable) {
+#if defined(__linux__)
+    if (fd != -1) {
+        ioctl(fd, enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+    }
+#else
+    (void)fd;
+    (void)enable;
+#endif
+}
@@ -0,0 +1,141 @@
+/**
+ * @brief   Host hardware performance counters around the emulator (Linux perf_event_open)
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * This measures IRVE itself rather than the guest: how many host cycles, instructions, branch
+ * misses, cache misses and dTLB misses each guest instruction costs. Counters are only enabled while
+ * emulator_t::run_until() is running, and only count the thread that created the HostPerf.
+ *
+ * To attribute time to the different parts of the interpreter, the emulator always stores which
+ * Phase it is in (a single byte store, which is cheaper than checking whether we are measuring).
+ * An extra sampling counter (host cycles, or the task clock if hardware counters aren't available,
+ * ex. in most VMs) sends a signal every so often, and the signal handler counts which Phase the
+ * emulator was in when it arrived.
+ *
+ * Any counters that can't be opened (ex. due to /proc/sys/kernel/perf_event_paranoid) are simply
+ * reported as unavailable.
+ *
+ * Emulators on different threads can each have their own HostPerf at the same time; the signal
+ * handler is process-wide, so it stays installed while any of them exist.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+#include <signal.h>
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal::hostperf {
+
+/**
+ * @brief What part of a tick the emulator is in
+*/
+enum class Phase : uint8_t {
+    OTHER = 0,  //Peripheral updates, checking for interrupts, run_until() itself, etc.
+    DECODE,     //Fetching (including the icache lookup) and decoding
+    EXECUTE,    //Executing anything other than loads, stores and AMOs
+    MEMORY,     //Executing loads, stores and AMOs (including address translation)
+    TRAP,       //Unwinding from exceptions and handling exceptions and interrupts
+    COUNT
+};
+
+/**
+ * @brief The host counters we try to open
+*/
+enum class Counter : uint8_t {
+    CYCLES = 0,
+    INSTRUCTIONS,
+    BRANCH_MISSES,
+    L1D_READ_MISSES,
+    LLC_READ_MISSES,
+    DTLB_READ_MISSES,
+    TASK_CLOCK,//In nanoseconds; a software counter, so it's usually available even when the others aren't
+    COUNT
+};
+
+/**
+ * @brief Owns the perf_event_open counters, and prints a report when destroyed
+*/
+class HostPerf {
+public:
+    /**
+     * @brief Open the counters (but don't start them) for the calling thread
+     * @param phase Where the emulator stores which Phase it is in; must outlive the HostPerf
+     * @note Must be created on the same thread that calls begin() and end()
+    */
+    HostPerf(const volatile Phase& phase);
+
+    /**
+     * @brief Print a report of everything counted and close the counters
+    */
+    ~HostPerf();
+
+    HostPerf(const HostPerf&) = delete;
+    HostPerf& operator=(const HostPerf&) = delete;
+
+    /**
+     * @brief Determine if at least one counter could be opened
+     * @return True if there is anything to measure
+    */
+    bool available() const;
+
+    /**
+     * @brief Start counting
+     * @param inst_count minstret, so we know how many guest instructions were executed
+    */
+    void begin(uint64_t inst_count);
+
+    /**
+     * @brief Stop counting and accumulate what was counted since begin()
+     * @param inst_count minstret
+    */
+    void end(uint64_t inst_count);
+
+    /**
+     * @brief Get the total of a counter accumulated so far
+     * @param counter Which counter
+     * @return The total (scaled if the kernel had to multiplex counters), or 0 if it's unavailable
+    */
+    uint64_t total(Counter counter) const;
+
+    /**
+     * @brief Get how many samples landed in a phase so far
+     * @param phase Which phase
+     * @return The number of samples
+    */
+    uint64_t phase_samples(Phase phase) const;
+
+    /**
+     * @brief Get how many guest instructions were executed between begin() and end() calls
+     * @return The number of guest instructions
+    */
+    uint64_t guest_inst_count() const;
+
+private:
+    static void handle_sample(int signal, siginfo_t* info, void* context);
+
+    const volatile Phase& m_phase;
+
+    int m_fds[static_cast<uint8_t>(Counter::COUNT)];
+    uint64_t m_totals[static_cast<uint8_t>(Counter::COUNT)];
+
+    int m_sampling_fd;
+    bool m_sampling_cycles;//Otherwise we're sampling the task clock
+    volatile uint64_t m_phase_samples[static_cast<uint8_t>(Phase::COUNT)];//Written by the signal handler
+
+    uint64_t m_begin_inst_count;
+    uint64_t m_guest_inst_count;
+};
+
+} // namespace irve::internal::hostperf
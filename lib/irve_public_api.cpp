@@ -16,15 +16,25 @@
 
 #include "irve_public_api.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 
+#include <cstdio>
+#include <stdexcept>
+#include <type_traits>
+
 #include "config.h"
 #include "emulator.h"
+#include "log_sink.h"
+#include "stats.h"
+#include "trace.h"
 
 #define INST_COUNT 0
 #include "logging.h"
 
+static_assert(std::is_same_v<irve::logging::callback_t, irve::internal::logging::sink_function_t>, "Log callbacks are passed straight through");
+
 //NO using statements here to make it obvious if we are refering to the internal namespace or the
 //public namespace
 
@@ -34,23 +44,64 @@
 
 //Namepace: irve::emulator
 
+//Everything that could log does so inside a ScopedThreadSink for the emulator's callback (which the
+//internal emulator_t picks up from the thread that constructs it)
+
 irve::emulator::emulator_t::emulator_t(int imagec, const char* const* imagev):
-    m_emulator_ptr(new irve::internal::emulator::emulator_t(imagec, imagev)) {}
+    emulator_t(imagec, imagev, "stdio", nullptr, nullptr) {}
+
+irve::emulator::emulator_t::emulator_t(int imagec, const char* const* imagev, const char* uart_backend_spec):
+    emulator_t(imagec, imagev, uart_backend_spec, nullptr, nullptr) {}
+
+irve::emulator::emulator_t::emulator_t(int imagec, const char* const* imagev, const char* uart_backend_spec,
+                                       irve::logging::callback_t log_callback, void* log_context) {
+    irve::internal::logging::ScopedThreadSink sink_scope({log_callback, log_context});
+    this->m_emulator_ptr = new irve::internal::emulator::emulator_t(imagec, imagev, uart_backend_spec);
+}
 
 irve::emulator::emulator_t::~emulator_t() {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
     delete this->m_emulator_ptr;
     this->m_emulator_ptr = nullptr;
 }
 
+bool irve::emulator::emulator_t::set_hart_count(uint32_t hart_count) {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    return this->m_emulator_ptr->set_hart_count(hart_count);
+}
+
+bool irve::emulator::emulator_t::set_virtual_time(uint64_t insts_per_tick) {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    return this->m_emulator_ptr->set_virtual_time(insts_per_tick);
+}
+
+bool irve::emulator::emulator_t::set_timebase_frequency(uint64_t frequency) {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    return this->m_emulator_ptr->set_timebase_frequency(frequency);
+}
+
+void irve::emulator::emulator_t::set_native_sbi(bool enable) {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    this->m_emulator_ptr->set_native_sbi(enable);
+}
+
+void irve::emulator::emulator_t::set_misaligned_access(bool enable) {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    this->m_emulator_ptr->set_misaligned_access(enable);
+}
+
 bool irve::emulator::emulator_t::tick() {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
     return this->m_emulator_ptr->tick();
 }
 
 void irve::emulator::emulator_t::run_until(uint64_t inst_count) {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
     this->m_emulator_ptr->run_until(inst_count);
 }
 
 void irve::emulator::emulator_t::run_gdbserver(uint16_t port) {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
     this->m_emulator_ptr->run_gdbserver(port);
 }
 
@@ -58,6 +109,75 @@ uint64_t irve::emulator::emulator_t::get_inst_count() const {
     return this->m_emulator_ptr->get_inst_count();
 }
 
+irve::emulator::stats_t irve::emulator::emulator_t::get_stats() const {
+    irve::internal::Stats internal_stats = this->m_emulator_ptr->get_stats();
+
+    irve::emulator::stats_t stats = {};
+    stats.inst_count = internal_stats.inst_count;
+    std::copy_n(internal_stats.insts_by_opcode, 32, stats.insts_by_opcode);
+    stats.icache_hits = internal_stats.icache_hits;
+    stats.icache_misses = internal_stats.icache_misses;
+    stats.icache_flushes = internal_stats.icache_flushes;
+    stats.tlb_hits = 0;
+    stats.tlb_misses = internal_stats.memory.translations;
+    stats.page_table_reads = internal_stats.memory.page_table_reads;
+    stats.pte_ad_updates = internal_stats.memory.pte_ad_updates;
+    std::copy_n(internal_stats.exceptions_by_cause, 16, stats.exceptions_by_cause);
+    std::copy_n(internal_stats.interrupts_by_cause, 16, stats.interrupts_by_cause);
+    stats.aclint_reads = internal_stats.memory.aclint_reads;
+    stats.aclint_writes = internal_stats.memory.aclint_writes;
+    stats.uart_reads = internal_stats.memory.uart_reads;
+    stats.uart_writes = internal_stats.memory.uart_writes;
+    stats.debug_writes = internal_stats.memory.debug_writes;
+    stats.peripheral_updates = internal_stats.peripheral_updates;
+    stats.peripheral_update_time_ns = internal_stats.peripheral_update_time_ns;
+    stats.wfi_sleeps = internal_stats.memory.wfi_sleeps;
+    stats.wfi_sleep_time_ns = internal_stats.memory.wfi_sleep_time_ns;
+    stats.native_sbi_calls = internal_stats.native_sbi_calls;
+    stats.misaligned_accesses = internal_stats.memory.misaligned_accesses;
+    return stats;
+}
+
+bool irve::emulator::emulator_t::start_trace(const char* trace_path) {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    return this->m_emulator_ptr->start_trace(trace_path);
+}
+
+void irve::emulator::emulator_t::stop_trace() {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    this->m_emulator_ptr->stop_trace();
+}
+
+bool irve::emulator::emulator_t::start_profiling(const char* output_path, uint32_t period) {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    return this->m_emulator_ptr->start_profiling(output_path, period);
+}
+
+void irve::emulator::emulator_t::stop_profiling() {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    this->m_emulator_ptr->stop_profiling();
+}
+
+bool irve::emulator::emulator_t::start_callgraph_profiling(const char* output_path) {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    return this->m_emulator_ptr->start_callgraph_profiling(output_path);
+}
+
+void irve::emulator::emulator_t::stop_callgraph_profiling() {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    this->m_emulator_ptr->stop_callgraph_profiling();
+}
+
+bool irve::emulator::emulator_t::start_host_perf() {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    return this->m_emulator_ptr->start_host_perf();
+}
+
+void irve::emulator::emulator_t::stop_host_perf() {
+    irve::internal::logging::ScopedThreadSink sink_scope(this->m_emulator_ptr->log_sink());
+    this->m_emulator_ptr->stop_host_perf();
+}
+
 //Namepace: irve::logging
 
 #if IRVE_INTERNAL_CONFIG_DISABLE_LOGGING
@@ -67,6 +187,10 @@ void irve::logging::log(uint8_t, const char*, ...) {}
 #else
 
 void irve::logging::log(uint8_t indent, const char* str, ...) {
+    if (!irve::internal::logging::enabled(irve::internal::logging::Subsystem::OTHER, indent)) {
+        return;//Don't bother formatting
+    }
+
     va_list list_copy_1;
     va_start(list_copy_1, str);
     va_list list_copy_2;
@@ -112,6 +236,10 @@ bool irve::logging::logging_disabled() {
     return IRVE_INTERNAL_CONFIG_DISABLE_LOGGING;
 }
 
+bool irve::logging::configure(const char* spec) {
+    return irve::internal::logging::configure(spec);
+}
+
 //Namepace: irve::about
 
 std::size_t irve::about::get_version_major() {
@@ -157,3 +285,30 @@ const char* irve::about::get_compiler_string() {
 bool irve::about::fuzzish_build() {
     return IRVE_INTERNAL_CONFIG_FUZZISH == 1;
 }
+
+//Namepace: irve::trace
+
+bool irve::trace::decode(const char* trace_path, const char* text_path) {
+    std::FILE* text_file = text_path ? std::fopen(text_path, "w") : stdout;
+    if (!text_file) {
+        return false;
+    }
+
+    bool success = true;
+    try {
+        irve::internal::trace::TraceReader reader(trace_path);
+        irve::internal::trace::Record record;
+        while (reader.next(record)) {
+            irve::internal::trace::print_record(text_file, record);
+        }
+    } catch (const std::runtime_error&) {
+        success = false;
+    }
+
+    if (text_path) {
+        success = (std::fclose(text_file) == 0) && success;
+    } else {
+        std::fflush(stdout);
+    }
+    return success;
+}
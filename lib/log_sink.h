@@ -0,0 +1,74 @@
+/**
+ * @brief   Where log messages go, per thread
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Separate from logging.h so classes can hold on to a Sink without needing INST_COUNT
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal::logging {
+
+/**
+ * @brief Receives log messages instead of stderr/stdout (the same signature as irve::logging::callback_t)
+ * @param context Whatever was given along with the function in the Sink
+ * @param guest_output True for output from the guest (which would otherwise go to stdout)
+*/
+typedef void (*sink_function_t)(void* context, uint64_t inst_num, uint8_t indent, const char* str, bool guest_output);
+
+/**
+ * @brief Where a thread's log messages go (stderr/stdout if function is null)
+*/
+struct Sink {
+    sink_function_t function;
+    void* context;
+};
+
+/**
+ * @brief The calling thread's Sink
+ * @note Don't use this directly; use ScopedThreadSink and current_thread_sink() instead
+*/
+extern constinit thread_local Sink t_sink;
+
+/**
+ * @brief Get where the calling thread's log messages are going at the moment
+*/
+inline Sink current_thread_sink() {
+    return t_sink;
+}
+
+/**
+ * @brief Sends the calling thread's log messages to a Sink until it goes out of scope
+ *
+ * This is how each emulator's logging is routed separately: everything that runs an emulator
+ * (or one of its helper threads) does so inside a ScopedThreadSink for that emulator's Sink.
+ * Messages sent to a Sink are formatted and delivered right away on the calling thread, even
+ * with async logging, so no state is shared with other threads.
+*/
+class ScopedThreadSink {
+public:
+    explicit ScopedThreadSink(Sink sink);
+    ~ScopedThreadSink();
+
+    ScopedThreadSink(const ScopedThreadSink&) = delete;
+    ScopedThreadSink& operator=(const ScopedThreadSink&) = delete;
+
+private:
+    Sink m_previous_sink;
+};
+
+} // namespace irve::internal::logging
@@ -19,120 +19,452 @@
 #define INST_COUNT this does not actually need to be defined with anything important before including logging.h in this case
 #include "logging.h"
 
-#include "tsqueue.h"
-
 #include <cassert>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdint>
 #include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <string>
 
 #if IRVE_INTERNAL_CONFIG_ASYNC_LOGGING
-#include <string>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include <thread>
-#include <atomic>
+#include <vector>
 #endif
 
 using namespace irve::internal;
 
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+//Indents are uint8_t, so this lets every message through
+#define THRESHOLD_ALL 256
+
+#define NUM_SUBSYSTEMS static_cast<std::size_t>(logging::Subsystem::COUNT)
+
+#if IRVE_INTERNAL_CONFIG_ASYNC_LOGGING
+
+//Per logging thread; a producer that fills its ring waits for the logging thread to catch up
+#define RING_BUFFER_SIZE (1024 * 1024)
+
+//Bigger records than this are formatted on the spot instead so they can never wedge a ring
+#define MAX_DEFERRED_RECORD_SIZE (RING_BUFFER_SIZE / 4)
+
+//Safety net in case the logging thread ever misses a wakeup
+#define LOGGING_THREAD_MAX_SLEEP_TIME std::chrono::milliseconds(100)
+
+#endif
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+#if IRVE_INTERNAL_CONFIG_ASYNC_LOGGING
+
+namespace {
+
+enum class RecordType : uint8_t {
+    PADDING,    //Skip to the start of the ring
+    DEFERRED,   //Packed arguments for the formatter follow
+    STRING      //An already-formatted string follows
+};
+
+struct RecordHeader {
+    std::size_t size;//Including this header
+    logging::deferred_formatter_t formatter;
+    FILE* destination;
+    uint64_t inst_num;
+    const char* str;
+    uint8_t indent;
+    RecordType type;
+};
+
+constexpr std::size_t HEADER_SIZE = logging::deferred::align_up(sizeof(RecordHeader));
+
+//Byte offsets are free-running and only reduced modulo RING_BUFFER_SIZE when indexing
+//If fewer than HEADER_SIZE bytes remain before the end of the ring, both sides implicitly skip them
+class ThreadRing {
+public:
+    ThreadRing() : m_buffer(new uint8_t[RING_BUFFER_SIZE]), m_head(0), m_tail(0), m_retired(false), m_reserved_tail(0), m_reserved_size(0) {}
+
+    std::unique_ptr<uint8_t[]> m_buffer;
+    alignas(64) std::atomic<std::size_t> m_head;//Written by the logging thread only
+    alignas(64) std::atomic<std::size_t> m_tail;//Written by the owning thread only
+    std::atomic<bool> m_retired;//Set once the owning thread exits; we free the ring after draining it
+
+    //Owning thread only
+    std::size_t m_reserved_tail;//Where the record being built starts
+    std::size_t m_reserved_size;//And how big it is
+};
+
+class AsyncLogger {
+public:
+    AsyncLogger();
+    ~AsyncLogger();
+
+    std::shared_ptr<ThreadRing> register_thread();
+    void wake_if_sleeping();
+
+private:
+    void logging_thread_function();
+    bool drain_all();//Returns true if anything was logged
+    bool any_pending();
+
+    std::mutex m_rings_mutex;
+    std::vector<std::shared_ptr<ThreadRing>> m_rings;
+
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_sleep_condition_variable;
+    std::atomic<bool> m_sleeping;
+    std::atomic<bool> m_thread_should_keep_running;
+    std::thread m_thread;
+};
+
+//Marks the thread's ring as retired when the thread exits
+struct ThreadRingHandle {
+    std::shared_ptr<ThreadRing> ring;
+    ~ThreadRingHandle() {
+        if (this->ring) {
+            this->ring->m_retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+}
+
+#endif
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Variables
+ * --------------------------------------------------------------------------------------------- */
+
+//In the same order as logging::Subsystem
+static const char* const SUBSYSTEM_NAMES[] = {"other", "memory", "decode", "execute", "csr", "uart", "gdbserver"};
+static_assert((sizeof(SUBSYSTEM_NAMES) / sizeof(SUBSYSTEM_NAMES[0])) == NUM_SUBSYSTEMS, "Missing subsystem name");
+
+#if IRVE_INTERNAL_CONFIG_ASYNC_LOGGING
+static thread_local ThreadRingHandle t_ring_handle;
+static thread_local std::vector<uint8_t> t_oversized_record;//Used instead of the ring for records that are too big
+static thread_local bool t_using_oversized_record = false;
+#endif
+
 /* ------------------------------------------------------------------------------------------------
  * Static Function Declarations
  * --------------------------------------------------------------------------------------------- */
 
 static void actual_log_function(FILE* destination, uint64_t inst_num, uint8_t indent, const char* str);
 
+#if IRVE_INTERNAL_CONFIG_ASYNC_LOGGING
+static AsyncLogger& get_async_logger();
+static void log_record(const RecordHeader& header, const uint8_t* payload);
+#endif
+
 /* ------------------------------------------------------------------------------------------------
  * Function Implementations
  * --------------------------------------------------------------------------------------------- */
 
-void logging::irvelog_internal_variadic_function_dont_use_this_directly(FILE* destination, uint64_t inst_num, uint8_t indent, const char* str, ...) {
-    //TODO in async logging try to do this on the logging thread
-    va_list list_copy_1;
-    va_start(list_copy_1, str);
-    va_list list_copy_2;
-    va_copy(list_copy_2, list_copy_1);
+//Verbose logging is compiled in by default, so it starts off to keep the output (and the emulator) quiet
+std::atomic<uint16_t> logging::g_thresholds[NUM_SUBSYSTEMS] = {0, 0, 0, 0, 0, 0, 0};
+
+bool logging::configure(const char* spec) {
+    assert(spec && "Attempt to configure logging with null spec");
+    std::string spec_string(spec);
 
-    //Perform variable argument string formatting into a buffer
-    std::size_t buffer_size = std::vsnprintf(nullptr, 0, str, list_copy_1) + 1;//vsnprintf doesn't count the null terminator
-    va_end(list_copy_1);
-    char* buffer = (char*)std::malloc(buffer_size);
-    std::vsnprintf(buffer, buffer_size, str, list_copy_2);
-    va_end(list_copy_2);
+    uint16_t new_thresholds[NUM_SUBSYSTEMS];
+    if (spec_string == "all") {
+        std::fill_n(new_thresholds, NUM_SUBSYSTEMS, THRESHOLD_ALL);
+    } else if (spec_string == "off") {
+        std::fill_n(new_thresholds, NUM_SUBSYSTEMS, 0);
+    } else {
+        //The max indent comes first
+        std::size_t colon_pos = spec_string.find(':');
+        std::string max_indent_string = spec_string.substr(0, colon_pos);
+        if (max_indent_string.empty() || (max_indent_string.find_first_not_of("0123456789") != std::string::npos)) {
+            return false;
+        }
+        unsigned long max_indent = std::strtoul(max_indent_string.c_str(), nullptr, 10);
+        uint16_t threshold = (max_indent >= (THRESHOLD_ALL - 1)) ? THRESHOLD_ALL : static_cast<uint16_t>(max_indent + 1);
 
-    //Actually log the string
-    irvelog_internal_function_dont_use_this_directly(destination, inst_num, indent, buffer);
+        if (colon_pos == std::string::npos) {//Every subsystem
+            std::fill_n(new_thresholds, NUM_SUBSYSTEMS, threshold);
+        } else {//Just the listed subsystems
+            std::fill_n(new_thresholds, NUM_SUBSYSTEMS, 0);
+            std::string subsystems = spec_string.substr(colon_pos + 1);
+            std::size_t start = 0;
+            while (true) {
+                std::size_t comma_pos = subsystems.find(',', start);
+                std::string name = subsystems.substr(start, comma_pos - start);
 
-    //Free the buffer
-    std::free(buffer);
+                std::size_t i = 0;
+                while ((i < NUM_SUBSYSTEMS) && (name != SUBSYSTEM_NAMES[i])) {
+                    ++i;
+                }
+                if (i == NUM_SUBSYSTEMS) {
+                    return false;//Unknown subsystem
+                }
+                new_thresholds[i] = threshold;
+
+                if (comma_pos == std::string::npos) {
+                    break;
+                }
+                start = comma_pos + 1;
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < NUM_SUBSYSTEMS; ++i) {
+        g_thresholds[i].store(new_thresholds[i], std::memory_order_relaxed);
+    }
+    return true;
+}
+
+constinit thread_local logging::Sink logging::t_sink = {nullptr, nullptr};
+
+logging::ScopedThreadSink::ScopedThreadSink(Sink sink) : m_previous_sink(t_sink) {
+    t_sink = sink;
+}
+
+logging::ScopedThreadSink::~ScopedThreadSink() {
+    t_sink = this->m_previous_sink;
 }
 
 void logging::irvelog_internal_function_dont_use_this_directly(FILE* destination, uint64_t inst_num, uint8_t indent, const char* str) {
     assert(destination && "Attempt to log to null destination file");
     assert(str && "Attempt to log with null string");
 
+    if (t_sink.function) {
+        t_sink.function(t_sink.context, inst_num, indent, str, destination == stdout);
+        return;
+    }
+
 #if IRVE_INTERNAL_CONFIG_ASYNC_LOGGING
-    class AsyncLogger {
-        private:
-            tsqueue::tsqueue_t<std::tuple<FILE*, uint64_t, uint8_t, std::string>> m_queue;
-            std::atomic<bool> m_thread_should_keep_running;
-            std::thread m_thread;
-        public:
-            AsyncLogger() : m_thread_should_keep_running(true), m_thread([&]() {
-                //Main logging loop
-                while (true) {
-                    if (this->m_queue.empty()) {
-                        if (this->m_thread_should_keep_running.load()) {
-                            //Yield so as to not absolutely burn CPU time
-                            std::this_thread::yield();
-                        } else {//The queue is empty and will never be filled again (our backlog is empty forever)
-                            return;//So exit the thread
-                        }
-                    } else {//The queue is not empty
-                        //Pop the front element from the queue
-                        auto [destination, inst_num, indent, str] = m_queue.front();
-                        m_queue.pop();
-
-                        //Log the popped element
-                        actual_log_function(destination, inst_num, indent, str.c_str());
-                    }
-                }
-            })
-            {}
+    //We don't know how long str will be around, so copy it
+    std::size_t length = std::strlen(str) + 1;
+    uint8_t* payload = deferred_log_reserve(length);
+    std::memcpy(payload, str, length);
+    deferred_log_commit(destination, inst_num, indent, nullptr, nullptr);
+#else//Non-async logging
+    actual_log_function(destination, inst_num, indent, str);
+#endif
+}
 
-            ~AsyncLogger() {
-                m_thread_should_keep_running.store(false);
-                m_thread.join();//Wait for the thread to finish its backlog
-            }
+#if IRVE_INTERNAL_CONFIG_ASYNC_LOGGING
 
-            void enqueue_log_request(FILE* destination, uint64_t inst_num, uint8_t indent, std::string str) {
-                m_queue.emplace(destination, inst_num, indent, str);
-            }
+uint8_t* logging::deferred_log_reserve(std::size_t packed_args_size) {
+    std::size_t record_size = HEADER_SIZE + deferred::align_up(packed_args_size);
+    if (record_size > MAX_DEFERRED_RECORD_SIZE) {
+        t_oversized_record.resize(record_size);
+        t_using_oversized_record = true;
+        return t_oversized_record.data() + HEADER_SIZE;
+    }
+
+    if (!t_ring_handle.ring) {
+        t_ring_handle.ring = get_async_logger().register_thread();
+    }
+    ThreadRing& ring = *t_ring_handle.ring;
+
+    //Records never wrap around the end of the ring
+    std::size_t tail = ring.m_tail.load(std::memory_order_relaxed);
+    std::size_t offset = tail % RING_BUFFER_SIZE;
+    std::size_t remaining = RING_BUFFER_SIZE - offset;
+    std::size_t skip = (remaining < record_size) ? remaining : 0;
+
+    //Wait for the logging thread to make room if we've gotten too far ahead of it
+    while (((tail + skip + record_size) - ring.m_head.load(std::memory_order_acquire)) > RING_BUFFER_SIZE) {
+        get_async_logger().wake_if_sleeping();
+        std::this_thread::yield();
+    }
+
+    if (skip >= HEADER_SIZE) {//Otherwise the logging thread skips the leftover bytes implicitly
+        RecordHeader padding = {};
+        padding.size = skip;
+        padding.type = RecordType::PADDING;
+        std::memcpy(ring.m_buffer.get() + offset, &padding, sizeof(padding));
+    }
+
+    ring.m_reserved_tail = tail + skip;
+    ring.m_reserved_size = record_size;
+    return ring.m_buffer.get() + (ring.m_reserved_tail % RING_BUFFER_SIZE) + HEADER_SIZE;
+}
+
+void logging::deferred_log_commit(FILE* destination, uint64_t inst_num, uint8_t indent, const char* str, deferred_formatter_t formatter) {
+    RecordHeader header = {
+        .size           = 0,
+        .formatter      = formatter,
+        .destination    = destination,
+        .inst_num       = inst_num,
+        .str            = str,
+        .indent         = indent,
+        .type           = formatter ? RecordType::DEFERRED : RecordType::STRING
     };
 
-    static AsyncLogger async_logger;//We make this static so the thread lasts for the entirety of IRVE's execution
-    async_logger.enqueue_log_request(destination, inst_num, indent, str);
-#else//Non-async logging
-    actual_log_function(destination, inst_num, indent, str);
-#endif
+    if (t_using_oversized_record) {
+        t_using_oversized_record = false;
+        log_record(header, t_oversized_record.data() + HEADER_SIZE);
+        return;
+    }
+
+    ThreadRing& ring = *t_ring_handle.ring;
+    std::size_t record_start = ring.m_reserved_tail;
+    header.size = ring.m_reserved_size;
+    std::memcpy(ring.m_buffer.get() + (record_start % RING_BUFFER_SIZE), &header, sizeof(header));
+
+    ring.m_tail.store(record_start + header.size, std::memory_order_release);
+    get_async_logger().wake_if_sleeping();
 }
 
+#endif
+
 /* ------------------------------------------------------------------------------------------------
  * Static Function Implementations
  * --------------------------------------------------------------------------------------------- */
 
+#if IRVE_INTERNAL_CONFIG_ASYNC_LOGGING
+
+AsyncLogger::AsyncLogger() :
+    m_sleeping(false),
+    m_thread_should_keep_running(true),
+    m_thread(&AsyncLogger::logging_thread_function, this)
+{}
+
+AsyncLogger::~AsyncLogger() {
+    this->m_thread_should_keep_running.store(false);
+    {
+        std::lock_guard<std::mutex> lock(this->m_sleep_mutex);
+        this->m_sleep_condition_variable.notify_one();
+    }
+    this->m_thread.join();//Wait for the thread to finish its backlog
+}
+
+std::shared_ptr<ThreadRing> AsyncLogger::register_thread() {
+    auto ring = std::make_shared<ThreadRing>();
+    std::lock_guard<std::mutex> lock(this->m_rings_mutex);
+    this->m_rings.push_back(ring);
+    return ring;
+}
+
+void AsyncLogger::wake_if_sleeping() {
+    //Pairs with the fence in logging_thread_function(): either it sees our new record, or we see it's asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->m_sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(this->m_sleep_mutex);
+        this->m_sleep_condition_variable.notify_one();
+    }
+}
+
+void AsyncLogger::logging_thread_function() {
+    while (true) {
+        if (this->drain_all()) {
+            continue;
+        }
+
+        if (!this->m_thread_should_keep_running.load()) {//Our backlog is empty and will never be filled again
+            return;
+        }
+
+        //Nothing to do, so sleep until a producer wakes us rather than burning CPU time
+        std::unique_lock<std::mutex> lock(this->m_sleep_mutex);
+        this->m_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!this->any_pending() && this->m_thread_should_keep_running.load()) {
+            this->m_sleep_condition_variable.wait_for(lock, LOGGING_THREAD_MAX_SLEEP_TIME);
+        }
+        this->m_sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+bool AsyncLogger::drain_all() {
+    bool logged_anything = false;
+    std::lock_guard<std::mutex> lock(this->m_rings_mutex);
+    for (auto it = this->m_rings.begin(); it != this->m_rings.end();) {
+        ThreadRing& ring = **it;
+        bool retired = ring.m_retired.load(std::memory_order_acquire);//Check before draining so we don't miss anything
+
+        std::size_t head = ring.m_head.load(std::memory_order_relaxed);
+        std::size_t tail = ring.m_tail.load(std::memory_order_acquire);
+        while (head != tail) {
+            std::size_t offset = head % RING_BUFFER_SIZE;
+            if ((RING_BUFFER_SIZE - offset) < HEADER_SIZE) {//Implicit padding
+                head += RING_BUFFER_SIZE - offset;
+                continue;
+            }
+
+            RecordHeader header;
+            std::memcpy(&header, ring.m_buffer.get() + offset, sizeof(header));
+            if (header.type != RecordType::PADDING) {
+                log_record(header, ring.m_buffer.get() + offset + HEADER_SIZE);
+                logged_anything = true;
+            }
+            head += header.size;
+            ring.m_head.store(head, std::memory_order_release);//Give the space back as soon as possible
+        }
+
+        if (retired) {
+            it = this->m_rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return logged_anything;
+}
+
+bool AsyncLogger::any_pending() {
+    std::lock_guard<std::mutex> lock(this->m_rings_mutex);
+    for (const auto& ring : this->m_rings) {
+        if (ring->m_head.load(std::memory_order_relaxed) != ring->m_tail.load(std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static AsyncLogger& get_async_logger() {
+    static AsyncLogger async_logger;//We make this static so the thread lasts for the entirety of IRVE's execution
+    return async_logger;
+}
+
+static void log_record(const RecordHeader& header, const uint8_t* payload) {
+    if (header.type == RecordType::STRING) {
+        actual_log_function(header.destination, header.inst_num, header.indent, reinterpret_cast<const char*>(payload));
+        return;
+    }
+
+    char buffer[1024];
+    int length = header.formatter(buffer, sizeof(buffer), header.str, payload);
+    if ((length < 0) || (static_cast<std::size_t>(length) < sizeof(buffer))) {
+        actual_log_function(header.destination, header.inst_num, header.indent, buffer);
+    } else {
+        std::string long_buffer(static_cast<std::size_t>(length), '\0');
+        header.formatter(long_buffer.data(), long_buffer.size() + 1, header.str, payload);
+        actual_log_function(header.destination, header.inst_num, header.indent, long_buffer.c_str());
+    }
+}
+
+#endif
+
 static void actual_log_function(FILE* destination, uint64_t inst_num, uint8_t indent, const char* str) {
     assert(destination && "Attempt to log to null destination file");
     assert(str && "Attempt to log with null string");
 
+    //Build the whole line first and write it with a single call; stdio locks the file for each call,
+    //so this keeps lines logged from different threads at the same time from getting mixed together
+    char prefix[64];
     if (inst_num) {
-        std::fprintf(destination, "\x1b[94m%llu\x1b[1;90m>\x1b[0m ", (long long unsigned int) inst_num);
+        std::snprintf(prefix, sizeof(prefix), "\x1b[94m%llu\x1b[1;90m>\x1b[0m ", (long long unsigned int) inst_num);
     } else {
-        std::fprintf(destination, "\x1b[94mIRVE\x1b[1;90m>\x1b[0m ");
-    }
-
-    while (indent--) {
-        std::fprintf(destination, "  ");
+        std::snprintf(prefix, sizeof(prefix), "\x1b[94mIRVE\x1b[1;90m>\x1b[0m ");
     }
 
-    std::fprintf(destination, "%s\n", str);
+    std::string line(prefix);
+    line.append(static_cast<std::size_t>(indent) * 2, ' ');
+    line += str;
+    line += '\n';
+    std::fwrite(line.data(), 1, line.size(), destination);
 }
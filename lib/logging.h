@@ -21,7 +21,15 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
 #include "config.h"
+#include "log_sink.h"
 
 /* ------------------------------------------------------------------------------------------------
  * Constants/Defines
@@ -31,10 +39,19 @@
 #error "INST_COUNT must be defined before including logging.h"
 #endif
 
+//Define this to one of the logging::Subsystem values before including logging.h so irvelog
+//messages from the file can be filtered at runtime
+#ifndef LOG_SUBSYSTEM
+#define LOG_SUBSYSTEM OTHER
+#endif
+
 /** \def irvelog(indent, ...)
- * @brief Logs a message to stderr when logging is enabled
+ * @brief Logs a message to stderr when logging is enabled, and LOG_SUBSYSTEM is currently logging
+ *        messages of this indentation level
  * @param indent The indentation level of the message
  * @param ... The message to log, and any additional format arguments
+ *
+ * The runtime check happens before the message is formatted (or INST_COUNT is evaluated)
 */
 
 /** \def irvelog_always(indent, ...)
@@ -53,8 +70,6 @@
  * The magic of __VA_OPT__ automatically chooses the more efficient function if there are no variadic arguments
 */
 
-//TODO add verbosity support
-
 #if IRVE_INTERNAL_CONFIG_DISABLE_LOGGING
 
 //Compiles down to nothing, but prevents warnings/errors if logging is disabled
@@ -64,7 +79,9 @@
 #else//Logging is enabled
 
 #define irvelog(indent, ...) do { \
-    irvelog_always(indent, __VA_ARGS__); \
+    if (irve::internal::logging::enabled(irve::internal::logging::Subsystem::LOG_SUBSYSTEM, indent)) [[unlikely]] { \
+        irvelog_always(indent, __VA_ARGS__); \
+    } \
 } while (0)
 
 #endif
@@ -88,6 +105,47 @@
  * --------------------------------------------------------------------------------------------- */
 
 namespace irve::internal::logging {
+    /**
+     * @brief The parts of IRVE whose irvelog messages can be turned on and off independently
+    */
+    enum class Subsystem : uint8_t {
+        OTHER,
+        MEMORY,
+        DECODE,
+        EXECUTE,
+        CSR,
+        UART,
+        GDBSERVER,
+        COUNT
+    };
+
+    /**
+     * @brief Per subsystem, messages with an indent below this are logged (so 0 silences the subsystem)
+     * @note Don't use this directly; use enabled() and configure() instead
+    */
+    extern std::atomic<uint16_t> g_thresholds[static_cast<std::size_t>(Subsystem::COUNT)];
+
+    /**
+     * @brief Check if a message from subsystem at indentation level indent should be logged
+    */
+    inline bool enabled(Subsystem subsystem, uint8_t indent) {
+        return indent < g_thresholds[static_cast<std::size_t>(subsystem)].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Change which irvelog messages are logged at runtime (nothing is logged by default)
+     * @param spec "all", "off", "<max indent>" (every subsystem), or "<max indent>:<subsystem>[,<subsystem>...]"
+     *             (just those subsystems, the rest are silenced). Subsystems are other, memory, decode,
+     *             execute, csr, uart, and gdbserver.
+     * @return False (leaving the current settings unchanged) if spec is invalid
+    */
+    bool configure(const char* spec);
+
+    /**
+     * @brief Formats a deferred log record's packed arguments into buffer (snprintf semantics)
+    */
+    typedef int (*deferred_formatter_t)(char* buffer, std::size_t buffer_size, const char* str, const uint8_t* packed_args);
+
     /**
      * @brief Don't use this function directly. Use the irvelog family of macros instead.
      * @param destination The file to log to
@@ -104,10 +162,117 @@ namespace irve::internal::logging {
      * @param destination The file to log to
      * @param inst_num The current instruction number
      * @param indent The indentation level of the message
-     * @param str The message to log
-     * @param ... Any additional format arguments (if any)
+     * @param str The message to log (must be a string literal with async logging, since it is formatted later)
+     * @param args Any additional format arguments (if any)
      *
-     * The slower version that supports variadic arguments
+     * The slower version that supports variadic arguments. With async logging, the arguments are
+     * just copied into a per-thread ring buffer and the logging thread does the formatting.
     */
-    void irvelog_internal_variadic_function_dont_use_this_directly(FILE* destination, uint64_t inst_num, uint8_t indent, const char* str, ...);
+    template<typename... Args>
+    void irvelog_internal_variadic_function_dont_use_this_directly(FILE* destination, uint64_t inst_num, uint8_t indent, const char* str, const Args&... args);
+
+    /**
+     * @brief Reserves space for a record in the calling thread's ring buffer (async logging only)
+     * @param packed_args_size The number of bytes needed for the record's packed arguments
+     * @return Where to pack the arguments to
+    */
+    uint8_t* deferred_log_reserve(std::size_t packed_args_size);
+
+    /**
+     * @brief Hands the record reserved by the last deferred_log_reserve() call to the logging thread
+    */
+    void deferred_log_commit(FILE* destination, uint64_t inst_num, uint8_t indent, const char* str, deferred_formatter_t formatter);
+
+    //Packing and unpacking of arguments for deferred formatting
+    //C strings are copied since they may not be around by the time the logging thread gets to them;
+    //everything else is copied as-is
+    namespace deferred {
+        template<typename T>
+        constexpr bool is_c_string_v = std::is_same_v<std::decay_t<T>, char*> || std::is_same_v<std::decay_t<T>, const char*>;
+
+        template<typename T>
+        using unpacked_t = std::conditional_t<is_c_string_v<T>, const char*, std::decay_t<T>>;
+
+        constexpr std::size_t ALIGNMENT = 8;
+
+        constexpr std::size_t align_up(std::size_t size) {
+            return (size + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
+        }
+
+        template<typename T>
+        std::size_t packed_size(const T& arg) {
+            const std::decay_t<const T> value = arg;//Arrays to pointers, functions to function pointers, etc.
+            if constexpr (is_c_string_v<T>) {
+                return align_up(std::strlen(value ? value : "(null)") + 1);
+            } else {
+                static_assert(std::is_trivially_copyable_v<decltype(value)> && (alignof(decltype(value)) <= ALIGNMENT), "Unsupported log argument type");
+                return align_up(sizeof(value));
+            }
+        }
+
+        template<typename T>
+        uint8_t* pack(uint8_t* destination, const T& arg) {
+            const std::decay_t<const T> value = arg;
+            if constexpr (is_c_string_v<T>) {
+                const char* string = value ? value : "(null)";
+                std::size_t length = std::strlen(string) + 1;
+                std::memcpy(destination, string, length);
+                return destination + align_up(length);
+            } else {
+                std::memcpy(destination, &value, sizeof(value));
+                return destination + align_up(sizeof(value));
+            }
+        }
+
+        template<typename T>
+        unpacked_t<T> unpack(const uint8_t*& source) {
+            if constexpr (is_c_string_v<T>) {
+                const char* string = reinterpret_cast<const char*>(source);
+                source += align_up(std::strlen(string) + 1);
+                return string;
+            } else {
+                std::decay_t<T> arg;
+                std::memcpy(&arg, source, sizeof(arg));
+                source += align_up(sizeof(arg));
+                return arg;
+            }
+        }
+
+        template<typename... Args>
+        int format(char* buffer, std::size_t buffer_size, const char* str, const uint8_t* packed_args) {
+            //Braced initialization guarantees the arguments are unpacked left to right
+            std::tuple<unpacked_t<Args>...> args{unpack<Args>(packed_args)...};
+            return std::apply([&](const auto&... unpacked_args) {
+                return std::snprintf(buffer, buffer_size, str, unpacked_args...);
+            }, args);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+//NOTE: Must be in header file because this is templated
+
+template<typename... Args>
+void irve::internal::logging::irvelog_internal_variadic_function_dont_use_this_directly(FILE* destination, uint64_t inst_num, uint8_t indent, const char* str, const Args&... args) {
+#if IRVE_INTERNAL_CONFIG_ASYNC_LOGGING
+    if (!t_sink.function) [[likely]] {
+        uint8_t* packed_args = deferred_log_reserve((std::size_t(0) + ... + deferred::packed_size(args)));
+        ((packed_args = deferred::pack(packed_args, args)), ...);
+        deferred_log_commit(destination, inst_num, indent, str, &deferred::format<Args...>);
+        return;
+    }
+#endif
+
+    //Most messages fit on the stack, so only fall back to the heap for the odd long one
+    char buffer[512];
+    int length = std::snprintf(buffer, sizeof(buffer), str, args...);
+    if ((length < 0) || (static_cast<std::size_t>(length) < sizeof(buffer))) {
+        irvelog_internal_function_dont_use_this_directly(destination, inst_num, indent, buffer);
+    } else {
+        std::string long_buffer(static_cast<std::size_t>(length), '\0');
+        std::snprintf(long_buffer.data(), long_buffer.size() + 1, str, args...);
+        irvelog_internal_function_dont_use_this_directly(destination, inst_num, indent, long_buffer.c_str());
+    }
 }
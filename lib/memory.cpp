@@ -14,16 +14,24 @@
 
 #include "memory.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <iostream>
 #include <cstring>
 #include <memory>
+#include <mutex>
 #include <fstream>
 #include <string>
 #include <cstdlib>
 #include <cstdio>
+#include <new>
 #include <vector>
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "csr.h"
 #include "common.h"
 #include "memory_map.h"
@@ -31,6 +39,7 @@
 #include "fuzzish.h"
 #include "uart.h"
 
+#define LOG_SUBSYSTEM MEMORY
 #define INST_COUNT 0 // We only log at init
 #include "logging.h"
 
@@ -40,6 +49,10 @@ using namespace irve::internal;
  * Constants/Defines
  * --------------------------------------------------------------------------------------------- */
 
+// The longest a WFI sleeps for (WFI can complete for no reason at any time, so this just means
+// callers like emulator_t::tick() and other harts' threads being told to stop never block for long)
+constexpr std::chrono::milliseconds MAX_WFI_SLEEP(10);
+
 // The directory where test files are located
 //FIXME this should be moved to config.h
 #define TESTFILES_DIR   "rvsw/compiled/"
@@ -71,6 +84,9 @@ using namespace irve::internal;
 //Previous privilige mode field of the mstatus CSR
 #define mstatus_MPP     (m_CSR_ref.implicit_read(Csr::Address::MSTATUS).bits(12, 11).u)
 
+//A/D Update Enable field of the menvcfg CSR (Svadu, bit 61 of menvcfg so bit 29 of menvcfgh)
+#define menvcfg_ADUE    (m_CSR_ref.implicit_read(Csr::Address::MENVCFGH).bit(29).u)
+
 //The virtual page number (VPN) of a virtual address (va)
 #define va_VPN(i)       ((uint64_t)va.bits(21 + (10 * i), 12 + (10 * i)).u)
 
@@ -116,56 +132,132 @@ using namespace irve::internal;
 
 #define PAGE_FAULT_BASE 12
 
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief       Map a region of guest RAM.
+ * @param[in]   size The size of the region in bytes.
+ * @param[in]   fuzzish_template_offset Where the region's initial contents start in the fuzzish
+ *              template (fuzzish builds only).
+ * @return      The region (zeroed, or random in fuzzish builds).
+*/
+static std::unique_ptr<uint8_t[], RamDeleter> allocate_ram(uint64_t size, uint64_t fuzzish_template_offset);
+
+/**
+ * @brief       Load from guest RAM.
+ * @note        Other harts may access RAM at the same time, so every access is a relaxed atomic one
+ *              (which on common hosts compiles to the same plain load or store anyway).
+ * @param[in]   ptr Where in guest RAM to load from (aligned).
+ * @return      The data.
+*/
+template <typename T>
+static inline T load_ram(void* ptr) {
+    return std::atomic_ref<T>(*static_cast<T*>(ptr)).load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief       Store to guest RAM (see load_ram()).
+ * @param[in]   ptr Where in guest RAM to store to (aligned).
+ * @param[in]   data The data.
+*/
+template <typename T>
+static inline void store_ram(void* ptr, T data) {
+    std::atomic_ref<T>(*static_cast<T*>(ptr)).store(data, std::memory_order_relaxed);
+}
+
+/**
+ * @brief       Get the address bits that must be zero for an access to be aligned.
+ * @param[in]   data_type The data type of the access.
+ * @return      0 for bytes, 0b1 for halfwords and 0b11 for words.
+*/
+static inline uint32_t misaligned_mask(uint8_t data_type);
+
+#if IRVE_INTERNAL_CONFIG_FUZZISH && defined(__linux__)
+/**
+ * @brief       Get a file full of random bytes to map guest RAM from, creating it the first time.
+ * @return      Its file descriptor, or -1 if it couldn't be created.
+*/
+static int get_fuzzish_ram_template_fd();
+#endif
+
 /* ------------------------------------------------------------------------------------------------
  * Function Implementations
  * --------------------------------------------------------------------------------------------- */
 
+void RamDeleter::operator()(uint8_t* ram) const {
+    munmap(ram, this->size);
+}
+
 Memory::Memory(Csr& CSR_ref):
         m_CSR_ref(CSR_ref),
-        m_user_ram(new uint8_t[MEM_MAP_REGION_SIZE_USER_RAM]),
-        m_kernel_ram(new uint8_t[MEM_MAP_REGION_SIZE_KERNEL_RAM]),
-        m_aclint(CSR_ref),
-        m_uart(),
-        m_output_line_buffer() {
+        m_hart0_memory(nullptr),
+        m_user_ram(allocate_ram(MEM_MAP_REGION_SIZE_USER_RAM, 0)),
+        m_kernel_ram(allocate_ram(MEM_MAP_REGION_SIZE_KERNEL_RAM, MEM_MAP_REGION_SIZE_USER_RAM)),
+        m_aclint(std::make_shared<Aclint>(CSR_ref)),
+        m_uart(std::make_shared<Uart>("stdio", &CSR_ref.doorbell())),
+        m_output_line_buffer(),
+        m_debug_output_capture(nullptr),
+        m_sleep_in_wfi(true),
+        m_emulate_misaligned(false),
+        m_stats() {
 
     //Check endianness of host (only little-endian hosts are supported)
     [[maybe_unused]] const union {uint8_t bytes[4]; uint32_t value;} host_order = {{0, 1, 2, 3}};
     assert((host_order.value == 0x03020100) && "Host endianness not supported");
 
-    //Initialize all ram to random values
-    irve_fuzzish_meminit(this->m_user_ram.get(), MEM_MAP_REGION_SIZE_USER_RAM);
-    irve_fuzzish_meminit(this->m_kernel_ram.get(), MEM_MAP_REGION_SIZE_KERNEL_RAM);
-
     irvelog(1, "Created new Memory instance");
 }
 
-Memory::Memory(int imagec, const char* const* imagev, Csr& CSR_ref):
+Memory::Memory(int imagec, const char* const* imagev, Csr& CSR_ref, const char* uart_backend_spec):
     m_CSR_ref(CSR_ref),
-    m_user_ram(new uint8_t[MEM_MAP_REGION_SIZE_USER_RAM]),
-    m_kernel_ram(new uint8_t[MEM_MAP_REGION_SIZE_KERNEL_RAM]),
-    m_aclint(CSR_ref),
-    m_uart(),
-    m_output_line_buffer()
+    m_hart0_memory(nullptr),
+    m_user_ram(allocate_ram(MEM_MAP_REGION_SIZE_USER_RAM, 0)),
+    m_kernel_ram(allocate_ram(MEM_MAP_REGION_SIZE_KERNEL_RAM, MEM_MAP_REGION_SIZE_USER_RAM)),
+    m_aclint(std::make_shared<Aclint>(CSR_ref)),
+    m_uart(std::make_shared<Uart>(uart_backend_spec, &CSR_ref.doorbell())),
+    m_output_line_buffer(),
+    m_debug_output_capture(nullptr),
+    m_sleep_in_wfi(true),
+    m_emulate_misaligned(false),
+    m_stats()
 {
 
     //Check endianness of host (only little-endian hosts are supported)
     [[maybe_unused]] const union {uint8_t bytes[4]; uint32_t value;} host_order = {{0, 1, 2, 3}};
     assert((host_order.value == 0x03020100) && "Host endianness not supported");
 
-    //Initialize all ram to random values
-    irve_fuzzish_meminit(this->m_user_ram.get(), MEM_MAP_REGION_SIZE_USER_RAM);
-    irve_fuzzish_meminit(this->m_kernel_ram.get(), MEM_MAP_REGION_SIZE_KERNEL_RAM);
-
     //Load memory images and throw an exception if an error occured
     image_load_status_t load_status;
     load_status = load_memory_image_files(imagec, imagev);
     if (load_status == IL_FAIL) {
         throw std::exception();
     }
+    this->m_symbols.sort();
 
     irvelog(1, "Created new Memory instance");
 }
 
+Memory::Memory(Memory& hart0_memory, Csr& CSR_ref):
+    m_CSR_ref(CSR_ref),
+    m_hart0_memory(&hart0_memory),
+    m_user_ram(hart0_memory.m_user_ram),
+    m_kernel_ram(hart0_memory.m_kernel_ram),
+    m_aclint(hart0_memory.m_aclint),
+    m_uart(hart0_memory.m_uart),
+    m_output_line_buffer(),
+    m_debug_output_capture(nullptr),
+    m_sleep_in_wfi(true),
+    m_emulate_misaligned(hart0_memory.m_emulate_misaligned),
+    m_symbols(hart0_memory.m_symbols),
+    m_stats()
+{
+    this->m_aclint->add_hart(CSR_ref);
+
+    irvelog(1, "Created new Memory instance for hart %u", CSR_ref.hart_id());
+}
+
 Memory::~Memory() {
     if (this->m_output_line_buffer.size() > 0) {
         irvelog_always_stdout(
@@ -198,6 +290,10 @@ Word Memory::load(Word addr, uint8_t data_type) {
     assert((data_type <= 0b111) && "Invalid funct3");
     assert((data_type != 0b110) && "Invalid funct3");
 
+    if ((addr.u & misaligned_mask(data_type)) && this->m_emulate_misaligned) [[unlikely]] {
+        return this->load_misaligned(addr, data_type);
+    }
+
     access_status_t access_status;
     uint64_t machine_addr = translate_address(addr, AT_LOAD);
 
@@ -218,6 +314,11 @@ Word Memory::load(Word addr, uint8_t data_type) {
 void Memory::store(Word addr, uint8_t data_type, Word data) {
     assert((data_type <= 0b010) && "Invalid funct3");
 
+    if ((addr.u & misaligned_mask(data_type)) && this->m_emulate_misaligned) [[unlikely]] {
+        this->store_misaligned(addr, data_type, data);
+        return;
+    }
+
     access_status_t access_status;
     uint64_t machine_addr = translate_address(addr, AT_STORE);
 
@@ -233,12 +334,132 @@ void Memory::store(Word addr, uint8_t data_type, Word data) {
     }
 }
 
+bool Memory::load_physical(uint64_t addr, uint8_t data_type, Word& data) {
+    assert((data_type <= 0b111) && "Invalid funct3");
+    assert((data_type != 0b110) && "Invalid funct3");
+
+    access_status_t access_status;
+    data = read_memory(addr, data_type, access_status);
+    return access_status == AS_OKAY;
+}
+
+bool Memory::store_physical(uint64_t addr, uint8_t data_type, Word data) {
+    assert((data_type <= 0b010) && "Invalid funct3");
+
+    access_status_t access_status;
+    write_memory(addr, data_type, data, access_status);
+    return access_status == AS_OKAY;
+}
+
 void Memory::update_peripherals() {
-    if (this->m_uart.interrupt_pending()) {
+    //There's no PLIC, so the UART's interrupt only goes to hart 0
+    if (!this->m_hart0_memory && this->m_uart->interrupt_pending()) {
         this->m_CSR_ref.set_exti_pending();
     }//Note that we DON'T clear the interrupt pending bit otherwise; that is for software to do
 }
 
+void Memory::wait_for_interrupt() {
+    if (!this->m_sleep_in_wfi) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto give_up = start + MAX_WFI_SLEEP;
+    bool slept = false;
+    while (true) {
+        //Anything that happens after this point rings the doorbell, so we can't miss it
+        uint64_t seen_rings = this->m_CSR_ref.doorbell().rings();
+
+        this->m_CSR_ref.update_timer();
+        this->update_peripherals();
+        auto interrupt_regs = this->m_CSR_ref.fast_implicit_read_interrupt_regs();
+        if ((interrupt_regs.mip.u & interrupt_regs.mie.u) != 0) {
+            break;
+        }
+
+        //In virtual time, nothing happens while we're idle, so we may as well skip ahead
+        if (this->m_CSR_ref.skip_to_timer_interrupt()) {
+            continue;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= give_up) {
+            break;
+        }
+
+        //Timers that aren't enabled in mie are ignored, so if this is 0, it expired just after we checked
+        auto until_timer = this->m_CSR_ref.time_until_timer_interrupt(MAX_WFI_SLEEP);
+        auto deadline = std::min(give_up, now + until_timer);
+        bool was_running = this->m_CSR_ref.set_running(false);//Remote fences needn't wait for us while we sleep
+        this->m_CSR_ref.doorbell().wait_until(seen_rings, deadline);
+        this->m_CSR_ref.set_running(was_running);
+        slept = true;
+    }
+
+    if (slept) {
+        ++this->m_stats.wfi_sleeps;
+        this->m_stats.wfi_sleep_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+void Memory::set_sleep_in_wfi(bool sleep) {
+    this->m_sleep_in_wfi = sleep;
+}
+
+void Memory::set_emulate_misaligned(bool emulate) {
+    this->m_emulate_misaligned = emulate;
+}
+
+bool Memory::emulate_misaligned() const {
+    return this->m_emulate_misaligned;
+}
+
+const SymbolTable& Memory::symbols() const {
+    return this->m_symbols;
+}
+
+const MemoryStats& Memory::stats() const {
+    return this->m_stats;
+}
+
+void Memory::capture_debug_output(std::string* destination) {
+    std::lock_guard<std::mutex> lock(this->m_debug_output_mutex);
+    this->m_debug_output_capture = destination;
+}
+
+Word Memory::amo(Word addr, AmoOp op, Word operand) {
+    //Other harts may be accessing the same word at the same time
+    std::atomic_ref<uint32_t> word(*this->amo_word(addr));
+
+    switch (op) {
+        case AmoOp::SWAP:   return word.exchange(operand.u);
+        case AmoOp::ADD:    return word.fetch_add(operand.u);
+        case AmoOp::XOR:    return word.fetch_xor(operand.u);
+        case AmoOp::AND:    return word.fetch_and(operand.u);
+        case AmoOp::OR:     return word.fetch_or(operand.u);
+        default:            break;//There are no host atomics for the rest, so they need a CAS loop
+    }
+
+    Word loaded_word = word.load();
+    Word word_to_write = 0;
+    do {
+        switch (op) {
+            case AmoOp::MIN:    word_to_write = std::min(loaded_word.s, operand.s); break;
+            case AmoOp::MAX:    word_to_write = std::max(loaded_word.s, operand.s); break;
+            case AmoOp::MINU:   word_to_write = std::min(loaded_word.u, operand.u); break;
+            case AmoOp::MAXU:   word_to_write = std::max(loaded_word.u, operand.u); break;
+            default:            assert(false && "Invalid AmoOp"); break;
+        }
+    } while (!word.compare_exchange_weak(loaded_word.u, word_to_write.u));
+
+    return loaded_word;
+}
+
+bool Memory::compare_and_swap(Word addr, Word expected, Word data) {
+    std::atomic_ref<uint32_t> word(*this->amo_word(addr));
+    return word.compare_exchange_strong(expected.u, data.u);
+}
+
 uint64_t Memory::translate_address(Word untranslated_addr, uint8_t access_type) {
     //NOTE: On faults we set mtval/stval to the untranslated address, not the translated address (if any)
     if(no_address_translation(access_type)) {
@@ -246,6 +467,8 @@ uint64_t Memory::translate_address(Word untranslated_addr, uint8_t access_type)
         return (uint64_t)untranslated_addr.u;
     }
     irvelog(1, "Translating address");
+    this->m_CSR_ref.count_hpm_event(Csr::HpmEvent::TLB_MISS);
+    ++this->m_stats.translations;
 
     access_status_t access_status;
 
@@ -270,6 +493,8 @@ uint64_t Memory::translate_address(Word untranslated_addr, uint8_t access_type)
         // STEP 2
         pte_addr = a + (va_VPN(i) * 4);
         irvelog(2, "Accessing level %d pte at level at address 0x%09X", i, pte_addr);
+        this->m_CSR_ref.count_hpm_event(Csr::HpmEvent::PAGE_TABLE_READ);
+        ++this->m_stats.page_table_reads;
         pte = read_memory(pte_addr, DT_WORD, access_status);
         if(access_status != AS_OKAY) {
             irvelog(2, "Accessing the pte violated a PMA or PMP check,"
@@ -330,9 +555,42 @@ uint64_t Memory::translate_address(Word untranslated_addr, uint8_t access_type)
 
     //STEP 7
     if((pte_A == 0) || ((access_type == AT_STORE) && (pte_D == 0))) {
+        if(menvcfg_ADUE == 0) {
+            irvelog(2, "Accessed bit not set or operation is a store and the"
+                        "dirty bit is not set, raising exception");
+            rv_trap::invoke_exception(static_cast<rv_trap::Cause>(PAGE_FAULT_BASE + access_type), untranslated_addr);
+        }
+
+        //Svadu: set A (and D for stores) ourselves instead of making the guest do it in a trap handler
         irvelog(2, "Accessed bit not set or operation is a store and the"
-                    "dirty bit is not set, raising exception");
-        rv_trap::invoke_exception(static_cast<rv_trap::Cause>(PAGE_FAULT_BASE + access_type), untranslated_addr);
+                    "dirty bit is not set, updating the pte");
+        uint32_t* pte_word = this->ram_word(pte_addr);
+        if(pte_word == nullptr) {
+            irvelog(2, "The pte is not in RAM so it can't be updated, raising an access fault exception");
+            switch(access_type) {
+                case AT_INSTRUCTION:
+                    rv_trap::invoke_exception(rv_trap::Cause::INSTRUCTION_ACCESS_FAULT_EXCEPTION, untranslated_addr);
+                    break;
+                case AT_LOAD:
+                    rv_trap::invoke_exception(rv_trap::Cause::LOAD_ACCESS_FAULT_EXCEPTION, untranslated_addr);
+                    break;
+                case AT_STORE:
+                    rv_trap::invoke_exception(rv_trap::Cause::STORE_OR_AMO_ACCESS_FAULT_EXCEPTION, untranslated_addr);
+                    break;
+                default:
+                    assert(false && "Should never get here");
+            }
+        }
+
+        //The update must be atomic with the checks above, so if another hart changed the pte since
+        //we read it, we have to walk the page table again
+        uint32_t expected_pte = pte.u;
+        uint32_t updated_pte = pte.u | (1U << 6) | ((access_type == AT_STORE) ? (1U << 7) : 0);
+        if(!std::atomic_ref<uint32_t>(*pte_word).compare_exchange_strong(expected_pte, updated_pte)) {
+            irvelog(2, "The pte changed while we were updating it, retrying the translation");
+            return this->translate_address(untranslated_addr, access_type);
+        }
+        ++this->m_stats.pte_ad_updates;
     }
 
     //STEP 8
@@ -373,6 +631,104 @@ bool Memory::no_address_translation(uint8_t access_type) const {
     return true;
 }
 
+uint32_t* Memory::amo_word(Word addr) {
+    assert(((addr.u & 0b11) == 0) && "AMOs must be word-aligned");
+
+    uint64_t machine_addr = translate_address(addr, AT_STORE);//AMOs need write permission (and raise store/AMO faults)
+
+    //None of the peripherals support AMOs (PMA), so only RAM is allowed
+    uint32_t* word = this->ram_word(machine_addr);
+    if (word != nullptr) {
+        return word;
+    }
+
+    rv_trap::invoke_exception(rv_trap::Cause::STORE_OR_AMO_ACCESS_FAULT_EXCEPTION, addr);
+    assert(false && "We should never get here");
+    __builtin_unreachable();
+}
+
+uint32_t* Memory::ram_word(uint64_t machine_addr) {
+    assert(((machine_addr & 0b11) == 0) && "RAM words must be word-aligned");
+    return reinterpret_cast<uint32_t*>(this->ram_byte(machine_addr));
+}
+
+uint8_t* Memory::ram_byte(uint64_t machine_addr) {
+    if (machine_addr <= MEM_MAP_REGION_END_USER_RAM) {
+        return &(this->m_user_ram[machine_addr - MEM_MAP_REGION_START_USER_RAM]);
+    } else if ((machine_addr >= MEM_MAP_REGION_START_KERNEL_RAM) && (machine_addr <= MEM_MAP_REGION_END_KERNEL_RAM)) {
+        return &(this->m_kernel_ram[machine_addr - MEM_MAP_REGION_START_KERNEL_RAM]);
+    }
+
+    return nullptr;
+}
+
+bool Memory::misaligned_ram_bytes(Word addr, uint8_t data_type, uint8_t access_type, uint8_t* bytes[4]) {
+    uint32_t size = misaligned_mask(data_type) + 1;
+
+    //The first and last bytes may be on different pages, in which case both need translating
+    //(before touching either, so a fault on the second page doesn't leave a store half done)
+    Word last_addr = addr + (size - 1);
+    uint64_t first_machine_addr = translate_address(addr, access_type);
+    uint64_t second_page_machine_addr = first_machine_addr & ~(uint64_t)(PAGESIZE - 1);
+    bool crosses_page = (addr.u / PAGESIZE) != (last_addr.u / PAGESIZE);
+    if (crosses_page) {
+        second_page_machine_addr = translate_address(last_addr, access_type) & ~(uint64_t)(PAGESIZE - 1);
+    }
+
+    for (uint32_t i = 0; i < size; ++i) {
+        Word byte_addr = addr + i;
+        uint64_t machine_addr = (crosses_page && ((byte_addr.u / PAGESIZE) != (addr.u / PAGESIZE)))
+            ? (second_page_machine_addr | (byte_addr.u & (PAGESIZE - 1)))
+            : (first_machine_addr + i);
+        bytes[i] = this->ram_byte(machine_addr);
+        if (bytes[i] == nullptr) {
+            irvelog(2, "Misaligned access to machine address 0x%09X isn't to RAM", machine_addr);
+            return false;
+        }
+    }
+
+    ++this->m_stats.misaligned_accesses;
+    return true;
+}
+
+Word Memory::load_misaligned(Word addr, uint8_t data_type) {
+    irvelog(2, "Emulating misaligned load from 0x%08X", addr.u);
+
+    uint8_t* bytes[4];
+    if (!this->misaligned_ram_bytes(addr, data_type, AT_LOAD, bytes)) {
+        //Only RAM is emulated, anything else is left to the guest's trap handler as usual
+        rv_trap::invoke_exception(rv_trap::Cause::LOAD_ADDRESS_MISALIGNED_EXCEPTION);
+    }
+
+    //Misaligned accesses aren't guaranteed to be atomic, so going byte by byte is fine
+    uint32_t data = 0;
+    for (uint32_t i = 0; i <= misaligned_mask(data_type); ++i) {
+        data |= (uint32_t)load_ram<uint8_t>(bytes[i]) << (i * 8);
+    }
+
+    switch (data_type) {
+        case DT_WORD:               return data;
+        case DT_UNSIGNED_HALFWORD:  return (uint32_t)(uint16_t)data;
+        case DT_SIGNED_HALFWORD:    return (int32_t)(int16_t)data;
+        default:
+            assert(false && "Only halfwords and words can be misaligned");
+            return 0;
+    }
+}
+
+void Memory::store_misaligned(Word addr, uint8_t data_type, Word data) {
+    irvelog(2, "Emulating misaligned store to 0x%08X", addr.u);
+
+    uint8_t* bytes[4];
+    if (!this->misaligned_ram_bytes(addr, data_type, AT_STORE, bytes)) {
+        rv_trap::invoke_exception(rv_trap::Cause::STORE_OR_AMO_ADDRESS_MISALIGNED_EXCEPTION);
+    }
+
+    for (uint32_t i = 0; i <= misaligned_mask(data_type); ++i) {
+        store_ram<uint8_t>(bytes[i], (uint8_t)(data.u >> (i * 8)));
+    }
+}
+
 Word Memory::read_memory(
         uint64_t addr, uint8_t data_type, access_status_t& access_status) {
 
@@ -431,19 +787,19 @@ Word Memory::read_memory_region_user_ram(
     void* mem_ptr = &(m_user_ram[mem_index]);
     switch(data_type) {
         case DT_WORD:
-            data = *(uint32_t*)mem_ptr;
+            data = load_ram<uint32_t>(mem_ptr);
             break;
         case DT_UNSIGNED_HALFWORD:
-            data = (uint32_t)(*(uint16_t*)mem_ptr);
+            data = (uint32_t)load_ram<uint16_t>(mem_ptr);
             break;
         case DT_SIGNED_HALFWORD:
-            data = (int32_t)(*(int16_t*)mem_ptr);
+            data = (int32_t)load_ram<int16_t>(mem_ptr);
             break;
         case DT_UNSIGNED_BYTE:
-            data = (uint32_t)(*(uint8_t*)mem_ptr);
+            data = (uint32_t)load_ram<uint8_t>(mem_ptr);
             break;
         case DT_SIGNED_BYTE:
-            data = (int32_t)(*(int8_t*)mem_ptr);
+            data = (int32_t)load_ram<int8_t>(mem_ptr);
             break;
         default:
             assert(false && "This should never be reached");
@@ -475,19 +831,19 @@ Word Memory::read_memory_region_kernel_ram(
     void* mem_ptr = &(m_kernel_ram[mem_index]);
     switch (data_type) {
         case DT_WORD:
-            data = *(uint32_t*)mem_ptr;
+            data = load_ram<uint32_t>(mem_ptr);
             break;
         case DT_UNSIGNED_HALFWORD:
-            data = (uint32_t)(*(uint16_t*)mem_ptr);
+            data = (uint32_t)load_ram<uint16_t>(mem_ptr);
             break;
         case DT_SIGNED_HALFWORD:
-            data = (int32_t)(*(int16_t*)mem_ptr);
+            data = (int32_t)load_ram<int16_t>(mem_ptr);
             break;
         case DT_UNSIGNED_BYTE:
-            data = (uint32_t)(*(uint8_t*)mem_ptr);
+            data = (uint32_t)load_ram<uint8_t>(mem_ptr);
             break;
         case DT_SIGNED_BYTE:
-            data = (int32_t)(*(int8_t*)mem_ptr);
+            data = (int32_t)load_ram<int8_t>(mem_ptr);
             break;
         default:
             assert(false && "This should never be reached");
@@ -515,7 +871,8 @@ Word Memory::read_memory_region_aclint(
         return Word(0);
     }
 
-    return this->m_aclint.read(static_cast<Aclint::Address>(addr - MEM_MAP_REGION_START_ACLINT));
+    ++this->m_stats.aclint_reads;
+    return this->m_aclint->read(static_cast<Aclint::Address>(addr - MEM_MAP_REGION_START_ACLINT));
 }
 
 Word Memory::read_memory_region_uart(
@@ -533,13 +890,14 @@ Word Memory::read_memory_region_uart(
     auto uart_addr = static_cast<Uart::Address>(addr - MEM_MAP_REGION_START_UART);
 
     Word data = 0;
+    ++this->m_stats.uart_reads;
     
     //TODO uart read should also update access_status?
     if (data_type & DATA_SIGN_MASK) {
-        data.u = (uint32_t)this->m_uart.read(uart_addr);
+        data.u = (uint32_t)this->m_uart->read(uart_addr);
     }
     else {
-        data.s = (int32_t)this->m_uart.read(uart_addr);
+        data.s = (int32_t)this->m_uart->read(uart_addr);
     }
     
     return data;
@@ -585,23 +943,25 @@ void Memory::write_memory_region_user_ram(uint64_t addr, uint8_t data_type, Word
     if (((data_type & DATA_WIDTH_MASK) == DT_HALFWORD) && ((addr & 0b1) != 0)) {
         //Misaligned halfword write
         access_status = AS_MISALIGNED;
+        return;
     }
     else if ((data_type == DT_WORD) && ((addr & 0b11) != 0)) {
         //Misaligned word write
         access_status = AS_MISALIGNED;
+        return;
     }
 
     uint64_t mem_index = addr - MEM_MAP_REGION_START_USER_RAM;
     void* mem_ptr = &(m_user_ram[mem_index]);
     switch (data_type) {
         case DT_WORD:
-            *(uint32_t*)mem_ptr = data.u;
+            store_ram<uint32_t>(mem_ptr, data.u);
             break;
         case DT_HALFWORD:
-            *(uint16_t*)mem_ptr = (uint16_t)data.u;
+            store_ram<uint16_t>(mem_ptr, (uint16_t)data.u);
             break;
         case DT_BYTE:
-            *(uint8_t*)mem_ptr = (uint8_t)data.u;
+            store_ram<uint8_t>(mem_ptr, (uint8_t)data.u);
             break;
         default:
             assert(false && "This should never be reached");
@@ -618,23 +978,25 @@ void Memory::write_memory_region_kernel_ram(uint64_t addr, uint8_t data_type, Wo
     if (((data_type & DATA_WIDTH_MASK) == DT_HALFWORD) && ((addr & 0b1) != 0)) {
         // Misaligned halfword write
         access_status = AS_MISALIGNED;
+        return;
     }
     else if ((data_type == DT_WORD) && ((addr & 0b11) != 0)) {
         //Misaligned word write
         access_status = AS_MISALIGNED;
+        return;
     }
 
     uint64_t mem_index = addr - MEM_MAP_REGION_START_KERNEL_RAM;
     void* mem_ptr = &(m_kernel_ram[mem_index]);
     switch (data_type) {
         case DT_WORD:
-            *(uint32_t*)mem_ptr = data.u;
+            store_ram<uint32_t>(mem_ptr, data.u);
             break;
         case DT_HALFWORD:
-            *(uint16_t*)mem_ptr = (uint16_t)data.u;
+            store_ram<uint16_t>(mem_ptr, (uint16_t)data.u);
             break;
         case DT_BYTE:
-            *(uint8_t*)mem_ptr = (uint8_t)data.u;
+            store_ram<uint8_t>(mem_ptr, (uint8_t)data.u);
             break;
         default:
             assert(false && "This should never be reached");
@@ -660,7 +1022,8 @@ void Memory::write_memory_region_aclint(uint64_t addr, uint8_t data_type, Word d
         return;
     }
 
-    this->m_aclint.write(static_cast<Aclint::Address>(addr - MEM_MAP_REGION_START_ACLINT), data);
+    ++this->m_stats.aclint_writes;
+    this->m_aclint->write(static_cast<Aclint::Address>(addr - MEM_MAP_REGION_START_ACLINT), data);
 }
 
 void Memory::write_memory_region_uart(uint64_t addr, uint8_t data_type, Word data,
@@ -678,8 +1041,9 @@ void Memory::write_memory_region_uart(uint64_t addr, uint8_t data_type, Word dat
     auto uart_addr = static_cast<Uart::Address>(addr - MEM_MAP_REGION_START_UART);
     uint8_t uart_data = (uint8_t)data.u;
 
+    ++this->m_stats.uart_writes;
     //TODO uart write can update access_status?
-    this->m_uart.write(uart_addr, uart_data);
+    this->m_uart->write(uart_addr, uart_data);
 }
 
 void Memory::write_memory_region_debug([[maybe_unused]] uint64_t addr, uint8_t data_type, Word data,
@@ -693,7 +1057,23 @@ void Memory::write_memory_region_debug([[maybe_unused]] uint64_t addr, uint8_t d
         return;
     }
 
+    ++this->m_stats.debug_writes;
     char character = (char)data.s;
+    if (this->m_hart0_memory) {
+        this->m_hart0_memory->debug_output(character);
+    } else {
+        this->debug_output(character);
+    }
+}
+
+void Memory::debug_output(char character) {
+    std::lock_guard<std::mutex> lock(this->m_debug_output_mutex);
+
+    if (this->m_debug_output_capture) {
+        this->m_debug_output_capture->push_back((character == '\0') ? '\n' : character);
+        return;
+    }
+
     switch (character) {
         case '\n':
             //End of line; print the contents of the line buffer and clear it
@@ -979,11 +1359,18 @@ image_load_status_t Memory::load_elf_32(std::string image_path) {
     } section_header;
 
     std::vector<elf32_chunk> section_chunks;
+    std::vector<elf32_section_header> symbol_tables;
 
     file.seekg(file_header.e_shoff, std::ios::beg);
     // Iterate over the section header table to identify program data sections
     for (uint16_t i = 0; i < file_header.e_shnum; i++) {
         file.read((char*)&section_header, sizeof(section_header));
+        // Remember symbol tables for later (they are never loaded into memory)
+        const uint32_t SHT_SYMTAB = 0x2;
+        if (section_header.sh_type == SHT_SYMTAB) {
+            symbol_tables.push_back(section_header);
+            continue;
+        }
         // Filter out section chunks that shouldn't be loaded into memory
         const uint32_t SHT_PROGBITS = 0x1;
         const uint32_t SHT_INIT_ARRAY = 0xe;
@@ -1024,5 +1411,124 @@ image_load_status_t Memory::load_elf_32(std::string image_path) {
         }
     }
 
+    // Symbols aren't needed to run the image, but they make profiles much easier to read
+    file.clear();
+    for (elf32_section_header& symbol_table : symbol_tables) {
+        // Symbol names live in the string table section the symbol table links to
+        elf32_section_header string_table;
+        file.seekg(file_header.e_shoff + (symbol_table.sh_link * sizeof(elf32_section_header)), std::ios::beg);
+        file.read((char*)&string_table, sizeof(string_table));
+        if (!file) {
+            break;
+        }
+        std::vector<char> strings(string_table.sh_size + 1, '\0');//Extra NUL in case the table isn't terminated
+        file.seekg(string_table.sh_offset, std::ios::beg);
+        file.read(strings.data(), string_table.sh_size);
+
+        struct elf32_symbol {
+            uint32_t st_name;
+            uint32_t st_value;
+            uint32_t st_size;
+            uint8_t  st_info;
+            uint8_t  st_other;
+            uint16_t st_shndx;
+        } symbol;
+
+        file.seekg(symbol_table.sh_offset, std::ios::beg);
+        for (uint32_t i = 0; i < (symbol_table.sh_size / sizeof(symbol)); ++i) {
+            file.read((char*)&symbol, sizeof(symbol));
+            if (!file) {
+                break;
+            }
+
+            // Keep functions, and untyped labels (from assembly), that are defined in some section
+            const uint8_t  STT_NOTYPE = 0;
+            const uint8_t  STT_FUNC = 2;
+            const uint16_t SHN_UNDEF = 0;
+            const uint16_t SHN_LORESERVE = 0xff00;
+            uint8_t type = symbol.st_info & 0xf;
+            if (((type != STT_NOTYPE) && (type != STT_FUNC)) || (symbol.st_shndx == SHN_UNDEF) || (symbol.st_shndx >= SHN_LORESERVE)) {
+                continue;
+            }
+            if (symbol.st_name >= string_table.sh_size) {
+                continue;
+            }
+            const char* name = strings.data() + symbol.st_name;
+            // Skip unnamed symbols, RISC-V mapping symbols ($x, $d) and local assembler labels
+            if ((name[0] == '\0') || (name[0] == '$') || (std::strncmp(name, ".L", 2) == 0)) {
+                continue;
+            }
+            this->m_symbols.add(symbol.st_value, symbol.st_size, name);
+        }
+    }
+
     return IL_OKAY;
 }
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static std::unique_ptr<uint8_t[], RamDeleter> allocate_ram(uint64_t size, [[maybe_unused]] uint64_t fuzzish_template_offset) {
+    void* ram = MAP_FAILED;
+
+#if IRVE_INTERNAL_CONFIG_FUZZISH && defined(__linux__)
+    //Copy-on-write, so every instance starts out random but only pays for the pages it writes
+    int template_fd = get_fuzzish_ram_template_fd();
+    if (template_fd != -1) {
+        ram = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE, template_fd, static_cast<off_t>(fuzzish_template_offset));
+    }
+#endif
+
+    if (ram == MAP_FAILED) {
+        //The kernel zero-fills pages the first time they are touched, so idle instances are cheap
+        ram = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (ram == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+#if IRVE_INTERNAL_CONFIG_FUZZISH
+        irve_fuzzish_meminit(ram, size);
+#endif
+    }
+
+    return std::unique_ptr<uint8_t[], RamDeleter>(static_cast<uint8_t*>(ram), RamDeleter{size});
+}
+
+static inline uint32_t misaligned_mask(uint8_t data_type) {
+    switch (data_type & DATA_WIDTH_MASK) {
+        case DT_HALFWORD:   return 0b1;
+        case DT_WORD:       return 0b11;
+        default:            return 0;
+    }
+}
+
+#if IRVE_INTERNAL_CONFIG_FUZZISH && defined(__linux__)
+static int get_fuzzish_ram_template_fd() {
+    //Shared by every instance in the process (and initializing a static is thread-safe)
+    static const int template_fd = []() {
+        const uint64_t template_size = MEM_MAP_REGION_SIZE_USER_RAM + MEM_MAP_REGION_SIZE_KERNEL_RAM;
+
+        int fd = memfd_create("irve_fuzzish_ram", MFD_CLOEXEC);
+        if (fd == -1) {
+            return -1;
+        }
+        if (ftruncate(fd, static_cast<off_t>(template_size)) != 0) {
+            close(fd);
+            return -1;
+        }
+
+        void* contents = mmap(nullptr, template_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (contents == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        irve_fuzzish_meminit(contents, template_size);
+        munmap(contents, template_size);
+
+        return fd;
+    }();
+
+    return template_fd;
+}
+#endif
@@ -16,11 +16,15 @@
 
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <string>
 
 #include "common.h"
 
 #include "aclint.h"
 #include "csr.h"
+#include "stats.h"
+#include "symbols.h"
 #include "uart.h"
 
 /* ------------------------------------------------------------------------------------------------
@@ -41,6 +45,25 @@ typedef enum {
     IL_FAIL
 } image_load_status_t;
 
+// The read-modify-write operations Memory::amo() can do.
+enum class AmoOp : uint8_t {
+    SWAP,
+    ADD,
+    XOR,
+    AND,
+    OR,
+    MIN,
+    MAX,
+    MINU,
+    MAXU
+};
+
+// Unmaps guest RAM (which Memory gets straight from mmap() so untouched pages cost nothing).
+struct RamDeleter {
+    std::size_t size;
+    void operator()(uint8_t* ram) const;
+};
+
 // Facilitates address translation, memory protection, and loading the memory image file
 class Memory {
 public:
@@ -56,8 +79,18 @@ public:
      * @param[in]   imagec The number of memory image files to load.
      * @param[in]   imagev Vector of memory image file names.
      * @param[in]   CSR_ref A reference to the CSR's.
+     * @param[in]   uart_backend_spec Where the UART's input and output go (see Uart::Uart()).
+    */
+    Memory(int imagec, const char* const* imagev, Csr& CSR_ref, const char* uart_backend_spec = "stdio");
+
+    /**
+     * @brief       The constructor for any hart other than hart 0.
+     * @note        RAM and the peripherals are shared with hart 0's Memory (which must outlive this
+     *              one); only address translation, which depends on the hart's CSRs, is separate.
+     * @param[in]   hart0_memory Hart 0's Memory.
+     * @param[in]   CSR_ref A reference to this hart's CSR's.
     */
-    Memory(int imagec, const char* const* imagev, Csr& CSR_ref);
+    Memory(Memory& hart0_memory, Csr& CSR_ref);
 
     /**
      * @brief       The destructor.
@@ -94,10 +127,106 @@ public:
     */
     void store(Word addr, uint8_t data_type, Word data);
 
+    /**
+     * @brief       Atomically read, modify and write a word in memory (for AMOs).
+     * @note        This can raise exceptions (the same ones as a word store).
+     * @param[in]   addr The address of the word (physical or virtual depending on operating mode).
+     *              Must be word-aligned.
+     * @param[in]   op How to modify the word.
+     * @param[in]   operand The other operand of op.
+     * @return      The value of the word before it was modified.
+    */
+    Word amo(Word addr, AmoOp op, Word operand);
+
+    /**
+     * @brief       Atomically store a word, but only if memory still holds an expected value (for SC).
+     * @note        This can raise exceptions (the same ones as a word store).
+     * @param[in]   addr The address of the word (physical or virtual depending on operating mode).
+     *              Must be word-aligned.
+     * @param[in]   expected The value the word must still have.
+     * @param[in]   data The data to store.
+     * @return      True if the store happened.
+    */
+    bool compare_and_swap(Word addr, Word expected, Word data);
+
+    /**
+     * @brief       Load data from a machine address, without address translation (as M-mode
+     *              firmware would, for the native SBI implementation).
+     * @param[in]   addr 34 bit machine address.
+     * @param[in]   data_type From funct3 of memory instructions, specifies data width and
+     *              signed/unsigned.
+     * @param[out]  data The data read from memory.
+     * @return      False if there is nothing to read at addr or it is misaligned (unlike load(),
+     *              this never raises exceptions).
+    */
+    bool load_physical(uint64_t addr, uint8_t data_type, Word& data);
+
+    /**
+     * @brief       Store data to a machine address, without address translation (as M-mode
+     *              firmware would, for the native SBI implementation).
+     * @param[in]   addr 34 bit machine address.
+     * @param[in]   data_type From funct3 of memory instructions, specifies data width.
+     * @param[in]   data The data to be stored in memory.
+     * @return      False if there is nothing to write at addr or it is misaligned (unlike store(),
+     *              this never raises exceptions).
+    */
+    bool store_physical(uint64_t addr, uint8_t data_type, Word data);
+
     /**
      * @brief       Update peripherals (usually to check if the external interrupt pending bit should be set).
     */
     void update_peripherals();
+
+    /**
+     * @brief       Wait for an interrupt (for WFI) by putting the host thread to sleep.
+     * @note        Returns once an interrupt is both pending and enabled in mie (regardless of
+     *              mstatus.MIE/SIE and delegation, as the spec requires), or after a short time limit
+     *              (which WFI is allowed to do), so callers never block for long. Wakes up early
+     *              for UART input, software interrupts and mtime/mtimecmp writes, and when the timer
+     *              expires.
+    */
+    void wait_for_interrupt();
+
+    /**
+     * @brief       Choose whether wait_for_interrupt() actually sleeps.
+     * @param[in]   sleep False to make WFI a NOP instead (ex. when one thread steps several harts,
+     *              since a sleeping hart would hold up the one that could wake it).
+    */
+    void set_sleep_in_wfi(bool sleep);
+
+    /**
+     * @brief       Choose whether misaligned loads and stores to RAM are performed directly instead
+     *              of raising address-misaligned exceptions.
+     * @param[in]   emulate True to emulate them (including ones that cross a page boundary), false
+     *              to leave them to the guest's trap handler.
+    */
+    void set_emulate_misaligned(bool emulate);
+
+    /**
+     * @brief       Check whether misaligned RAM accesses are being performed directly.
+     * @return      True if they are (see set_emulate_misaligned()).
+    */
+    bool emulate_misaligned() const;
+
+    /**
+     * @brief       Get the symbols from any ELF images that were loaded.
+     * @return      The symbol table (empty if no loaded image had one).
+    */
+    const SymbolTable& symbols() const;
+
+    /**
+     * @brief       Get counters describing the memory accesses made so far.
+     * @return      The counters.
+    */
+    const MemoryStats& stats() const;
+
+    /**
+     * @brief       Collect what the guest writes to the debug address instead of logging it.
+     * @param[in]   destination The string to append the guest's output to (as-is, with '\0'
+     *              treated as a newline), or nullptr to go back to logging it. Must outlive the
+     *              Memory or be replaced before it goes away.
+    */
+    void capture_debug_output(std::string* destination);
 private:
 
     /**
@@ -117,6 +246,56 @@ private:
     */
     bool no_address_translation(uint8_t access_type) const;
 
+    /**
+     * @brief       Find the word in RAM an AMO (or SC) accesses.
+     * @note        Raises the appropriate exception if the address doesn't translate to RAM, since
+     *              none of the peripherals support AMOs.
+     * @param[in]   addr The address of the word (physical or virtual depending on operating mode).
+     * @return      Where the word is in host memory.
+    */
+    uint32_t* amo_word(Word addr);
+
+    /**
+     * @brief       Find a word of RAM in host memory.
+     * @param[in]   machine_addr 34 bit machine address of the word (aligned).
+     * @return      Where the word is in host memory, or nullptr if the address isn't in RAM.
+    */
+    uint32_t* ram_word(uint64_t machine_addr);
+
+    /**
+     * @brief       Find a byte of RAM in host memory.
+     * @param[in]   machine_addr 34 bit machine address of the byte.
+     * @return      Where the byte is in host memory, or nullptr if the address isn't in RAM.
+    */
+    uint8_t* ram_byte(uint64_t machine_addr);
+
+    /**
+     * @brief       Translate each byte of a misaligned access and find it in RAM.
+     * @note        Raises any page fault the translations cause.
+     * @param[in]   addr The address of the first byte (physical or virtual depending on operating mode).
+     * @param[in]   data_type Specifies data width.
+     * @param[in]   access_type AT_LOAD or AT_STORE.
+     * @param[out]  bytes Where each byte of the access is in host memory, lowest address first.
+     * @return      True if every byte is in RAM (and so can be accessed directly).
+    */
+    bool misaligned_ram_bytes(Word addr, uint8_t data_type, uint8_t access_type, uint8_t* bytes[4]);
+
+    /**
+     * @brief       Perform a misaligned load from RAM (see set_emulate_misaligned()).
+     * @param[in]   addr The address to load from (physical or virtual depending on operating mode).
+     * @param[in]   data_type Specifies data width and signed/unsigned.
+     * @return      The data.
+    */
+    Word load_misaligned(Word addr, uint8_t data_type);
+
+    /**
+     * @brief       Perform a misaligned store to RAM (see set_emulate_misaligned()).
+     * @param[in]   addr The address to store to (physical or virtual depending on operating mode).
+     * @param[in]   data_type Specifies data width.
+     * @param[in]   data The data to store.
+    */
+    void store_misaligned(Word addr, uint8_t data_type, Word data);
+
     /**
      * @brief       Read the specified data type from memory.
      * @param[in]   addr 34 bit machine address.
@@ -148,6 +327,13 @@ private:
     void write_memory_region_uart(uint64_t addr, uint8_t data_type, Word data, access_status_t& access_status);
     void write_memory_region_debug(uint64_t addr, uint8_t data_type, Word data, access_status_t& access_status);
 
+    /**
+     * @brief       Output a character written to the debug address (on hart 0's Memory, which
+     *              every hart's debug output goes through).
+     * @param[in]   character The character.
+    */
+    void debug_output(char character);
+
     /**
      * @brief       Loads memory image files (only called by the constructor).
      * @param[in]   imagec The number of memory image files.
@@ -188,22 +374,43 @@ private:
     // Reference to the CSRs since memory operations depend on them.
     Csr& m_CSR_ref;
 
-    // Pointer to user ram.
-    std::unique_ptr<uint8_t[]> m_user_ram;
+    // Hart 0's Memory, or null if this is it.
+    Memory* m_hart0_memory;
+
+    // Pointer to user ram (shared by every hart).
+    std::shared_ptr<uint8_t[]> m_user_ram;
 
-    // Pointer to kernel ram.
-    std::unique_ptr<uint8_t[]> m_kernel_ram;
+    // Pointer to kernel ram (shared by every hart).
+    std::shared_ptr<uint8_t[]> m_kernel_ram;
 
     /**
-     * @brief       ACLINT
+     * @brief       ACLINT (shared by every hart)
     */
-    Aclint m_aclint;
+    std::shared_ptr<Aclint> m_aclint;
 
-    // 16550 UART.
-    Uart m_uart;
+    // 16550 UART (shared by every hart).
+    std::shared_ptr<Uart> m_uart;
 
-    // Output line buffer.
+    // Output line buffer (only used on hart 0).
     std::string m_output_line_buffer;
+
+    // Where debug address output goes instead, if not null (only used on hart 0).
+    std::string* m_debug_output_capture;
+
+    // Protects the above two, since every hart's debug output goes through hart 0's Memory.
+    std::mutex m_debug_output_mutex;
+
+    // False if WFI should just be a NOP.
+    bool m_sleep_in_wfi;
+
+    // True if misaligned RAM accesses are performed instead of raising exceptions.
+    bool m_emulate_misaligned;
+
+    // Symbols from loaded ELF images.
+    SymbolTable m_symbols;
+
+    // Counters for emulator_t::get_stats().
+    MemoryStats m_stats;
 };
 
 } // namespace irve::internal
@@ -0,0 +1,104 @@
+/**
+ * @brief   Low-overhead sampling profiler for guest code
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * See profiler.h for a description of the output format
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "profiler.h"
+
+#include <cassert>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include "csr.h"
+#include "symbols.h"
+
+#define INST_COUNT 0
+#include "logging.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+static const char* privilege_mode_name(PrivilegeMode privilege_mode);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+profiler::Profiler::Profiler(const char* output_path, uint32_t period, const SymbolTable& symbols) :
+    m_file(std::fopen(output_path, "w")),
+    m_period(period),
+    m_countdown(period),
+    m_symbols(symbols)
+{
+    assert((period != 0) && "The sampling period must be nonzero");
+
+    if (!this->m_file) {
+        irvelog_always(0, "Failed to create profile file \"%s\"", output_path);
+        throw std::runtime_error("Failed to create profile file");
+    }
+
+    if (this->m_symbols.empty()) {
+        irvelog_always(0, "No symbols were loaded, so the profile will only contain raw PCs");
+    }
+}
+
+profiler::Profiler::~Profiler() {
+    //Many PCs map to the same function, so merge them (sorted so the output is deterministic)
+    std::map<std::string, uint64_t> folded;
+    uint64_t total_samples = 0;
+    for (const auto& [key, count] : this->m_samples) {
+        uint32_t pc = static_cast<uint32_t>(key);
+        PrivilegeMode privilege_mode = static_cast<PrivilegeMode>(key >> 32);
+
+        std::string stack = privilege_mode_name(privilege_mode);
+        stack += ';';
+        const std::string* symbol = this->m_symbols.lookup(pc);
+        if (symbol) {
+            stack += *symbol;
+        } else {
+            char pc_string[11];
+            std::snprintf(pc_string, sizeof(pc_string), "0x%08X", pc);
+            stack += pc_string;
+        }
+
+        folded[stack] += count;
+        total_samples += count;
+    }
+
+    for (const auto& [stack, count] : folded) {
+        std::fprintf(this->m_file, "%s %" PRIu64 "\n", stack.c_str(), count);
+    }
+    std::fclose(this->m_file);
+
+    irvelog_always(0, "Wrote %" PRIu64 " profile samples (one every %u instructions)", total_samples, this->m_period);
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static const char* privilege_mode_name(PrivilegeMode privilege_mode) {
+    switch (privilege_mode) {
+        case PrivilegeMode::USER_MODE:          return "U-mode";
+        case PrivilegeMode::SUPERVISOR_MODE:    return "S-mode";
+        case PrivilegeMode::MACHINE_MODE:       return "M-mode";
+        default:                                return "?-mode";
+    }
+}
@@ -0,0 +1,77 @@
+/**
+ * @brief   Low-overhead sampling profiler for guest code
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Every N instructions, the PC about to be executed and the current privilege mode are recorded.
+ * When profiling stops, samples are resolved to symbols and written in the "folded stacks" format
+ * understood by flamegraph.pl, speedscope, inferno, etc. Each line looks like:
+ *
+ *  M-mode;some_function 1234
+ *
+ * Samples that don't fall within any known symbol are written as their raw PC instead.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+
+#include "csr.h"
+#include "symbols.h"
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal::profiler {
+
+/**
+ * @brief Samples the guest PC and writes a folded-stack profile when destroyed
+*/
+class Profiler {
+public:
+    /**
+     * @brief Create the output file and start sampling
+     * @param output_path Where to write the profile
+     * @param period How many instructions between samples (must be nonzero)
+     * @param symbols Used to resolve samples when writing the profile; must outlive the Profiler
+     * @note Throws std::runtime_error if the file couldn't be created
+    */
+    Profiler(const char* output_path, uint32_t period, const SymbolTable& symbols);
+
+    /**
+     * @brief Write out the profile and close the file
+    */
+    ~Profiler();
+
+    /**
+     * @brief Called once per instruction, before it is executed
+     * @param pc The PC of the instruction
+     * @param privilege_mode The mode it will execute in
+    */
+    void tick(uint32_t pc, PrivilegeMode privilege_mode) {
+        if (--this->m_countdown == 0) [[unlikely]] {
+            this->m_countdown = this->m_period;
+            ++this->m_samples[(static_cast<uint64_t>(privilege_mode) << 32) | pc];
+        }
+    }
+
+private:
+    std::FILE* m_file;
+    uint32_t m_period;
+    uint32_t m_countdown;
+    const SymbolTable& m_symbols;
+
+    std::unordered_map<uint64_t, uint64_t> m_samples;//(Privilege mode << 32) | PC -> Number of samples
+};
+
+} // namespace irve::internal::profiler
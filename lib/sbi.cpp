@@ -0,0 +1,303 @@
+/**
+ * @brief   Native (emulator-side) SBI implementation for S-mode guests
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "sbi.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "cpu_state.h"
+#include "csr.h"
+#include "memory.h"
+#include "memory_map.h"
+#include "rv_trap.h"
+#include "uart.h"
+
+#define INST_COUNT 0
+#include "logging.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+constexpr uint8_t a0 = 10;
+constexpr uint8_t a1 = 11;
+constexpr uint8_t a2 = 12;
+constexpr uint8_t a6 = 16;
+constexpr uint8_t a7 = 17;
+
+//Extension IDs (from a7)
+constexpr uint32_t EID_LEGACY_SET_TIMER             = 0x00;
+constexpr uint32_t EID_LEGACY_CONSOLE_PUTCHAR       = 0x01;
+constexpr uint32_t EID_LEGACY_CONSOLE_GETCHAR       = 0x02;
+constexpr uint32_t EID_LEGACY_CLEAR_IPI             = 0x03;
+constexpr uint32_t EID_LEGACY_SEND_IPI              = 0x04;
+constexpr uint32_t EID_LEGACY_REMOTE_FENCE_I        = 0x05;
+constexpr uint32_t EID_LEGACY_REMOTE_SFENCE_VMA     = 0x06;
+constexpr uint32_t EID_LEGACY_REMOTE_SFENCE_VMA_ASID = 0x07;
+constexpr uint32_t EID_TIME                         = 0x54494D45;//"TIME"
+constexpr uint32_t EID_IPI                          = 0x00735049;//"sPI"
+constexpr uint32_t EID_RFENCE                       = 0x52464E43;//"RFNC"
+constexpr uint32_t EID_DBCN                         = 0x4442434E;//"DBCN"
+
+//Error codes (returned in a0)
+constexpr int32_t SBI_SUCCESS               = 0;
+constexpr int32_t SBI_ERR_FAILED            = -1;
+constexpr int32_t SBI_ERR_NOT_SUPPORTED     = -2;
+constexpr int32_t SBI_ERR_INVALID_PARAM     = -3;
+
+//menvcfg.STCE (Sstc) and menvcfg.ADUE (Svadu), bits 63 and 61 so bits 31 and 29 of menvcfgh
+constexpr uint32_t MENVCFGH_STCE = 1U << 31;
+constexpr uint32_t MENVCFGH_ADUE = 1U << 29;
+
+//The SBI spec allows physical addresses as wide as XLEN * 2, but ours are only 34 bits
+constexpr uint64_t MAX_MACHINE_ADDR = 0x3FFFFFFFF;
+
+constexpr uint64_t UART_RHR = MEM_MAP_REGION_START_UART + static_cast<uint8_t>(Uart::Address::RHR);
+constexpr uint64_t UART_THR = MEM_MAP_REGION_START_UART + static_cast<uint8_t>(Uart::Address::THR);
+constexpr uint64_t UART_LSR = MEM_MAP_REGION_START_UART + static_cast<uint8_t>(Uart::Address::LSR);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+void SbiHandler::add_hart(Csr& csr, std::atomic<bool>& icache_flush_requested) {
+    assert((csr.hart_id() == this->m_harts.size()) && "Harts must be added in order!");
+    this->m_harts.push_back(Hart{&csr, &icache_flush_requested});
+
+    //Like any other SBI implementation, turn on what the device tree tells S-mode it has. We need
+    //Sstc anyways, since sbi_set_timer() is implemented with stimecmp.
+    csr.implicit_write(Csr::Address::MENVCFGH, csr.implicit_read(Csr::Address::MENVCFGH) | MENVCFGH_STCE | MENVCFGH_ADUE);
+}
+
+void SbiHandler::remove_harts() {
+    for (Hart& hart : this->m_harts) {
+        Csr& csr = *hart.csr;
+        csr.implicit_write(Csr::Address::MENVCFGH, csr.implicit_read(Csr::Address::MENVCFGH) & ~(MENVCFGH_STCE | MENVCFGH_ADUE));
+    }
+    this->m_harts.clear();
+}
+
+bool SbiHandler::handle(CpuState& cpu_state, Csr& CSR, Memory& memory) {
+    uint32_t eid = cpu_state.get_r(a7).u;
+    uint32_t fid = cpu_state.get_r(a6).u;
+    uint32_t arg0 = cpu_state.get_r(a0).u;
+    uint32_t arg1 = cpu_state.get_r(a1).u;
+    uint32_t arg2 = cpu_state.get_r(a2).u;
+    irvelog(1, "SBI call from hart %u: EID 0x%08X, FID %u", CSR.hart_id(), eid, fid);
+
+    int32_t error = SBI_SUCCESS;
+    uint32_t value = 0;
+    std::vector<Hart*> harts;
+    switch (eid) {
+        //The legacy extensions only return a single value in a0, and take hart masks by pointer
+        case EID_LEGACY_SET_TIMER:
+            CSR.set_stimecmp(((uint64_t)arg1 << 32) | arg0);
+            cpu_state.set_r(a0, 0);
+            return true;
+        case EID_LEGACY_CONSOLE_PUTCHAR:
+            this->console_write_byte(memory, arg0 & 0xFF);
+            cpu_state.set_r(a0, 0);
+            return true;
+        case EID_LEGACY_CONSOLE_GETCHAR:
+            cpu_state.set_r(a0, this->console_read_byte(memory));
+            return true;
+        case EID_LEGACY_CLEAR_IPI:
+            CSR.implicit_write(Csr::Address::SIP, CSR.implicit_read(Csr::Address::SIP) & ~(1U << 1));
+            cpu_state.set_r(a0, 0);
+            return true;
+        case EID_LEGACY_SEND_IPI:
+        case EID_LEGACY_REMOTE_FENCE_I:
+        case EID_LEGACY_REMOTE_SFENCE_VMA:
+        case EID_LEGACY_REMOTE_SFENCE_VMA_ASID: {
+            //The mask is in S-mode's address space; if it faults, let the firmware deal with it
+            uint32_t hart_mask = 0xFFFFFFFF;//A null pointer means every hart
+            uint32_t hart_mask_base = (arg0 == 0) ? 0xFFFFFFFF : 0;
+            if (arg0 != 0) {
+                try {
+                    hart_mask = memory.load(arg0, 0b010).u;
+                } catch (const rv_trap::RvException&) {
+                    return false;
+                }
+            }
+
+            if (!this->select_harts(hart_mask, hart_mask_base, harts)) {
+                cpu_state.set_r(a0, SBI_ERR_INVALID_PARAM);
+                return true;
+            }
+            if (eid == EID_LEGACY_SEND_IPI) {
+                for (Hart* hart : harts) {
+                    hart->csr->set_ssip();
+                }
+            } else {//IRVE has no TLB, so SFENCE.VMA only has to flush the icache, same as FENCE.I
+                this->remote_fence(CSR, harts);
+            }
+            cpu_state.set_r(a0, 0);
+            return true;
+        }
+
+        case EID_TIME:
+            if (fid == 0) {//sbi_set_timer()
+                CSR.set_stimecmp(((uint64_t)arg1 << 32) | arg0);
+            } else {
+                error = SBI_ERR_NOT_SUPPORTED;
+            }
+            break;
+        case EID_IPI:
+            if (fid != 0) {
+                error = SBI_ERR_NOT_SUPPORTED;
+            } else if (!this->select_harts(arg0, arg1, harts)) {//sbi_send_ipi()
+                error = SBI_ERR_INVALID_PARAM;
+            } else {
+                for (Hart* hart : harts) {
+                    hart->csr->set_ssip();
+                }
+            }
+            break;
+        case EID_RFENCE:
+            //Only sbi_remote_fence_i(), sbi_remote_sfence_vma() and sbi_remote_sfence_vma_asid();
+            //the rest are for the hypervisor extension, which we don't have
+            if (fid > 2) {
+                error = SBI_ERR_NOT_SUPPORTED;
+            } else if (!this->select_harts(arg0, arg1, harts)) {
+                error = SBI_ERR_INVALID_PARAM;
+            } else {//IRVE has no TLB, so SFENCE.VMA only has to flush the icache, same as FENCE.I
+                this->remote_fence(CSR, harts);
+            }
+            break;
+        case EID_DBCN:
+            switch (fid) {
+                case 0://sbi_debug_console_write()
+                    error = this->console_write(memory, arg0, ((uint64_t)arg2 << 32) | arg1, value);
+                    break;
+                case 1://sbi_debug_console_read()
+                    error = this->console_read(memory, arg0, ((uint64_t)arg2 << 32) | arg1, value);
+                    break;
+                case 2://sbi_debug_console_write_byte()
+                    this->console_write_byte(memory, arg0 & 0xFF);
+                    break;
+                default:
+                    error = SBI_ERR_NOT_SUPPORTED;
+                    break;
+            }
+            break;
+
+        default:
+            irvelog(1, "Not handled natively; passing it on to the firmware");
+            return false;
+    }
+
+    cpu_state.set_r(a0, error);
+    cpu_state.set_r(a1, value);
+    return true;
+}
+
+bool SbiHandler::select_harts(uint32_t hart_mask, uint32_t hart_mask_base, std::vector<Hart*>& harts) {
+    if (hart_mask_base == 0xFFFFFFFF) {//Every hart, ignoring the mask
+        for (Hart& hart : this->m_harts) {
+            harts.push_back(&hart);
+        }
+        return true;
+    }
+
+    for (uint32_t i = 0; i < 32; ++i) {
+        if (hart_mask & (1U << i)) {
+            uint64_t hart_id = (uint64_t)hart_mask_base + i;
+            if (hart_id >= this->m_harts.size()) {
+                return false;
+            }
+            harts.push_back(&this->m_harts[hart_id]);
+        }
+    }
+    return true;
+}
+
+void SbiHandler::remote_fence(Csr& CSR, const std::vector<Hart*>& harts) {
+    //We aren't running instructions while we wait, so don't let a hart fencing us wait for us
+    bool was_running = CSR.set_running(false);
+
+    //Every hart checks its flag before each instruction, so once it has been cleared the hart has
+    //flushed. Harts that aren't running (asleep in WFI, waiting here themselves, stepped on this
+    //thread, or stopped) will check it before their next instruction, so there's no need to wait
+    //for them (and they might never clear it). Both sides use sequentially consistent accesses so a
+    //hart that starts running just as we check either sees its flag or is seen running.
+    for (Hart* hart : harts) {
+        hart->icache_flush_requested->store(true);
+    }
+    for (Hart* hart : harts) {
+        if (hart->csr == &CSR) {
+            continue;//We'll flush before our next instruction, after returning from the ECALL
+        }
+        while (hart->icache_flush_requested->load() && hart->csr->running()) {
+            std::this_thread::yield();
+        }
+    }
+
+    CSR.set_running(was_running);
+}
+
+int32_t SbiHandler::console_write(Memory& memory, uint32_t num_bytes, uint64_t base_addr, uint32_t& written) {
+    written = 0;
+    if ((base_addr > MAX_MACHINE_ADDR) || (num_bytes > (MAX_MACHINE_ADDR - base_addr + 1))) {
+        return SBI_ERR_INVALID_PARAM;
+    }
+
+    for (; written < num_bytes; ++written) {
+        Word byte;
+        if (!memory.load_physical(base_addr + written, 0b100, byte)) {
+            return (written == 0) ? SBI_ERR_INVALID_PARAM : SBI_ERR_FAILED;
+        }
+        this->console_write_byte(memory, byte.u);
+    }
+    return SBI_SUCCESS;
+}
+
+int32_t SbiHandler::console_read(Memory& memory, uint32_t num_bytes, uint64_t base_addr, uint32_t& read) {
+    read = 0;
+    if ((base_addr > MAX_MACHINE_ADDR) || (num_bytes > (MAX_MACHINE_ADDR - base_addr + 1))) {
+        return SBI_ERR_INVALID_PARAM;
+    }
+
+    //Only what has already arrived; the call doesn't block
+    for (; read < num_bytes; ++read) {
+        int32_t byte = this->console_read_byte(memory);
+        if (byte < 0) {
+            break;
+        }
+        if (!memory.store_physical(base_addr + read, 0b000, (uint32_t)byte)) {
+            return (read == 0) ? SBI_ERR_INVALID_PARAM : SBI_ERR_FAILED;
+        }
+    }
+    return SBI_SUCCESS;
+}
+
+void SbiHandler::console_write_byte(Memory& memory, uint8_t byte) {
+    //Through the UART, the same as the firmware would
+    memory.store_physical(UART_THR, 0b000, byte);
+}
+
+int32_t SbiHandler::console_read_byte(Memory& memory) {
+    Word lsr;
+    if (!memory.load_physical(UART_LSR, 0b100, lsr) || (lsr.bit(0) == 0)) {//LSR.DR: data ready
+        return -1;
+    }
+
+    Word byte;
+    memory.load_physical(UART_RHR, 0b100, byte);
+    return byte.u;
+}
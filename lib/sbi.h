@@ -0,0 +1,97 @@
+/**
+ * @brief   Native (emulator-side) SBI implementation for S-mode guests
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Normally an ECALL from S-mode traps into the M-mode firmware (ex. ogsbi), which runs hundreds of
+ * instructions to do something as simple as reprogramming the timer. When enabled, the emulator
+ * intercepts those ECALLs and services the TIME, IPI, RFENCE and DBCN extensions (and the
+ * equivalent legacy calls) itself instead, returning straight back to S-mode.
+ *
+ * Everything else (BASE, HSM, SRST, ...) still goes to the firmware. In particular the firmware
+ * keeps answering probe_extension(), and is what parks and starts secondary harts, so it remains in
+ * charge of what the guest thinks is available.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_state.h"
+#include "csr.h"
+#include "memory.h"
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal {
+
+class SbiHandler {
+public:
+    SbiHandler() = default;
+
+    /**
+     * @brief Make a hart reachable by IPIs and remote fences (harts must be added in order of mhartid),
+     *  and turn on Sstc and Svadu for it
+     * @param csr The hart's CSRs
+     * @param icache_flush_requested Set to make the hart flush its icache before its next instruction
+     * @note Must be done before any SBI calls are handled
+    */
+    void add_hart(Csr& csr, std::atomic<bool>& icache_flush_requested);
+
+    /**
+     * @brief Turn Sstc and Svadu back off for every hart, for when the native SBI is turned off
+     *  and the firmware is left to set them up itself
+     * @note No SBI calls may be handled afterwards
+    */
+    void remove_harts();
+
+    /**
+     * @brief Handle an SBI call (an ECALL from S-mode)
+     * @note Safe to call from every hart's thread at once
+     * @return True if it was handled (the results are in a0 and a1, and the ECALL should be skipped),
+     *  or false if the firmware should handle it instead
+    */
+    bool handle(CpuState& cpu_state, Csr& CSR, Memory& memory);
+
+private:
+    struct Hart {
+        Csr* csr;
+        std::atomic<bool>* icache_flush_requested;
+    };
+
+    /**
+     * @brief Find the harts an SBI hart mask refers to
+     * @param hart_mask Bit i selects hart hart_mask_base + i
+     * @param hart_mask_base The first hart in the mask, or all ones for every hart
+     * @param harts Where to put the harts
+     * @return False if any of the harts doesn't exist
+    */
+    bool select_harts(uint32_t hart_mask, uint32_t hart_mask_base, std::vector<Hart*>& harts);
+
+    /**
+     * @brief Make harts flush their icaches, returning once none of them can run a stale instruction
+     * @param CSR The CSRs of the hart making the call
+     * @param harts The harts to fence
+    */
+    void remote_fence(Csr& CSR, const std::vector<Hart*>& harts);
+
+    int32_t console_write(Memory& memory, uint32_t num_bytes, uint64_t base_addr, uint32_t& written);
+    int32_t console_read(Memory& memory, uint32_t num_bytes, uint64_t base_addr, uint32_t& read);
+    void console_write_byte(Memory& memory, uint8_t byte);
+    int32_t console_read_byte(Memory& memory);//-1 if there is nothing to read
+
+    std::vector<Hart> m_harts;//Indexed by mhartid
+};
+
+} // namespace irve::internal
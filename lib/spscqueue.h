@@ -0,0 +1,101 @@
+/**
+ * @brief   A fixed-capacity lock-free single-producer single-consumer queue
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Unlike tsqueue_t, this never takes a lock, so it is suitable for handing data between a helper
+ * thread and the emulator thread on the hot path. Exactly one thread may push and exactly one
+ * (other) thread may pop.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal::spscqueue {
+
+template<typename T, std::size_t CAPACITY>
+class spscqueue_t {
+    static_assert((CAPACITY != 0) && ((CAPACITY & (CAPACITY - 1)) == 0), "CAPACITY must be a power of two");
+public:
+    spscqueue_t() : m_head(0), m_tail(0) {}
+
+    spscqueue_t(const spscqueue_t&) = delete;
+    spscqueue_t& operator=(const spscqueue_t&) = delete;
+
+    //Producer side; returns false (and does nothing) if the queue is full
+    bool push(const T& value);
+
+    //Consumer side; returns false (and leaves value untouched) if the queue is empty
+    bool pop(T& value);
+
+    //Safe to call from either side, though the answer may be stale by the time it is used
+    bool empty() const;
+    std::size_t size() const;
+
+private:
+    static constexpr std::size_t INDEX_MASK = CAPACITY - 1;
+
+    //The indices are free-running and are only masked when indexing into m_buffer
+    //They live on separate cache lines so the producer and consumer don't fight over them
+    alignas(64) std::atomic<std::size_t> m_head;//Next slot to pop (written by the consumer only)
+    alignas(64) std::atomic<std::size_t> m_tail;//Next slot to push (written by the producer only)
+    alignas(64) T m_buffer[CAPACITY];
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+//NOTE: Must be in header file because this is templated
+
+template<typename T, std::size_t CAPACITY>
+bool spscqueue_t<T, CAPACITY>::push(const T& value) {
+    std::size_t tail = this->m_tail.load(std::memory_order_relaxed);
+    if ((tail - this->m_head.load(std::memory_order_acquire)) == CAPACITY) {
+        return false;//Full
+    }
+
+    this->m_buffer[tail & INDEX_MASK] = value;
+    this->m_tail.store(tail + 1, std::memory_order_release);//Publish the new element
+    return true;
+}
+
+template<typename T, std::size_t CAPACITY>
+bool spscqueue_t<T, CAPACITY>::pop(T& value) {
+    std::size_t head = this->m_head.load(std::memory_order_relaxed);
+    if (head == this->m_tail.load(std::memory_order_acquire)) {
+        return false;//Empty
+    }
+
+    value = this->m_buffer[head & INDEX_MASK];
+    this->m_head.store(head + 1, std::memory_order_release);//Give the slot back to the producer
+    return true;
+}
+
+template<typename T, std::size_t CAPACITY>
+bool spscqueue_t<T, CAPACITY>::empty() const {
+    return this->m_head.load(std::memory_order_acquire) == this->m_tail.load(std::memory_order_acquire);
+}
+
+template<typename T, std::size_t CAPACITY>
+std::size_t spscqueue_t<T, CAPACITY>::size() const {
+    std::size_t head = this->m_head.load(std::memory_order_acquire);
+    std::size_t tail = this->m_tail.load(std::memory_order_acquire);
+    assert(((tail - head) <= CAPACITY) && "spscqueue_t indices are corrupt");
+    return tail - head;
+}
+
+}
@@ -0,0 +1,61 @@
+/**
+ * @brief   Counters describing what the emulator has been doing
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * These are always collected (they are just increments) and are exposed publicly through
+ * irve::emulator::emulator_t::get_stats()
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal {
+
+/**
+ * @brief Counters kept by Memory
+*/
+struct MemoryStats {
+    uint64_t translations;//IRVE has no TLB, so every one of these is a page table walk
+    uint64_t page_table_reads;
+    uint64_t pte_ad_updates;//A/D bits set by the page table walker (Svadu)
+    uint64_t aclint_reads;
+    uint64_t aclint_writes;
+    uint64_t uart_reads;
+    uint64_t uart_writes;
+    uint64_t debug_writes;
+    uint64_t misaligned_accesses;//Emulated instead of trapping (see Memory::set_emulate_misaligned())
+    uint64_t wfi_sleeps;
+    uint64_t wfi_sleep_time_ns;
+};
+
+/**
+ * @brief Counters kept by the emulator (plus the ones from Memory)
+*/
+struct Stats {
+    uint64_t inst_count;
+    uint64_t insts_by_opcode[32];//Indexed by decode::Opcode
+    uint64_t icache_hits;
+    uint64_t icache_misses;
+    uint64_t icache_flushes;
+    uint64_t exceptions_by_cause[16];
+    uint64_t interrupts_by_cause[16];
+    uint64_t peripheral_updates;
+    uint64_t peripheral_update_time_ns;
+    uint64_t native_sbi_calls;
+    MemoryStats memory;
+};
+
+} // namespace irve::internal
@@ -0,0 +1,60 @@
+/**
+ * @brief   Guest symbol tables (for turning addresses into function names)
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "symbols.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+void SymbolTable::add(uint32_t addr, uint32_t size, std::string name) {
+    this->m_symbols.push_back({addr, size, std::move(name)});
+}
+
+void SymbolTable::sort() {
+    //When several symbols share an address (ex. aliases), keep the one that tells us its size
+    std::sort(this->m_symbols.begin(), this->m_symbols.end(), [](const Symbol& a, const Symbol& b) {
+        return (a.addr != b.addr) ? (a.addr < b.addr) : (a.size > b.size);
+    });
+    auto new_end = std::unique(this->m_symbols.begin(), this->m_symbols.end(), [](const Symbol& a, const Symbol& b) {
+        return a.addr == b.addr;
+    });
+    this->m_symbols.erase(new_end, this->m_symbols.end());
+}
+
+const std::string* SymbolTable::lookup(uint32_t addr) const {
+    //Find the last symbol starting at or before addr
+    auto it = std::upper_bound(this->m_symbols.begin(), this->m_symbols.end(), addr, [](uint32_t addr, const Symbol& symbol) {
+        return addr < symbol.addr;
+    });
+    if (it == this->m_symbols.begin()) {
+        return nullptr;
+    }
+    --it;
+
+    if ((it->size != 0) && ((addr - it->addr) >= it->size)) {
+        return nullptr;
+    }
+    return &it->name;
+}
+
+bool SymbolTable::empty() const {
+    return this->m_symbols.empty();
+}
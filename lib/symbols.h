@@ -0,0 +1,67 @@
+/**
+ * @brief   Guest symbol tables (for turning addresses into function names)
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal {
+
+/**
+ * @brief Maps guest addresses to the symbols that contain them
+ *
+ * Symbols are added while loading images (see Memory::load_elf_32()), then sort() must be called
+ * before doing any lookups.
+*/
+class SymbolTable {
+public:
+    /**
+     * @brief Add a symbol
+     * @param addr The address the symbol starts at
+     * @param size The size of the symbol in bytes, or 0 if unknown (ex. hand-written assembly labels)
+     * @param name The name of the symbol
+    */
+    void add(uint32_t addr, uint32_t size, std::string name);
+
+    /**
+     * @brief Get the table ready for lookups after symbols have been added
+    */
+    void sort();
+
+    /**
+     * @brief Find the symbol an address belongs to
+     * @param addr The address to look up
+     * @return The symbol's name, or nullptr if the address isn't within any symbol. An address after
+     *         a symbol of unknown size is considered part of it until the next symbol starts.
+    */
+    const std::string* lookup(uint32_t addr) const;
+
+    bool empty() const;
+
+private:
+    struct Symbol {
+        uint32_t    addr;
+        uint32_t    size;
+        std::string name;
+    };
+
+    std::vector<Symbol> m_symbols;//Sorted by address once sort() is called
+};
+
+} // namespace irve::internal
@@ -0,0 +1,342 @@
+/**
+ * @brief   Compact binary instruction traces
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * See trace.h for a description of the format
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#define INST_COUNT 0
+#include "logging.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+static const char TRACE_MAGIC[8] = {'I', 'R', 'V', 'E', 'T', 'R', 'C', '1'};
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+static uint8_t* encode_varint(uint8_t* destination, uint32_t value);
+static uint32_t zigzag_encode(uint32_t difference);
+static uint32_t zigzag_decode(uint32_t encoded);
+static std::size_t inst_table_index(uint32_t pc);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+trace::DeltaState::DeltaState() : m_expected_pc(0), m_regs(), m_mem_addr(0) {
+    //PCs are always 4 byte aligned, so this will never match
+    std::fill_n(this->m_inst_table_pcs, INST_TABLE_SIZE, 0xFFFFFFFF);
+    std::fill_n(this->m_inst_table_insts, INST_TABLE_SIZE, 0);
+}
+
+trace::TraceWriter::TraceWriter(const char* trace_path) :
+    m_has_inst(false),
+    m_current{std::make_unique<uint8_t[]>(BUFFER_SIZE), 0},
+    m_num_buffers(1),
+    m_file(std::fopen(trace_path, "wb")),
+    m_stop(false)
+{
+    if (!this->m_file) {
+        irvelog_always(0, "Failed to create trace file \"%s\"", trace_path);
+        throw std::runtime_error("Failed to create trace file");
+    }
+
+    std::memcpy(this->m_current.data.get(), TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    this->m_current.size = sizeof(TRACE_MAGIC);
+
+    //We do our own (much larger) buffering
+    std::setvbuf(this->m_file, nullptr, _IONBF, 0);
+
+    //Log to wherever the emulator that created us does
+    this->m_writer_thread = std::thread([this, log_sink = logging::current_thread_sink()]() {
+        logging::ScopedThreadSink sink_scope(log_sink);
+        this->writer_thread_function();
+    });
+}
+
+trace::TraceWriter::~TraceWriter() {
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_full_buffers.push_back(std::move(this->m_current));
+        this->m_stop = true;
+        this->m_condition_variable.notify_all();
+    }
+    this->m_writer_thread.join();
+    std::fclose(this->m_file);
+}
+
+void trace::TraceWriter::end() {
+    uint8_t* start = this->m_current.data.get() + this->m_current.size;
+    uint8_t* next = start + 1;//Leave room for the flags
+    uint8_t flags = this->m_record.flags;
+
+    if (this->m_record.pc != this->m_state.m_expected_pc) {
+        flags |= PC_JUMP;
+        next = encode_varint(next, zigzag_encode(this->m_record.pc - this->m_state.m_expected_pc));
+    }
+    this->m_state.m_expected_pc = this->m_record.pc + 4;
+
+    if (this->m_has_inst) {
+        std::size_t index = inst_table_index(this->m_record.pc);
+        if ((this->m_state.m_inst_table_pcs[index] != this->m_record.pc) || (this->m_state.m_inst_table_insts[index] != this->m_record.inst)) {
+            flags |= INST;
+            std::memcpy(next, &this->m_record.inst, sizeof(uint32_t));//We only support little-endian hosts
+            next += sizeof(uint32_t);
+            this->m_state.m_inst_table_pcs[index] = this->m_record.pc;
+            this->m_state.m_inst_table_insts[index] = this->m_record.inst;
+        }
+    } else {
+        assert((flags & TRAP) && "Only a trap can prevent us from having an instruction");
+        flags |= NO_INST;
+    }
+
+    if (flags & RD) {
+        *(next++) = this->m_record.rd;
+        next = encode_varint(next, zigzag_encode(this->m_record.rd_value - this->m_state.m_regs[this->m_record.rd]));
+        this->m_state.m_regs[this->m_record.rd] = this->m_record.rd_value;
+    }
+
+    if (flags & MEM) {
+        next = encode_varint(next, zigzag_encode(this->m_record.mem_addr - this->m_state.m_mem_addr));
+        next = encode_varint(next, this->m_record.mem_value);
+        this->m_state.m_mem_addr = this->m_record.mem_addr;
+    }
+
+    if (flags & TRAP) {
+        next = encode_varint(next, this->m_record.cause);
+        next = encode_varint(next, this->m_record.tval);
+    }
+
+    *start = flags;
+    this->m_current.size += static_cast<std::size_t>(next - start);
+    assert((static_cast<std::size_t>(next - start) <= MAX_RECORD_SIZE) && "MAX_RECORD_SIZE is too small");
+
+    if ((BUFFER_SIZE - this->m_current.size) < MAX_RECORD_SIZE) {
+        this->swap_buffers();
+    }
+}
+
+void trace::TraceWriter::interrupt(uint32_t cause) {
+    uint8_t* start = this->m_current.data.get() + this->m_current.size;
+    *start = INTERRUPT;
+    uint8_t* next = encode_varint(start + 1, cause);
+    this->m_current.size += static_cast<std::size_t>(next - start);
+
+    if ((BUFFER_SIZE - this->m_current.size) < MAX_RECORD_SIZE) {
+        this->swap_buffers();
+    }
+}
+
+void trace::TraceWriter::swap_buffers() {
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+    this->m_full_buffers.push_back(std::move(this->m_current));
+    this->m_condition_variable.notify_all();
+
+    if (this->m_free_buffers.empty() && (this->m_num_buffers < MAX_BUFFERS)) {
+        this->m_current = {std::make_unique<uint8_t[]>(BUFFER_SIZE), 0};
+        ++this->m_num_buffers;
+        return;
+    }
+
+    //The disk can't keep up with us, so we have no choice but to wait for it
+    this->m_condition_variable.wait(lock, [this]() { return !this->m_free_buffers.empty(); });
+    this->m_current = std::move(this->m_free_buffers.back());
+    this->m_free_buffers.pop_back();
+    this->m_current.size = 0;
+}
+
+void trace::TraceWriter::writer_thread_function() {
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+    while (true) {
+        this->m_condition_variable.wait(lock, [this]() { return this->m_stop || !this->m_full_buffers.empty(); });
+
+        if (this->m_full_buffers.empty()) {//Stopping and there's nothing left to write
+            return;
+        }
+
+        Buffer buffer = std::move(this->m_full_buffers.front());
+        this->m_full_buffers.pop_front();
+
+        lock.unlock();//Don't hold up the emulator thread while we do I/O
+        if (std::fwrite(buffer.data.get(), 1, buffer.size, this->m_file) != buffer.size) {
+            irvelog_always(0, "Failed to write to the trace file; the trace will be incomplete");
+        }
+        lock.lock();
+
+        this->m_free_buffers.push_back(std::move(buffer));
+        this->m_condition_variable.notify_all();
+    }
+}
+
+trace::TraceReader::TraceReader(const char* trace_path) : m_file(std::fopen(trace_path, "rb")) {
+    if (!this->m_file) {
+        throw std::runtime_error("Failed to open trace file");
+    }
+
+    //Larger buffer since traces tend to be big
+    std::setvbuf(this->m_file, nullptr, _IOFBF, 1024 * 1024);
+
+    char magic[sizeof(TRACE_MAGIC)];
+    if ((std::fread(magic, 1, sizeof(magic), this->m_file) != sizeof(magic)) || (std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)) {
+        std::fclose(this->m_file);
+        throw std::runtime_error("Not an IRVE trace file");
+    }
+}
+
+trace::TraceReader::~TraceReader() {
+    std::fclose(this->m_file);
+}
+
+bool trace::TraceReader::next(Record& record) {
+    int flags = std::getc(this->m_file);
+    if (flags == EOF) {
+        return false;
+    }
+
+    record = {};
+    if (flags & INTERRUPT) {
+        record.flags = INTERRUPT;
+        return this->read_varint(record.cause);
+    }
+
+    record.flags = static_cast<uint8_t>(flags & (NO_INST | RD | MEM | TRAP));
+
+    uint32_t pc_difference = 0;
+    if ((flags & PC_JUMP) && !this->read_varint(pc_difference)) {
+        return false;
+    }
+    record.pc = this->m_state.m_expected_pc + zigzag_decode(pc_difference);
+    this->m_state.m_expected_pc = record.pc + 4;
+
+    if (!(flags & NO_INST)) {
+        std::size_t index = inst_table_index(record.pc);
+        if (flags & INST) {
+            if (std::fread(&record.inst, sizeof(uint32_t), 1, this->m_file) != 1) {
+                return false;
+            }
+            this->m_state.m_inst_table_pcs[index] = record.pc;
+            this->m_state.m_inst_table_insts[index] = record.inst;
+        } else {
+            record.inst = this->m_state.m_inst_table_insts[index];
+        }
+    }
+
+    if (flags & RD) {
+        int rd = std::getc(this->m_file);
+        uint32_t difference;
+        if ((rd == EOF) || (rd >= 32) || !this->read_varint(difference)) {
+            return false;
+        }
+        record.rd = static_cast<uint8_t>(rd);
+        record.rd_value = this->m_state.m_regs[rd] + zigzag_decode(difference);
+        this->m_state.m_regs[rd] = record.rd_value;
+    }
+
+    if (flags & MEM) {
+        uint32_t difference;
+        if (!this->read_varint(difference) || !this->read_varint(record.mem_value)) {
+            return false;
+        }
+        record.mem_addr = this->m_state.m_mem_addr + zigzag_decode(difference);
+        this->m_state.m_mem_addr = record.mem_addr;
+    }
+
+    if (flags & TRAP) {
+        if (!this->read_varint(record.cause) || !this->read_varint(record.tval)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool trace::TraceReader::read_varint(uint32_t& value) {
+    value = 0;
+    for (uint32_t shift = 0; shift < 35; shift += 7) {
+        int byte = std::getc(this->m_file);
+        if (byte == EOF) {
+            return false;
+        }
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;//Too long to be valid
+}
+
+void trace::print_record(std::FILE* destination, const Record& record) {
+    if (record.flags & INTERRUPT) {
+        std::fprintf(destination, "interrupt cause=0x%08X\n", record.cause);
+        return;
+    }
+
+    if (record.flags & NO_INST) {
+        std::fprintf(destination, "0x%08X: ----------", record.pc);
+    } else {
+        std::fprintf(destination, "0x%08X: 0x%08X", record.pc, record.inst);
+    }
+
+    if (record.flags & RD) {
+        std::fprintf(destination, " x%u=0x%08X", record.rd, record.rd_value);
+    }
+
+    if (record.flags & MEM) {
+        std::fprintf(destination, " mem[0x%08X]=0x%08X", record.mem_addr, record.mem_value);
+    }
+
+    if (record.flags & TRAP) {
+        std::fprintf(destination, " trap cause=0x%08X tval=0x%08X", record.cause, record.tval);
+    }
+
+    std::fputc('\n', destination);
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static uint8_t* encode_varint(uint8_t* destination, uint32_t value) {
+    while (value >= 0x80) {
+        *(destination++) = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *(destination++) = static_cast<uint8_t>(value);
+    return destination;
+}
+
+static uint32_t zigzag_encode(uint32_t difference) {
+    //Small negative differences become small positive numbers, so they encode to short varints
+    return (difference << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(difference) >> 31);
+}
+
+static uint32_t zigzag_decode(uint32_t encoded) {
+    return (encoded >> 1) ^ (0U - (encoded & 1));
+}
+
+static std::size_t inst_table_index(uint32_t pc) {
+    return (pc >> 2) & (trace::DeltaState::INST_TABLE_SIZE - 1);
+}
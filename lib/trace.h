@@ -0,0 +1,227 @@
+/**
+ * @brief   Compact binary instruction traces
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * A trace file starts with an 8 byte magic number, followed by one variable-length record per
+ * instruction (or interrupt). Each record starts with a flags byte saying which fields follow:
+ *
+ *  PC_JUMP:        The PC wasn't the previous PC + 4; a zigzag varint of the difference follows
+ *  INST:           The raw instruction (4 bytes, little endian) follows. When clear, it is the same
+ *                  instruction as was last seen at this PC (looked up in a small direct-mapped table)
+ *  NO_INST:        The instruction couldn't be fetched (only with TRAP)
+ *  RD:             The rd number (1 byte) follows, then a zigzag varint of the difference between
+ *                  its new value and the last value traced for that register
+ *  MEM:            A zigzag varint of the difference from the last traced memory address, then the
+ *                  value stored (or loaded) as a varint
+ *  TRAP:           The cause and tval of the exception the instruction raised follow as varints
+ *  INTERRUPT:      Not an instruction; just the cause of an interrupt being taken follows as a varint
+ *
+ * All varints are unsigned LEB128. The writer and reader keep identical state to undo the deltas.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal::trace {
+
+/**
+ * @brief What a record in the trace contains
+*/
+enum Flags : uint8_t {
+    PC_JUMP     = 1 << 0,
+    INST        = 1 << 1,
+    NO_INST     = 1 << 2,
+    RD          = 1 << 3,
+    MEM         = 1 << 4,
+    TRAP        = 1 << 5,
+    INTERRUPT   = 1 << 6
+};
+
+/**
+ * @brief A single decoded trace record
+ * @note Only the fields indicated by the flags are meaningful (PC_JUMP and INST are encoding details
+ *       and are never set here; NO_INST is set instead if there is no instruction)
+*/
+struct Record {
+    uint8_t     flags;
+    uint32_t    pc;
+    uint32_t    inst;
+    uint8_t     rd;
+    uint32_t    rd_value;
+    uint32_t    mem_addr;
+    uint32_t    mem_value;
+    uint32_t    cause;
+    uint32_t    tval;
+};
+
+/**
+ * @brief State that both the writer and the reader must track to undo delta encoding
+*/
+class DeltaState {
+public:
+    DeltaState();
+
+    static constexpr std::size_t INST_TABLE_SIZE = 4096;//Must be a power of two
+
+    uint32_t m_expected_pc;
+    uint32_t m_regs[32];
+    uint32_t m_mem_addr;
+    uint32_t m_inst_table_pcs[INST_TABLE_SIZE];
+    uint32_t m_inst_table_insts[INST_TABLE_SIZE];
+};
+
+/**
+ * @brief Encodes records and streams them to a file on a background thread
+ *
+ * The emulator fills in one record at a time with begin(), the optional setters, and end()
+*/
+class TraceWriter {
+public:
+    /**
+     * @brief Create a trace file and start the writer thread
+     * @param trace_path Where to write the trace
+     * @note Throws std::runtime_error if the file couldn't be created
+    */
+    TraceWriter(const char* trace_path);
+
+    /**
+     * @brief Flush everything to the file, stop the writer thread and close the file
+    */
+    ~TraceWriter();
+
+    void begin(uint32_t pc) {
+        this->m_record.flags = 0;
+        this->m_record.pc = pc;
+        this->m_has_inst = false;
+    }
+
+    void inst(uint32_t inst) {
+        this->m_record.inst = inst;
+        this->m_has_inst = true;
+    }
+
+    void rd(uint8_t rd, uint32_t value) {
+        this->m_record.flags |= RD;
+        this->m_record.rd = rd;
+        this->m_record.rd_value = value;
+    }
+
+    void mem(uint32_t addr, uint32_t value) {
+        this->m_record.flags |= MEM;
+        this->m_record.mem_addr = addr;
+        this->m_record.mem_value = value;
+    }
+
+    void mem_value(uint32_t value) {
+        this->m_record.mem_value = value;
+    }
+
+    void trap(uint32_t cause, uint32_t tval) {
+        this->m_record.flags |= TRAP;
+        this->m_record.cause = cause;
+        this->m_record.tval = tval;
+    }
+
+    /**
+     * @brief Encode the record built up since begin()
+    */
+    void end();
+
+    /**
+     * @brief Encode a record for an interrupt being taken (outside of begin()/end())
+    */
+    void interrupt(uint32_t cause);
+
+private:
+    static constexpr std::size_t BUFFER_SIZE = 1024 * 1024;
+    static constexpr std::size_t MAX_RECORD_SIZE = 64;//Comfortably larger than the biggest possible record
+    static constexpr std::size_t MAX_BUFFERS = 8;
+
+    struct Buffer {
+        std::unique_ptr<uint8_t[]> data;
+        std::size_t size;
+    };
+
+    /**
+     * @brief Hand the current buffer to the writer thread and get an empty one to continue with
+    */
+    void swap_buffers();
+
+    void writer_thread_function();
+
+    DeltaState m_state;
+    Record m_record;
+    bool m_has_inst;
+
+    Buffer m_current;
+    std::size_t m_num_buffers;//Allocated so far (including the current one)
+
+    std::FILE* m_file;
+    std::mutex m_mutex;
+    std::condition_variable m_condition_variable;
+    std::deque<Buffer> m_full_buffers;
+    std::vector<Buffer> m_free_buffers;
+    bool m_stop;
+    std::thread m_writer_thread;
+};
+
+/**
+ * @brief Decodes records from a trace file
+*/
+class TraceReader {
+public:
+    /**
+     * @brief Open a trace file and check its magic number
+     * @param trace_path The trace to read
+     * @note Throws std::runtime_error if the file couldn't be opened or isn't a trace
+    */
+    TraceReader(const char* trace_path);
+
+    ~TraceReader();
+
+    /**
+     * @brief Decode the next record
+     * @param record Where to put it
+     * @return False at the end of the trace (or if it is truncated)
+    */
+    bool next(Record& record);
+
+private:
+    bool read_varint(uint32_t& value);
+
+    DeltaState m_state;
+    std::FILE* m_file;
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Print a record as a line of text
+ * @param destination Where to print it
+ * @param record The record to print
+*/
+void print_record(std::FILE* destination, const Record& record);
+
+} // namespace irve::internal::trace
@@ -19,11 +19,17 @@
 #include <string>
 #include <cstdio>
 #include <thread>
-#include <iostream>
 #include <condition_variable>
+#include <chrono>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdlib>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "common.h"
 
@@ -31,16 +37,76 @@
 #include "tsqueue.h"
 #include "fuzzish.h"
 
+#define LOG_SUBSYSTEM UART
 #define INST_COUNT 0
 #include "logging.h"
 
 using namespace irve::internal;
 
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+//How long the guest must stop printing before the FILE backend writes out what it has batched up
+#define TRANSMIT_IDLE_FLUSH_PERIOD std::chrono::milliseconds(10)
+
+//The FILE backend writes once it has this much, or once the guest stops printing for a bit
+#define FILE_TRANSMIT_BUFFER_SIZE (64 * 1024)
+
+//Where MSG_NOSIGNAL doesn't exist, SO_NOSIGPIPE is set on the client socket instead
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//Output kept around for a UNIX_SOCKET client that hasn't connected yet; anything past this is dropped
+#define MAX_UNCONNECTED_TRANSMIT_BUFFER_SIZE (1024 * 1024)
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Variables
+ * --------------------------------------------------------------------------------------------- */
+
+//stdin and the terminal's settings belong to the whole process, so only one STDIO UART at a time can have them
+static std::atomic<bool> s_stdin_in_use = false;
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Write all of data to fd, waiting for it to become writable as needed
+ * @return False if the other end went away or some other error occurred
+*/
+static bool write_all(int fd, const char* data, std::size_t size, bool is_socket);
+
+/**
+ * @brief Set O_NONBLOCK on fd
+*/
+static void set_nonblocking(int fd);
+
+/**
+ * @brief Set FD_CLOEXEC on fd
+ *
+ * Done after the fact rather than with SOCK_CLOEXEC and friends, which aren't available everywhere
+*/
+static void set_close_on_exec(int fd);
+
 /* ------------------------------------------------------------------------------------------------
  * Function Implementations
  * --------------------------------------------------------------------------------------------- */
 
-Uart::Uart() :
+Uart::Uart(const char* backend_spec, Doorbell* receive_doorbell) :
+    m_backend(Backend::STDIO),
+    receive_file_fd(-1),
+    m_receive_doorbell(receive_doorbell),
+    m_original_receive_file_fd_flags(-1),
+    m_restore_receive_file_fd_settings(false),
+    m_owns_stdin(false),
+    m_listen_fd(-1),
+    m_pty_slave_fd(-1),
+    m_transmit_fd(-1),
+    m_transmit_failed(false),
+    m_transmit_in_progress(false),
+    m_transmit_thread_idle(false),
     m_isr_read_since_last_thr_write(true)
 {
     this->regs = {
@@ -54,26 +120,36 @@ Uart::Uart() :
         .m_dlm = static_cast<uint8_t>(irve_fuzzish_rand()),
         .m_psd = 0x00
     };
-    this->transmit_thread = std::thread(&Uart::transmit_thread_function, this);
-    this->receive_file_fd = fileno(stdin);
-    int flags = fcntl(this->receive_file_fd, F_GETFL, 0);
-    fcntl(this->receive_file_fd, F_SETFL, flags | O_NONBLOCK);
-
-    //Save original terminal settings
-    this->m_original_receive_file_fd_settings = termios();
-    tcgetattr(this->receive_file_fd, &this->m_original_receive_file_fd_settings);
-
-    //Disable buffering characters until \n is entered, and echo
-    struct termios new_receive_file_fd_settings = this->m_original_receive_file_fd_settings;
-    new_receive_file_fd_settings.c_lflag &= ~ICANON;
-    new_receive_file_fd_settings.c_lflag &= ~ECHO;
-    tcsetattr(this->receive_file_fd, TCSANOW, &new_receive_file_fd_settings);
+
+    //This may throw, so do it before starting any threads
+    this->open_backend(backend_spec);
+
+    //Only start receiving once the backend is set up
+    [[maybe_unused]] int pipe_result = pipe(this->m_receive_thread_wakeup_pipe);
+    assert((pipe_result == 0) && "Failed to create the UART receive thread's wakeup pipe");
+    //Our threads log to wherever the emulator that created us does
+    logging::Sink log_sink = logging::current_thread_sink();
+    this->receive_thread = std::thread([this, log_sink]() {
+        logging::ScopedThreadSink sink_scope(log_sink);
+        this->receive_thread_function();
+    });
+    this->transmit_thread = std::thread([this, log_sink]() {
+        logging::ScopedThreadSink sink_scope(log_sink);
+        this->transmit_thread_function();
+    });
 }
 
 Uart::~Uart() {
-    //Restore terminal settings
-    tcsetattr(this->receive_file_fd, TCSANOW, &this->m_original_receive_file_fd_settings);
+    //Break the receive thread out of poll() and wait for it to exit
+    const uint8_t wakeup = 0;
+    [[maybe_unused]] ssize_t write_result = ::write(this->m_receive_thread_wakeup_pipe[1], &wakeup, 1);
+    if (receive_thread.joinable()) {
+        receive_thread.join();
+    }
+    close(this->m_receive_thread_wakeup_pipe[0]);
+    close(this->m_receive_thread_wakeup_pipe[1]);
 
+    //The transmit thread flushes anything still buffered before it exits
     {                                  
         std::lock_guard<std::mutex> lock(this->transmit_mutex); 
         this->kill_transmit_thread = true; 
@@ -82,6 +158,42 @@ Uart::~Uart() {
     if(transmit_thread.joinable()){
         transmit_thread.join();
     }
+
+    switch (this->m_backend) {
+        case Backend::STDIO: {
+            //Restore terminal settings
+            if (this->m_restore_receive_file_fd_settings) {
+                tcsetattr(this->receive_file_fd, TCSANOW, &this->m_original_receive_file_fd_settings);
+            }
+            if (this->m_original_receive_file_fd_flags != -1) {
+                fcntl(this->receive_file_fd, F_SETFL, this->m_original_receive_file_fd_flags);
+            }
+            if (this->m_owns_stdin) {
+                s_stdin_in_use.store(false);
+            }
+            break;
+        }
+        case Backend::FILE: {
+            if (this->receive_file_fd != -1) {
+                close(this->receive_file_fd);
+            }
+            close(this->m_transmit_fd.load());
+            break;
+        }
+        case Backend::PTY: {
+            close(this->receive_file_fd);//Also the transmit fd
+            close(this->m_pty_slave_fd);
+            break;
+        }
+        case Backend::UNIX_SOCKET: {
+            if (this->receive_file_fd != -1) {
+                close(this->receive_file_fd);//Also the transmit fd
+            }
+            close(this->m_listen_fd);
+            unlink(this->m_socket_path.c_str());
+            break;
+        }
+    }
 }
 
 uint8_t Uart::read(Uart::Address register_address) {
@@ -92,10 +204,7 @@ uint8_t Uart::read(Uart::Address register_address) {
                 return this->regs.m_dll;
             } else {//RHR
                 uint8_t data = 0;
-                if(receive_queue.size()>0){
-                    data = receive_queue.front();
-                    receive_queue.pop();
-                }else{
+                if (!this->receive_queue.pop(data)) {
                     irvelog(0, "Software tried to read from the RHR even though it's empty!");
                 }
                 return data;
@@ -131,7 +240,7 @@ uint8_t Uart::read(Uart::Address register_address) {
             uint8_t lsr = 0;
             lsr |= 1U << LSR_TX_NOT_IN_PROGRESS_POS;//We are always ready to transmit
             lsr |= 1U << LSR_TX_READY_POS;//We are always ready to transmit
-            lsr |= (receive_queue.size() > 0) ? (1U << LSR_RX_READY_POS) : 0;//Set this if characters are waiting!
+            lsr |= !this->receive_queue.empty() ? (1U << LSR_RX_READY_POS) : 0;//Set this if characters are waiting!
             return lsr;
         }
         case Uart::Address::MSR: {
@@ -159,7 +268,9 @@ void Uart::write(Uart::Address register_address, uint8_t data) {
             } else {//THR
                 this->m_isr_read_since_last_thr_write = false;
                 this->async_transmit_queue.push(data);
-                {//Wake up the transmit thread                          
+                //The FILE backend only needs to wake the transmit thread for the first write after it goes idle; after
+                //that, the transmit thread batches up output until the guest stops printing for a bit
+                if ((this->m_backend != Backend::FILE) || this->m_transmit_thread_idle.load()) {
                     std::lock_guard<std::mutex> lock(this->transmit_mutex); 
                     this->transmit_condition_variable.notify_one();          
                 }       
@@ -228,7 +339,7 @@ uint8_t Uart::construct_isr() const {
     //If there is a character available to read, and the Received Data Ready interrupt is enabled
     constexpr uint32_t DATA_READY_IER_POS   = 0U;
     constexpr uint32_t THR_EMPTY_IER_POS    = 1U;
-    if ((receive_queue.size() > 0) && (this->regs.m_ier & (1U << DATA_READY_IER_POS))) {
+    if (!this->receive_queue.empty() && (this->regs.m_ier & (1U << DATA_READY_IER_POS))) {
         isr |= 0b0100;//Code indicating the Received Data Ready interrupt is pending
     //If the THR empty interrupt is enabled (since we are always ready to transmit) and...
     //the user hasn't already read the ISR to check this
@@ -241,16 +352,8 @@ uint8_t Uart::construct_isr() const {
     return isr;
 }
 
-void Uart::update_receive() {
-    uint8_t data;
-    ssize_t bytesRead = ::read(this->receive_file_fd, &data, 1);
-    if(bytesRead > 0){
-            receive_queue.push(data);
-    }
-}
-
 bool Uart::interrupt_pending() {
-    update_receive();
+    //No syscalls here: the receive thread has already moved any new input into receive_queue
     constexpr uint32_t INTERRUPT_STATUS_ISR_POS = 0U;
     return (this->construct_isr() & (1U << INTERRUPT_STATUS_ISR_POS)) == 0;
 }
@@ -259,14 +362,365 @@ bool Uart::dlab() const {
     return this->regs.m_lcr & (1 << 7);
 }
 
+void Uart::open_backend(const char* backend_spec) {
+    std::string spec(backend_spec);
+
+    if (spec == "stdio") {
+        this->m_backend = Backend::STDIO;
+        this->m_transmit_fd = fileno(stdout);
+
+        if (s_stdin_in_use.exchange(true)) {
+            irvelog_always(0, "Another UART is already reading from stdin, so this one will only write to stdout");
+            return;
+        }
+        this->m_owns_stdin = true;
+        this->receive_file_fd = fileno(stdin);
+
+        this->m_original_receive_file_fd_flags = fcntl(this->receive_file_fd, F_GETFL, 0);
+        if (this->m_original_receive_file_fd_flags != -1) {
+            fcntl(this->receive_file_fd, F_SETFL, this->m_original_receive_file_fd_flags | O_NONBLOCK);
+        }
+
+        //Save original terminal settings (if stdin is a terminal at all)
+        this->m_original_receive_file_fd_settings = termios();
+        if (tcgetattr(this->receive_file_fd, &this->m_original_receive_file_fd_settings) == 0) {
+            this->m_restore_receive_file_fd_settings = true;
+
+            //Disable buffering characters until \n is entered, and echo
+            struct termios new_receive_file_fd_settings = this->m_original_receive_file_fd_settings;
+            new_receive_file_fd_settings.c_lflag &= ~ICANON;
+            new_receive_file_fd_settings.c_lflag &= ~ECHO;
+            tcsetattr(this->receive_file_fd, TCSANOW, &new_receive_file_fd_settings);
+        }
+    } else if (spec.starts_with("file:")) {
+        this->m_backend = Backend::FILE;
+        std::string paths = spec.substr(5);
+        std::size_t comma_pos = paths.find(',');
+        std::string output_path = paths.substr(0, comma_pos);
+        std::string input_path = (comma_pos == std::string::npos) ? "" : paths.substr(comma_pos + 1);
+        if (output_path.empty()) {
+            irvelog_always(0, "The UART file backend needs an output path: \"%s\"", backend_spec);
+            throw std::runtime_error("UART file backend is missing an output path");
+        }
+
+        if (!input_path.empty()) {
+            //Non-blocking so opening a named pipe doesn't wait for a writer
+            this->receive_file_fd = open(input_path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (this->receive_file_fd == -1) {
+                irvelog_always(0, "Failed to open UART input file \"%s\"", input_path.c_str());
+                throw std::runtime_error("Failed to open UART input file");
+            }
+        }
+
+        int output_fd = open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (output_fd == -1) {
+            irvelog_always(0, "Failed to open UART output file \"%s\"", output_path.c_str());
+            if (this->receive_file_fd != -1) {
+                close(this->receive_file_fd);
+            }
+            throw std::runtime_error("Failed to open UART output file");
+        }
+        this->m_transmit_fd = output_fd;
+    } else if (spec == "pty") {
+        this->m_backend = Backend::PTY;
+        int master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+        const char* slave_name = nullptr;
+        if ((master_fd == -1) || (grantpt(master_fd) != 0) || (unlockpt(master_fd) != 0) || !(slave_name = ptsname(master_fd))) {
+            irvelog_always(0, "Failed to create a pty for the UART");
+            if (master_fd != -1) {
+                close(master_fd);
+            }
+            throw std::runtime_error("Failed to create a pty for the UART");
+        }
+        set_close_on_exec(master_fd);
+
+        this->m_pty_slave_fd = open(slave_name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (this->m_pty_slave_fd == -1) {
+            irvelog_always(0, "Failed to open the UART's pty \"%s\"", slave_name);
+            close(master_fd);
+            throw std::runtime_error("Failed to open the UART's pty");
+        }
+
+        //Pass bytes through untouched; whatever attaches to the pty can set it up however it likes
+        struct termios pty_settings;
+        if (tcgetattr(this->m_pty_slave_fd, &pty_settings) == 0) {
+            cfmakeraw(&pty_settings);
+            tcsetattr(this->m_pty_slave_fd, TCSANOW, &pty_settings);
+        }
+
+        set_nonblocking(master_fd);
+        this->receive_file_fd = master_fd;
+        this->m_transmit_fd = master_fd;
+        irvelog_always(0, "The UART is attached to pty \"%s\"", slave_name);
+    } else if (spec.starts_with("unix:")) {
+        this->m_backend = Backend::UNIX_SOCKET;
+        this->m_socket_path = spec.substr(5);
+
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (this->m_socket_path.empty() || (this->m_socket_path.size() >= sizeof(address.sun_path))) {
+            irvelog_always(0, "Invalid UART socket path \"%s\"", this->m_socket_path.c_str());
+            throw std::runtime_error("Invalid UART socket path");
+        }
+        this->m_socket_path.copy(address.sun_path, this->m_socket_path.size());
+
+        this->m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (this->m_listen_fd != -1) {
+            set_nonblocking(this->m_listen_fd);
+            set_close_on_exec(this->m_listen_fd);
+        }
+        unlink(this->m_socket_path.c_str());//In case a previous run left it behind
+        if (
+            (this->m_listen_fd == -1) ||
+            (bind(this->m_listen_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) ||
+            (listen(this->m_listen_fd, 1) != 0)
+        ) {
+            irvelog_always(0, "Failed to listen on UART socket \"%s\"", this->m_socket_path.c_str());
+            if (this->m_listen_fd != -1) {
+                close(this->m_listen_fd);
+            }
+            throw std::runtime_error("Failed to listen on UART socket");
+        }
+
+        //The receive thread accepts the client; until then output is held onto
+        irvelog_always(0, "The UART is listening on socket \"%s\"", this->m_socket_path.c_str());
+    } else {
+        irvelog_always(0, "Unknown UART backend \"%s\"", backend_spec);
+        throw std::runtime_error("Unknown UART backend");
+    }
+}
+
+bool Uart::accept_unix_socket_client() {
+    struct pollfd poll_fds[2] = {
+        {.fd = this->m_listen_fd,                       .events = POLLIN, .revents = 0},
+        {.fd = this->m_receive_thread_wakeup_pipe[0],   .events = POLLIN, .revents = 0}
+    };
+
+    while (true) {
+        if (::poll(poll_fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        if (poll_fds[1].revents) {//The destructor wants us to exit
+            return false;
+        }
+
+        if (poll_fds[0].revents & POLLIN) {
+            int client_fd = accept(this->m_listen_fd, nullptr, nullptr);
+            if (client_fd == -1) {
+                if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ECONNABORTED)) {
+                    continue;
+                }
+                return false;
+            }
+            set_nonblocking(client_fd);
+            set_close_on_exec(client_fd);
+#ifdef SO_NOSIGPIPE
+            int no_sigpipe = 1;
+            setsockopt(client_fd, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+
+            this->receive_file_fd = client_fd;
+            irvelog_always(0, "A client connected to the UART socket");
+
+            //Let the transmit thread write out what it held onto while nobody was connected
+            std::lock_guard<std::mutex> lock(this->transmit_mutex);
+            this->m_transmit_fd.store(client_fd, std::memory_order_release);
+            this->transmit_condition_variable.notify_one();
+            return true;
+        } else if (poll_fds[0].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+            return false;
+        }
+    }
+}
+
 void Uart::transmit_thread_function(){
+    //Characters are batched up here so each wakeup results in (at most) one write() rather than one per character
+    std::string buffer;
     std::unique_lock<std::mutex> lock(this->transmit_mutex); 
-    while (!this->kill_transmit_thread){
-        this->transmit_condition_variable.wait(lock);
+    while (true) {
+        if ((this->m_backend == Backend::FILE) && !buffer.empty()) {
+            //The FILE backend isn't notified on every THR write, so the timeout is what tells us the guest went quiet
+            this->transmit_condition_variable.wait_for(lock, TRANSMIT_IDLE_FLUSH_PERIOD);
+        } else {//Nothing to do until there's a write (or a UNIX_SOCKET client shows up for held output)
+            this->m_transmit_thread_idle = true;
+            this->transmit_condition_variable.wait(lock, [this, &buffer] {
+                return
+                    this->kill_transmit_thread ||
+                    !this->async_transmit_queue.empty() ||
+                    (!buffer.empty() && (this->m_transmit_fd.load(std::memory_order_acquire) != -1));
+            });
+            this->m_transmit_thread_idle = false;
+        }
+        bool exiting = this->kill_transmit_thread;
+        lock.unlock();//Don't hold up the emulator thread while we do I/O
+
+        std::size_t previous_size = buffer.size();
         while(this->async_transmit_queue.size() > 0){
-            char data = char(this->async_transmit_queue.front());
+            buffer.push_back(char(this->async_transmit_queue.front()));
             this->async_transmit_queue.pop();
-            std::cout<<data<<std::flush;
+        }
+        bool idle = buffer.size() == previous_size;
+
+        //Files are better off with fewer, larger writes; everything else wants characters to appear right away
+        if (exiting || idle || (this->m_backend != Backend::FILE) || (buffer.size() >= FILE_TRANSMIT_BUFFER_SIZE)) {
+            this->flush_transmit_buffer(buffer);
+        }
+
+        if (exiting) {
+            return;
+        }
+        lock.lock();
+    }
+}
+
+void Uart::flush_transmit_buffer(std::string& buffer) {
+    if (buffer.empty()) {
+        return;
+    }
+
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(this->transmit_mutex);
+        if (this->m_transmit_failed) {
+            buffer.clear();
+            return;
+        }
+
+        fd = this->m_transmit_fd.load(std::memory_order_relaxed);
+        if (fd == -1) {//No UNIX_SOCKET client (yet), so hold onto output for when one connects (within reason)
+            if (buffer.size() > MAX_UNCONNECTED_TRANSMIT_BUFFER_SIZE) {
+                buffer.resize(MAX_UNCONNECTED_TRANSMIT_BUFFER_SIZE);
+            }
+            return;
+        }
+        this->m_transmit_in_progress = true;//So a disconnecting UNIX_SOCKET client's fd isn't closed under us
+    }
+
+    if (this->m_backend == Backend::STDIO) {
+        fflush(stdout);//So we don't get out of order with anything else that libirve printed to stdout
+    }
+
+    bool written = write_all(fd, buffer.data(), buffer.size(), this->m_backend == Backend::UNIX_SOCKET);
+    buffer.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(this->transmit_mutex);
+        this->m_transmit_in_progress = false;
+        if (!written && (this->m_transmit_fd.load(std::memory_order_relaxed) == fd)) {//Not just a client disconnecting
+            irvelog_always(0, "Failed to write to the UART's backend; further output will be discarded");
+            this->m_transmit_failed = true;
         }
     }
+    this->transmit_condition_variable.notify_all();//In case disconnect_unix_socket_client() is waiting for us
+}
+
+void Uart::receive_thread_function() {
+    if (this->m_backend != Backend::UNIX_SOCKET) {
+        this->receive_until_hangup();
+        return;
+    }
+
+    //Serve one client at a time, going back to waiting for another whenever one goes away
+    while (this->accept_unix_socket_client() && this->receive_until_hangup()) {
+        this->disconnect_unix_socket_client();
+    }
+}
+
+bool Uart::receive_until_hangup() {
+    struct pollfd poll_fds[2] = {
+        {.fd = this->receive_file_fd,                   .events = POLLIN, .revents = 0},
+        {.fd = this->m_receive_thread_wakeup_pipe[0],   .events = POLLIN, .revents = 0}
+    };
+
+    uint8_t buffer[256];
+    while (true) {
+        if (::poll(poll_fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return true;
+        }
+
+        if (poll_fds[1].revents) {//The destructor wants us to exit
+            return false;
+        }
+
+        if (poll_fds[0].revents & POLLIN) {
+            //Drain everything available right now rather than one byte at a time
+            ssize_t bytes_read;
+            while ((bytes_read = ::read(this->receive_file_fd, buffer, sizeof(buffer))) > 0) {
+                for (ssize_t i = 0; i < bytes_read; ++i) {
+                    while (!this->receive_queue.push(buffer[i])) {
+                        //The guest isn't keeping up, so wait for it to make room (or for us to be told to exit)
+                        if (::poll(&poll_fds[1], 1, 1) > 0) {
+                            return false;
+                        }
+                    }
+                }
+                if (this->m_receive_doorbell) {
+                    this->m_receive_doorbell->ring();
+                }
+            }
+
+            if (bytes_read == 0) {//EOF, so nothing more will ever arrive
+                return true;
+            } else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                return true;
+            }
+        } else if (poll_fds[0].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+            return true;
+        }
+    }
+}
+
+void Uart::disconnect_unix_socket_client() {
+    int client_fd = this->receive_file_fd;
+    shutdown(client_fd, SHUT_RDWR);//So a write the transmit thread is in the middle of fails rather than waiting
+
+    {
+        std::unique_lock<std::mutex> lock(this->transmit_mutex);
+        this->m_transmit_fd.store(-1, std::memory_order_release);//Hold onto output until the next client connects
+        this->m_transmit_failed = false;//That write failing doesn't mean the next client's will
+        this->transmit_condition_variable.wait(lock, [this] { return !this->m_transmit_in_progress; });
+    }
+
+    close(client_fd);
+    this->receive_file_fd = -1;
+    irvelog_always(0, "The UART socket's client disconnected; waiting for another");
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static bool write_all(int fd, const char* data, std::size_t size, bool is_socket) {
+    while (size > 0) {
+        //MSG_NOSIGNAL (or SO_NOSIGPIPE) so a client disconnecting from a socket doesn't kill the whole emulator with SIGPIPE
+        ssize_t bytes_written = is_socket ? ::send(fd, data, size, MSG_NOSIGNAL) : ::write(fd, data, size);
+        if (bytes_written > 0) {
+            data += bytes_written;
+            size -= static_cast<std::size_t>(bytes_written);
+        } else if ((bytes_written == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            //The fd is non-blocking (for the receive thread's sake), so wait for the other end to catch up
+            struct pollfd poll_fd = {.fd = fd, .events = POLLOUT, .revents = 0};
+            ::poll(&poll_fd, 1, -1);
+        } else if ((bytes_written == -1) && (errno == EINTR)) {
+            continue;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static void set_close_on_exec(int fd) {
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD, 0) | FD_CLOEXEC);
 }
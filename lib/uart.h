@@ -17,14 +17,19 @@
  * Includes
  * --------------------------------------------------------------------------------------------- */
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 #include <thread>
 #include <condition_variable>
+#include "doorbell.h"
+#include "spscqueue.h"
 #include "tsqueue.h"
-#include <queue>
 #include <termios.h>
 
+//termios.h defines this c_cc index, which would otherwise clobber Csr::Address::VSTART (we never use it)
+#undef VSTART
+
 /* ------------------------------------------------------------------------------------------------
  * Type/Class Declarations
  * --------------------------------------------------------------------------------------------- */
@@ -57,8 +62,17 @@ public:
 
     /**
      * @brief The constructor
+     * @param backend_spec Where the UART's input comes from and its output goes to. One of:
+     *  "stdio": The terminal IRVE was started from (the default). Only one UART at a time reads from
+     *  stdin; any others created while it exists only write to stdout\n
+     *  "file:<output path>[,<input path>]": Files or named pipes; output is written in large chunks\n
+     *  "pty": A new host pseudo-terminal, whose name is logged so you can attach to it\n
+     *  "unix:<socket path>": A Unix domain socket which serves one client at a time (another can
+     *  connect once it disconnects)
+     * @param receive_doorbell Rung whenever input arrives (so harts in WFI wake up), or nullptr
+     * @note Throws std::runtime_error if backend_spec is invalid or the backend couldn't be set up
     */
-    Uart();
+    Uart(const char* backend_spec = "stdio", Doorbell* receive_doorbell = nullptr);
 
     /**
      * @brief The desctructor
@@ -83,6 +97,36 @@ public:
     bool interrupt_pending();//More convenient than reading ISR and checking bits
 
 private:
+    enum class Backend : uint8_t {
+        STDIO,
+        FILE,
+        PTY,
+        UNIX_SOCKET
+    };
+
+    /**
+     * @brief Parse backend_spec and open the file descriptors it refers to
+     * @note Cleans up after itself before throwing, since the destructor won't run if it does
+    */
+    void open_backend(const char* backend_spec);
+
+    /**
+     * @brief Wait for a client to connect to the UNIX_SOCKET backend's listening socket
+     * @return False if we were told to exit (or something went wrong) before anyone connected
+    */
+    bool accept_unix_socket_client();
+
+    /**
+     * @brief Close the UNIX_SOCKET backend's client after it hangs up, so another can connect
+     * @note Waits for the transmit thread to stop writing to it first
+    */
+    void disconnect_unix_socket_client();
+
+    /**
+     * @brief Write out (and clear) everything the transmit thread has batched up
+    */
+    void flush_transmit_buffer(std::string& buffer);
+
     uint8_t construct_isr() const;
 
     /**
@@ -92,9 +136,20 @@ private:
 
     void transmit_thread_function();
 
-    void update_receive();
+    /**
+     * @brief Blocks in poll() on the receive fd and drains everything available into
+     *        receive_queue, so the emulator thread never has to make syscalls to receive
+    */
+    void receive_thread_function();
+
+    /**
+     * @brief Move input from receive_file_fd into receive_queue until the other end hangs up
+     * @return False if we were told to exit, true if the other end hung up (or something went wrong)
+    */
+    bool receive_until_hangup();
+
     struct {
-        //No need for rhr and thr since they just go directly to stdin/stdout
+        //No need for rhr and thr since they just go directly to the backend
         uint8_t m_ier;//Interrupt Enable Register
         //No need for the Interrupt Status Register since we just construct it on-the-fly when read
         uint8_t m_fcr;//FIFO Control Register
@@ -105,20 +160,36 @@ private:
         uint8_t m_spr;//Scratch Pad Register
     
         //Note: We expose these registers, but we completely ignore their contents
-        //since the serial output is the terminal and there are no real "wires" to
+        //since the serial output is a host file descriptor and there are no real "wires" to
         //run at a particular baud rate
         uint8_t m_dll;//Divisor Latch LSB
         uint8_t m_dlm;//Divisor Latch MSB
         uint8_t m_psd;//Prescaler Division
     } regs;
 
-    int receive_file_fd;
-    std::queue<uint8_t> receive_queue;
+    Backend m_backend;
+
+    int receive_file_fd;//-1 if there is no input (yet)
+    spscqueue::spscqueue_t<uint8_t, 4096> receive_queue;//Pushed by the receive thread, popped by the emulator (whether it's empty is LSR.DR)
+    Doorbell* m_receive_doorbell;//Rung by the receive thread when it pushes; may be nullptr
+    int m_original_receive_file_fd_flags;//To restore the O_NONBLOCK change we made to stdin when we're done
     struct termios m_original_receive_file_fd_settings;//To restore terminal changes we made when we're done
+    bool m_restore_receive_file_fd_settings;//False if stdin isn't a terminal
+    bool m_owns_stdin;//STDIO backend only; false if another UART already had stdin when we were created
+    int m_listen_fd;//UNIX_SOCKET backend only
+    std::string m_socket_path;//UNIX_SOCKET backend only, so we can unlink it when we're done
+    int m_pty_slave_fd;//PTY backend only; we keep the slave open so the master doesn't see a hangup
+
+    std::thread receive_thread;
+    int m_receive_thread_wakeup_pipe[2];//Written to in the destructor to break the receive thread out of poll()
 
     std::thread transmit_thread;//Thread for write operations.
+    std::atomic<int> m_transmit_fd;//-1 while no UNIX_SOCKET client is connected; only changed with transmit_mutex held
+    bool m_transmit_failed;//Protected by transmit_mutex
+    bool m_transmit_in_progress;//Protected by transmit_mutex; the transmit thread is writing to m_transmit_fd without it
     tsqueue::tsqueue_t<uint8_t> async_transmit_queue;//Queue for async transmits.
     bool kill_transmit_thread = false;
+    std::atomic<bool> m_transmit_thread_idle;//Waiting for a THR write with nothing batched up (so the FILE backend must wake it)
     std::condition_variable transmit_condition_variable;
     std::mutex transmit_mutex;
     bool m_isr_read_since_last_thr_write;
@@ -0,0 +1,1005 @@
+/**
+ * @brief   The vector unit (a Zve32x subset of the V extension)
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Element loops are plain loops over the register file so the compiler can vectorize them for
+ * whatever the host is. The most common unmasked operations also have an explicit SSE2 path
+ * (which every x86-64 host has) that handles 16 bytes at a time, leaving the scalar loop to finish
+ * off any partial chunk at the end so tail elements are never touched.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "vector.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "common.h"
+#include "cpu_state.h"
+#include "csr.h"
+#include "decode.h"
+#include "memory.h"
+#include "rv_trap.h"
+
+#define LOG_SUBSYSTEM EXECUTE
+#define INST_COUNT CSR.implicit_read(Csr::Address::MINSTRET).u
+#include "logging.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+//The largest element width supported (Zve32x)
+#define ELEN 32
+
+//funct3 values for OP-V
+#define OPIVV 0b000
+#define OPMVV 0b010
+#define OPIVI 0b011
+#define OPIVX 0b100
+#define OPMVX 0b110
+
+//Wraps an SSE2 implementation of an operation (on a = vs2 and b = vs1 or the scalar) so that it
+//disappears entirely on hosts without SSE2
+#if defined(__SSE2__)
+#define SIMD(...) []([[maybe_unused]] __m128i a, [[maybe_unused]] __m128i b) { return __VA_ARGS__; }
+#else
+#define SIMD(...) nullptr
+#endif
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief The decoded form of vtype
+*/
+struct VConfig {
+    uint32_t sew;//Element width in bits
+    int32_t  lmul_log2;//-2 to 3
+    uint32_t vlmax;
+};
+
+/**
+ * @brief The fields of an OP-V instruction (other than vset*)
+*/
+struct Operands {
+    uint8_t  funct3;
+    uint8_t  funct6;
+    bool     masked;//Only elements whose v0 mask bit is set are active
+    uint8_t  vd;
+    uint8_t  vs1;//Also rs1 and the immediate
+    uint8_t  vs2;
+    bool     vector_op1;//The second operand is vs1 rather than the scalar
+    uint32_t scalar;//x[rs1] or the sign-extended immediate
+    uint32_t vl;
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+static bool decode_vtype(uint32_t vtype, VConfig& config);
+static VConfig current_config(Csr& CSR);
+static void require_aligned(uint8_t reg, int32_t emul_log2);
+
+template<typename E>
+static void arithmetic_sew(const Operands& ops, const VConfig& config, CpuState& cpu_state, Csr& CSR);
+
+template<typename E>
+static E get_elem(const uint8_t* reg, uint32_t i);
+template<typename E>
+static void set_elem(uint8_t* reg, uint32_t i, E value);
+static bool mask_bit(const uint8_t* reg, uint32_t i);
+static void set_mask_bit(uint8_t* reg, uint32_t i, bool value);
+
+/**
+ * @brief vd[i] = op(vs2[i], vs1[i] or the scalar, vd[i]) for each active element
+*/
+template<typename E, typename Op, typename SimdOp>
+static void elementwise(CpuState& cpu_state, const Operands& ops, Op op, SimdOp simd_op);
+
+/**
+ * @brief Mask bit i of vd = pred(vs2[i], vs1[i] or the scalar) for each active element
+*/
+template<typename E, typename Pred>
+static void compare(CpuState& cpu_state, const Operands& ops, Pred pred);
+
+/**
+ * @brief vd[0] = op(... op(op(vs1[0], vs2[0]), vs2[1]) ..., vs2[vl - 1]) over the active elements
+*/
+template<typename E, typename Op>
+static void reduce(CpuState& cpu_state, const Operands& ops, Op op);
+
+/**
+ * @brief Mask bit i of vd = op(mask bit i of vs2, mask bit i of vs1) for every body element
+*/
+template<typename Op>
+static void mask_logical(CpuState& cpu_state, const Operands& ops, Op op);
+
+#if defined(__SSE2__)
+template<typename E>
+static __m128i simd_splat(E value);
+template<typename E>
+static __m128i simd_add(__m128i a, __m128i b);
+template<typename E>
+static __m128i simd_sub(__m128i a, __m128i b);
+#endif
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+bool vector::is_vector_width(uint8_t width) {
+    //000 is 8 bits, and 101 to 111 are 16 to 64 bits (001 to 100 are scalar floating point)
+    return (width == 0b000) || (width >= 0b101);
+}
+
+void vector::vset(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Csr& CSR) {
+    Word raw = decoded_inst.get_raw();
+    uint8_t rd = decoded_inst.get_rd();
+    uint8_t rs1 = decoded_inst.get_rs1();
+
+    uint32_t vtype;
+    bool avl_from_rs1 = true;
+    if (raw.bit(31) == 0) {
+        irvelog(3, "Mnemonic: VSETVLI");
+        vtype = raw.bits(30, 20).u;
+    } else if (raw.bits(31, 30) == 0b11) {
+        irvelog(3, "Mnemonic: VSETIVLI");
+        vtype = raw.bits(29, 20).u;
+        avl_from_rs1 = false;
+    } else if (raw.bits(30, 25) == 0) {
+        irvelog(3, "Mnemonic: VSETVL");
+        vtype = cpu_state.get_r(decoded_inst.get_rs2()).u;
+    } else {
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+
+    //The application vector length
+    uint32_t avl;
+    if (!avl_from_rs1) {
+        avl = rs1;//An immediate
+    } else if (rs1 != 0) {
+        avl = cpu_state.get_r(rs1).u;
+    } else if (rd != 0) {
+        avl = std::numeric_limits<uint32_t>::max();//As long as possible
+    } else {
+        avl = CSR.implicit_read(Csr::Address::VL).u;//Just change vtype
+    }
+
+    VConfig config;
+    uint32_t vl;
+    if (decode_vtype(vtype, config)) {
+        vl = std::min(avl, config.vlmax);
+        irvelog(3, "SEW = %u, LMUL = 2^%d, VLMAX = %u, vl = %u", config.sew, config.lmul_log2, config.vlmax, vl);
+    } else {
+        irvelog(3, "Unsupported vtype 0x%08X, setting vill", vtype);
+        vtype = VTYPE_VILL;
+        vl = 0;
+    }
+
+    CSR.implicit_write(Csr::Address::VTYPE, vtype);
+    CSR.implicit_write(Csr::Address::VL, vl);
+    CSR.implicit_write(Csr::Address::VSTART, 0);
+    cpu_state.set_r(rd, vl);
+}
+
+void vector::arithmetic(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Csr& CSR) {
+    VConfig config = current_config(CSR);
+
+    //We're allowed to refuse to resume arithmetic partway through, which keeps the loops simple
+    if (CSR.implicit_read(Csr::Address::VSTART).u != 0) {
+        irvelog(3, "vstart is nonzero, which isn't supported for arithmetic instructions");
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+
+    Word raw = decoded_inst.get_raw();
+    Operands ops = {
+        .funct3     = decoded_inst.get_funct3(),
+        .funct6     = (uint8_t)raw.bits(31, 26).u,
+        .masked     = raw.bit(25) == 0,
+        .vd         = decoded_inst.get_rd(),
+        .vs1        = decoded_inst.get_rs1(),
+        .vs2        = decoded_inst.get_rs2(),
+        .vector_op1 = false,
+        .scalar     = 0,
+        .vl         = CSR.implicit_read(Csr::Address::VL).u,
+    };
+
+    switch (ops.funct3) {
+        case OPIVV:
+        case OPMVV:
+            ops.vector_op1 = true;
+            break;
+        case OPIVX:
+        case OPMVX:
+            ops.scalar = cpu_state.get_r(ops.vs1).u;
+            break;
+        case OPIVI:
+            ops.scalar = raw.bits(19, 15).sign_extend_from_bit_number(4).u;
+            break;
+        default://OPFVV and OPFVF: there's no floating point in Zve32x
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            break;
+    }
+
+    switch (config.sew) {
+        case 8:     arithmetic_sew<uint8_t> (ops, config, cpu_state, CSR); break;
+        case 16:    arithmetic_sew<uint16_t>(ops, config, cpu_state, CSR); break;
+        case 32:    arithmetic_sew<uint32_t>(ops, config, cpu_state, CSR); break;
+        default:
+            assert(false && "We should never get here");
+            break;
+    }
+
+    CSR.set_vector_dirty();
+}
+
+void vector::load(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Memory& memory, Csr& CSR) {
+    VConfig config = current_config(CSR);
+
+    Word raw = decoded_inst.get_raw();
+    bool masked = raw.bit(25) == 0;
+    uint8_t mop = raw.bits(27, 26).u;
+    uint8_t lumop = decoded_inst.get_rs2();
+    uint8_t vd = decoded_inst.get_rd();
+
+    if (raw.bits(31, 28) != 0) {//nf and mew
+        irvelog(3, "Segment loads (and EEW > 64) aren't supported");
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+
+    uint32_t eew;
+    uint8_t data_type;
+    switch (decoded_inst.get_funct3()) {
+        case 0b000: eew = 8;  data_type = DT_BYTE;      break;
+        case 0b101: eew = 16; data_type = DT_HALFWORD;  break;
+        case 0b110: eew = 32; data_type = DT_WORD;      break;
+        default://64 bit elements are larger than ELEN
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            break;
+    }
+
+    //EMUL = (EEW / SEW) * LMUL
+    int32_t emul_log2 = std::countr_zero(eew) - std::countr_zero(config.sew) + config.lmul_log2;
+    uint32_t evl = CSR.implicit_read(Csr::Address::VL).u;
+    uint32_t stride = eew / 8;
+    bool fault_only_first = false;
+    if (mop == 0b00) {
+        if (lumop == 0b00000) {
+            irvelog(3, "Mnemonic: VLE%u.V", eew);
+        } else if ((lumop == 0b01011) && (eew == 8) && !masked) {
+            irvelog(3, "Mnemonic: VLM.V");
+            evl = (evl + 7) / 8;
+            emul_log2 = 0;
+        } else if (lumop == 0b10000) {
+            irvelog(3, "Mnemonic: VLE%uFF.V", eew);
+            fault_only_first = true;
+        } else {//Whole register loads aren't supported
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+        }
+    } else if (mop == 0b10) {
+        irvelog(3, "Mnemonic: VLSE%u.V", eew);
+        stride = cpu_state.get_r(decoded_inst.get_rs2()).u;
+    } else {//Indexed loads aren't supported
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+
+    if ((emul_log2 < -3) || (emul_log2 > 3) || (masked && (vd == 0))) {
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+    require_aligned(vd, emul_log2);
+
+    Word base = cpu_state.get_r(decoded_inst.get_rs1());
+    const uint8_t* mask = cpu_state.get_v(0);
+    uint8_t* dest = cpu_state.get_v(vd);
+    uint32_t i = CSR.implicit_read(Csr::Address::VSTART).u;
+    try {
+        for (; i < evl; ++i) {
+            if (masked && !mask_bit(mask, i)) {
+                continue;
+            }
+
+            Word value = memory.load(base + (i * stride), data_type);
+            switch (eew) {
+                case 8:     set_elem<uint8_t> (dest, i, (uint8_t) value.u); break;
+                case 16:    set_elem<uint16_t>(dest, i, (uint16_t)value.u); break;
+                case 32:    set_elem<uint32_t>(dest, i, (uint32_t)value.u); break;
+            }
+        }
+    } catch (const rv_trap::RvException&) {
+        CSR.set_vector_dirty();//Earlier elements may have been written
+        if (fault_only_first && (i > 0)) {
+            irvelog(3, "Element %u faulted, so trimming vl to %u instead", i, i);
+            CSR.implicit_write(Csr::Address::VL, i);
+        } else {
+            irvelog(3, "Element %u faulted", i);
+            CSR.implicit_write(Csr::Address::VSTART, i);
+            throw;
+        }
+    }
+
+    CSR.implicit_write(Csr::Address::VSTART, 0);
+    CSR.set_vector_dirty();
+}
+
+void vector::store(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Memory& memory, Csr& CSR) {
+    VConfig config = current_config(CSR);
+
+    Word raw = decoded_inst.get_raw();
+    bool masked = raw.bit(25) == 0;
+    uint8_t mop = raw.bits(27, 26).u;
+    uint8_t sumop = decoded_inst.get_rs2();
+    uint8_t vs3 = raw.bits(11, 7).u;
+
+    if (raw.bits(31, 28) != 0) {//nf and mew
+        irvelog(3, "Segment stores (and EEW > 64) aren't supported");
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+
+    uint32_t eew;
+    uint8_t data_type;
+    switch (decoded_inst.get_funct3()) {
+        case 0b000: eew = 8;  data_type = DT_BYTE;      break;
+        case 0b101: eew = 16; data_type = DT_HALFWORD;  break;
+        case 0b110: eew = 32; data_type = DT_WORD;      break;
+        default://64 bit elements are larger than ELEN
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+            break;
+    }
+
+    int32_t emul_log2 = std::countr_zero(eew) - std::countr_zero(config.sew) + config.lmul_log2;
+    uint32_t evl = CSR.implicit_read(Csr::Address::VL).u;
+    uint32_t stride = eew / 8;
+    if (mop == 0b00) {
+        if (sumop == 0b00000) {
+            irvelog(3, "Mnemonic: VSE%u.V", eew);
+        } else if ((sumop == 0b01011) && (eew == 8) && !masked) {
+            irvelog(3, "Mnemonic: VSM.V");
+            evl = (evl + 7) / 8;
+            emul_log2 = 0;
+        } else {//Whole register stores aren't supported
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+        }
+    } else if (mop == 0b10) {
+        irvelog(3, "Mnemonic: VSSE%u.V", eew);
+        stride = cpu_state.get_r(decoded_inst.get_rs2()).u;
+    } else {//Indexed stores aren't supported
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+
+    if ((emul_log2 < -3) || (emul_log2 > 3)) {
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+    require_aligned(vs3, emul_log2);
+
+    Word base = cpu_state.get_r(decoded_inst.get_rs1());
+    const uint8_t* mask = cpu_state.get_v(0);
+    const uint8_t* src = cpu_state.get_v(vs3);
+    uint32_t i = CSR.implicit_read(Csr::Address::VSTART).u;
+    try {
+        for (; i < evl; ++i) {
+            if (masked && !mask_bit(mask, i)) {
+                continue;
+            }
+
+            Word value;
+            switch (eew) {
+                case 8:     value = get_elem<uint8_t> (src, i); break;
+                case 16:    value = get_elem<uint16_t>(src, i); break;
+                case 32:    value = get_elem<uint32_t>(src, i); break;
+            }
+            memory.store(base + (i * stride), data_type, value);
+        }
+    } catch (const rv_trap::RvException&) {
+        irvelog(3, "Element %u faulted", i);
+        CSR.implicit_write(Csr::Address::VSTART, i);
+        throw;
+    }
+
+    CSR.implicit_write(Csr::Address::VSTART, 0);
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static bool decode_vtype(uint32_t vtype, VConfig& config) {
+    if (vtype & ~0xFFU) {//vill, or reserved bits set
+        return false;
+    }
+
+    uint32_t vsew = (vtype >> 3) & 0b111;
+    uint32_t vlmul = vtype & 0b111;
+    if ((vsew > 0b010) || (vlmul == 0b100)) {//SEW > ELEN, or a reserved LMUL
+        return false;
+    }
+
+    config.sew = 8U << vsew;
+    config.lmul_log2 = (vlmul & 0b100) ? ((int32_t)vlmul - 8) : (int32_t)vlmul;
+    if ((config.lmul_log2 < 0) && (config.sew > ((uint32_t)ELEN >> -config.lmul_log2))) {//Need SEW <= LMUL * ELEN
+        return false;
+    }
+
+    if (config.lmul_log2 >= 0) {
+        config.vlmax = (VLEN / config.sew) << config.lmul_log2;
+    } else {
+        config.vlmax = (VLEN / config.sew) >> -config.lmul_log2;
+    }
+    return true;
+}
+
+static VConfig current_config(Csr& CSR) {
+    VConfig config;
+    if (!decode_vtype(CSR.implicit_read(Csr::Address::VTYPE).u, config)) {
+        irvelog(3, "vtype.vill is set, so vector instructions are illegal");
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+    return config;
+}
+
+static void require_aligned(uint8_t reg, int32_t emul_log2) {
+    //Register groups must start at a multiple of their size (which also keeps them below v32)
+    if ((emul_log2 > 0) && (reg & ((1U << emul_log2) - 1))) {
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    }
+}
+
+template<typename E>
+static void arithmetic_sew(const Operands& ops, const VConfig& config, CpuState& cpu_state, [[maybe_unused]] Csr& CSR) {
+    using S = std::make_signed_t<E>;
+    constexpr uint32_t SEW = sizeof(E) * 8;
+    constexpr E SHIFT_MASK = SEW - 1;
+
+    bool opi = (ops.funct3 == OPIVV) || (ops.funct3 == OPIVX) || (ops.funct3 == OPIVI);
+    bool vv  = (ops.funct3 == OPIVV) || (ops.funct3 == OPMVV);
+    bool vi  = ops.funct3 == OPIVI;
+    bool vx  = (ops.funct3 == OPIVX) || (ops.funct3 == OPMVX);
+
+    //Register group checks for each kind of instruction
+    auto elementwise_checks = [&] {
+        require_aligned(ops.vd, config.lmul_log2);
+        require_aligned(ops.vs2, config.lmul_log2);
+        if (vv) {
+            require_aligned(ops.vs1, config.lmul_log2);
+        }
+        if (ops.masked && (ops.vd == 0)) {//The mask would be overwritten partway through
+            rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+        }
+    };
+    auto compare_checks = [&] {
+        require_aligned(ops.vs2, config.lmul_log2);
+        if (vv) {
+            require_aligned(ops.vs1, config.lmul_log2);
+        }
+    };
+    auto illegal = [] {
+        rv_trap::invoke_exception(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    };
+
+    if (opi) {
+        switch (ops.funct6) {
+            case 0b000000://VADD
+                irvelog(3, "Mnemonic: VADD");
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)(a + b); }, SIMD(simd_add<E>(a, b)));
+                break;
+            case 0b000010://VSUB
+                irvelog(3, "Mnemonic: VSUB");
+                if (vi) { illegal(); }
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)(a - b); }, SIMD(simd_sub<E>(a, b)));
+                break;
+            case 0b000011://VRSUB
+                irvelog(3, "Mnemonic: VRSUB");
+                if (vv) { illegal(); }
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)(b - a); }, SIMD(simd_sub<E>(b, a)));
+                break;
+            case 0b000100://VMINU
+                irvelog(3, "Mnemonic: VMINU");
+                if (vi) { illegal(); }
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return std::min(a, b); }, nullptr);
+                break;
+            case 0b000101://VMIN
+                irvelog(3, "Mnemonic: VMIN");
+                if (vi) { illegal(); }
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)std::min((S)a, (S)b); }, nullptr);
+                break;
+            case 0b000110://VMAXU
+                irvelog(3, "Mnemonic: VMAXU");
+                if (vi) { illegal(); }
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return std::max(a, b); }, nullptr);
+                break;
+            case 0b000111://VMAX
+                irvelog(3, "Mnemonic: VMAX");
+                if (vi) { illegal(); }
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)std::max((S)a, (S)b); }, nullptr);
+                break;
+            case 0b001001://VAND
+                irvelog(3, "Mnemonic: VAND");
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)(a & b); }, SIMD(_mm_and_si128(a, b)));
+                break;
+            case 0b001010://VOR
+                irvelog(3, "Mnemonic: VOR");
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)(a | b); }, SIMD(_mm_or_si128(a, b)));
+                break;
+            case 0b001011://VXOR
+                irvelog(3, "Mnemonic: VXOR");
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)(a ^ b); }, SIMD(_mm_xor_si128(a, b)));
+                break;
+            case 0b010111://VMERGE or VMV.V
+                if (ops.masked) {
+                    irvelog(3, "Mnemonic: VMERGE");
+                    require_aligned(ops.vd, config.lmul_log2);
+                    require_aligned(ops.vs2, config.lmul_log2);
+                    if (vv) {
+                        require_aligned(ops.vs1, config.lmul_log2);
+                    }
+                    if (ops.vd == 0) {
+                        illegal();
+                    }
+
+                    //Every body element is written: vs1/the scalar where the mask is set, vs2 elsewhere
+                    const uint8_t* mask = cpu_state.get_v(0);
+                    const uint8_t* vs1 = cpu_state.get_v(ops.vs1);
+                    const uint8_t* vs2 = cpu_state.get_v(ops.vs2);
+                    uint8_t* vd = cpu_state.get_v(ops.vd);
+                    for (uint32_t i = 0; i < ops.vl; ++i) {
+                        E op1 = vv ? get_elem<E>(vs1, i) : (E)ops.scalar;
+                        set_elem<E>(vd, i, mask_bit(mask, i) ? op1 : get_elem<E>(vs2, i));
+                    }
+                } else {
+                    irvelog(3, "Mnemonic: VMV.V");
+                    if (ops.vs2 != 0) {
+                        illegal();
+                    }
+                    elementwise_checks();
+                    elementwise<E>(cpu_state, ops, [](E, E b, E) { return b; }, SIMD(b));
+                }
+                break;
+            case 0b011000://VMSEQ
+                irvelog(3, "Mnemonic: VMSEQ");
+                compare_checks();
+                compare<E>(cpu_state, ops, [](E a, E b) { return a == b; });
+                break;
+            case 0b011001://VMSNE
+                irvelog(3, "Mnemonic: VMSNE");
+                compare_checks();
+                compare<E>(cpu_state, ops, [](E a, E b) { return a != b; });
+                break;
+            case 0b011010://VMSLTU
+                irvelog(3, "Mnemonic: VMSLTU");
+                if (vi) { illegal(); }
+                compare_checks();
+                compare<E>(cpu_state, ops, [](E a, E b) { return a < b; });
+                break;
+            case 0b011011://VMSLT
+                irvelog(3, "Mnemonic: VMSLT");
+                if (vi) { illegal(); }
+                compare_checks();
+                compare<E>(cpu_state, ops, [](E a, E b) { return (S)a < (S)b; });
+                break;
+            case 0b011100://VMSLEU
+                irvelog(3, "Mnemonic: VMSLEU");
+                compare_checks();
+                compare<E>(cpu_state, ops, [](E a, E b) { return a <= b; });
+                break;
+            case 0b011101://VMSLE
+                irvelog(3, "Mnemonic: VMSLE");
+                compare_checks();
+                compare<E>(cpu_state, ops, [](E a, E b) { return (S)a <= (S)b; });
+                break;
+            case 0b011110://VMSGTU
+                irvelog(3, "Mnemonic: VMSGTU");
+                if (vv) { illegal(); }
+                compare_checks();
+                compare<E>(cpu_state, ops, [](E a, E b) { return a > b; });
+                break;
+            case 0b011111://VMSGT
+                irvelog(3, "Mnemonic: VMSGT");
+                if (vv) { illegal(); }
+                compare_checks();
+                compare<E>(cpu_state, ops, [](E a, E b) { return (S)a > (S)b; });
+                break;
+            case 0b100101://VSLL
+                irvelog(3, "Mnemonic: VSLL");
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)(a << (b & SHIFT_MASK)); }, nullptr);
+                break;
+            case 0b101000://VSRL
+                irvelog(3, "Mnemonic: VSRL");
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)(a >> (b & SHIFT_MASK)); }, nullptr);
+                break;
+            case 0b101001://VSRA
+                irvelog(3, "Mnemonic: VSRA");
+                elementwise_checks();
+                elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)((S)a >> (b & SHIFT_MASK)); }, nullptr);
+                break;
+            default:
+                illegal();
+                break;
+        }
+        return;
+    }
+
+    //OPMVV and OPMVX
+    switch (ops.funct6) {
+        case 0b000000 ... 0b000111: {//Reductions
+            if (vx) { illegal(); }
+            require_aligned(ops.vs2, config.lmul_log2);
+            switch (ops.funct6) {
+                case 0b000000:
+                    irvelog(3, "Mnemonic: VREDSUM.VS");
+                    reduce<E>(cpu_state, ops, [](E acc, E a) { return (E)(acc + a); });
+                    break;
+                case 0b000001:
+                    irvelog(3, "Mnemonic: VREDAND.VS");
+                    reduce<E>(cpu_state, ops, [](E acc, E a) { return (E)(acc & a); });
+                    break;
+                case 0b000010:
+                    irvelog(3, "Mnemonic: VREDOR.VS");
+                    reduce<E>(cpu_state, ops, [](E acc, E a) { return (E)(acc | a); });
+                    break;
+                case 0b000011:
+                    irvelog(3, "Mnemonic: VREDXOR.VS");
+                    reduce<E>(cpu_state, ops, [](E acc, E a) { return (E)(acc ^ a); });
+                    break;
+                case 0b000100:
+                    irvelog(3, "Mnemonic: VREDMINU.VS");
+                    reduce<E>(cpu_state, ops, [](E acc, E a) { return std::min(acc, a); });
+                    break;
+                case 0b000101:
+                    irvelog(3, "Mnemonic: VREDMIN.VS");
+                    reduce<E>(cpu_state, ops, [](E acc, E a) { return (E)std::min((S)acc, (S)a); });
+                    break;
+                case 0b000110:
+                    irvelog(3, "Mnemonic: VREDMAXU.VS");
+                    reduce<E>(cpu_state, ops, [](E acc, E a) { return std::max(acc, a); });
+                    break;
+                case 0b000111:
+                    irvelog(3, "Mnemonic: VREDMAX.VS");
+                    reduce<E>(cpu_state, ops, [](E acc, E a) { return (E)std::max((S)acc, (S)a); });
+                    break;
+            }
+            break;
+        }
+        case 0b010000://VWXUNARY0 (VMV.X.S, VCPOP.M, VFIRST.M) or VRXUNARY0 (VMV.S.X)
+            if (vv) {
+                uint8_t rd = ops.vd;
+                const uint8_t* vs2 = cpu_state.get_v(ops.vs2);
+                if ((ops.vs1 == 0b00000) && !ops.masked) {
+                    irvelog(3, "Mnemonic: VMV.X.S");
+                    cpu_state.set_r(rd, (uint32_t)(int32_t)(S)get_elem<E>(vs2, 0));
+                } else if ((ops.vs1 == 0b10000) || (ops.vs1 == 0b10001)) {
+                    const uint8_t* mask = cpu_state.get_v(0);
+                    uint32_t count = 0;
+                    int32_t first = -1;
+                    for (uint32_t i = 0; i < ops.vl; ++i) {
+                        if ((!ops.masked || mask_bit(mask, i)) && mask_bit(vs2, i)) {
+                            if (first < 0) {
+                                first = (int32_t)i;
+                            }
+                            ++count;
+                        }
+                    }
+                    if (ops.vs1 == 0b10000) {
+                        irvelog(3, "Mnemonic: VCPOP.M");
+                        cpu_state.set_r(rd, count);
+                    } else {
+                        irvelog(3, "Mnemonic: VFIRST.M");
+                        cpu_state.set_r(rd, first);
+                    }
+                } else {
+                    illegal();
+                }
+            } else {
+                irvelog(3, "Mnemonic: VMV.S.X");
+                if ((ops.vs2 != 0) || ops.masked) {
+                    illegal();
+                }
+                if (ops.vl > 0) {
+                    set_elem<E>(cpu_state.get_v(ops.vd), 0, (E)ops.scalar);
+                }
+            }
+            break;
+        case 0b010100://VMUNARY0 (only VID.V)
+            irvelog(3, "Mnemonic: VID.V");
+            if (!vv || (ops.vs1 != 0b10001) || (ops.vs2 != 0)) {
+                illegal();
+            }
+            elementwise_checks();
+            {
+                const uint8_t* mask = cpu_state.get_v(0);
+                uint8_t* vd = cpu_state.get_v(ops.vd);
+                for (uint32_t i = 0; i < ops.vl; ++i) {
+                    if (!ops.masked || mask_bit(mask, i)) {
+                        set_elem<E>(vd, i, (E)i);
+                    }
+                }
+            }
+            break;
+        case 0b011000 ... 0b011111://Mask logical instructions
+            if (vx || ops.masked) {
+                illegal();
+            }
+            switch (ops.funct6) {
+                case 0b011000:
+                    irvelog(3, "Mnemonic: VMANDN.MM");
+                    mask_logical(cpu_state, ops, [](bool a, bool b) { return a && !b; });
+                    break;
+                case 0b011001:
+                    irvelog(3, "Mnemonic: VMAND.MM");
+                    mask_logical(cpu_state, ops, [](bool a, bool b) { return a && b; });
+                    break;
+                case 0b011010:
+                    irvelog(3, "Mnemonic: VMOR.MM");
+                    mask_logical(cpu_state, ops, [](bool a, bool b) { return a || b; });
+                    break;
+                case 0b011011:
+                    irvelog(3, "Mnemonic: VMXOR.MM");
+                    mask_logical(cpu_state, ops, [](bool a, bool b) { return a != b; });
+                    break;
+                case 0b011100:
+                    irvelog(3, "Mnemonic: VMORN.MM");
+                    mask_logical(cpu_state, ops, [](bool a, bool b) { return a || !b; });
+                    break;
+                case 0b011101:
+                    irvelog(3, "Mnemonic: VMNAND.MM");
+                    mask_logical(cpu_state, ops, [](bool a, bool b) { return !(a && b); });
+                    break;
+                case 0b011110:
+                    irvelog(3, "Mnemonic: VMNOR.MM");
+                    mask_logical(cpu_state, ops, [](bool a, bool b) { return !(a || b); });
+                    break;
+                case 0b011111:
+                    irvelog(3, "Mnemonic: VMXNOR.MM");
+                    mask_logical(cpu_state, ops, [](bool a, bool b) { return a == b; });
+                    break;
+            }
+            break;
+        case 0b100000://VDIVU
+            irvelog(3, "Mnemonic: VDIVU");
+            elementwise_checks();
+            elementwise<E>(cpu_state, ops, [](E a, E b, E) {
+                return (b == 0) ? std::numeric_limits<E>::max() : (E)(a / b);
+            }, nullptr);
+            break;
+        case 0b100001://VDIV
+            irvelog(3, "Mnemonic: VDIV");
+            elementwise_checks();
+            elementwise<E>(cpu_state, ops, [](E a, E b, E) {
+                if (b == 0) {
+                    return (E)-1;
+                } else if (((S)a == std::numeric_limits<S>::min()) && ((S)b == -1)) {//Overflow
+                    return a;
+                }
+                return (E)((S)a / (S)b);
+            }, nullptr);
+            break;
+        case 0b100010://VREMU
+            irvelog(3, "Mnemonic: VREMU");
+            elementwise_checks();
+            elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (b == 0) ? a : (E)(a % b); }, nullptr);
+            break;
+        case 0b100011://VREM
+            irvelog(3, "Mnemonic: VREM");
+            elementwise_checks();
+            elementwise<E>(cpu_state, ops, [](E a, E b, E) {
+                if (b == 0) {
+                    return a;
+                } else if ((S)b == -1) {//Avoids overflow
+                    return (E)0;
+                }
+                return (E)((S)a % (S)b);
+            }, nullptr);
+            break;
+        case 0b100100://VMULHU
+            irvelog(3, "Mnemonic: VMULHU");
+            elementwise_checks();
+            elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)(((uint64_t)a * (uint64_t)b) >> SEW); }, nullptr);
+            break;
+        case 0b100101://VMUL
+            irvelog(3, "Mnemonic: VMUL");
+            elementwise_checks();
+            //Widened first, since two uint16_ts would otherwise multiply as (possibly overflowing) ints
+            elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)((uint32_t)a * (uint32_t)b); }, nullptr);
+            break;
+        case 0b100110://VMULHSU
+            irvelog(3, "Mnemonic: VMULHSU");
+            elementwise_checks();
+            elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)(((int64_t)(S)a * (int64_t)b) >> SEW); }, nullptr);
+            break;
+        case 0b100111://VMULH
+            irvelog(3, "Mnemonic: VMULH");
+            elementwise_checks();
+            elementwise<E>(cpu_state, ops, [](E a, E b, E) { return (E)(((int64_t)(S)a * (int64_t)(S)b) >> SEW); }, nullptr);
+            break;
+        case 0b101001://VMADD (vd = vs1 * vd + vs2)
+            irvelog(3, "Mnemonic: VMADD");
+            elementwise_checks();
+            elementwise<E>(cpu_state, ops, [](E a, E b, E d) { return (E)(((uint32_t)b * (uint32_t)d) + a); }, nullptr);
+            break;
+        case 0b101011://VNMSUB (vd = -(vs1 * vd) + vs2)
+            irvelog(3, "Mnemonic: VNMSUB");
+            elementwise_checks();
+            elementwise<E>(cpu_state, ops, [](E a, E b, E d) { return (E)(a - ((uint32_t)b * (uint32_t)d)); }, nullptr);
+            break;
+        case 0b101101://VMACC (vd = vs1 * vs2 + vd)
+            irvelog(3, "Mnemonic: VMACC");
+            elementwise_checks();
+            elementwise<E>(cpu_state, ops, [](E a, E b, E d) { return (E)(((uint32_t)b * (uint32_t)a) + d); }, nullptr);
+            break;
+        case 0b101111://VNMSAC (vd = -(vs1 * vs2) + vd)
+            irvelog(3, "Mnemonic: VNMSAC");
+            elementwise_checks();
+            elementwise<E>(cpu_state, ops, [](E a, E b, E d) { return (E)(d - ((uint32_t)b * (uint32_t)a)); }, nullptr);
+            break;
+        default:
+            illegal();
+            break;
+    }
+}
+
+template<typename E>
+static E get_elem(const uint8_t* reg, uint32_t i) {
+    E value;
+    std::memcpy(&value, reg + (i * sizeof(E)), sizeof(E));//Assumes a little-endian host
+    return value;
+}
+
+template<typename E>
+static void set_elem(uint8_t* reg, uint32_t i, E value) {
+    std::memcpy(reg + (i * sizeof(E)), &value, sizeof(E));
+}
+
+static bool mask_bit(const uint8_t* reg, uint32_t i) {
+    return (reg[i / 8] >> (i % 8)) & 1;
+}
+
+static void set_mask_bit(uint8_t* reg, uint32_t i, bool value) {
+    reg[i / 8] = (reg[i / 8] & ~(1U << (i % 8))) | ((value ? 1U : 0U) << (i % 8));
+}
+
+template<typename E, typename Op, typename SimdOp>
+static void elementwise(CpuState& cpu_state, const Operands& ops, Op op, [[maybe_unused]] SimdOp simd_op) {
+    const uint8_t* mask = cpu_state.get_v(0);
+    const uint8_t* vs1 = ops.vector_op1 ? cpu_state.get_v(ops.vs1) : nullptr;
+    const uint8_t* vs2 = cpu_state.get_v(ops.vs2);
+    uint8_t* vd = cpu_state.get_v(ops.vd);
+    uint32_t i = 0;
+
+#if defined(__SSE2__)
+    if constexpr (!std::is_same_v<SimdOp, std::nullptr_t>) {
+        if (!ops.masked) {//Whole 16 byte chunks; any partial chunk at the end is left to the loop below
+            constexpr uint32_t ELEMS_PER_CHUNK = 16 / sizeof(E);
+            __m128i scalar = simd_splat<E>((E)ops.scalar);
+            for (; (i + ELEMS_PER_CHUNK) <= ops.vl; i += ELEMS_PER_CHUNK) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(vs2 + (i * sizeof(E))));
+                __m128i b = vs1 ? _mm_loadu_si128((const __m128i*)(vs1 + (i * sizeof(E)))) : scalar;
+                _mm_storeu_si128((__m128i*)(vd + (i * sizeof(E))), simd_op(a, b));
+            }
+        }
+    }
+#endif
+
+    for (; i < ops.vl; ++i) {
+        if (ops.masked && !mask_bit(mask, i)) {
+            continue;
+        }
+        E b = vs1 ? get_elem<E>(vs1, i) : (E)ops.scalar;
+        set_elem<E>(vd, i, op(get_elem<E>(vs2, i), b, get_elem<E>(vd, i)));
+    }
+}
+
+template<typename E, typename Pred>
+static void compare(CpuState& cpu_state, const Operands& ops, Pred pred) {
+    const uint8_t* mask = cpu_state.get_v(0);
+    const uint8_t* vs1 = ops.vector_op1 ? cpu_state.get_v(ops.vs1) : nullptr;
+    const uint8_t* vs2 = cpu_state.get_v(ops.vs2);
+
+    //vd may overlap the sources (or v0), so only write it once they've all been read
+    uint8_t result[VLEN_BYTES];
+    std::memcpy(result, cpu_state.get_v(ops.vd), VLEN_BYTES);
+    for (uint32_t i = 0; i < ops.vl; ++i) {
+        if (ops.masked && !mask_bit(mask, i)) {
+            continue;
+        }
+        E b = vs1 ? get_elem<E>(vs1, i) : (E)ops.scalar;
+        set_mask_bit(result, i, pred(get_elem<E>(vs2, i), b));
+    }
+    std::memcpy(cpu_state.get_v(ops.vd), result, VLEN_BYTES);
+}
+
+template<typename E, typename Op>
+static void reduce(CpuState& cpu_state, const Operands& ops, Op op) {
+    if (ops.vl == 0) {//vd isn't written at all
+        return;
+    }
+
+    const uint8_t* mask = cpu_state.get_v(0);
+    const uint8_t* vs2 = cpu_state.get_v(ops.vs2);
+    E acc = get_elem<E>(cpu_state.get_v(ops.vs1), 0);
+    for (uint32_t i = 0; i < ops.vl; ++i) {
+        if (!ops.masked || mask_bit(mask, i)) {
+            acc = op(acc, get_elem<E>(vs2, i));
+        }
+    }
+    set_elem<E>(cpu_state.get_v(ops.vd), 0, acc);
+}
+
+template<typename Op>
+static void mask_logical(CpuState& cpu_state, const Operands& ops, Op op) {
+    const uint8_t* vs1 = cpu_state.get_v(ops.vs1);
+    const uint8_t* vs2 = cpu_state.get_v(ops.vs2);
+
+    uint8_t result[VLEN_BYTES];
+    std::memcpy(result, cpu_state.get_v(ops.vd), VLEN_BYTES);
+    for (uint32_t i = 0; i < ops.vl; ++i) {
+        set_mask_bit(result, i, op(mask_bit(vs2, i), mask_bit(vs1, i)));
+    }
+    std::memcpy(cpu_state.get_v(ops.vd), result, VLEN_BYTES);
+}
+
+#if defined(__SSE2__)
+template<typename E>
+static __m128i simd_splat(E value) {
+    if constexpr (sizeof(E) == 1) {
+        return _mm_set1_epi8((char)value);
+    } else if constexpr (sizeof(E) == 2) {
+        return _mm_set1_epi16((short)value);
+    } else {
+        return _mm_set1_epi32((int)value);
+    }
+}
+
+template<typename E>
+static __m128i simd_add(__m128i a, __m128i b) {
+    if constexpr (sizeof(E) == 1) {
+        return _mm_add_epi8(a, b);
+    } else if constexpr (sizeof(E) == 2) {
+        return _mm_add_epi16(a, b);
+    } else {
+        return _mm_add_epi32(a, b);
+    }
+}
+
+template<typename E>
+static __m128i simd_sub(__m128i a, __m128i b) {
+    if constexpr (sizeof(E) == 1) {
+        return _mm_sub_epi8(a, b);
+    } else if constexpr (sizeof(E) == 2) {
+        return _mm_sub_epi16(a, b);
+    } else {
+        return _mm_sub_epi32(a, b);
+    }
+}
+#endif
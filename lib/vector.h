@@ -0,0 +1,75 @@
+/**
+ * @brief   The vector unit (a Zve32x subset of the V extension)
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * VLEN is 128 bits and ELEN is 32 bits, so SEW can be 8, 16, or 32 and LMUL can be 1/4 to 8
+ * (1/4 only with SEW=8 and 1/2 only with SEW <= 16).
+ *
+ * Supported:
+ *  - vsetvli, vsetivli, and vsetvl
+ *  - Unit-stride (including mask and fault-only-first) and strided loads and stores
+ *  - Single-width integer arithmetic, logic, shifts, min/max, multiply, divide, and multiply-add
+ *  - Integer comparisons, vmerge and vmv
+ *  - Single-width integer reductions
+ *  - Mask logical instructions, vcpop.m, vfirst.m, vid.v, vmv.x.s, and vmv.s.x
+ *
+ * Everything else (segment and indexed accesses, whole register moves, widening and narrowing,
+ * fixed point, permutations, and of course floating point) is an illegal instruction.
+ *
+ * Tail and masked-off elements are always left undisturbed, which is a valid choice for either
+ * policy vtype can ask for.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+
+#include "cpu_state.h"
+#include "csr.h"
+#include "decode.h"
+#include "memory.h"
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace irve::internal::vector {
+
+/**
+ * @brief       Check if a LOAD-FP or STORE-FP instruction is actually a vector load or store.
+ * @param[in]   width The width (funct3) field of the instruction.
+ * @return      True if it belongs to the vector unit.
+*/
+bool is_vector_width(uint8_t width);
+
+/**
+ * @brief       Execute vsetvli, vsetivli, or vsetvl (OP-V with funct3 = OPCFG).
+*/
+void vset(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Csr& CSR);
+
+/**
+ * @brief       Execute any other OP-V instruction.
+*/
+void arithmetic(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Csr& CSR);
+
+/**
+ * @brief       Execute a vector load (LOAD-FP with a vector width).
+ * @note        If an element faults, vstart is left pointing at it so the load can be resumed.
+*/
+void load(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Memory& memory, Csr& CSR);
+
+/**
+ * @brief       Execute a vector store (STORE-FP with a vector width).
+ * @note        If an element faults, vstart is left pointing at it so the store can be resumed.
+*/
+void store(const decode::DecodedInst& decoded_inst, CpuState& cpu_state, Memory& memory, Csr& CSR);
+
+} // namespace irve::internal::vector
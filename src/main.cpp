@@ -21,9 +21,14 @@
 
 #include <cassert>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <optional>
 #include <string>
+#include <vector>
 
 /* ------------------------------------------------------------------------------------------------
  * Constants/Defines
@@ -32,11 +37,25 @@
 #define irvelog(...) irve::logging::log(__VA_ARGS__)
 #define irvelog_always(...) irve::logging::log_always(__VA_ARGS__)
 
+/* ------------------------------------------------------------------------------------------------
+ * Static Variables
+ * --------------------------------------------------------------------------------------------- */
+
+//Indexed by the major opcode (bits [6:2] of the instruction), the same as stats_t::insts_by_opcode
+static const char* const OPCODE_NAMES[32] = {
+    "LOAD",     "LOAD_FP",  "CUSTOM_0",     "MISC_MEM", "OP_IMM",   "AUIPC",        "OP_IMM_32",    "B48_0",
+    "STORE",    "STORE_FP", "CUSTOM_1",     "AMO",      "OP",       "LUI",          "OP_32",        "B64",
+    "MADD",     "MSUB",     "NMSUB",        "NMADD",    "OP_FP",    "OP_V",         "CUSTOM_2",     "B48_1",
+    "BRANCH",   "JALR",     "RESERVED_1",   "JAL",      "SYSTEM",   "RESERVED_3",   "CUSTOM_3",     "BGE80"
+};
+
 /* ------------------------------------------------------------------------------------------------
  * Static Function Declarations
  * --------------------------------------------------------------------------------------------- */
 
 static void print_startup_message();
+static void print_stats(const irve::emulator::stats_t& stats);
+static bool write_stats_json(const irve::emulator::stats_t& stats, uint64_t execution_time_us, const char* path);
 
 /* ------------------------------------------------------------------------------------------------
  * Function Implementations
@@ -53,16 +72,140 @@ int main(int argc, const char* const* argv) {
         irvelog_always(0, "Fuzzish Build: Set seed to %lu", seed);
     }
 
+    //Anything starting with "--" is an option; everything else is a memory image to load
+    const char* uart_backend_spec = "stdio";
+    const char* trace_path = nullptr;
+    const char* callgrind_path = nullptr;
+    std::string profile_path;
+    uint32_t profile_period = 997;//Prime, so we're unlikely to alias with loops in the guest
+    bool print_stats_at_exit = false;
+    bool measure_host = false;
+    const char* stats_json_path = nullptr;
+    uint32_t hart_count = 1;
+    uint64_t virtual_time_insts_per_tick = 0;//0 for host time
+    uint64_t timebase_frequency = 0;//0 for the default
+    bool native_sbi = false;
+    bool misaligned_access = false;
+    std::vector<const char*> images;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.starts_with("--uart=")) {
+            uart_backend_spec = argv[i] + 7;
+        } else if (arg.starts_with("--trace=")) {
+            trace_path = argv[i] + 8;
+        } else if (arg == "--stats") {
+            print_stats_at_exit = true;
+        } else if (arg.starts_with("--stats=")) {
+            stats_json_path = argv[i] + 8;
+        } else if (arg == "--native-sbi") {
+            native_sbi = true;
+        } else if (arg == "--misaligned-access") {
+            misaligned_access = true;
+        } else if (arg == "--hostperf") {
+            measure_host = true;
+        } else if (arg.starts_with("--callgrind=")) {
+            callgrind_path = argv[i] + 12;
+        } else if (arg.starts_with("--profile=")) {
+            //--profile=PATH[,PERIOD]
+            profile_path = arg.substr(10);
+            std::size_t comma = profile_path.find(',');
+            if (comma != std::string::npos) {
+                char* end;
+                unsigned long period = std::strtoul(profile_path.c_str() + comma + 1, &end, 0);
+                if ((*end != '\0') || (period == 0) || (period > UINT32_MAX)) {
+                    irvelog_always(0, "Invalid profiling period in \"%s\"", argv[i]);
+                    return 1;
+                }
+                profile_period = static_cast<uint32_t>(period);
+                profile_path.resize(comma);
+            }
+        } else if (arg.starts_with("--harts=")) {
+            char* end;
+            unsigned long harts = std::strtoul(argv[i] + 8, &end, 0);
+            if ((*end != '\0') || (harts == 0) || (harts > UINT32_MAX)) {
+                irvelog_always(0, "Invalid number of harts in \"%s\"", argv[i]);
+                return 1;
+            }
+            hart_count = static_cast<uint32_t>(harts);
+        } else if (arg.starts_with("--virtual-time=")) {
+            char* end;
+            virtual_time_insts_per_tick = std::strtoull(argv[i] + 15, &end, 0);
+            if ((*end != '\0') || (virtual_time_insts_per_tick == 0)) {
+                irvelog_always(0, "Invalid number of instructions per mtime tick in \"%s\"", argv[i]);
+                return 1;
+            }
+        } else if (arg.starts_with("--timebase=")) {
+            char* end;
+            timebase_frequency = std::strtoull(argv[i] + 11, &end, 0);
+            if ((*end != '\0') || (timebase_frequency == 0)) {
+                irvelog_always(0, "Invalid timebase frequency in \"%s\"", argv[i]);
+                return 1;
+            }
+        } else if (arg.starts_with("--log=")) {
+            if (irve::logging::logging_disabled()) {
+                irvelog_always(0, "This build of IRVE has logging compiled out (IRVE_DISABLE_LOGGING), so \"%s\" can't work", argv[i]);
+                return 1;
+            }
+            if (!irve::logging::configure(argv[i] + 6)) {
+                irvelog_always(0, "Invalid logging spec \"%s\"", argv[i] + 6);
+                return 1;
+            }
+        } else if (arg.starts_with("--")) {
+            irvelog_always(0, "Unknown option \"%s\"", argv[i]);
+            return 1;
+        } else {
+            images.push_back(argv[i]);
+        }
+    }
+
     irvelog_always(0, "Initializing emulator...");
 
     std::optional<irve::emulator::emulator_t> emulator;
     try {
-        emulator.emplace(argc - 1, &(argv[1]));
+        emulator.emplace(static_cast<int>(images.size()), images.data(), uart_backend_spec);
     } catch (...) {
         irvelog_always(0, "Failed to initialize the emulator!");
         return 1;
     }
 
+    if ((hart_count > 1) && !emulator->set_hart_count(hart_count)) {
+        irvelog_always(0, "Failed to create %u harts!", hart_count);
+        return 1;
+    }
+
+    if (virtual_time_insts_per_tick && !emulator->set_virtual_time(virtual_time_insts_per_tick)) {
+        irvelog_always(0, "Failed to switch to virtual time (it only works with a single hart)!");
+        return 1;
+    }
+
+    if (timebase_frequency && !emulator->set_timebase_frequency(timebase_frequency)) {
+        irvelog_always(0, "Failed to set the timebase frequency!");
+        return 1;
+    }
+
+    emulator->set_native_sbi(native_sbi);
+    emulator->set_misaligned_access(misaligned_access);
+
+    if (trace_path && !emulator->start_trace(trace_path)) {
+        irvelog_always(0, "Failed to start tracing!");
+        return 1;
+    }
+
+    if (!profile_path.empty() && !emulator->start_profiling(profile_path.c_str(), profile_period)) {
+        irvelog_always(0, "Failed to start profiling!");
+        return 1;
+    }
+
+    if (callgrind_path && !emulator->start_callgraph_profiling(callgrind_path)) {
+        irvelog_always(0, "Failed to start callgrind profiling!");
+        return 1;
+    }
+
+    if (measure_host && !emulator->start_host_perf()) {
+        irvelog_always(0, "Failed to start measuring the host!");
+        return 1;
+    }
+
     auto init_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - irve_boot_time).count();
 
     irvelog_always(0, "Initialized the emulator in %luus", init_time);
@@ -78,6 +221,16 @@ int main(int argc, const char* const* argv) {
     auto average_ips = (((double)emulator->get_inst_count()) / ((double)execution_time_us)) * 1000000.0;
     irvelog_always(0, "Average of %f instructions per second (%fMHz)", average_ips, (average_ips / 1000000.0));
 
+    if (print_stats_at_exit) {
+        print_stats(emulator->get_stats());
+    }
+
+    if (stats_json_path && !write_stats_json(emulator->get_stats(), execution_time_us, stats_json_path)) {
+        irvelog_always(0, "Failed to write stats to \"%s\"", stats_json_path);
+    }
+
+    emulator->stop_host_perf();//Prints its report (if we were measuring the host)
+
     irvelog_always(0, "\x1b[1mIRVE is shutting down. Bye bye!\x1b[0m");
     
     return 0;
@@ -112,3 +265,101 @@ static void print_startup_message() {
     irvelog_always(0, "");
     irvelog_always(0, "");
 }
+
+static void print_stats(const irve::emulator::stats_t& stats) {
+    auto percent = [](uint64_t part, uint64_t whole) { return whole ? ((100.0 * (double)part) / (double)whole) : 0.0; };
+
+    irvelog_always(0, "------------------------------------------------------------------------");
+    irvelog_always(0, "Instructions by opcode:");
+    for (std::size_t i = 0; i < 32; ++i) {
+        if (stats.insts_by_opcode[i]) {
+            irvelog_always(1, "%-12s %14lu (%5.1f%%)", OPCODE_NAMES[i], stats.insts_by_opcode[i], percent(stats.insts_by_opcode[i], stats.inst_count));
+        }
+    }
+
+    uint64_t icache_lookups = stats.icache_hits + stats.icache_misses;
+    irvelog_always(0, "Instruction cache:");
+    irvelog_always(1, "Hits:        %14lu (%5.1f%%)", stats.icache_hits, percent(stats.icache_hits, icache_lookups));
+    irvelog_always(1, "Misses:      %14lu (%5.1f%%)", stats.icache_misses, percent(stats.icache_misses, icache_lookups));
+    irvelog_always(1, "Flushes:     %14lu", stats.icache_flushes);
+
+    irvelog_always(0, "Address translation:");
+    irvelog_always(1, "TLB hits:    %14lu", stats.tlb_hits);
+    irvelog_always(1, "TLB misses:  %14lu", stats.tlb_misses);
+    irvelog_always(1, "PTE reads:   %14lu", stats.page_table_reads);
+    irvelog_always(1, "A/D updates: %14lu", stats.pte_ad_updates);
+
+    irvelog_always(0, "Traps:");
+    for (std::size_t i = 0; i < 16; ++i) {
+        if (stats.exceptions_by_cause[i]) {
+            irvelog_always(1, "Exception %2zu: %13lu", i, stats.exceptions_by_cause[i]);
+        }
+    }
+    for (std::size_t i = 0; i < 16; ++i) {
+        if (stats.interrupts_by_cause[i]) {
+            irvelog_always(1, "Interrupt %2zu: %13lu", i, stats.interrupts_by_cause[i]);
+        }
+    }
+
+    irvelog_always(0, "MMIO accesses:");
+    irvelog_always(1, "ACLINT:      %14lu reads, %lu writes", stats.aclint_reads, stats.aclint_writes);
+    irvelog_always(1, "UART:        %14lu reads, %lu writes", stats.uart_reads, stats.uart_writes);
+    irvelog_always(1, "Debug:       %14lu writes", stats.debug_writes);
+
+    irvelog_always(0, "Peripheral updates: %lu, taking %luus in total", stats.peripheral_updates, stats.peripheral_update_time_ns / 1000);
+    irvelog_always(0, "WFI sleeps: %lu, taking %luus in total", stats.wfi_sleeps, stats.wfi_sleep_time_ns / 1000);
+    irvelog_always(0, "Native SBI calls: %lu", stats.native_sbi_calls);
+    irvelog_always(0, "Emulated misaligned accesses: %lu", stats.misaligned_accesses);
+    irvelog_always(0, "------------------------------------------------------------------------");
+}
+
+static bool write_stats_json(const irve::emulator::stats_t& stats, uint64_t execution_time_us, const char* path) {
+    FILE* file = std::fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+
+    auto write_array = [file](const char* name, const uint64_t* values, std::size_t count) {
+        std::fprintf(file, "  \"%s\": [", name);
+        for (std::size_t i = 0; i < count; ++i) {
+            std::fprintf(file, "%s%lu", i ? ", " : "", values[i]);
+        }
+        std::fprintf(file, "],\n");
+    };
+
+    std::fprintf(file, "{\n");
+    std::fprintf(file, "  \"execution_time_us\": %lu,\n", execution_time_us);
+    std::fprintf(file, "  \"inst_count\": %lu,\n", stats.inst_count);
+    std::fprintf(file, "  \"insts_by_opcode\": {");
+    bool first = true;
+    for (std::size_t i = 0; i < 32; ++i) {
+        if (stats.insts_by_opcode[i]) {
+            std::fprintf(file, "%s\"%s\": %lu", first ? "" : ", ", OPCODE_NAMES[i], stats.insts_by_opcode[i]);
+            first = false;
+        }
+    }
+    std::fprintf(file, "},\n");
+    std::fprintf(file, "  \"icache_hits\": %lu,\n", stats.icache_hits);
+    std::fprintf(file, "  \"icache_misses\": %lu,\n", stats.icache_misses);
+    std::fprintf(file, "  \"icache_flushes\": %lu,\n", stats.icache_flushes);
+    std::fprintf(file, "  \"tlb_hits\": %lu,\n", stats.tlb_hits);
+    std::fprintf(file, "  \"tlb_misses\": %lu,\n", stats.tlb_misses);
+    std::fprintf(file, "  \"page_table_reads\": %lu,\n", stats.page_table_reads);
+    std::fprintf(file, "  \"pte_ad_updates\": %lu,\n", stats.pte_ad_updates);
+    write_array("exceptions_by_cause", stats.exceptions_by_cause, 16);
+    write_array("interrupts_by_cause", stats.interrupts_by_cause, 16);
+    std::fprintf(file, "  \"aclint_reads\": %lu,\n", stats.aclint_reads);
+    std::fprintf(file, "  \"aclint_writes\": %lu,\n", stats.aclint_writes);
+    std::fprintf(file, "  \"uart_reads\": %lu,\n", stats.uart_reads);
+    std::fprintf(file, "  \"uart_writes\": %lu,\n", stats.uart_writes);
+    std::fprintf(file, "  \"debug_writes\": %lu,\n", stats.debug_writes);
+    std::fprintf(file, "  \"peripheral_updates\": %lu,\n", stats.peripheral_updates);
+    std::fprintf(file, "  \"peripheral_update_time_ns\": %lu,\n", stats.peripheral_update_time_ns);
+    std::fprintf(file, "  \"wfi_sleeps\": %lu,\n", stats.wfi_sleeps);
+    std::fprintf(file, "  \"wfi_sleep_time_ns\": %lu,\n", stats.wfi_sleep_time_ns);
+    std::fprintf(file, "  \"native_sbi_calls\": %lu,\n", stats.native_sbi_calls);
+    std::fprintf(file, "  \"misaligned_accesses\": %lu\n", stats.misaligned_accesses);
+    std::fprintf(file, "}\n");
+
+    return std::fclose(file) == 0;
+}
@@ -0,0 +1,328 @@
+/**
+ * @file    mainirvebench.cpp
+ * @brief   IRVE - The Inextensible RISC-V Emulator (Benchmark Suite)
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Runs a curated set of rvsw programs several times each, and reports the median MIPS, the startup
+ * time (creating the emulator and loading images) and the peak RSS of each one, both as a table and
+ * (with --json=PATH) as JSON so results can be compared between builds.
+ *
+ * Each run happens in a forked process, so peak RSS can be measured per run (with wait4()), and so
+ * the guest's output and IRVE's logging can be thrown away without affecting the report.
+ *
+ * Like the rvsw tests, this expects to be run from the root of the project after rvsw is compiled.
+ * Workloads whose images are missing are skipped.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "irve_public_api.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+#define irvelog_always(...) irve::logging::log_always(__VA_ARGS__)
+
+#define RVSW_SINGLE_FILE    "rvsw/compiled/src/single_file/"
+#define OGSBI               "rvsw/compiled/sbi/ogsbi/ogsbi.vhex8"
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+struct Workload {
+    std::string name;
+    std::vector<std::string> images;
+};
+
+struct RunResult {//Sent from the child process to the parent through a pipe
+    bool ok;
+    uint64_t inst_count;
+    uint64_t startup_us;
+    uint64_t execution_us;
+};
+
+struct WorkloadResult {
+    const char* status;//"ok", "skipped" (missing images) or "failed"
+    uint64_t inst_count;
+    std::vector<double> mips;//One per run
+    std::vector<uint64_t> startup_us;//One per run
+    uint64_t peak_rss_kib;//The largest of any run
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Variables
+ * --------------------------------------------------------------------------------------------- */
+
+//Chosen to exercise different parts of the interpreter's hot path
+static const Workload CURATED_WORKLOADS[] = {
+    {"integer_loops",   {RVSW_SINGLE_FILE "c/nouveau_stress_test.vhex8"}},
+    {"interpreter",     {RVSW_SINGLE_FILE "c/rv32esim.vhex8"}},
+    {"memory_copy",     {RVSW_SINGLE_FILE "cxx/cppreference/string.vhex8"}},
+    {"amo_stress",      {RVSW_SINGLE_FILE "c/irve_stress_test.vhex8"}},
+    {"trap_heavy",      {RVSW_SINGLE_FILE "c/hello_exceptions.vhex8"}},
+    {"interrupt_heavy", {RVSW_SINGLE_FILE "c/timer_interrupt_mmode.vhex8"}},
+    {"sv32_user_mode",  {OGSBI, RVSW_SINGLE_FILE "cxx/morevm_smode.vhex8"}},
+    {"uart_output",     {RVSW_SINGLE_FILE "cxx/uart_write_test.vhex8"}},
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+static bool parse_workload(const std::string& arg, Workload& workload);
+static WorkloadResult run_workload(const Workload& workload, unsigned runs, uint64_t max_insts);
+static bool run_once(const Workload& workload, uint64_t max_insts, RunResult& result, uint64_t& peak_rss_kib);
+static RunResult run_in_child(const Workload& workload, uint64_t max_insts);
+template<typename T>
+static T median(std::vector<T> values);
+static bool write_json(const std::vector<Workload>& workloads, const std::vector<WorkloadResult>& results, unsigned runs, const char* path);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int main(int argc, const char* const* argv) {
+    unsigned runs = 5;
+    uint64_t max_insts = 0;//No limit
+    const char* json_path = nullptr;
+    std::vector<Workload> workloads;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.starts_with("--runs=")) {
+            runs = static_cast<unsigned>(std::strtoul(argv[i] + 7, nullptr, 0));
+        } else if (arg.starts_with("--max-insts=")) {
+            max_insts = std::strtoull(argv[i] + 12, nullptr, 0);
+        } else if (arg.starts_with("--json=")) {
+            json_path = argv[i] + 7;
+        } else {
+            Workload workload;
+            if (arg.starts_with("--") || !parse_workload(arg, workload)) {
+                irvelog_always(0, "Usage: %s [--runs=N] [--max-insts=N] [--json=PATH] [NAME=IMAGE[,IMAGE...]...]", argv[0]);
+                return 1;
+            }
+            workloads.push_back(workload);
+        }
+    }
+    if (runs == 0) {
+        irvelog_always(0, "There must be at least one run");
+        return 1;
+    }
+    if (workloads.empty()) {
+        workloads.assign(std::begin(CURATED_WORKLOADS), std::end(CURATED_WORKLOADS));
+    }
+
+    irvelog_always(0, "IRVE benchmark suite: libirve %s, %u runs per workload", irve::about::get_version_string(), runs);
+
+    std::vector<WorkloadResult> results;
+    bool any_failed = false;
+    bool any_ran = false;
+    for (const Workload& workload : workloads) {
+        results.push_back(run_workload(workload, runs, max_insts));
+        const WorkloadResult& result = results.back();
+
+        if (result.mips.empty()) {
+            irvelog_always(1, "%-16s %s", workload.name.c_str(), result.status);
+        } else {
+            irvelog_always(1, "%-16s %s: %12" PRIu64 " insts, %9.3f MIPS (median of %zu; %.3f to %.3f), startup %" PRIu64 "us, peak RSS %" PRIu64 "KiB",
+                workload.name.c_str(), result.status, result.inst_count,
+                median(result.mips), result.mips.size(),
+                *std::min_element(result.mips.begin(), result.mips.end()),
+                *std::max_element(result.mips.begin(), result.mips.end()),
+                median(result.startup_us), result.peak_rss_kib
+            );
+        }
+
+        any_failed = any_failed || (std::string(result.status) == "failed");
+        any_ran = any_ran || !result.mips.empty();
+    }
+
+    if (json_path && !write_json(workloads, results, runs, json_path)) {
+        irvelog_always(0, "Failed to write results to \"%s\"", json_path);
+        return 1;
+    }
+
+    if (!any_ran && !any_failed) {
+        irvelog_always(0, "Nothing was benchmarked! (Is rvsw compiled, and are we in the root of the project?)");
+        return 1;
+    }
+
+    return any_failed ? 1 : 0;
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static bool parse_workload(const std::string& arg, Workload& workload) {
+    //NAME=IMAGE[,IMAGE...]
+    std::size_t equals = arg.find('=');
+    if ((equals == std::string::npos) || (equals == 0) || (equals == arg.size() - 1)) {
+        return false;
+    }
+
+    workload.name = arg.substr(0, equals);
+    std::size_t start = equals + 1;
+    while (true) {
+        std::size_t comma = arg.find(',', start);
+        workload.images.push_back(arg.substr(start, comma - start));
+        if (comma == std::string::npos) {
+            return true;
+        }
+        start = comma + 1;
+    }
+}
+
+static WorkloadResult run_workload(const Workload& workload, unsigned runs, uint64_t max_insts) {
+    WorkloadResult result = {"ok", 0, {}, {}, 0};
+
+    for (const std::string& image : workload.images) {
+        if (access(image.c_str(), R_OK) != 0) {
+            result.status = "skipped";
+            return result;
+        }
+    }
+
+    for (unsigned i = 0; i < runs; ++i) {
+        RunResult run;
+        uint64_t peak_rss_kib;
+        if (!run_once(workload, max_insts, run, peak_rss_kib)) {
+            result.status = "failed";
+            return result;
+        }
+
+        result.inst_count = run.inst_count;
+        result.mips.push_back(static_cast<double>(run.inst_count) / static_cast<double>(std::max<uint64_t>(run.execution_us, 1)));
+        result.startup_us.push_back(run.startup_us);
+        result.peak_rss_kib = std::max(result.peak_rss_kib, peak_rss_kib);
+    }
+
+    return result;
+}
+
+static bool run_once(const Workload& workload, uint64_t max_insts, RunResult& result, uint64_t& peak_rss_kib) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        return false;
+    }
+
+    std::fflush(nullptr);//So nothing buffered is written twice
+    pid_t pid = fork();
+    if (pid == -1) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return false;
+    } else if (pid == 0) {
+        close(pipe_fds[0]);
+        RunResult child_result = run_in_child(workload, max_insts);
+        bool sent = write(pipe_fds[1], &child_result, sizeof(child_result)) == sizeof(child_result);
+        _exit((sent && child_result.ok) ? 0 : 1);
+    }
+
+    close(pipe_fds[1]);
+    bool received = read(pipe_fds[0], &result, sizeof(result)) == sizeof(result);
+    close(pipe_fds[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid) {
+        return false;
+    }
+    peak_rss_kib = static_cast<uint64_t>(usage.ru_maxrss);//Linux reports this in KiB
+
+    return received && result.ok && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+static RunResult run_in_child(const Workload& workload, uint64_t max_insts) {
+    //Throw away IRVE's logging and anything the guest prints
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd != -1) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+    }
+
+    std::vector<const char*> imagev;
+    for (const std::string& image : workload.images) {
+        imagev.push_back(image.c_str());
+    }
+
+    RunResult result = {false, 0, 0, 0};
+    try {
+        auto start_time = std::chrono::steady_clock::now();
+        irve::emulator::emulator_t emulator(static_cast<int>(imagev.size()), imagev.data(), "file:/dev/null");
+        auto execution_start_time = std::chrono::steady_clock::now();
+        emulator.run_until(max_insts);
+        auto execution_end_time = std::chrono::steady_clock::now();
+
+        result.inst_count = emulator.get_inst_count();
+        result.startup_us = std::chrono::duration_cast<std::chrono::microseconds>(execution_start_time - start_time).count();
+        result.execution_us = std::chrono::duration_cast<std::chrono::microseconds>(execution_end_time - execution_start_time).count();
+        result.ok = true;
+    } catch (...) {
+        //result.ok is still false
+    }
+
+    return result;
+}
+
+template<typename T>
+static T median(std::vector<T> values) {
+    std::sort(values.begin(), values.end());
+    std::size_t middle = values.size() / 2;
+    if (values.size() % 2) {
+        return values[middle];
+    } else {
+        return (values[middle - 1] + values[middle]) / 2;
+    }
+}
+
+static bool write_json(const std::vector<Workload>& workloads, const std::vector<WorkloadResult>& results, unsigned runs, const char* path) {
+    FILE* file = std::fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+
+    std::fprintf(file, "{\n");
+    std::fprintf(file, "  \"version\": \"%s\",\n", irve::about::get_version_string());
+    std::fprintf(file, "  \"runs\": %u,\n", runs);
+    std::fprintf(file, "  \"workloads\": [\n");
+    for (std::size_t i = 0; i < workloads.size(); ++i) {
+        const WorkloadResult& result = results[i];
+        std::fprintf(file, "    {\"name\": \"%s\", \"status\": \"%s\"", workloads[i].name.c_str(), result.status);
+        if (!result.mips.empty()) {
+            std::fprintf(file, ", \"inst_count\": %" PRIu64, result.inst_count);
+            std::fprintf(file, ", \"median_mips\": %.3f", median(result.mips));
+            std::fprintf(file, ", \"min_mips\": %.3f", *std::min_element(result.mips.begin(), result.mips.end()));
+            std::fprintf(file, ", \"max_mips\": %.3f", *std::max_element(result.mips.begin(), result.mips.end()));
+            std::fprintf(file, ", \"median_startup_us\": %" PRIu64, median(result.startup_us));
+            std::fprintf(file, ", \"peak_rss_kib\": %" PRIu64, result.peak_rss_kib);
+        }
+        std::fprintf(file, "}%s\n", (i + 1 < workloads.size()) ? "," : "");
+    }
+    std::fprintf(file, "  ]\n");
+    std::fprintf(file, "}\n");
+
+    return std::fclose(file) == 0;
+}
@@ -0,0 +1,41 @@
+/**
+ * @file    mainirvetrace.cpp
+ * @brief   IRVE - The Inextensible RISC-V Emulator (Trace Decoder)
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Entry point for converting binary traces written with `irve --trace=PATH` to text
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "irve_public_api.h"
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+#define irvelog_always(...) irve::logging::log_always(__VA_ARGS__)
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int main(int argc, const char* const* argv) {
+    if ((argc != 2) && (argc != 3)) {
+        irvelog_always(0, "Usage: %s TRACE_FILE [TEXT_FILE]", argv[0]);
+        return 1;
+    }
+
+    if (!irve::trace::decode(argv[1], (argc == 3) ? argv[2] : nullptr)) {
+        irvelog_always(0, "Failed to decode trace \"%s\"", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
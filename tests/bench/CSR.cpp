@@ -0,0 +1,73 @@
+/**
+ * @file    CSR.cpp
+ * @brief   Microbenchmarks for IRVE's csr.h & csr.cpp
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+
+#include "harness.h"
+
+#include "common.h"
+#include "csr.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants
+ * --------------------------------------------------------------------------------------------- */
+
+static constexpr uint64_t OPS = 1 << 16;
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int bench_CSR_Csr_implicit_read() {
+    Csr CSR;
+
+    bench::measure("Csr::implicit_read (mstatus)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            bench::do_not_optimize(CSR.implicit_read(bench::opaque(Csr::Address::MSTATUS)));
+        }
+    });
+    bench::measure("Csr::implicit_read (minstret)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            bench::do_not_optimize(CSR.implicit_read(bench::opaque(Csr::Address::MINSTRET)));
+        }
+    });
+    bench::measure("Csr::fast_implicit_read_interrupt_regs", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            bench::do_not_optimize(CSR.fast_implicit_read_interrupt_regs());
+        }
+    });
+
+    return 0;
+}
+
+int bench_CSR_Csr_explicit_write() {
+    Csr CSR;//Starts in M-mode, so every write is allowed
+
+    bench::measure("Csr::explicit_write (mscratch)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            CSR.explicit_write(bench::opaque(Csr::Address::MSCRATCH), Word((uint32_t)i));
+            bench::do_not_optimize(&CSR);//Otherwise the writes can be optimized away
+        }
+    });
+    bench::measure("Csr::explicit_write (mstatus)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            CSR.explicit_write(bench::opaque(Csr::Address::MSTATUS), Word(0x00001800));
+            bench::do_not_optimize(&CSR);
+        }
+    });
+
+    return 0;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file    decode.cpp
+ * @brief   Microbenchmarks for IRVE's decode.h & decode.cpp
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+
+#include "harness.h"
+
+#include "common.h"
+#include "decode.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants
+ * --------------------------------------------------------------------------------------------- */
+
+//A mix of formats, like a real instruction stream
+static const uint32_t INSTS[] = {
+    0x00A00093,//addi x1, x0, 10
+    0x002081B3,//add x3, x1, x2
+    0x0000A103,//lw x2, 0(x1)
+    0x0020A023,//sw x2, 0(x1)
+    0xFE209EE3,//bne x1, x2, -4
+    0x123450B7,//lui x1, 0x12345
+    0x008000EF,//jal x1, 8
+    0x00008067 //jalr x0, 0(x1)
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int bench_decode_DecodedInst() {
+    constexpr uint64_t OPS = 1 << 16;
+    bench::measure("decode::DecodedInst construction", OPS, [] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            decode::DecodedInst decoded_inst(INSTS[i % (sizeof(INSTS) / sizeof(INSTS[0]))]);
+            bench::do_not_optimize(decoded_inst);
+        }
+    });
+    return 0;
+}
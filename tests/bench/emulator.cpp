@@ -0,0 +1,83 @@
+/**
+ * @file    emulator.cpp
+ * @brief   Microbenchmarks for IRVE's emulator.h & emulator.cpp
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+#include "harness.h"
+
+// We do this so we can access internal emulator state for benchmarking
+#define private public
+
+#include "common.h"
+#include "emulator.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants
+ * --------------------------------------------------------------------------------------------- */
+
+static constexpr uint64_t OPS = 1 << 16;
+
+static constexpr uint32_t NUM_CACHED_INSTS = 64;//Roughly the size of a hot loop
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int bench_emulator_icache() {
+    emulator::emulator_t emulator(0, nullptr, "file:/dev/null");
+    for (uint32_t i = 0; i < NUM_CACHED_INSTS; ++i) {
+        emulator.m_memory.store(Word(i * 4), DT_WORD, Word(0x00000013));//nop
+    }
+
+    bench::measure("emulator_t::fetch_and_decode (icache hit)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            emulator.m_cpu_state.set_pc((uint32_t)((i % NUM_CACHED_INSTS) * 4));
+            bench::do_not_optimize(emulator.fetch_and_decode());
+        }
+    });
+    bench::measure("emulator_t::fetch_and_decode (icache miss)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            emulator.m_icache.clear();
+            emulator.m_cpu_state.set_pc((uint32_t)((i % NUM_CACHED_INSTS) * 4));
+            bench::do_not_optimize(emulator.fetch_and_decode());
+        }
+    });
+
+    return 0;
+}
+
+int bench_emulator_check_and_handle_interrupts() {
+    emulator::emulator_t emulator(0, nullptr, "file:/dev/null");
+
+    bench::measure("check_and_handle_interrupts (none)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            emulator.check_and_handle_interrupts();
+        }
+    });
+
+    //Pending and enabled, but interrupts are globally disabled in M-mode (ex. in a critical section)
+    emulator.m_CSR.implicit_write(Csr::Address::MIE, Word(0x00000008));
+    emulator.m_CSR.implicit_write(Csr::Address::MIP, Word(0x00000008));
+    bench::measure("check_and_handle_interrupts (masked)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            emulator.check_and_handle_interrupts();
+        }
+    });
+
+    return 0;
+}
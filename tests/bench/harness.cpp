@@ -0,0 +1,62 @@
+/**
+ * @file    harness.cpp
+ * @brief   A tiny timing harness for IRVE's microbenchmarks
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "harness.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/* ------------------------------------------------------------------------------------------------
+ * Variables
+ * --------------------------------------------------------------------------------------------- */
+
+bench::Config bench::config = {3, 15};
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+void bench::report(const char* name, uint64_t ops, const std::vector<double>& rep_times_ns) {
+    if (rep_times_ns.empty() || !ops) {
+        return;
+    }
+
+    std::vector<double> ns_per_op;
+    for (double rep_time_ns : rep_times_ns) {
+        ns_per_op.push_back(rep_time_ns / static_cast<double>(ops));
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+
+    std::size_t count = ns_per_op.size();
+    double median = (count % 2) ? ns_per_op[count / 2] : ((ns_per_op[(count / 2) - 1] + ns_per_op[count / 2]) / 2);
+    double mean = 0;
+    for (double value : ns_per_op) {
+        mean += value;
+    }
+    mean /= count;
+    double variance = 0;
+    for (double value : ns_per_op) {
+        variance += (value - mean) * (value - mean);
+    }
+    double stddev = (count > 1) ? std::sqrt(variance / (count - 1)) : 0;
+
+    std::printf("%-44s %10.3f ns/op median (min %.3f, max %.3f, mean %.3f +/- %.1f%%) %zu x %" PRIu64 " ops\n",
+        name, median, ns_per_op.front(), ns_per_op.back(), mean, mean ? (100 * stddev / mean) : 0, count, ops
+    );
+    std::fflush(stdout);
+}
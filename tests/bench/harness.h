@@ -0,0 +1,96 @@
+/**
+ * @file    harness.h
+ * @brief   A tiny timing harness for IRVE's microbenchmarks
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Each microbenchmark calls bench::measure() with a body that performs some number of operations.
+ * The body is run a few times untimed to warm up caches and branch predictors, then timed several
+ * times, and statistics about the time per operation are printed.
+ *
+*/
+
+#pragma once
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+namespace bench {
+
+struct Config {
+    uint32_t warmup;//Untimed repetitions before measuring
+    uint32_t repetitions;//Timed repetitions
+};
+
+extern Config config;//Set by micro_bench from the command line
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Print statistics about the timed repetitions of a benchmark
+ * @param name What was measured
+ * @param ops How many operations each repetition performed
+ * @param rep_times_ns How long each repetition took
+*/
+void report(const char* name, uint64_t ops, const std::vector<double>& rep_times_ns);
+
+/**
+ * @brief Keep the compiler from optimizing away a value (and the work done to compute it)
+ * @param value The value to keep
+*/
+template<typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * @brief Hide a value from the compiler so it can't constant-fold the code using it
+ * @param value The value
+ * @return The same value
+ * @note Use this for things the interpreter wouldn't know ahead of time (ex. CSR addresses); T must
+ *       fit in a register
+*/
+template<typename T>
+inline T opaque(T value) {
+    asm volatile("" : "+r"(value) : : "memory");
+    return value;
+}
+
+/**
+ * @brief Time a benchmark body and print statistics about it
+ * @param name What is being measured
+ * @param ops How many operations one call to body performs
+ * @param body The code to time; called config.warmup times untimed, then config.repetitions times
+*/
+template<typename F>
+void measure(const char* name, uint64_t ops, F&& body) {
+    for (uint32_t i = 0; i < config.warmup; ++i) {
+        body();
+    }
+
+    std::vector<double> rep_times_ns;
+    rep_times_ns.reserve(config.repetitions);
+    for (uint32_t i = 0; i < config.repetitions; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        rep_times_ns.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+
+    report(name, ops, rep_times_ns);
+}
+
+} // namespace bench
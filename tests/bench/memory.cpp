@@ -0,0 +1,115 @@
+/**
+ * @file    memory.cpp
+ * @brief   Microbenchmarks for IRVE's memory.h & memory.cpp
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+
+#include "harness.h"
+
+// We do this so we can access translate_address()
+#define private public
+
+#include "common.h"
+#include "csr.h"
+#include "memory.h"
+#include "memory_map.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants
+ * --------------------------------------------------------------------------------------------- */
+
+static constexpr uint64_t OPS = 1 << 16;
+
+static constexpr uint8_t AT_LOAD = 1;//See memory.cpp
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int bench_memory_Memory_ram() {
+    Csr CSR;
+    Memory memory(CSR);
+
+    bench::measure("Memory::load (user RAM, word)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            bench::do_not_optimize(memory.load((uint32_t)(MEM_MAP_REGION_START_USER_RAM + ((i * 4) % 4096)), DT_WORD));
+        }
+    });
+    bench::measure("Memory::load (kernel RAM, byte)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            bench::do_not_optimize(memory.load((uint32_t)(MEM_MAP_REGION_START_KERNEL_RAM + (i % 4096)), DT_UNSIGNED_BYTE));
+        }
+    });
+    bench::measure("Memory::store (user RAM, word)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            memory.store((uint32_t)(MEM_MAP_REGION_START_USER_RAM + ((i * 4) % 4096)), DT_WORD, (uint32_t)i);
+        }
+    });
+
+    return 0;
+}
+
+int bench_memory_Memory_mmio() {
+    Csr CSR;
+    Memory memory(CSR);
+
+    //mtimecmp, since unlike mtime it doesn't need to look at the host's clock
+    uint32_t mtimecmp_addr = (uint32_t)(MEM_MAP_REGION_START_ACLINT + 0x4000);
+    bench::measure("Memory::load (ACLINT mtimecmp)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            bench::do_not_optimize(memory.load(bench::opaque(mtimecmp_addr), DT_WORD));
+        }
+    });
+    bench::measure("Memory::store (ACLINT mtimecmp)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            memory.store(bench::opaque(mtimecmp_addr), DT_WORD, 0xFFFFFFFF);
+        }
+    });
+
+    return 0;
+}
+
+int bench_memory_Memory_translate_address() {
+    Csr CSR;
+    Memory memory(CSR);
+
+    //A superpage (see test_memory_Memory_supervisor_loads_with_translation) and a regular 4KiB page
+    memory.store(0x0010A1F24, DT_WORD, 0x00000043);//Valid, readable, accessed superpage
+    memory.store(0x010A1000, DT_WORD, 0x00000401);//Points to the second level table at 0x1000
+    memory.store(0x00001F00, DT_WORD, 0x00001047);//Valid, readable, writable, accessed page
+
+    CSR.set_privilege_mode(PrivilegeMode::SUPERVISOR_MODE);
+
+    CSR.implicit_write(Csr::Address::SATP, Word(0x00000000));
+    bench::measure("Memory::translate_address (bare)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            bench::do_not_optimize(memory.translate_address(bench::opaque(0x003C0FF0u), AT_LOAD));
+        }
+    });
+
+    CSR.implicit_write(Csr::Address::SATP, Word(0x800010A1));
+    bench::measure("Memory::translate_address (Sv32 superpage)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            bench::do_not_optimize(memory.translate_address(bench::opaque(0xF24E0960u), AT_LOAD));
+        }
+    });
+    bench::measure("Memory::translate_address (Sv32 4KiB page)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            bench::do_not_optimize(memory.translate_address(bench::opaque(0x003C0FF0u), AT_LOAD));
+        }
+    });
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file    tsqueue.cpp
+ * @brief   Microbenchmarks for IRVE's tsqueue.h
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <cstdint>
+#include <thread>
+
+#include "harness.h"
+
+#include "tsqueue.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants
+ * --------------------------------------------------------------------------------------------- */
+
+static constexpr uint64_t OPS = 1 << 16;
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int bench_tsqueue_tsqueue_t() {
+    tsqueue::tsqueue_t<uint64_t> queue;
+
+    bench::measure("tsqueue_t push + pop (uncontended)", OPS, [&] {
+        for (uint64_t i = 0; i < OPS; ++i) {
+            queue.push(i);
+            bench::do_not_optimize(queue.front());
+            queue.pop();
+        }
+    });
+
+    bench::measure("tsqueue_t push + pop (two threads)", OPS, [&] {
+        std::thread consumer([&] {
+            for (uint64_t i = 0; i < OPS; ++i) {
+                while (queue.empty());
+                bench::do_not_optimize(queue.front());
+                queue.pop();
+            }
+        });
+        for (uint64_t i = 0; i < OPS; ++i) {
+            queue.push(i);
+        }
+        consumer.join();
+    });
+
+    return 0;
+}
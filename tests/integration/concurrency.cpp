@@ -0,0 +1,479 @@
+/**
+ * @file    concurrency.cpp
+ * @brief   Concurrency tests
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Performs integration tests to ensure that many independent emulator_t instances can run on
+ * separate threads at once, each with its own logging, that a single emulator_t with several
+ * harts works, that WFI puts the host thread to sleep rather than spinning, that virtual time
+ * is reproducible, and that native SBI calls reach other harts
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include "irve_public_api.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#undef NDEBUG//Asserts should work even in release mode for tests
+#include <cassert>
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+#define NUM_INSTANCES 64
+
+#define NUM_HARTS 4
+#define AMOS_PER_HART 500
+
+#define WFI_TIMER_MS 50
+
+//Registers used by the hand-assembled programs
+#define ZERO    0
+#define T0      5
+#define T1      6
+#define T2      7
+#define A0      10
+#define A1      11
+#define A6      16
+#define A7      17
+#define T3      28
+#define T4      29
+#define T5      30
+#define T6      31
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+struct InstanceLog {//Each instance's log callback context
+    std::atomic<uint32_t> messages;
+    std::atomic<uint32_t> greetings;//Guest output lines containing the greeting
+    std::atomic<uint32_t> stray_guest_output;//Any other guest output
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+static void log_callback(void* context, uint64_t inst_num, uint8_t indent, const char* message, bool guest_output);
+static std::string write_image(const std::vector<uint32_t>& program, bool zero_shared_words);
+static void append_greeting(std::vector<uint32_t>& program);
+static std::vector<uint32_t> timer_program(bool idle_loop);
+static void append_li(std::vector<uint32_t>& program, uint8_t rd, uint32_t value);
+static uint32_t i_type(int32_t imm, uint8_t rs1, uint8_t funct3, uint8_t rd, uint8_t opcode);
+static uint32_t s_type(int32_t imm, uint8_t rs2, uint8_t rs1, uint8_t funct3);
+static uint32_t b_type(int32_t imm, uint8_t rs2, uint8_t rs1, uint8_t funct3);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int test_emulator_t_concurrent_instances() {
+    //Count to 1000, print a greeting to the debug address, then exit
+    std::vector<uint32_t> program = {
+        0xFFF00293,//addi t0, zero, -1 (the debug address)
+        0x00000393,//addi t2, zero, 0
+        0x3E800E13,//addi t3, zero, 1000
+        0x00138393,//addi t2, t2, 1
+        0xFFC3CEE3,//blt t2, t3, -4
+    };
+    append_greeting(program);
+    program.push_back(0x0000000B);//Exit request
+
+    std::string image_path = write_image(program, false);
+
+    //Every instance is alive and running at the same time
+    InstanceLog logs[NUM_INSTANCES] = {};
+    uint64_t inst_counts[NUM_INSTANCES] = {};
+    std::atomic<uint32_t> num_constructed = 0;
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < NUM_INSTANCES; ++i) {
+        threads.emplace_back([&, i]() {
+            const char* image_name = image_path.c_str();
+            irve::emulator::emulator_t emulator(1, &image_name, "file:/dev/null", log_callback, &logs[i]);
+
+            num_constructed.fetch_add(1);
+            while (num_constructed.load() < NUM_INSTANCES) {
+                std::this_thread::yield();
+            }
+
+            emulator.run_until(0);
+            inst_counts[i] = emulator.get_inst_count();
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    unlink(image_path.c_str());
+
+    //Each instance's messages went to its own callback, and only there
+    for (uint32_t i = 0; i < NUM_INSTANCES; ++i) {
+        assert(logs[i].greetings.load() == 1);
+        assert(logs[i].stray_guest_output.load() == 0);
+        assert(logs[i].messages.load() >= 1);
+        assert(inst_counts[i] == inst_counts[0]);
+    }
+    assert(inst_counts[0] == (3 + (1000 * 2) + (16 * 2) + 1));
+
+    return 0;
+}
+
+int test_emulator_t_harts() {
+    //Every hart adds to a shared counter with AMOs. Hart 0 waits for all of them to finish, then
+    //sends hart 1 an IPI and waits for it to acknowledge it before printing a greeting and exiting.
+    //The rest of the harts spin forever once they are done.
+    std::vector<uint32_t> program = {
+        0xF1402573,//csrr a0, mhartid
+        0x000012B7,//lui t0, 0x1 (the counter; the IPI acknowledgement is the word after it)
+        i_type(1, ZERO, 0b000, T1, 0x13),//addi t1, zero, 1
+        i_type(AMOS_PER_HART, ZERO, 0b000, T2, 0x13),//addi t2, zero, AMOS_PER_HART
+        0x0062A02F,//amoadd.w zero, t1, (t0)
+        i_type(-1, T2, 0b000, T2, 0x13),//addi t2, t2, -1
+        b_type(-8, ZERO, T2, 0b001),//bne t2, zero, (the amoadd.w)
+        0,//bne a0, zero, (the other harts' code), filled in below
+        i_type(NUM_HARTS * AMOS_PER_HART, ZERO, 0b000, T3, 0x13),//addi t3, zero, NUM_HARTS * AMOS_PER_HART
+        i_type(0, T0, 0b010, T4, 0x03),//lw t4, 0(t0)
+        b_type(-4, T3, T4, 0b100),//blt t4, t3, (the lw)
+        0xF0000F37,//lui t5, 0xF0000 (the ACLINT)
+        i_type(1, ZERO, 0b000, T6, 0x13),//addi t6, zero, 1
+        s_type(4, T6, T5, 0b010),//sw t6, 4(t5) (hart 1's msip)
+        i_type(4, T0, 0b010, T4, 0x03),//lw t4, 4(t0)
+        b_type(-4, ZERO, T4, 0b000),//beq t4, zero, (the lw)
+        0xFFF00293,//addi t0, zero, -1 (the debug address)
+    };
+    append_greeting(program);
+    program.push_back(0x0000000B);//Exit request
+
+    std::size_t other_harts = program.size();
+    program[7] = b_type(static_cast<int32_t>((other_harts - 7) * 4), ZERO, A0, 0b001);
+    program.insert(program.end(), {
+        i_type(1, ZERO, 0b000, T3, 0x13),//addi t3, zero, 1
+        b_type(7 * 4, T3, A0, 0b001),//bne a0, t3, (the jal)
+        0x34402EF3,//csrr t4, mip
+        i_type(8, T4, 0b111, T4, 0x13),//andi t4, t4, 8 (MSIP)
+        b_type(-8, ZERO, T4, 0b000),//beq t4, zero, (the csrr)
+        0xF0000F37,//lui t5, 0xF0000 (the ACLINT)
+        s_type(4, ZERO, T5, 0b010),//sw zero, 4(t5) (clear our msip)
+        s_type(4, T1, T0, 0b010),//sw t1, 4(t0) (acknowledge the IPI)
+        0x0000006F,//jal zero, 0 (spin forever)
+    });
+
+    std::string image_path = write_image(program, true);
+    const char* image_name = image_path.c_str();
+
+    //Each of the other harts on its own thread
+    InstanceLog threaded_log = {};
+    {
+        irve::emulator::emulator_t emulator(1, &image_name, "file:/dev/null", log_callback, &threaded_log);
+        assert(emulator.set_hart_count(NUM_HARTS));
+        assert(!emulator.set_hart_count(NUM_HARTS));//Only once
+        emulator.run_until(10000000);//So a broken AMO or IPI fails the test rather than hanging
+    }
+
+    //Every hart stepped in turn on this thread
+    InstanceLog stepped_log = {};
+    {
+        irve::emulator::emulator_t emulator(1, &image_name, "file:/dev/null", log_callback, &stepped_log);
+        assert(emulator.set_hart_count(NUM_HARTS));
+        while (emulator.tick() && (emulator.get_inst_count() < 10000000));
+    }
+    unlink(image_path.c_str());
+
+    assert(threaded_log.greetings.load() == 1);
+    assert(threaded_log.stray_guest_output.load() == 0);
+    assert(stepped_log.greetings.load() == 1);
+    assert(stepped_log.stray_guest_output.load() == 0);
+
+    return 0;
+}
+
+int test_emulator_t_wfi() {
+    std::string image_path = write_image(timer_program(false), false);
+    const char* image_name = image_path.c_str();
+
+    InstanceLog log = {};
+    irve::emulator::emulator_t emulator(1, &image_name, "file:/dev/null", log_callback, &log);
+
+    timespec cpu_start, cpu_end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+    auto wall_start = std::chrono::steady_clock::now();
+    emulator.run_until(100000000);//So a broken timer fails the test rather than hanging
+    auto wall_time = std::chrono::steady_clock::now() - wall_start;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+    unlink(image_path.c_str());
+
+    assert(log.greetings.load() == 1);
+    assert(log.stray_guest_output.load() == 0);
+
+    //mtime only counts whole milliseconds, so the timer can go off up to one early
+    assert(wall_time >= std::chrono::milliseconds(WFI_TIMER_MS - 1));
+
+    //The thread should have slept rather than spinning in the WFI loop the whole time
+    auto cpu_time = std::chrono::seconds(cpu_end.tv_sec - cpu_start.tv_sec) + std::chrono::nanoseconds(cpu_end.tv_nsec - cpu_start.tv_nsec);
+    assert(cpu_time < std::chrono::milliseconds(WFI_TIMER_MS / 2));
+    assert(emulator.get_stats().wfi_sleeps >= 1);
+    assert(emulator.get_inst_count() < 1000);
+
+    return 0;
+}
+
+int test_emulator_t_virtual_time() {
+    //Both waiting in WFI and idle loops should skip straight to the timer interrupt, taking the
+    //same number of instructions every time
+    for (bool idle_loop : {false, true}) {
+        std::string image_path = write_image(timer_program(idle_loop), false);
+        const char* image_name = image_path.c_str();
+
+        uint64_t inst_counts[2];
+        for (uint64_t& inst_count : inst_counts) {
+            InstanceLog log = {};
+            irve::emulator::emulator_t emulator(1, &image_name, "file:/dev/null", log_callback, &log);
+            assert(!emulator.set_virtual_time(0));
+            assert(emulator.set_virtual_time(1000000));//So the guest would spin for a long time otherwise
+            assert(!emulator.set_hart_count(2));//Virtual time only works with a single hart
+
+            emulator.run_until(100000000);
+            inst_count = emulator.get_inst_count();
+
+            assert(log.greetings.load() == 1);
+            assert(log.stray_guest_output.load() == 0);
+            assert(emulator.get_stats().wfi_sleeps == 0);
+        }
+        unlink(image_path.c_str());
+
+        assert(inst_counts[0] == inst_counts[1]);
+        assert(inst_counts[0] < 1000);
+    }
+
+    return 0;
+}
+
+int test_emulator_t_native_sbi() {
+    //Both harts drop to S-mode. Hart 0 sets its timer to go off immediately, sends hart 1 an IPI,
+    //and asks every hart to FENCE.I, then waits for hart 1 to acknowledge the IPI before printing a
+    //greeting. If any call goes to the "firmware" (which just exits), the greeting never appears.
+    std::vector<uint32_t> program = {
+        0xF1402573,//csrr a0, mhartid
+        0x000012B7,//lui t0, 0x1 (the IPI acknowledgement is the word after this)
+        0,//addi t1, zero, (the S-mode code), filled in below
+        i_type(0x341, T1, 0b001, ZERO, 0x73),//csrw mepc, t1
+        0,//addi t1, zero, (the M-mode trap handler), filled in below
+        i_type(0x305, T1, 0b001, ZERO, 0x73),//csrw mtvec, t1
+        0x00001337,//lui t1, 0x1
+        i_type(-2048, T1, 0b000, T1, 0x13),//addi t1, t1, -2048 (mstatus.MPP = S-mode)
+        i_type(0x300, T1, 0b001, ZERO, 0x73),//csrw mstatus, t1
+        0x30200073,//mret
+    };
+    std::size_t firmware = program.size();
+    program[4] = i_type(static_cast<int32_t>(firmware * 4), ZERO, 0b000, T1, 0x13);
+    program.push_back(0x0000000B);//Exit request (the "firmware")
+
+    std::size_t smode = program.size();
+    program[2] = i_type(static_cast<int32_t>(smode * 4), ZERO, 0b000, T1, 0x13);
+    program.push_back(0);//bne a0, zero, (hart 1's code), filled in below
+
+    //sbi_set_timer(0), after which sip.STIP should be set
+    append_li(program, A7, 0x54494D45);
+    program.insert(program.end(), {
+        i_type(0, ZERO, 0b000, A6, 0x13),//addi a6, zero, 0
+        i_type(0, ZERO, 0b000, A0, 0x13),//addi a0, zero, 0
+        i_type(0, ZERO, 0b000, A1, 0x13),//addi a1, zero, 0
+        0x00000073,//ecall
+        i_type(0x144, ZERO, 0b010, T4, 0x73),//csrr t4, sip
+        i_type(0x20, T4, 0b111, T4, 0x13),//andi t4, t4, 0x20 (STIP)
+    });
+    std::vector<std::size_t> failures = {program.size()};
+    program.push_back(0);//beq t4, zero, (the failure path), filled in below
+
+    //sbi_send_ipi(0b10, 0)
+    append_li(program, A7, 0x00735049);
+    program.insert(program.end(), {
+        i_type(2, ZERO, 0b000, A0, 0x13),//addi a0, zero, 2
+        0x00000073,//ecall
+    });
+    failures.push_back(program.size());
+    program.push_back(0);//bne a0, zero, (the failure path), filled in below
+
+    //sbi_remote_fence_i(0, -1) (every hart)
+    append_li(program, A7, 0x52464E43);
+    program.insert(program.end(), {
+        i_type(0, ZERO, 0b000, A0, 0x13),//addi a0, zero, 0
+        i_type(-1, ZERO, 0b000, A1, 0x13),//addi a1, zero, -1
+        0x00000073,//ecall
+    });
+    failures.push_back(program.size());
+    program.push_back(0);//bne a0, zero, (the failure path), filled in below
+
+    program.insert(program.end(), {
+        i_type(4, T0, 0b010, T4, 0x03),//lw t4, 4(t0)
+        b_type(-4, ZERO, T4, 0b000),//beq t4, zero, (the lw)
+        0xFFF00293,//addi t0, zero, -1 (the debug address)
+    });
+    append_greeting(program);
+
+    //sbi_get_spec_version() isn't handled natively, so this goes to the "firmware"
+    std::size_t failure = program.size();
+    program.insert(program.end(), {
+        i_type(0x10, ZERO, 0b000, A7, 0x13),//addi a7, zero, 0x10
+        i_type(0, ZERO, 0b000, A6, 0x13),//addi a6, zero, 0
+        0x00000073,//ecall
+    });
+    for (std::size_t i : failures) {
+        uint8_t funct3 = (i == failures[0]) ? 0b000 : 0b001;
+        uint8_t rs1 = (i == failures[0]) ? T4 : A0;
+        program[i] = b_type(static_cast<int32_t>((failure - i) * 4), ZERO, rs1, funct3);
+    }
+
+    std::size_t hart1 = program.size();
+    program[smode] = b_type(static_cast<int32_t>((hart1 - smode) * 4), ZERO, A0, 0b001);
+    program.insert(program.end(), {
+        i_type(0x144, ZERO, 0b010, T4, 0x73),//csrr t4, sip
+        i_type(2, T4, 0b111, T4, 0x13),//andi t4, t4, 2 (SSIP)
+        b_type(-8, ZERO, T4, 0b000),//beq t4, zero, (the csrr)
+        i_type(1, ZERO, 0b000, T1, 0x13),//addi t1, zero, 1
+        s_type(4, T1, T0, 0b010),//sw t1, 4(t0) (acknowledge the IPI)
+        0x0000006F,//jal zero, 0 (spin forever)
+    });
+
+    std::string image_path = write_image(program, true);
+    const char* image_name = image_path.c_str();
+
+    InstanceLog native_log = {};
+    {
+        irve::emulator::emulator_t emulator(1, &image_name, "file:/dev/null", log_callback, &native_log);
+        emulator.set_native_sbi(true);
+        assert(emulator.set_hart_count(2));//After enabling native SBI, so the new hart has to be added
+        emulator.run_until(10000000);//So a lost IPI fails the test rather than hanging
+        assert(emulator.get_stats().native_sbi_calls == 3);
+    }
+
+    //Without native SBI, the first call goes straight to the "firmware"
+    InstanceLog firmware_log = {};
+    {
+        irve::emulator::emulator_t emulator(1, &image_name, "file:/dev/null", log_callback, &firmware_log);
+        assert(emulator.set_hart_count(2));
+        emulator.run_until(10000000);
+        assert(emulator.get_stats().native_sbi_calls == 0);
+    }
+    unlink(image_path.c_str());
+
+    assert(native_log.greetings.load() == 1);
+    assert(native_log.stray_guest_output.load() == 0);
+    assert(firmware_log.greetings.load() == 0);
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static void log_callback(void* context, uint64_t, uint8_t, const char* message, bool guest_output) {
+    InstanceLog* log = static_cast<InstanceLog*>(context);
+    log->messages.fetch_add(1);
+    if (guest_output) {
+        if (std::strstr(message, "Hello from IRVE")) {
+            log->greetings.fetch_add(1);
+        } else {
+            log->stray_guest_output.fetch_add(1);
+        }
+    }
+}
+
+static std::string write_image(const std::vector<uint32_t>& program, bool zero_shared_words) {
+    char image_path[] = "/tmp/irve_concurrency_test_XXXXXX.vhex8";
+    int image_fd = mkstemps(image_path, 6);
+    assert(image_fd != -1);
+    FILE* image = fdopen(image_fd, "w");
+    assert(image);
+    std::fprintf(image, "@00000000\n");
+    for (uint32_t word : program) {
+        std::fprintf(image, "%02x %02x %02x %02x\n", word & 0xFF, (word >> 8) & 0xFF, (word >> 16) & 0xFF, word >> 24);
+    }
+    if (zero_shared_words) {//RAM isn't necessarily zeroed (ex. in fuzzish builds)
+        std::fprintf(image, "@00001000\n00 00 00 00 00 00 00 00\n");
+    }
+    std::fclose(image);
+    return image_path;
+}
+
+static void append_greeting(std::vector<uint32_t>& program) {//Assumes t0 holds the debug address
+    for (const char* character = "Hello from IRVE\n"; *character; ++character) {
+        program.push_back((static_cast<uint32_t>(*character) << 20) | 0x00000313);//addi t1, zero, character
+        program.push_back(0x00628023);//sb t1, 0(t0)
+    }
+}
+
+static std::vector<uint32_t> timer_program(bool idle_loop) {
+    //Set the timer to go off in WFI_TIMER_MS, enable only the timer interrupt in mie, then wait for
+    //it. With WFI, interrupts stay globally disabled (which shouldn't stop WFI from waking up), and
+    //the guest checks mip itself. Otherwise it waits in an idle loop for the interrupt handler.
+    std::vector<uint32_t> program = {
+        0xF000CF37,//lui t5, 0xF000C (the ACLINT's mtime is at -8 from here)
+        0xF0004FB7,//lui t6, 0xF0004 (hart 0's mtimecmp)
+        i_type(-8, T5, 0b010, T1, 0x03),//lw t1, -8(t5)
+        i_type(WFI_TIMER_MS, T1, 0b000, T1, 0x13),//addi t1, t1, WFI_TIMER_MS
+        s_type(4, ZERO, T6, 0b010),//sw zero, 4(t6)
+        s_type(0, T1, T6, 0b010),//sw t1, 0(t6)
+        i_type(0x80, ZERO, 0b000, T2, 0x13),//addi t2, zero, 0x80 (MTIE)
+        i_type(0x304, T2, 0b001, ZERO, 0x73),//csrw mie, t2
+    };
+    if (idle_loop) {
+        program.insert(program.end(), {
+            0x00000397,//auipc t2, 0
+            i_type(5 * 4, T2, 0b000, T2, 0x13),//addi t2, t2, 20 (the interrupt handler)
+            i_type(0x305, T2, 0b001, ZERO, 0x73),//csrw mtvec, t2
+            i_type(0x300, 8, 0b110, ZERO, 0x73),//csrsi mstatus, 8 (MIE)
+            0x0000006F,//jal zero, 0 (idle loop)
+        });
+    } else {
+        program.insert(program.end(), {
+            0x10500073,//wfi
+            i_type(0x344, ZERO, 0b010, T3, 0x73),//csrr t3, mip
+            i_type(0x80, T3, 0b111, T3, 0x13),//andi t3, t3, 0x80 (MTIP)
+            b_type(-12, ZERO, T3, 0b000),//beq t3, zero, (the wfi) since WFI may wake up for no reason
+        });
+    }
+    program.push_back(0xFFF00293);//addi t0, zero, -1 (the debug address)
+    append_greeting(program);
+    program.push_back(0x0000000B);//Exit request
+    return program;
+}
+
+static void append_li(std::vector<uint32_t>& program, uint8_t rd, uint32_t value) {
+    uint32_t upper = (value + 0x800) & 0xFFFFF000;//Since the addi sign-extends the lower 12 bits
+    program.push_back(upper | (rd << 7) | 0x37);//lui rd, upper
+    program.push_back(i_type(static_cast<int32_t>(value - upper), rd, 0b000, rd, 0x13));//addi rd, rd, lower
+}
+
+static uint32_t i_type(int32_t imm, uint8_t rs1, uint8_t funct3, uint8_t rd, uint8_t opcode) {
+    return (static_cast<uint32_t>(imm) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+static uint32_t s_type(int32_t imm, uint8_t rs2, uint8_t rs1, uint8_t funct3) {
+    uint32_t uimm = static_cast<uint32_t>(imm);
+    return ((uimm & 0xFE0) << 20) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((uimm & 0x1F) << 7) | 0x23;
+}
+
+static uint32_t b_type(int32_t imm, uint8_t rs2, uint8_t rs1, uint8_t funct3) {
+    uint32_t uimm = static_cast<uint32_t>(imm);
+    return (((uimm >> 12) & 0b1) << 31) | (((uimm >> 5) & 0x3F) << 25) | (rs2 << 20) | (rs1 << 15) |
+           (funct3 << 12) | (((uimm >> 1) & 0xF) << 8) | (((uimm >> 11) & 0b1) << 7) | 0x63;
+}
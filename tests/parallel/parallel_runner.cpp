@@ -0,0 +1,307 @@
+/**
+ * @file    parallel_runner.cpp
+ * @brief   Runs many test images at once, each in its own emulator instance
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+ * Usage: parallel_runner [--jobs=N] [--max-insts=N] [--log=SPEC] MANIFEST
+ *
+ * Each line of the manifest is one test:
+ *
+ *     NAME IMAGE[,IMAGE...] [SIGNATURE_BEGIN SIGNATURE_END SIGNATURE_FILE]
+ *
+ * (blank lines and lines starting with # are ignored). Tests are handed out to a pool of worker
+ * threads (one per host core by default), each of which creates a fresh emulator_t per test, so no
+ * state is shared between tests. What the guest writes to the debug address is collected per test
+ * rather than logged, so output from different tests doesn't get mixed together.
+ *
+ * A test passes if the guest makes an exit request (within --max-insts instructions, if given) and
+ * doesn't print an assertion failure (the same criteria as the rvsw parse tests). If a signature
+ * range is given, it is dumped afterwards the same way riscv_arch_tester does. Output from failing
+ * tests is printed at the end, and the exit code is nonzero if any test failed.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define private public//This is okay since the purpose of this is to test the emulator
+
+#include "irve_public_api.h"
+
+#include "common.h"
+#include "emulator.h"
+#include "memory.h"
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+#define irvelog_always(...) irve::logging::log_always(__VA_ARGS__)
+
+/* ------------------------------------------------------------------------------------------------
+ * Type/Class Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+struct Test {
+    std::string name;
+    std::vector<std::string> images;
+    bool dump_signature;
+    uint32_t signature_begin_inclusive;
+    uint32_t signature_end_exclusive;
+    std::string signature_path;
+};
+
+struct TestResult {
+    bool passed;
+    std::string reason;//Why the test failed
+    uint64_t inst_count;
+    double seconds;
+    std::string output;//What the guest wrote to the debug address
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+static bool parse_manifest(const char* manifest_path, std::vector<Test>& tests);
+static TestResult run_test(const Test& test, uint64_t max_insts);
+static bool dump_signature(const Test& test, irve::internal::Memory& memory);
+static void print_usage(const char* program_name);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int main(int argc, const char* const* argv) {
+    unsigned int jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    uint64_t max_insts = 0;
+    const char* log_spec = "off";//Logging from many emulators at once is both slow and unreadable
+    const char* manifest_path = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.starts_with("--jobs=")) {
+            jobs = static_cast<unsigned int>(std::strtoul(argv[i] + 7, nullptr, 0));
+        } else if (arg.starts_with("--max-insts=")) {
+            max_insts = std::strtoull(argv[i] + 12, nullptr, 0);
+        } else if (arg.starts_with("--log=")) {
+            log_spec = argv[i] + 6;
+        } else if (!arg.starts_with("--") && !manifest_path) {
+            manifest_path = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!manifest_path || !jobs || !irve::logging::configure(log_spec)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (irve::about::fuzzish_build()) {
+        auto seed = time(NULL);
+        srand(seed);
+        irvelog_always(0, "Fuzzish Build: Set seed to %lu", seed);
+    }
+
+    std::vector<Test> tests;
+    if (!parse_manifest(manifest_path, tests)) {
+        return 1;
+    }
+
+    //Each worker takes the next test nobody has started yet until there are none left
+    std::vector<TestResult> results(tests.size());
+    std::atomic<std::size_t> next_test = 0;
+    jobs = std::min<std::size_t>(jobs, std::max<std::size_t>(tests.size(), 1));
+    irvelog_always(0, "Running %zu tests on %u threads...", tests.size(), jobs);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < jobs; ++i) {
+        workers.emplace_back([&]() {
+            std::size_t test_index;
+            while ((test_index = next_test.fetch_add(1, std::memory_order_relaxed)) < tests.size()) {
+                results[test_index] = run_test(tests[test_index], max_insts);
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    //Report in manifest order (not completion order) so runs can be compared
+    std::size_t num_passed = 0;
+    for (std::size_t i = 0; i < tests.size(); ++i) {
+        const TestResult& result = results[i];
+        if (result.passed) {
+            ++num_passed;
+            irvelog_always(1, "\x1b[92mPASS\x1b[0m %s (%" PRIu64 " instructions, %.3f s)",
+                tests[i].name.c_str(), result.inst_count, result.seconds);
+        } else {
+            irvelog_always(1, "\x1b[91mFAIL\x1b[0m %s: %s (%" PRIu64 " instructions, %.3f s)",
+                tests[i].name.c_str(), result.reason.c_str(), result.inst_count, result.seconds);
+        }
+    }
+
+    for (std::size_t i = 0; i < tests.size(); ++i) {
+        if (!results[i].passed && !results[i].output.empty()) {
+            irvelog_always(0, "Output from %s:", tests[i].name.c_str());
+            std::istringstream output(results[i].output);
+            std::string line;
+            while (std::getline(output, line)) {
+                irvelog_always(1, "%s", line.c_str());
+            }
+        }
+    }
+
+    irvelog_always(0, "%zu/%zu tests passed in %.3f s", num_passed, tests.size(), seconds);
+    return (num_passed == tests.size()) ? 0 : 1;
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static bool parse_manifest(const char* manifest_path, std::vector<Test>& tests) {
+    std::ifstream manifest(manifest_path);
+    if (!manifest) {
+        irvelog_always(0, "Failed to open manifest \"%s\"", manifest_path);
+        return false;
+    }
+
+    std::string line;
+    std::size_t line_number = 0;
+    while (std::getline(manifest, line)) {
+        ++line_number;
+
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name) || name.starts_with("#")) {
+            continue;
+        }
+
+        Test test = {};
+        test.name = name;
+
+        std::string images;
+        if (!(fields >> images)) {
+            irvelog_always(0, "%s:%zu: Test \"%s\" has no images", manifest_path, line_number, name.c_str());
+            return false;
+        }
+        std::istringstream image_list(images);
+        std::string image;
+        while (std::getline(image_list, image, ',')) {
+            if (!image.empty()) {
+                test.images.push_back(image);
+            }
+        }
+
+        std::string signature_begin, signature_end;
+        if (fields >> signature_begin) {
+            if (!(fields >> signature_end >> test.signature_path)) {
+                irvelog_always(0, "%s:%zu: Expected SIGNATURE_BEGIN SIGNATURE_END SIGNATURE_FILE", manifest_path, line_number);
+                return false;
+            }
+            test.dump_signature = true;
+            test.signature_begin_inclusive = static_cast<uint32_t>(std::strtoull(signature_begin.c_str(), nullptr, 0));
+            test.signature_end_exclusive   = static_cast<uint32_t>(std::strtoull(signature_end.c_str(), nullptr, 0));
+
+            //We are guaranteed 4 byte alignment by the spec
+            if ((test.signature_begin_inclusive >= test.signature_end_exclusive) ||
+                (test.signature_begin_inclusive % 4) || (test.signature_end_exclusive % 4)) {
+                irvelog_always(0, "%s:%zu: Bad signature range", manifest_path, line_number);
+                return false;
+            }
+        }
+
+        tests.push_back(std::move(test));
+    }
+
+    return true;
+}
+
+static TestResult run_test(const Test& test, uint64_t max_insts) {
+    //The way we did assertions pre-newlib and Newlib-style respectively (matches add_rvsw_parse_test())
+    static const std::regex assertion_failed("Assertion failed|assertion \".*\" failed");
+
+    TestResult result = {};
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<const char*> imagev;
+    for (const std::string& image : test.images) {
+        imagev.push_back(image.c_str());
+    }
+
+    try {
+        irve::emulator::emulator_t emulator(static_cast<int>(imagev.size()), imagev.data(), "file:/dev/null");
+        emulator.m_emulator_ptr->m_memory.capture_debug_output(&result.output);
+
+        bool exited = false;
+        while (!max_insts || (emulator.get_inst_count() < max_insts)) {
+            if (!emulator.tick()) {
+                exited = true;
+                break;
+            }
+        }
+        result.inst_count = emulator.get_inst_count();
+
+        if (!exited) {
+            result.reason = "didn't exit within the instruction limit";
+        } else if (std::regex_search(result.output, assertion_failed)) {
+            result.reason = "assertion failed";
+        } else if (test.dump_signature && !dump_signature(test, emulator.m_emulator_ptr->m_memory)) {
+            result.reason = "couldn't write the signature to \"" + test.signature_path + "\"";
+        } else {
+            result.passed = true;
+        }
+
+        emulator.m_emulator_ptr->m_memory.capture_debug_output(nullptr);
+    } catch (const std::exception&) {
+        result.reason = "couldn't load the images";
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+static bool dump_signature(const Test& test, irve::internal::Memory& memory) {
+    //https://github.com/riscv-non-isa/riscv-arch-test/blob/main/spec/TestFormatSpec.adoc#the-test-signature
+    FILE* signature_file = fopen(test.signature_path.c_str(), "w");
+    if (!signature_file) {
+        return false;
+    }
+
+    for (uint32_t addr = test.signature_begin_inclusive; addr < test.signature_end_exclusive; addr += 4) {
+        uint32_t signature_word = memory.load(addr, 0b010).u;
+        fprintf(signature_file, "%08x\n", signature_word);//This should match the way Spike outputs things (lowercase)
+    }
+
+    return fclose(signature_file) == 0;
+}
+
+static void print_usage(const char* program_name) {
+    irvelog_always(0, "Usage: %s [--jobs=N] [--max-insts=N] [--log=SPEC] MANIFEST", program_name);
+    irvelog_always(0, "Each line of MANIFEST is: NAME IMAGE[,IMAGE...] [SIGNATURE_BEGIN SIGNATURE_END SIGNATURE_FILE]");
+}
@@ -76,6 +76,12 @@ class irve(pluginTemplate):
         # is missing in the config.ini we can hardcode the alternate here.
         self.dut_exe = os.path.join(config['PATH'] if 'PATH' in config else "","riscv_arch_tester")
 
+        # With parallel=1, the make targets only compile the tests, and then every test is run at
+        # once in a single parallel_runner process (one emulator per test, on a thread per host core)
+        # instead of starting riscv_arch_tester once per test
+        self.parallel_runner_exe = os.path.join(config['PATH'] if 'PATH' in config else "","parallel_runner")
+        self.parallel = 'parallel' in config and config['parallel']=='1'
+
         # Number of parallel jobs that can be spawned off by RISCOF
         # for various actions performed in later functions, specifically to run the tests in
         # parallel on the DUT executable. Can also be used in the build function if required.
@@ -201,7 +207,10 @@ class irve(pluginTemplate):
           # if the user wants to disable running the tests and only compile the tests, then
           # the "else" clause is executed below assigning the sim command to simple no action
           # echo statement.
-          if self.target_run:
+          if self.target_run and self.parallel:
+            # just record how to run the test; parallel_runner runs them all after compiling
+            simcmd = 'echo {0} {1} {2} {3} {4} > irve.manifest'.format(testname, vhex8_file, get_signature_begin_cmd, get_signature_end_cmd, sig_file)
+          elif self.target_run:
             # set up the simulation command. Template is for spike. Please change.
             simcmd = self.dut_exe + ' {0} {1} {2} {3}'.format(get_signature_begin_cmd, get_signature_end_cmd, sig_file, vhex8_file)
             #simcmd = self.dut_exe + ' --isa={0} +signature={1} +signature-granularity=4 {2}'.format(self.isa, sig_file, elf)
@@ -223,6 +232,17 @@ class irve(pluginTemplate):
       # parallel using the make command set above.
       make.execute_all(self.work_dir)
 
+      if self.target_run and self.parallel:
+          manifest_file = os.path.join(self.work_dir, "irve.manifest")
+          with open(manifest_file, "w") as manifest:
+              for testname in testList:
+                  test_manifest_file = os.path.join(testList[testname]['work_dir'], "irve.manifest")
+                  if os.path.exists(test_manifest_file):
+                      with open(test_manifest_file) as test_manifest:
+                          manifest.write(test_manifest.read())
+          # riscof compares the signatures itself, so failures here aren't fatal
+          subprocess.run([self.parallel_runner_exe, manifest_file], cwd=self.work_dir)
+
       # if target runs are not required then we simply exit as this point after running all
       # the makefile targets.
       if not self.target_run:
@@ -134,6 +134,9 @@ class spike(pluginTemplate):
           self.isa += 'd'
       if "C" in ispec["ISA"]:
           self.isa += 'c'
+      for extension in ["Zba", "Zbb", "Zbs"]:
+          if extension in ispec["ISA"]:
+              self.isa += '_' + extension.lower()
 
       #TODO: The following assumes you are using the riscv-gcc toolchain. If
       #      not please change appropriately
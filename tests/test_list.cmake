@@ -10,7 +10,7 @@
 #   cd build
 #   cmake ..
 #   make -j TESTER_NAME
-#       Where TESTER_NAME is one of the following: unit_tester, integration_tester, testfiles_tester
+#       Where TESTER_NAME is one of the following: unit_tester, integration_tester, testfiles_tester, micro_bench
 #   ctest -j
 
 ####################################################################################################
@@ -22,11 +22,41 @@ add_unit_test(common_upow)
 add_unit_test(common_ipow)
 add_unit_test(cpu_state_CpuState)
 add_unit_test(CSR_Csr_init)
+add_unit_test(CSR_Csr_hpm)
+add_unit_test(CSR_Csr_harts)
+add_unit_test(CSR_Csr_virtual_time)
+add_unit_test(CSR_Csr_timebase_frequency)
+add_unit_test(CSR_Csr_sstc)
+add_unit_test(CSR_Csr_fcsr)
 add_unit_test(decode_decoded_inst_t)
 add_unit_test(decode_decoded_inst_t_invalid)
+add_unit_test(execute_zba)
+add_unit_test(execute_zbb)
+add_unit_test(execute_zbs)
+add_unit_test(execute_op_invalid)
+add_unit_test(execute_fp)
+add_unit_test(execute_fp_misaligned)
+add_unit_test(fpu_rounding)
+add_unit_test(fpu_nan)
+add_unit_test(fpu_convert)
+add_unit_test(vector_vset)
+add_unit_test(vector_arithmetic)
+add_unit_test(vector_mask)
+add_unit_test(vector_load_store)
 add_unit_test(logging_irvelog)
+add_unit_test(logging_deferred_format)
+add_unit_test(logging_configure)
 add_unit_test(uart_Uart_sanity)
 add_unit_test(uart_Uart_init)
+add_unit_test(uart_Uart_file_backend)
+add_unit_test(uart_Uart_receive_thread)
+add_unit_test(uart_Uart_unix_socket_reconnect)
+add_unit_test(trace_round_trip)
+add_unit_test(profiler_SymbolTable)
+add_unit_test(profiler_Profiler_folded_output)
+add_unit_test(sbi_SbiHandler_menvcfg)
+add_unit_test(callgraph_CallGraphProfiler)
+add_unit_test(hostperf_HostPerf)
 
 add_unit_test(memory_Memory_user_ram_endianness)
 add_unit_test(memory_Memory_user_ram_sign_extending)
@@ -39,6 +69,10 @@ add_unit_test(memory_Memory_invalid_ramaddrs_misaligned_halfwords)
 add_unit_test(memory_Memory_invalid_ramaddrs_misaligned_words)
 add_unit_test(memory_Memory_translation_conditions)
 add_unit_test(memory_Memory_supervisor_loads_with_translation)
+add_unit_test(memory_Memory_svadu)
+add_unit_test(memory_Memory_emulate_misaligned)
+add_unit_test(memory_Memory_stats)
+add_unit_test(memory_Memory_capture_debug_output)
 
 #add_unit_test(memory_Memory_invalid_unmapped_bytes)#TODO Not written yet
 #add_unit_test(memory_Memory_invalid_unmapped_halfwords)#TODO Not written yet
@@ -53,6 +87,11 @@ add_unit_test(memory_Memory_supervisor_loads_with_translation)
 add_integration_test(about)
 #add_integration_test(emulator_t_init)#TODO
 add_integration_test(emulator_t_sanity)
+add_integration_test(emulator_t_concurrent_instances)
+add_integration_test(emulator_t_harts)
+add_integration_test(emulator_t_wfi)
+add_integration_test(emulator_t_virtual_time)
+add_integration_test(emulator_t_native_sbi)
 add_integration_test(logging)
 
 ####################################################################################################
@@ -151,3 +190,17 @@ add_rvsw_smode_parse_test(cppreference_integer_sequence src/single_file/cxx/cppr
 add_rvsw_smode_parse_test(cppereference_map src/single_file/cxx/cppreference/map)
 add_rvsw_smode_parse_test(cppreference_string src/single_file/cxx/cppreference/string)
 add_rvsw_smode_parse_test(cppreference_tuple src/single_file/cxx/cppreference/tuple)
+
+####################################################################################################
+# Microbenchmark List (micro_bench)
+####################################################################################################
+
+add_micro_bench(decode_DecodedInst)
+add_micro_bench(memory_Memory_ram)
+add_micro_bench(memory_Memory_mmio)
+add_micro_bench(memory_Memory_translate_address)
+add_micro_bench(CSR_Csr_implicit_read)
+add_micro_bench(CSR_Csr_explicit_write)
+add_micro_bench(emulator_icache)
+add_micro_bench(emulator_check_and_handle_interrupts)
+add_micro_bench(tsqueue_tsqueue_t)
@@ -13,9 +13,13 @@
 
 #undef NDEBUG//Asserts should work even in release mode for tests
 #include <cassert>
+#include <chrono>
 #include <cstddef>
+#include <thread>
 #include "common.h"
 #include "csr.h"
+#include "host_clock.h"
+#include "rv_trap.h"
 
 using namespace irve::internal;
 
@@ -46,3 +50,262 @@ int test_CSR_Csr_init() {
 
     return 0;
 }
+
+int test_CSR_Csr_hpm() {
+    Csr csr;
+
+    auto mhpmevent = [](uint16_t i) { return static_cast<Csr::Address>(static_cast<uint16_t>(Csr::Address::MHPMEVENT_START) + i - 3); };
+    auto mhpmcounter = [](uint16_t i) { return static_cast<Csr::Address>(static_cast<uint16_t>(Csr::Address::MHPMCOUNTER_START) + i - 3); };
+    auto mhpmcounterh = [](uint16_t i) { return static_cast<Csr::Address>(static_cast<uint16_t>(Csr::Address::MHPMCOUNTERH_START) + i - 3); };
+    auto hpmcounter = [](uint16_t i) { return static_cast<Csr::Address>(static_cast<uint16_t>(Csr::Address::HPMCOUNTER_START) + i - 3); };
+
+    //Nothing is counted until an event is selected
+    for (uint16_t i = 3; i <= 31; ++i) {
+        assert(csr.explicit_read(mhpmevent(i)) == 0);
+        assert(csr.explicit_read(mhpmcounter(i)) == 0);
+    }
+    csr.count_hpm_event(Csr::HpmEvent::LOAD);
+    for (uint16_t i = 3; i <= 31; ++i) {
+        assert(csr.explicit_read(mhpmcounter(i)) == 0);
+    }
+
+    //Unsupported events read back as 0 (WARL)
+    csr.explicit_write(mhpmevent(3), 0x12345678);
+    assert(csr.explicit_read(mhpmevent(3)) == 0);
+
+    //Several counters can count the same event
+    csr.explicit_write(mhpmevent(3), static_cast<uint32_t>(Csr::HpmEvent::LOAD));
+    csr.explicit_write(mhpmevent(31), static_cast<uint32_t>(Csr::HpmEvent::LOAD));
+    csr.explicit_write(mhpmevent(4), static_cast<uint32_t>(Csr::HpmEvent::EXCEPTION_CAUSE_0) + 2);
+    csr.explicit_write(mhpmevent(5), static_cast<uint32_t>(Csr::HpmEvent::INTERRUPT));
+    csr.explicit_write(mhpmevent(6), static_cast<uint32_t>(Csr::HpmEvent::EXCEPTION));
+    for (uint32_t i = 0; i < 10; ++i) {
+        csr.count_hpm_event(Csr::HpmEvent::LOAD);
+        csr.count_hpm_event(Csr::HpmEvent::STORE);
+    }
+    csr.count_hpm_trap_event(rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+    csr.count_hpm_trap_event(rv_trap::Cause::LOAD_PAGE_FAULT_EXCEPTION);
+    csr.count_hpm_trap_event(rv_trap::Cause::MACHINE_TIMER_INTERRUPT);
+    assert(csr.explicit_read(mhpmcounter(3)) == 10);
+    assert(csr.explicit_read(mhpmcounter(31)) == 10);
+    assert(csr.explicit_read(mhpmcounter(4)) == 1);
+    assert(csr.explicit_read(mhpmcounter(5)) == 1);
+    assert(csr.explicit_read(mhpmcounter(6)) == 2);
+    assert(csr.explicit_read(hpmcounter(3)) == 10);//The unprivileged shadows
+
+    //Inhibited counters stop, and mcycle/minstret can't be inhibited
+    csr.explicit_write(Csr::Address::MCOUNTINHIBIT, 0xFFFFFFFF);
+    assert(csr.explicit_read(Csr::Address::MCOUNTINHIBIT) == 0xFFFFFFF8);
+    csr.count_hpm_event(Csr::HpmEvent::LOAD);
+    assert(csr.explicit_read(mhpmcounter(3)) == 10);
+    csr.explicit_write(Csr::Address::MCOUNTINHIBIT, 0);
+    csr.count_hpm_event(Csr::HpmEvent::LOAD);
+    assert(csr.explicit_read(mhpmcounter(3)) == 11);
+
+    //Counters are 64 bits and writable
+    csr.explicit_write(mhpmcounter(3), 0xFFFFFFFF);
+    csr.count_hpm_event(Csr::HpmEvent::LOAD);
+    assert(csr.explicit_read(mhpmcounter(3)) == 0);
+    assert(csr.explicit_read(mhpmcounterh(3)) == 1);
+
+    return 0;
+}
+
+int test_CSR_Csr_harts() {
+    Csr hart0;
+    Csr hart1(1, hart0);
+
+    assert(hart0.explicit_read(Csr::Address::MHARTID) == 0);
+    assert(hart1.explicit_read(Csr::Address::MHARTID) == 1);
+
+    //mtime is shared
+    hart0.implicit_write(Csr::Address::MTIMEH, 0x12345678);
+    assert(hart1.implicit_read(Csr::Address::MTIMEH) == 0x12345678);
+
+    //mtimecmp isn't
+    hart1.implicit_write(Csr::Address::MTIMECMPH, 0);
+    hart1.implicit_write(Csr::Address::MTIMECMP, 0);
+    assert(hart0.implicit_read(Csr::Address::MTIMECMP) == 0xFFFFFFFF);
+    hart0.update_timer();
+    hart1.update_timer();
+    assert(hart0.explicit_read(Csr::Address::MIP).bit(7) == 0);
+    assert(hart1.explicit_read(Csr::Address::MIP).bit(7) == 1);
+    hart1.implicit_write(Csr::Address::MTIMECMPH, 0xFFFFFFFF);//Writing mtimecmp clears mip.MTIP
+    assert(hart1.explicit_read(Csr::Address::MIP).bit(7) == 0);
+
+    //IPIs (and mip.MSIP can't be written directly)
+    hart1.set_msip(true);
+    assert(hart1.msip());
+    assert(hart1.explicit_read(Csr::Address::MIP).bit(3) == 1);
+    assert(hart0.explicit_read(Csr::Address::MIP).bit(3) == 0);
+    hart1.explicit_write(Csr::Address::MIP, 0);
+    assert(hart1.explicit_read(Csr::Address::MIP).bit(3) == 1);
+    hart1.set_msip(false);
+    assert(hart1.explicit_read(Csr::Address::MIP).bit(3) == 0);
+
+    return 0;
+}
+
+int test_CSR_Csr_virtual_time() {
+    Csr CSR;
+    CSR.use_virtual_time(10);
+    assert(CSR.virtual_time());
+    assert(CSR.implicit_read(Csr::Address::MTIME) == 0);
+
+    //mtime counts cycles
+    for (int i = 0; i < 25; ++i) {
+        CSR.increment_perf_counters();
+    }
+    assert(CSR.implicit_read(Csr::Address::MTIME) == 2);
+
+    //...that were actually run, so writing mcycle doesn't move it
+    CSR.implicit_write(Csr::Address::MCYCLE, 0);
+    CSR.implicit_write(Csr::Address::MCYCLEH, 0x1234);
+    assert(CSR.implicit_read(Csr::Address::MTIME) == 2);
+    for (int i = 0; i < 5; ++i) {
+        CSR.increment_perf_counters();
+    }
+    assert(CSR.implicit_read(Csr::Address::MTIME) == 3);
+
+    //Only skip to the timer interrupt if it is enabled and the timer is actually set
+    assert(!CSR.skip_to_timer_interrupt());
+    CSR.implicit_write(Csr::Address::MIE, 1 << 7);
+    assert(!CSR.skip_to_timer_interrupt());
+    CSR.implicit_write(Csr::Address::MTIMECMPH, 0);
+    CSR.implicit_write(Csr::Address::MTIMECMP, 1000);
+    assert(CSR.explicit_read(Csr::Address::MIP).bit(7) == 0);
+    assert(CSR.skip_to_timer_interrupt());
+    assert(CSR.implicit_read(Csr::Address::MTIME) == 1000);
+    assert(CSR.explicit_read(Csr::Address::MIP).bit(7) == 1);
+
+    //No amount of host time makes virtual time pass
+    assert(CSR.time_until_timer_interrupt(std::chrono::milliseconds(10)) == std::chrono::milliseconds(10));
+
+    return 0;
+}
+
+int test_CSR_Csr_timebase_frequency() {
+    //No overflow even when value * to_frequency doesn't fit in 64 bits
+    assert(host_clock::convert(0xFFFFFFFFFFFFFFFF, 1000, 1000) == 0xFFFFFFFFFFFFFFFF);
+    assert(host_clock::convert(3000000000, 1000, 1000000000) == 3000);
+    assert(host_clock::frequency() != 0);
+
+    Csr CSR;
+    CSR.set_timebase_frequency(1000000000);//1 GHz, so mtime counts nanoseconds
+
+    //Switching frequencies doesn't make mtime jump
+    uint64_t before = CSR.implicit_read(Csr::Address::MTIME).u;
+    assert(before < 1000000000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    uint64_t after = CSR.implicit_read(Csr::Address::MTIME).u;
+    assert((after - before) >= 4000000);//Any less and we're not counting nanoseconds
+
+    //The timer interrupt is 5ms away (minus however long it takes to get to the next line), though
+    //that only matters if it is enabled
+    assert(CSR.time_until_timer_interrupt(std::chrono::milliseconds(10)) == std::chrono::milliseconds(10));
+    CSR.implicit_write(Csr::Address::MIE, 1 << 7);
+    CSR.implicit_write(Csr::Address::MTIMECMPH, 0);
+    CSR.implicit_write(Csr::Address::MTIMECMP, 0);
+    CSR.implicit_write(Csr::Address::MTIME, 0);
+    CSR.implicit_write(Csr::Address::MTIMEH, 0);
+    CSR.implicit_write(Csr::Address::MTIMECMP, 5000000);
+    auto until_timer = CSR.time_until_timer_interrupt(std::chrono::milliseconds(10));
+    assert(until_timer <= std::chrono::milliseconds(5));
+    assert(until_timer > std::chrono::milliseconds(1));
+    assert(CSR.time_until_timer_interrupt(std::chrono::milliseconds(2)) == std::chrono::milliseconds(2));
+
+    return 0;
+}
+
+int test_CSR_Csr_sstc() {
+    Csr CSR;
+    CSR.use_virtual_time(1);//So mtime only moves when we say so
+    CSR.set_privilege_mode(PrivilegeMode::SUPERVISOR_MODE);
+
+    //S-mode can't touch stimecmp until M-mode sets menvcfg.STCE
+    bool trapped = false;
+    try {
+        CSR.explicit_read(Csr::Address::STIMECMP);
+    } catch (const rv_trap::RvException& e) {
+        trapped = e.cause() == rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION;
+    }
+    assert(trapped);
+
+    //Nor does stimecmp do anything
+    CSR.set_stimecmp(0);
+    CSR.update_timer();
+    assert(CSR.implicit_read(Csr::Address::MIP).bit(5) == 0);
+
+    CSR.implicit_write(Csr::Address::MENVCFGH, 0xFFFFFFFF);
+    assert(CSR.implicit_read(Csr::Address::MENVCFGH) == 0xA0000000);//Only STCE and ADUE are implemented
+
+    //Then STIP follows stimecmp...
+    CSR.explicit_write(Csr::Address::STIMECMPH, 0);
+    CSR.explicit_write(Csr::Address::STIMECMP, 10);
+    assert(CSR.explicit_read(Csr::Address::STIMECMP) == 10);
+    assert(CSR.explicit_read(Csr::Address::SIP).bit(5) == 0);
+    for (int i = 0; i < 10; ++i) {
+        CSR.increment_perf_counters();
+    }
+    CSR.update_timer();
+    assert(CSR.explicit_read(Csr::Address::SIP).bit(5) == 1);
+
+    //...and nothing else can change it
+    CSR.implicit_write(Csr::Address::MIP, 0);
+    assert(CSR.implicit_read(Csr::Address::MIP).bit(5) == 1);
+    CSR.explicit_write(Csr::Address::STIMECMP, 20);
+    assert(CSR.explicit_read(Csr::Address::SIP).bit(5) == 0);
+    CSR.implicit_write(Csr::Address::MIP, 1 << 5);
+    assert(CSR.implicit_read(Csr::Address::MIP).bit(5) == 0);
+
+    //WFI and idle loops know when it will go off, if STIE is set
+    CSR.implicit_write(Csr::Address::MIE, 1 << 5);
+    assert(CSR.skip_to_timer_interrupt());
+    assert(CSR.implicit_read(Csr::Address::MTIME) == 20);
+    assert(CSR.explicit_read(Csr::Address::SIP).bit(5) == 1);
+
+    return 0;
+}
+
+int test_CSR_Csr_fcsr() {
+    Csr CSR;
+    CSR.implicit_write(Csr::Address::MSTATUS, 0b01 << 13);//FS = Initial
+    assert(CSR.implicit_read(Csr::Address::MSTATUS).bit(31) == 0);
+
+    //fflags and frm are just views of fcsr
+    CSR.explicit_write(Csr::Address::FCSR, 0xFFFFFFFF);
+    assert(CSR.explicit_read(Csr::Address::FCSR) == 0xFF);
+    assert(CSR.explicit_read(Csr::Address::FFLAGS) == 0x1F);
+    assert(CSR.explicit_read(Csr::Address::FRM) == 0x7);
+    CSR.explicit_write(Csr::Address::FRM, 0b001);
+    CSR.explicit_write(Csr::Address::FFLAGS, 0b10000);
+    assert(CSR.explicit_read(Csr::Address::FCSR) == 0b001'10000);
+    assert(CSR.get_frm() == 0b001);
+
+    //Writing them makes the FP state dirty, which shows up in SD (in sstatus too)
+    assert(CSR.implicit_read(Csr::Address::MSTATUS).bits(14, 13) == 0b11);
+    assert(CSR.implicit_read(Csr::Address::MSTATUS).bit(31) == 1);
+    assert(CSR.implicit_read(Csr::Address::SSTATUS).bit(31) == 1);
+
+    //Software can't set SD itself, and it goes away with FS
+    CSR.implicit_write(Csr::Address::MSTATUS, 0x80000000 | (0b10 << 13));//FS = Clean
+    assert(CSR.implicit_read(Csr::Address::MSTATUS).bit(31) == 0);
+    CSR.accrue_fflags(0);
+    assert(CSR.implicit_read(Csr::Address::MSTATUS).bits(14, 13) == 0b10);
+    CSR.accrue_fflags(0b00001);//NX
+    assert(CSR.implicit_read(Csr::Address::MSTATUS).bits(14, 13) == 0b11);
+    assert(CSR.explicit_read(Csr::Address::FFLAGS) == 0b10001);
+
+    //With FS Off, they can't be accessed at all
+    CSR.implicit_write(Csr::Address::SSTATUS, 0);
+    assert(!CSR.fp_enabled());
+    bool trapped = false;
+    try {
+        CSR.explicit_read(Csr::Address::FFLAGS);
+    } catch (const rv_trap::RvException& e) {
+        trapped = e.cause() == rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION;
+    }
+    assert(trapped);
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file    callgraph.cpp
+ * @brief   Tests for IRVE's callgrind call graph profiler
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#undef NDEBUG//Asserts should work even in release mode for tests
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#include "callgraph.h"
+#include "symbols.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int test_callgraph_CallGraphProfiler() {
+    char profile_path[] = "/tmp/irve_callgrind_test_XXXXXX";
+    int profile_fd = mkstemp(profile_path);
+    assert(profile_fd != -1);
+    close(profile_fd);
+
+    SymbolTable symbols;
+    symbols.add(0x100, 0x10, "main");
+    symbols.add(0x200, 0x10, "leaf");
+    symbols.sort();
+
+    {
+        callgraph::CallGraphProfiler profiler(profile_path, symbols);
+
+        //main calls leaf twice (jal ra, leaf), which returns with jalr x0, 0(ra)
+        uint64_t inst_count = 0;
+        for (uint32_t i = 0; i < 2; ++i) {
+            profiler.add_inst_count(0x104, 1);
+            profiler.jump(1, 0, 0x108, 0x200, ++inst_count);
+            profiler.add_inst_count(0x200, 1);
+            profiler.add_inst_count(0x204, 1);
+            inst_count += 2;
+            profiler.jump(0, 1, 0, 0x108, inst_count);
+        }
+
+        //A return we never saw the call for shouldn't confuse anything
+        profiler.jump(0, 1, 0, 0x300, inst_count);
+
+        //A call that never returns is charged up until profiling finishes
+        profiler.add_inst_count(0x108, 1);
+        profiler.jump(5, 0, 0x10C, 0x200, ++inst_count);
+        inst_count += 10;
+        profiler.finish(inst_count);
+    }
+
+    FILE* profile = std::fopen(profile_path, "r");
+    assert(profile);
+    char contents[512] = {};
+    assert(std::fread(contents, 1, sizeof(contents) - 1, profile) > 0);
+    std::fclose(profile);
+    assert(std::strcmp(contents,
+        "# callgrind format\n"
+        "version: 1\n"
+        "creator: irve\n"
+        "positions: instr\n"
+        "events: Ir\n"
+        "summary: 7\n"
+        "\n"
+        "fn=leaf\n"
+        "0x00000200 2\n"
+        "0x00000204 2\n"
+        "\n"
+        "fn=main\n"
+        "0x00000104 2\n"
+        "0x00000108 1\n"
+        "cfn=leaf\n"
+        "calls=2 0x00000200\n"
+        "0x00000104 4\n"
+        "cfn=leaf\n"
+        "calls=1 0x00000200\n"
+        "0x00000108 10\n"
+    ) == 0);
+
+    unlink(profile_path);
+    return 0;
+}
@@ -0,0 +1,303 @@
+/**
+ * @file    execute.cpp
+ * @brief   Performs unit tests for IRVE's execute.h and execute.cpp
+ * 
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#undef NDEBUG//Asserts should work even in release mode for tests
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include "execute.h"
+
+#include "common.h"
+#include "cpu_state.h"
+#include "csr.h"
+#include "decode.h"
+#include "fpu.h"
+#include "memory.h"
+#include "rv_trap.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief       Execute an OP instruction on x1 and x2, putting the result in x3.
+ * @param[in]   funct7 The funct7 field of the instruction.
+ * @param[in]   funct3 The funct3 field of the instruction.
+ * @param[in]   rs1 The value of x1.
+ * @param[in]   rs2 The value of x2.
+ * @return      The value of x3 afterwards.
+*/
+static uint32_t op(uint8_t funct7, uint8_t funct3, uint32_t rs1, uint32_t rs2);
+
+/**
+ * @brief       Execute an OP-IMM instruction on x1, putting the result in x3.
+ * @param[in]   imm The (12 bit) immediate field of the instruction.
+ * @param[in]   funct3 The funct3 field of the instruction.
+ * @param[in]   rs1 The value of x1.
+ * @return      The value of x3 afterwards.
+*/
+static uint32_t op_imm(uint16_t imm, uint8_t funct3, uint32_t rs1);
+
+/**
+ * @brief       Check if an OP instruction is illegal.
+ * @param[in]   funct7 The funct7 field of the instruction.
+ * @param[in]   funct3 The funct3 field of the instruction.
+ * @return      True if executing it raises an illegal instruction exception.
+*/
+static bool op_is_illegal(uint8_t funct7, uint8_t funct3);
+
+/**
+ * @brief       Execute an OP-FP instruction on f1 and f2, putting the result in f3 (or x3).
+ * @param[in]   cpu_state The state to execute the instruction with.
+ * @param[in]   CSR The CSRs to execute the instruction with.
+ * @param[in]   funct7 The funct7 field of the instruction (funct5 and fmt).
+ * @param[in]   rs2 The rs2 field of the instruction (since some instructions use it for more bits).
+ * @param[in]   rm The rm (funct3) field of the instruction.
+*/
+static void op_fp(CpuState& cpu_state, Csr& CSR, uint8_t funct7, uint8_t rs2, uint8_t rm);
+
+/**
+ * @brief       Check if executing an instruction raises an illegal instruction exception.
+ * @param[in]   function Executes the instruction.
+ * @return      True if it does.
+*/
+template<typename F>
+static bool is_illegal(F function);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int test_execute_zba() {
+    assert(op(0b0010000, 0b010, 0x00000003, 0x00000100) == 0x00000106);//SH1ADD
+    assert(op(0b0010000, 0b100, 0x00000003, 0x00000100) == 0x0000010C);//SH2ADD
+    assert(op(0b0010000, 0b110, 0x00000003, 0x00000100) == 0x00000118);//SH3ADD
+    assert(op(0b0010000, 0b110, 0x80000001, 0x00000000) == 0x00000008);//SH3ADD (overflowing)
+
+    return 0;
+}
+
+int test_execute_zbb() {
+    assert(op(0b0100000, 0b111, 0xFF00FF00, 0x0F0F0F0F) == 0xF000F000);//ANDN
+    assert(op(0b0100000, 0b110, 0xFF00FF00, 0x0F0F0F0F) == 0xFFF0FFF0);//ORN
+    assert(op(0b0100000, 0b100, 0xFF00FF00, 0x0F0F0F0F) == 0x0FF00FF0);//XNOR
+
+    assert(op_imm(0b0110000'00000, 0b001, 0x00010000) == 15);//CLZ
+    assert(op_imm(0b0110000'00000, 0b001, 0x00000000) == 32);//CLZ
+    assert(op_imm(0b0110000'00001, 0b001, 0x00010000) == 16);//CTZ
+    assert(op_imm(0b0110000'00001, 0b001, 0x00000000) == 32);//CTZ
+    assert(op_imm(0b0110000'00010, 0b001, 0xF0F0000F) == 12);//CPOP
+
+    assert(op(0b0000101, 0b100, 0xFFFFFFFF, 0x00000001) == 0xFFFFFFFF);//MIN
+    assert(op(0b0000101, 0b101, 0xFFFFFFFF, 0x00000001) == 0x00000001);//MINU
+    assert(op(0b0000101, 0b110, 0xFFFFFFFF, 0x00000001) == 0x00000001);//MAX
+    assert(op(0b0000101, 0b111, 0xFFFFFFFF, 0x00000001) == 0xFFFFFFFF);//MAXU
+
+    assert(op_imm(0b0110000'00100, 0b001, 0x12345680) == 0xFFFFFF80);//SEXT.B
+    assert(op_imm(0b0110000'00101, 0b001, 0x12348000) == 0xFFFF8000);//SEXT.H
+    assert(op(0b0000100, 0b100, 0x12348000, 0x00000000) == 0x00008000);//ZEXT.H
+
+    assert(op(0b0110000, 0b001, 0x80000001, 4) == 0x00000018);//ROL
+    assert(op(0b0110000, 0b101, 0x80000001, 4) == 0x18000000);//ROR
+    assert(op(0b0110000, 0b101, 0x80000001, 32) == 0x80000001);//ROR (only the low 5 bits of rs2 count)
+    assert(op_imm(0b0110000'00100, 0b101, 0x80000001) == 0x18000000);//RORI
+
+    assert(op_imm(0b0010100'00111, 0b101, 0x00100080) == 0x00FF00FF);//ORC.B
+    assert(op_imm(0b0110100'11000, 0b101, 0x12345678) == 0x78563412);//REV8
+
+    return 0;
+}
+
+int test_execute_zbs() {
+    assert(op(0b0100100, 0b001, 0xFFFFFFFF, 31) == 0x7FFFFFFF);//BCLR
+    assert(op(0b0110100, 0b001, 0x0000000F, 1) == 0x0000000D);//BINV
+    assert(op(0b0010100, 0b001, 0x00000000, 4) == 0x00000010);//BSET
+    assert(op(0b0100100, 0b101, 0x00000010, 4) == 1);//BEXT
+    assert(op(0b0100100, 0b101, 0x00000010, 3) == 0);//BEXT
+
+    assert(op_imm(0b0100100'11111, 0b001, 0xFFFFFFFF) == 0x7FFFFFFF);//BCLRI
+    assert(op_imm(0b0110100'00001, 0b001, 0x0000000F) == 0x0000000D);//BINVI
+    assert(op_imm(0b0010100'00100, 0b001, 0x00000000) == 0x00000010);//BSETI
+    assert(op_imm(0b0100100'00100, 0b101, 0x00000010) == 1);//BEXTI
+
+    return 0;
+}
+
+int test_execute_op_invalid() {
+    //Encodings next to the ones from Zba, Zbb and Zbs that are still unused
+    assert(op_is_illegal(0b0010000, 0b000));
+    assert(op_is_illegal(0b0000101, 0b000));
+    assert(op_is_illegal(0b0110000, 0b000));
+    assert(op_is_illegal(0b0100000, 0b011));
+    assert(op_is_illegal(0b0010100, 0b101));
+    assert(op_is_illegal(0b1111111, 0b001));
+
+    return 0;
+}
+
+int test_execute_fp() {
+    CpuState cpu_state;
+    Csr CSR;
+    CSR.implicit_write(Csr::Address::MSTATUS, 0);
+
+    //Everything is illegal while mstatus.FS is Off
+    assert(is_illegal([&] { op_fp(cpu_state, CSR, 0b0000000, 2, 0b000); }));//FADD.S
+    assert(is_illegal([&] { CSR.explicit_read(Csr::Address::FCSR); }));
+    CSR.implicit_write(Csr::Address::MSTATUS, 0b01 << 13);//Initial
+
+    //Results are NaN-boxed and make the FP state dirty
+    cpu_state.set_f(1, fpu::box(1.5f));
+    cpu_state.set_f(2, fpu::box(2.25f));
+    op_fp(cpu_state, CSR, 0b0000000, 2, 0b000);//FADD.S
+    assert(cpu_state.get_f(3) == fpu::box(3.75f));
+    assert((CSR.implicit_read(Csr::Address::MSTATUS).u & (MSTATUS_FS | MSTATUS_SD)) == (MSTATUS_FS | MSTATUS_SD));
+
+    //Improperly NaN-boxed singles are treated as the canonical NaN, except by moves
+    cpu_state.set_f(1, 0x000000003FC00000);
+    op_fp(cpu_state, CSR, 0b0000000, 2, 0b000);//FADD.S
+    assert(cpu_state.get_f(3) == 0xFFFFFFFF7FC00000);
+    op_fp(cpu_state, CSR, 0b1110000, 0, 0b000);//FMV.X.W
+    assert(cpu_state.get_r(3).u == 0x3FC00000);
+    op_fp(cpu_state, CSR, 0b1110000, 0, 0b001);//FCLASS.S
+    assert(cpu_state.get_r(3).u == (1 << 9));
+
+    //Double precision, with the rounding mode coming from frm
+    cpu_state.set_f(1, std::bit_cast<uint64_t>(1.0));
+    cpu_state.set_f(2, std::bit_cast<uint64_t>(0x1p-53));
+    CSR.explicit_write(Csr::Address::FRM, 0b100);//RMM
+    op_fp(cpu_state, CSR, 0b0000001, 2, 0b111);//FADD.D
+    assert(cpu_state.get_f(3) == std::bit_cast<uint64_t>(1.0 + 0x1p-52));
+    assert(CSR.explicit_read(Csr::Address::FFLAGS).u == fpu::FFLAG_NX);
+    CSR.explicit_write(Csr::Address::FRM, 0b101);//Invalid
+    assert(is_illegal([&] { op_fp(cpu_state, CSR, 0b0000001, 2, 0b111); }));
+    assert(is_illegal([&] { op_fp(cpu_state, CSR, 0b0000001, 2, 0b110); }));
+    assert(is_illegal([&] { op_fp(cpu_state, CSR, 0b0000010, 2, 0b000); }));//Half precision isn't supported
+
+    //Comparisons and conversions to integers write x registers, and accrue fflags
+    CSR.explicit_write(Csr::Address::FCSR, 0);
+    cpu_state.set_f(1, fpu::box(-2.5f));
+    cpu_state.set_f(2, fpu::box(1.0f));
+    op_fp(cpu_state, CSR, 0b1010000, 2, 0b001);//FLT.S
+    assert(cpu_state.get_r(3).u == 1);
+    op_fp(cpu_state, CSR, 0b1100000, 0, 0b100);//FCVT.W.S (RMM)
+    assert(cpu_state.get_r(3).s == -3);
+    op_fp(cpu_state, CSR, 0b1100000, 1, 0b000);//FCVT.WU.S
+    assert(cpu_state.get_r(3).u == 0);
+    assert(CSR.explicit_read(Csr::Address::FFLAGS).u == (fpu::FFLAG_NV | fpu::FFLAG_NX));
+
+    //Fused multiply-adds (f1 * f2 + f4, from opcode MADD to NMADD)
+    cpu_state.set_f(1, fpu::box(2.0f));
+    cpu_state.set_f(2, fpu::box(3.0f));
+    cpu_state.set_f(4, fpu::box(1.0f));
+    const float expected[] = {7.0f, 5.0f, -5.0f, -7.0f};
+    for (uint32_t i = 0; i < 4; ++i) {
+        uint32_t inst = (4 << 27) | (2 << 20) | (1 << 15) | (3 << 7) | ((0b10000 + i) << 2) | 0b11;
+        execute::fused_multiply_add(decode::DecodedInst(inst), cpu_state, CSR);
+        assert(cpu_state.get_f(3) == fpu::box(expected[i]));
+    }
+
+    return 0;
+}
+
+int test_execute_fp_misaligned() {
+    CpuState cpu_state;
+    Csr CSR;
+    Memory memory(CSR);
+    CSR.implicit_write(Csr::Address::MSTATUS, 0b01 << 13);//Initial
+    memory.store(0x100, DT_WORD, 0);
+    memory.store(0x104, DT_WORD, 0);
+    memory.store(0x108, DT_WORD, 0);
+    cpu_state.set_r(1, 0x102);
+    decode::DecodedInst fld((1 << 15) | (0b011 << 12) | (3 << 7) | 0b0000111);//FLD f3, 0(x1)
+    decode::DecodedInst fsd((3 << 20) | (1 << 15) | (0b011 << 12) | 0b0100111);//FSD f3, 0(x1)
+
+    //Misaligned doubles are left to the guest by default...
+    try {
+        execute::store_fp(fsd, cpu_state, memory, CSR);
+        assert(false);
+    } catch (const rv_trap::RvException& e) {
+        assert(e.cause() == rv_trap::Cause::STORE_OR_AMO_ADDRESS_MISALIGNED_EXCEPTION);
+    }
+    try {
+        execute::load_fp(fld, cpu_state, memory, CSR);
+        assert(false);
+    } catch (const rv_trap::RvException& e) {
+        assert(e.cause() == rv_trap::Cause::LOAD_ADDRESS_MISALIGNED_EXCEPTION);
+    }
+
+    //...but are performed directly like any other access when Memory is asked to
+    memory.set_emulate_misaligned(true);
+    cpu_state.set_f(3, 0x0123456789ABCDEF);
+    execute::store_fp(fsd, cpu_state, memory, CSR);
+    assert(memory.load(0x100, DT_WORD).u == 0xCDEF0000);
+    assert(memory.load(0x104, DT_WORD).u == 0x456789AB);
+    assert(memory.load(0x108, DT_WORD).u == 0x00000123);
+    cpu_state.set_f(3, 0);
+    execute::load_fp(fld, cpu_state, memory, CSR);
+    assert(cpu_state.get_f(3) == 0x0123456789ABCDEF);
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static uint32_t op(uint8_t funct7, uint8_t funct3, uint32_t rs1, uint32_t rs2) {
+    CpuState cpu_state;
+    Csr CSR;
+    cpu_state.set_r(1, rs1);
+    cpu_state.set_r(2, rs2);
+
+    //ZEXT.H is the only one of these with rs2 fixed (to x0)
+    uint8_t rs2_num = (funct7 == 0b0000100) ? 0 : 2;
+    uint32_t inst = ((uint32_t)funct7 << 25) | ((uint32_t)rs2_num << 20) | (1 << 15) | ((uint32_t)funct3 << 12) | (3 << 7) | 0b0110011;
+    execute::op(decode::DecodedInst(inst), cpu_state, CSR);
+    return cpu_state.get_r(3).u;
+}
+
+static uint32_t op_imm(uint16_t imm, uint8_t funct3, uint32_t rs1) {
+    CpuState cpu_state;
+    Csr CSR;
+    cpu_state.set_r(1, rs1);
+
+    uint32_t inst = ((uint32_t)imm << 20) | (1 << 15) | ((uint32_t)funct3 << 12) | (3 << 7) | 0b0010011;
+    execute::op_imm(decode::DecodedInst(inst), cpu_state, CSR);
+    return cpu_state.get_r(3).u;
+}
+
+static bool op_is_illegal(uint8_t funct7, uint8_t funct3) {
+    try {
+        op(funct7, funct3, 0, 0);
+    } catch (const rv_trap::RvException& e) {
+        return e.cause() == rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION;
+    }
+    return false;
+}
+
+static void op_fp(CpuState& cpu_state, Csr& CSR, uint8_t funct7, uint8_t rs2, uint8_t rm) {
+    uint32_t inst = ((uint32_t)funct7 << 25) | ((uint32_t)rs2 << 20) | (1 << 15) | ((uint32_t)rm << 12) | (3 << 7) | 0b1010011;
+    execute::op_fp(decode::DecodedInst(inst), cpu_state, CSR);
+}
+
+template<typename F>
+static bool is_illegal(F function) {
+    try {
+        function();
+    } catch (const rv_trap::RvException& e) {
+        return e.cause() == rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION;
+    }
+    return false;
+}
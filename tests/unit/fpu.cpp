@@ -0,0 +1,220 @@
+/**
+ * @file    fpu.cpp
+ * @brief   Performs unit tests for IRVE's fpu.h and fpu.cpp
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#undef NDEBUG//Asserts should work even in release mode for tests
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include "fpu.h"
+
+using namespace irve::internal;
+using fpu::RoundingMode;
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int test_fpu_rounding() {
+    uint8_t fflags;
+
+    //Exactly halfway: RNE goes to the even neighbour, RMM goes away from zero
+    fflags = 0;
+    assert(fpu::add(1.0f, 0x1p-24f, RoundingMode::RNE, fflags) == 1.0f);
+    assert(fflags == fpu::FFLAG_NX);
+    fflags = 0;
+    assert(fpu::add(1.0f, 0x1p-24f, RoundingMode::RMM, fflags) == 1.0f + 0x1p-23f);
+    assert(fflags == fpu::FFLAG_NX);
+    fflags = 0;
+    assert(fpu::sub(-1.0f, 0x1p-24f, RoundingMode::RMM, fflags) == -1.0f - 0x1p-23f);
+    assert(fflags == fpu::FFLAG_NX);
+    fflags = 0;
+    assert(fpu::add(1.0, 0x1p-53, RoundingMode::RMM, fflags) == 1.0 + 0x1p-52);
+    assert(fflags == fpu::FFLAG_NX);
+
+    //Not halfway
+    fflags = 0;
+    assert(fpu::add(1.0f, 0x1p-25f, RoundingMode::RMM, fflags) == 1.0f);
+    assert(fflags == fpu::FFLAG_NX);
+    fflags = 0;
+    assert(fpu::add(1.0f, 0x1p-25f, RoundingMode::RUP, fflags) == 1.0f + 0x1p-23f);
+    assert(fpu::sub(-1.0f, 0x1p-25f, RoundingMode::RDN, fflags) == -1.0f - 0x1p-23f);
+    assert(fpu::sub(-1.0f, 0x1p-25f, RoundingMode::RTZ, fflags) == -1.0f);
+
+    //Exact results raise nothing
+    fflags = 0;
+    assert(fpu::add(1.5f, 1.5f, RoundingMode::RMM, fflags) == 3.0f);
+    assert(fpu::mul(1.5, 1.5, RoundingMode::RNE, fflags) == 2.25);
+    assert(fpu::sqrt(2.25f, RoundingMode::RMM, fflags) == 1.5f);
+    assert(fflags == 0);
+
+    //Overflow, underflow and divide by zero
+    fflags = 0;
+    float max = std::numeric_limits<float>::max();
+    assert(std::isinf(fpu::add(max, max, RoundingMode::RMM, fflags)));
+    assert(fflags == (fpu::FFLAG_OF | fpu::FFLAG_NX));
+    fflags = 0;
+    assert(fpu::add(max, max, RoundingMode::RTZ, fflags) == max);
+    assert(fflags == (fpu::FFLAG_OF | fpu::FFLAG_NX));
+    fflags = 0;
+    assert(fpu::mul(0x1.000002p-126f, 0.5f, RoundingMode::RMM, fflags) == 0x1p-127f + 0x1p-149f);
+    assert(fflags == (fpu::FFLAG_UF | fpu::FFLAG_NX));
+    fflags = 0;
+    assert(fpu::mul(0x1.000002p-126f, 0.5f, RoundingMode::RNE, fflags) == 0x1p-127f);
+    assert(fflags == (fpu::FFLAG_UF | fpu::FFLAG_NX));
+    fflags = 0;
+    assert(fpu::div(-1.0, 0.0, RoundingMode::RMM, fflags) == -std::numeric_limits<double>::infinity());
+    assert(fflags == fpu::FFLAG_DZ);
+
+    //Fused multiply-add only rounds once
+    fflags = 0;
+    float a = 1.0f + 0x1p-12f;
+    assert(fpu::fma(a, a, -1.0f - 0x1p-11f, RoundingMode::RNE, fflags) == 0x1p-24f);
+    assert(fflags == 0);
+    fflags = 0;
+    fpu::fma(std::numeric_limits<float>::infinity(), 0.0f, std::bit_cast<float>(0x7FC00000u), RoundingMode::RNE, fflags);
+    assert(fflags == fpu::FFLAG_NV);
+
+    //The host's rounding mode is put back afterwards
+    volatile float one = 1.0f;
+    volatile float tiny = 0x1p-25f;
+    assert(one + tiny == 1.0f);
+
+    return 0;
+}
+
+int test_fpu_nan() {
+    uint8_t fflags;
+    float inf = std::numeric_limits<float>::infinity();
+    float qnan = std::bit_cast<float>(0xFFC12345u);
+    float snan = std::bit_cast<float>(0x7F800001u);
+
+    //NaN results are always canonical
+    fflags = 0;
+    assert(std::bit_cast<uint32_t>(fpu::add(inf, -inf, RoundingMode::RNE, fflags)) == 0x7FC00000);
+    assert(fflags == fpu::FFLAG_NV);
+    fflags = 0;
+    assert(std::bit_cast<uint32_t>(fpu::add(inf, -inf, RoundingMode::RMM, fflags)) == 0x7FC00000);
+    assert(fflags == fpu::FFLAG_NV);
+    fflags = 0;
+    assert(std::bit_cast<uint32_t>(fpu::add(qnan, 1.0f, RoundingMode::RNE, fflags)) == 0x7FC00000);
+    assert(fflags == 0);
+    assert(std::bit_cast<uint32_t>(fpu::add(snan, 1.0f, RoundingMode::RNE, fflags)) == 0x7FC00000);
+    assert(fflags == fpu::FFLAG_NV);
+    fflags = 0;
+    assert(std::bit_cast<uint64_t>(fpu::sqrt(-1.0, RoundingMode::RNE, fflags)) == 0x7FF8000000000000);
+    assert(fflags == fpu::FFLAG_NV);
+
+    //Min and max
+    fflags = 0;
+    assert(std::signbit(fpu::min(0.0f, -0.0f, fflags)));
+    assert(!std::signbit(fpu::max(-0.0f, 0.0f, fflags)));
+    assert(fpu::min(qnan, 1.0f, fflags) == 1.0f);
+    assert(fpu::max(2.0f, qnan, fflags) == 2.0f);
+    assert(fflags == 0);
+    assert(fpu::min(snan, 1.0f, fflags) == 1.0f);
+    assert(fflags == fpu::FFLAG_NV);
+    assert(std::bit_cast<uint32_t>(fpu::max(qnan, snan, fflags)) == 0x7FC00000);
+
+    //Comparisons
+    fflags = 0;
+    assert(!fpu::eq(qnan, qnan, fflags));
+    assert(fflags == 0);
+    assert(!fpu::eq(snan, 1.0f, fflags));
+    assert(fflags == fpu::FFLAG_NV);
+    fflags = 0;
+    assert(!fpu::lt(qnan, 1.0f, fflags));
+    assert(fflags == fpu::FFLAG_NV);
+    fflags = 0;
+    assert(fpu::le(-0.0, 0.0, fflags) && !fpu::lt(-0.0, 0.0, fflags) && fpu::eq(-0.0, 0.0, fflags));
+    assert(fflags == 0);
+
+    //Classification
+    assert(fpu::classify(-inf) == (1 << 0));
+    assert(fpu::classify(-1.0f) == (1 << 1));
+    assert(fpu::classify(-0x1p-149f) == (1 << 2));
+    assert(fpu::classify(-0.0) == (1 << 3));
+    assert(fpu::classify(0.0) == (1 << 4));
+    assert(fpu::classify(0x1p-1074) == (1 << 5));
+    assert(fpu::classify(1.0) == (1 << 6));
+    assert(fpu::classify(inf) == (1 << 7));
+    assert(fpu::classify(snan) == (1 << 8));
+    assert(fpu::classify(qnan) == (1 << 9));
+
+    //NaN-boxing
+    assert(fpu::box(1.5f) == 0xFFFFFFFF3FC00000);
+    assert(fpu::unbox(0xFFFFFFFF3FC00000) == 1.5f);
+    assert(std::bit_cast<uint32_t>(fpu::unbox(0x000000003FC00000)) == 0x7FC00000);
+
+    return 0;
+}
+
+int test_fpu_convert() {
+    uint8_t fflags;
+
+    fflags = 0;
+    assert(fpu::to_int32(2.5f, RoundingMode::RNE, fflags) == 2);
+    assert(fflags == fpu::FFLAG_NX);
+    assert(fpu::to_int32(2.5f, RoundingMode::RMM, fflags) == 3);
+    assert(fpu::to_int32(-2.5, RoundingMode::RTZ, fflags) == -2);
+    assert(fpu::to_int32(-2.5, RoundingMode::RDN, fflags) == -3);
+    assert(fpu::to_int32(2.25, RoundingMode::RUP, fflags) == 3);
+    fflags = 0;
+    assert(fpu::to_int32(-7.0, RoundingMode::RNE, fflags) == -7);
+    assert(fflags == 0);
+
+    //Out of range values saturate, and are invalid but not inexact
+    fflags = 0;
+    assert(fpu::to_int32(3e9f, RoundingMode::RNE, fflags) == INT32_MAX);
+    assert(fflags == fpu::FFLAG_NV);
+    assert(fpu::to_int32(-std::numeric_limits<double>::infinity(), RoundingMode::RNE, fflags) == INT32_MIN);
+    assert(fpu::to_int32(std::numeric_limits<double>::quiet_NaN(), RoundingMode::RNE, fflags) == INT32_MAX);
+    assert(fpu::to_uint32(std::numeric_limits<float>::quiet_NaN(), RoundingMode::RNE, fflags) == UINT32_MAX);
+    assert(fpu::to_uint32(5e9, RoundingMode::RNE, fflags) == UINT32_MAX);
+    assert(fpu::to_uint32(-1.0f, RoundingMode::RNE, fflags) == 0);
+    assert(fflags == fpu::FFLAG_NV);
+    fflags = 0;
+    assert(fpu::to_uint32(-0.25f, RoundingMode::RTZ, fflags) == 0);//Rounds to -0, which is fine
+    assert(fflags == fpu::FFLAG_NX);
+    fflags = 0;
+    assert(fpu::to_uint32(4294967295.0, RoundingMode::RNE, fflags) == UINT32_MAX);
+    assert(fflags == 0);
+
+    //From integers
+    fflags = 0;
+    assert(fpu::from_int32<float>(16777217, RoundingMode::RNE, fflags) == 16777216.0f);
+    assert(fflags == fpu::FFLAG_NX);
+    assert(fpu::from_int32<float>(16777217, RoundingMode::RMM, fflags) == 16777218.0f);
+    assert(fpu::from_int32<float>(-16777217, RoundingMode::RUP, fflags) == -16777216.0f);
+    fflags = 0;
+    assert(fpu::from_uint32<double>(UINT32_MAX, RoundingMode::RMM, fflags) == 4294967295.0);
+    assert(fpu::from_int32<double>(INT32_MIN, RoundingMode::RNE, fflags) == -2147483648.0);
+    assert(fflags == 0);
+
+    //Between precisions
+    fflags = 0;
+    assert(fpu::to_single(1.0 + 0x1p-24, RoundingMode::RMM, fflags) == 1.0f + 0x1p-23f);
+    assert(fpu::to_single(1.0 + 0x1p-24, RoundingMode::RNE, fflags) == 1.0f);
+    assert(fflags == fpu::FFLAG_NX);
+    fflags = 0;
+    assert(std::isinf(fpu::to_single(1e300, RoundingMode::RNE, fflags)));
+    assert(fflags == (fpu::FFLAG_OF | fpu::FFLAG_NX));
+    fflags = 0;
+    assert(fpu::to_double(1.5f, fflags) == 1.5);
+    assert(fflags == 0);
+    assert(std::bit_cast<uint64_t>(fpu::to_double(std::bit_cast<float>(0x7F800001u), fflags)) == 0x7FF8000000000000);
+    assert(fflags == fpu::FFLAG_NV);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file    hostperf.cpp
+ * @brief   Tests for IRVE's host performance counters
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#undef NDEBUG//Asserts should work even in release mode for tests
+#include <cassert>
+#include <cstdint>
+#include <ctime>
+
+#include "hostperf.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+static void spin_for_cpu_time(uint64_t ns);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int test_hostperf_HostPerf() {
+    volatile hostperf::Phase phase = hostperf::Phase::OTHER;
+    hostperf::HostPerf host_perf(phase);
+
+    if (!host_perf.available()) {
+        return 0;//Ex. perf_event_open isn't allowed here; there's nothing more we can check
+    }
+
+    //Spend 50ms of CPU time in EXECUTE, which is plenty for at least one sample at 1kHz or more
+    //(CPU time rather than wall time, since we may not be scheduled much if other tests are running)
+    host_perf.begin(100);
+    phase = hostperf::Phase::EXECUTE;
+    spin_for_cpu_time(50000000);
+    phase = hostperf::Phase::OTHER;
+    host_perf.end(150);
+
+    assert(host_perf.guest_inst_count() == 50);
+    if (host_perf.total(hostperf::Counter::TASK_CLOCK)) {
+        assert(host_perf.total(hostperf::Counter::TASK_CLOCK) >= 10000000);//At least 10ms of the 50
+    }
+    assert(host_perf.phase_samples(hostperf::Phase::EXECUTE) > 0);
+    assert(host_perf.phase_samples(hostperf::Phase::TRAP) == 0);
+
+    //Counting stops at end()
+    uint64_t samples = host_perf.phase_samples(hostperf::Phase::EXECUTE);
+    phase = hostperf::Phase::EXECUTE;
+    spin_for_cpu_time(20000000);
+    assert(host_perf.phase_samples(hostperf::Phase::EXECUTE) == samples);
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static void spin_for_cpu_time(uint64_t ns) {
+    auto thread_cpu_time_ns = [] {
+        struct timespec time;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return (static_cast<uint64_t>(time.tv_sec) * 1000000000) + static_cast<uint64_t>(time.tv_nsec);
+    };
+
+    uint64_t start = thread_cpu_time_ns();
+    while ((thread_cpu_time_ns() - start) < ns);
+}
@@ -14,6 +14,8 @@
 #undef NDEBUG//Asserts should work even in release mode for tests
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <string>
 
 #define INST_COUNT i * 12345
 #include "logging.h"
@@ -38,4 +40,67 @@ int test_logging_irvelog() {
     return 0;
 }
 
-//TODO test the internal functions directly
+int test_logging_deferred_format() {
+    //Pack the arguments like the async logger does, then clobber the originals before formatting
+    char string[] = "Hello, world!";
+    uint64_t big_number = 0x123456789ABCDEF0;
+    char character = 'A';
+    double pi = 3.14159;
+
+    std::size_t packed_size = logging::deferred::packed_size(string) + logging::deferred::packed_size(big_number) +
+                              logging::deferred::packed_size(character) + logging::deferred::packed_size(pi) +
+                              logging::deferred::packed_size("literal");
+    uint8_t packed_args[256];
+    assert(packed_size <= sizeof(packed_args));
+    uint8_t* next = packed_args;
+    next = logging::deferred::pack(next, string);
+    next = logging::deferred::pack(next, big_number);
+    next = logging::deferred::pack(next, character);
+    next = logging::deferred::pack(next, pi);
+    next = logging::deferred::pack(next, "literal");
+    assert(static_cast<std::size_t>(next - packed_args) == packed_size);
+    std::memset(string, 'X', sizeof(string) - 1);
+
+    char buffer[256];
+    int length = logging::deferred::format<char[14], uint64_t, char, double, char[8]>(
+        buffer, sizeof(buffer), "%s %lX %c %.2f %s", packed_args
+    );
+    assert(std::string(buffer) == "Hello, world! 123456789ABCDEF0 A 3.14 literal");
+    assert(static_cast<std::size_t>(length) == std::strlen(buffer));
+
+    return 0;
+}
+
+int test_logging_configure() {
+    using logging::Subsystem;
+
+    //Everything is off by default
+    assert(!logging::enabled(Subsystem::MEMORY, 0));
+    assert(!logging::enabled(Subsystem::GDBSERVER, 0));
+
+    assert(logging::configure("off"));
+    assert(!logging::enabled(Subsystem::OTHER, 0));
+    assert(!logging::enabled(Subsystem::EXECUTE, 0));
+
+    assert(logging::configure("2"));
+    assert(logging::enabled(Subsystem::DECODE, 2));
+    assert(!logging::enabled(Subsystem::DECODE, 3));
+
+    assert(logging::configure("1:memory,csr"));
+    assert(logging::enabled(Subsystem::MEMORY, 1));
+    assert(!logging::enabled(Subsystem::MEMORY, 2));
+    assert(logging::enabled(Subsystem::CSR, 0));
+    assert(!logging::enabled(Subsystem::UART, 0));
+
+    //Invalid specs leave the settings alone
+    assert(!logging::configure("1:memory,bogus"));
+    assert(!logging::configure("loud"));
+    assert(!logging::configure(":memory"));
+    assert(logging::enabled(Subsystem::MEMORY, 1));
+    assert(!logging::enabled(Subsystem::UART, 0));
+
+    assert(logging::configure("all"));
+    assert(logging::enabled(Subsystem::UART, 255));
+
+    return 0;
+}
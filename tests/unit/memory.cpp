@@ -20,6 +20,7 @@
 
 #undef NDEBUG//Asserts should work even in release mode for tests
 #include <cassert>
+#include <string>
 #include "memory.h"
 #include "csr.h"
 #include "rv_trap.h"
@@ -427,3 +428,150 @@ int test_memory_Memory_supervisor_loads_with_translation() {
 
     return 0;
 }
+
+// Test that the page table walker sets A and D itself when menvcfg.ADUE is set (Svadu)
+int test_memory_Memory_svadu() {
+    Csr CSR;
+    Memory memory(CSR);
+
+    // First level pte at 0x00000000 pointing to the second level at 0x00001000
+    memory.store(0x00000000, DT_WORD, 0x00000401);
+    // Second level pte at 0x00001F00: valid, readable, writable, but neither accessed nor dirty
+    // pte.PPN = 0x4
+    memory.store(0x00001F00, DT_WORD, 0x00001007);
+    memory.store(0x00004FF0, DT_WORD, 0x1234ABCD);
+
+    CSR.set_privilege_mode(PrivilegeMode::SUPERVISOR_MODE);
+    CSR.implicit_write(Csr::Address::SATP, Word(0x80000000));
+    Word va = 0x003C0FF0;
+
+    // Without Svadu the guest has to set A itself
+    try {
+        memory.load(va, DT_WORD);
+        assert(false);
+    } catch (const rv_trap::RvException& e) {
+        assert(e.cause() == rv_trap::Cause::LOAD_PAGE_FAULT_EXCEPTION);
+    }
+
+    CSR.implicit_write(Csr::Address::MENVCFGH, Word(0x20000000));
+
+    // A load only sets A
+    assert(memory.load(va, DT_WORD).u == 0x1234ABCD);
+    CSR.set_privilege_mode(PrivilegeMode::MACHINE_MODE);
+    assert(memory.load(0x00001F00, DT_WORD).u == 0x00001047);
+    CSR.set_privilege_mode(PrivilegeMode::SUPERVISOR_MODE);
+
+    // A store sets D too
+    memory.store(va, DT_WORD, 0xABCD1234);
+    CSR.set_privilege_mode(PrivilegeMode::MACHINE_MODE);
+    assert(memory.load(0x00001F00, DT_WORD).u == 0x000010C7);
+    assert(memory.load(0x00004FF0, DT_WORD).u == 0xABCD1234);
+    assert(memory.stats().pte_ad_updates == 2);
+
+    return 0;
+}
+
+// Test that misaligned RAM accesses are performed directly when asked to, even across pages
+int test_memory_Memory_emulate_misaligned() {
+    Csr CSR;
+    Memory memory(CSR);
+    memory.set_emulate_misaligned(true);
+
+    memory.store(0x00000000, DT_WORD, 0x00000000);
+    memory.store(0x00000001, DT_WORD, 0x12345678);
+    assert(memory.load(0x00000000, DT_WORD).u == 0x34567800);
+    assert(memory.load(0x00000001, DT_WORD).u == 0x12345678);
+    memory.store(0x00000003, DT_HALFWORD, 0xBEEF);
+    assert(memory.load(0x00000003, DT_UNSIGNED_HALFWORD).u == 0x0000BEEF);
+    assert(memory.load(0x00000003, DT_SIGNED_HALFWORD).u == 0xFFFFBEEF);
+
+    // Kernel RAM too
+    memory.store((uint32_t)MEM_MAP_REGION_START_KERNEL_RAM + 2, DT_WORD, 0xCAFEF00D);
+    assert(memory.load((uint32_t)MEM_MAP_REGION_START_KERNEL_RAM + 2, DT_WORD).u == 0xCAFEF00D);
+
+    // Peripherals are still left to the guest
+    try {
+        memory.load((uint32_t)MEM_MAP_REGION_START_ACLINT + 1, DT_WORD);
+        assert(false);
+    } catch (const rv_trap::RvException& e) {
+        assert(e.cause() == rv_trap::Cause::LOAD_ADDRESS_MISALIGNED_EXCEPTION);
+    }
+
+    // Map virtual page 0x3C0 to physical page 0x4 and virtual page 0x3C1 to physical page 0x6,
+    // leaving virtual page 0x3C2 unmapped
+    memory.store(0x00000000, DT_WORD, 0x00000401);
+    memory.store(0x00001F00, DT_WORD, 0x000010C7);
+    memory.store(0x00001F04, DT_WORD, 0x000018C7);
+    memory.store(0x00004FFC, DT_WORD, 0x00000000);
+    memory.store(0x00006000, DT_WORD, 0x00000000);
+    memory.store(0x00006FFC, DT_WORD, 0x00000000);
+    CSR.set_privilege_mode(PrivilegeMode::SUPERVISOR_MODE);
+    CSR.implicit_write(Csr::Address::SATP, Word(0x80000000));
+
+    // The bytes on each side of the page boundary go to their own physical pages
+    memory.store(0x003C0FFE, DT_WORD, 0xAABBCCDD);
+    assert(memory.load(0x003C0FFE, DT_WORD).u == 0xAABBCCDD);
+    CSR.set_privilege_mode(PrivilegeMode::MACHINE_MODE);
+    assert(memory.load(0x00004FFC, DT_WORD).u == 0xCCDD0000);
+    assert(memory.load(0x00006000, DT_WORD).u == 0x0000AABB);
+    CSR.set_privilege_mode(PrivilegeMode::SUPERVISOR_MODE);
+
+    // A fault on the second page means nothing is written on the first
+    try {
+        memory.store(0x003C1FFF, DT_HALFWORD, 0x1234);
+        assert(false);
+    } catch (const rv_trap::RvException& e) {
+        assert(e.cause() == rv_trap::Cause::STORE_OR_AMO_PAGE_FAULT_EXCEPTION);
+    }
+    assert(memory.load(0x003C1FFC, DT_WORD).u == 0x00000000);
+
+    assert(memory.stats().misaligned_accesses == 9);
+
+    return 0;
+}
+
+// Test that Memory counts what it does
+int test_memory_Memory_stats() {
+    Csr CSR;
+    Memory memory(CSR);
+
+    memory.store((uint32_t)MEM_MAP_ADDR_DEBUG, DT_BYTE, 'I');
+    memory.store((uint32_t)MEM_MAP_ADDR_DEBUG, DT_BYTE, '\n');
+    assert(memory.stats().debug_writes == 2);
+
+    // No translation in M-mode
+    memory.store(0x000E0960, DT_WORD, 0xABCD1234);
+    assert(memory.stats().translations == 0);
+
+    // A superpage takes a single pte read to translate
+    memory.store(0x0010A1F24, DT_WORD, 0x00000043);
+    CSR.set_privilege_mode(PrivilegeMode::SUPERVISOR_MODE);
+    CSR.implicit_write(Csr::Address::SATP, Word(0x800010A1));
+    assert(memory.load(0xF24E0960, DT_WORD).u == 0xABCD1234);
+    assert(memory.stats().translations == 1);
+    assert(memory.stats().page_table_reads == 1);
+
+    return 0;
+}
+
+int test_memory_Memory_capture_debug_output() {
+    Csr CSR;
+    Memory memory(CSR);
+
+    std::string output;
+    memory.capture_debug_output(&output);
+    for (const char* character = "Hi\r\n"; *character; ++character) {
+        memory.store((uint32_t)MEM_MAP_ADDR_DEBUG, DT_BYTE, *character);
+    }
+    memory.store((uint32_t)MEM_MAP_ADDR_DEBUG, DT_BYTE, 'x');
+    memory.store((uint32_t)MEM_MAP_ADDR_DEBUG, DT_BYTE, '\0');
+    assert(output == "Hi\r\nx\n");
+
+    // Once we stop capturing, output is logged again instead
+    memory.capture_debug_output(nullptr);
+    memory.store((uint32_t)MEM_MAP_ADDR_DEBUG, DT_BYTE, '!');
+    assert(output == "Hi\r\nx\n");
+    assert(memory.stats().debug_writes == 7);
+
+    return 0;
+}
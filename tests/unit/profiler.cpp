@@ -0,0 +1,90 @@
+/**
+ * @file    profiler.cpp
+ * @brief   Tests for IRVE's guest sampling profiler and symbol tables
+ *
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#undef NDEBUG//Asserts should work even in release mode for tests
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#include "profiler.h"
+#include "symbols.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int test_profiler_SymbolTable() {
+    SymbolTable symbols;
+    assert(symbols.empty());
+
+    symbols.add(0x80001000, 0x100, "second");
+    symbols.add(0x80000000, 0x10, "first");
+    symbols.add(0x80000000, 0, "first_alias");//Sized symbols win over aliases without a size
+    symbols.add(0x80002000, 0, "asm_label");
+    symbols.sort();
+    assert(!symbols.empty());
+
+    assert(symbols.lookup(0x7FFFFFFC) == nullptr);
+    assert(*symbols.lookup(0x80000000) == "first");
+    assert(*symbols.lookup(0x8000000C) == "first");
+    assert(symbols.lookup(0x80000010) == nullptr);//Past the end of "first"
+    assert(*symbols.lookup(0x80001000) == "second");
+    assert(*symbols.lookup(0x800010FC) == "second");
+    assert(symbols.lookup(0x80001100) == nullptr);
+    assert(*symbols.lookup(0x80002000) == "asm_label");
+    assert(*symbols.lookup(0xFFFFFFFC) == "asm_label");//Unknown size extends until the next symbol
+
+    return 0;
+}
+
+int test_profiler_Profiler_folded_output() {
+    char profile_path[] = "/tmp/irve_profile_test_XXXXXX";
+    int profile_fd = mkstemp(profile_path);
+    assert(profile_fd != -1);
+    close(profile_fd);
+
+    SymbolTable symbols;
+    symbols.add(0x80000000, 0x100, "hot");
+    symbols.add(0x80000100, 0x100, "cold");
+    symbols.sort();
+
+    {
+        profiler::Profiler profiler(profile_path, 10, symbols);
+
+        //900 instructions in M-mode in "hot", then 100 in "cold", then 100 in S-mode at an unknown PC
+        for (uint32_t i = 0; i < 900; ++i) {
+            profiler.tick(0x80000000 + ((i % 64) * 4), PrivilegeMode::MACHINE_MODE);
+        }
+        for (uint32_t i = 0; i < 100; ++i) {
+            profiler.tick(0x80000100 + ((i % 64) * 4), PrivilegeMode::MACHINE_MODE);
+        }
+        for (uint32_t i = 0; i < 100; ++i) {
+            profiler.tick(0xC0000000, PrivilegeMode::SUPERVISOR_MODE);
+        }
+    }
+
+    FILE* profile = std::fopen(profile_path, "r");
+    assert(profile);
+    char contents[256] = {};
+    assert(std::fread(contents, 1, sizeof(contents) - 1, profile) > 0);
+    std::fclose(profile);
+    assert(std::strcmp(contents, "M-mode;cold 10\nM-mode;hot 90\nS-mode;0xC0000000 10\n") == 0);
+
+    unlink(profile_path);
+    return 0;
+}
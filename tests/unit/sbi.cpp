@@ -0,0 +1,46 @@
+/**
+ * @file    sbi.cpp
+ * @brief   Performs unit tests for IRVE's sbi.h and sbi.cpp
+ * 
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#undef NDEBUG//Asserts should work even in release mode for tests
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include "sbi.h"
+
+#include "csr.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int test_sbi_SbiHandler_menvcfg() {
+    Csr hart0;
+    Csr hart1(1, hart0);
+    std::atomic<bool> icache_flush_requested[2] = {false, false};
+
+    //The native SBI turns on Sstc and Svadu, since the device tree says S-mode has them...
+    SbiHandler sbi;
+    sbi.add_hart(hart0, icache_flush_requested[0]);
+    sbi.add_hart(hart1, icache_flush_requested[1]);
+    assert(hart0.implicit_read(Csr::Address::MENVCFGH) == 0xA0000000);
+    assert(hart1.implicit_read(Csr::Address::MENVCFGH) == 0xA0000000);
+
+    //...and turns them back off when it's turned off, leaving them to the firmware
+    sbi.remove_harts();
+    assert(hart0.implicit_read(Csr::Address::MENVCFGH) == 0);
+    assert(hart1.implicit_read(Csr::Address::MENVCFGH) == 0);
+
+    return 0;
+}
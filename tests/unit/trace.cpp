@@ -0,0 +1,122 @@
+/**
+ * @file    trace.cpp
+ * @brief   Tests for IRVE's binary instruction traces
+ * 
+ * @copyright
+ *  Copyright (C) 2023-2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+ *
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#undef NDEBUG//Asserts should work even in release mode for tests
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "trace.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int test_trace_round_trip() {
+    char trace_path[] = "/tmp/irve_trace_test_XXXXXX";
+    int trace_fd = mkstemp(trace_path);
+    assert(trace_fd != -1);
+    close(trace_fd);
+
+    //Enough records to go through several of the writer's buffers, with a loop so the instruction
+    //table and deltas get exercised, plus the occasional trap and interrupt
+    constexpr uint32_t NUM_RECORDS = 500000;
+    auto expected_record = [](uint32_t i) {
+        trace::Record record = {};
+        record.pc = 0x80000000 + ((i % 100) * 4);
+        record.inst = 0x00000013 | ((i % 100) << 20);
+        if ((i % 7) == 0) {
+            record.flags |= trace::RD;
+            record.rd = static_cast<uint8_t>(i % 32);
+            record.rd_value = i * 0x9E3779B9;
+        }
+        if ((i % 5) == 0) {
+            record.flags |= trace::MEM;
+            record.mem_addr = 0x80001000 - (i % 64);
+            record.mem_value = i;
+        }
+        if ((i % 1000) == 999) {
+            record.flags |= trace::TRAP;
+            record.cause = 2;
+            record.tval = record.inst;
+        }
+        if ((i % 3333) == 1) {
+            record.flags |= trace::TRAP | trace::NO_INST;
+            record.inst = 0;
+            record.cause = 12;
+            record.tval = record.pc;
+        }
+        return record;
+    };
+
+    {
+        trace::TraceWriter writer(trace_path);
+        for (uint32_t i = 0; i < NUM_RECORDS; ++i) {
+            trace::Record record = expected_record(i);
+            writer.begin(record.pc);
+            if (!(record.flags & trace::NO_INST)) {
+                writer.inst(record.inst);
+            }
+            if (record.flags & trace::RD) {
+                writer.rd(record.rd, record.rd_value);
+            }
+            if (record.flags & trace::MEM) {
+                writer.mem(record.mem_addr, record.mem_value);
+            }
+            if (record.flags & trace::TRAP) {
+                writer.trap(record.cause, record.tval);
+            }
+            writer.end();
+
+            if ((i % 10000) == 0) {
+                writer.interrupt(0x80000007);
+            }
+        }
+    }
+
+    trace::TraceReader reader(trace_path);
+    trace::Record record;
+    for (uint32_t i = 0; i < NUM_RECORDS; ++i) {
+        if ((i % 10000) == 1) {
+            assert(reader.next(record));
+            assert(record.flags == trace::INTERRUPT);
+            assert(record.cause == 0x80000007);
+        }
+
+        trace::Record expected = expected_record(i);
+        assert(reader.next(record));
+        assert(record.flags == expected.flags);
+        assert(record.pc == expected.pc);
+        assert(record.inst == expected.inst);
+        if (expected.flags & trace::RD) {
+            assert(record.rd == expected.rd);
+            assert(record.rd_value == expected.rd_value);
+        }
+        if (expected.flags & trace::MEM) {
+            assert(record.mem_addr == expected.mem_addr);
+            assert(record.mem_value == expected.mem_value);
+        }
+        if (expected.flags & trace::TRAP) {
+            assert(record.cause == expected.cause);
+            assert(record.tval == expected.tval);
+        }
+    }
+    assert(!reader.next(record));
+
+    unlink(trace_path);
+    return 0;
+}
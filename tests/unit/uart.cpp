@@ -16,6 +16,18 @@
 
 #undef NDEBUG//Asserts should work even in release mode for tests
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "uart.h"
 
@@ -43,7 +55,12 @@ using namespace irve::internal;
  * Static Function Declarations
  * --------------------------------------------------------------------------------------------- */
 
-//TODO
+/**
+ * @brief Connect to a UART's UNIX_SOCKET backend
+ * @param socket_path Where it is listening
+ * @return The client's fd
+*/
+static int connect_to_socket(const std::string& socket_path);
 
 /* ------------------------------------------------------------------------------------------------
  * Function Implementations
@@ -80,8 +97,147 @@ int test_uart_Uart_init() {
     return 0;
 }
 
+int test_uart_Uart_file_backend() {
+    char input_path[] = "/tmp/irve_uart_test_input_XXXXXX";
+    char output_path[] = "/tmp/irve_uart_test_output_XXXXXX";
+    int input_fd = mkstemp(input_path);
+    int output_fd = mkstemp(output_path);
+    assert((input_fd != -1) && (output_fd != -1));
+    close(output_fd);
+    assert(write(input_fd, "IRVE", 4) == 4);
+    close(input_fd);
+
+    std::string spec = std::string("file:") + output_path + "," + input_path;
+    {
+        Uart uart(spec.c_str());
+
+        //Echo everything we receive back out
+        for (char expected : std::string("IRVE")) {
+            auto start = std::chrono::steady_clock::now();
+            while (!(uart.read(Uart::Address::LSR) & 0x01)) {//Wait for the receive thread
+                assert((std::chrono::steady_clock::now() - start) < std::chrono::seconds(5));
+                std::this_thread::yield();
+            }
+            uint8_t data = uart.read(Uart::Address::RHR);
+            assert(data == expected);
+            uart.write(Uart::Address::THR, data);
+        }
+        assert(!(uart.read(Uart::Address::LSR) & 0x01));//Nothing left
+    }//Destroying the UART flushes its output
+
+    std::ifstream output_file(output_path);
+    std::stringstream output;
+    output << output_file.rdbuf();
+    assert(output.str() == "IRVE");
+
+    unlink(input_path);
+    unlink(output_path);
+    return 0;
+}
+
+int test_uart_Uart_receive_thread() {
+    //More than fits in the receive queue, so the receive thread has to wait for us to make room
+    constexpr std::size_t NUM_BYTES = 10000;
+
+    char dir_path[] = "/tmp/irve_uart_test_XXXXXX";
+    assert(mkdtemp(dir_path));
+    std::string input_path = std::string(dir_path) + "/input";
+    std::string output_path = std::string(dir_path) + "/output";
+    std::string spec = "file:" + output_path + "," + input_path;
+    assert(mkfifo(input_path.c_str(), 0600) == 0);
+
+    for (bool drain : {true, false}) {
+        Uart uart(spec.c_str());
+        uart.write(Uart::Address::IER, 0x01);//Received Data Ready interrupt
+        assert(!uart.interrupt_pending());
+
+        int input_fd = open(input_path.c_str(), O_WRONLY);
+        assert(input_fd != -1);
+        for (std::size_t i = 0; i < NUM_BYTES; ++i) {
+            uint8_t byte = (uint8_t)(i * 7);
+            assert(write(input_fd, &byte, 1) == 1);
+        }
+        close(input_fd);
+
+        auto start = std::chrono::steady_clock::now();
+        while (!(uart.read(Uart::Address::LSR) & 0x01)) {//Wait for the receive thread
+            assert((std::chrono::steady_clock::now() - start) < std::chrono::seconds(5));
+            std::this_thread::yield();
+        }
+        assert(uart.interrupt_pending());
+        assert(uart.read(Uart::Address::ISR) == 0x04);
+
+        //Give the receive thread time to fill the queue and start waiting for room
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (!drain) {
+            continue;//The destructor has to get the receive thread out of that wait
+        }
+
+        //Nothing was dropped while it waited
+        for (std::size_t i = 0; i < NUM_BYTES; ++i) {
+            start = std::chrono::steady_clock::now();
+            while (!(uart.read(Uart::Address::LSR) & 0x01)) {
+                assert((std::chrono::steady_clock::now() - start) < std::chrono::seconds(5));
+                std::this_thread::yield();
+            }
+            assert(uart.read(Uart::Address::RHR) == (uint8_t)(i * 7));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        assert(!(uart.read(Uart::Address::LSR) & 0x01));
+        assert(!uart.interrupt_pending());
+    }
+
+    unlink(input_path.c_str());
+    unlink(output_path.c_str());
+    rmdir(dir_path);
+    return 0;
+}
+
+int test_uart_Uart_unix_socket_reconnect() {
+    char dir_path[] = "/tmp/irve_uart_test_XXXXXX";
+    assert(mkdtemp(dir_path));
+    std::string socket_path = std::string(dir_path) + "/socket";
+    std::string spec = "unix:" + socket_path;
+
+    {
+        Uart uart(spec.c_str());
+
+        //Each client gets to talk to the guest in turn
+        for (char c : std::string("IR")) {
+            int client_fd = connect_to_socket(socket_path);
+
+            assert(write(client_fd, &c, 1) == 1);
+            auto start = std::chrono::steady_clock::now();
+            while (!(uart.read(Uart::Address::LSR) & 0x01)) {//Wait for the receive thread
+                assert((std::chrono::steady_clock::now() - start) < std::chrono::seconds(5));
+                std::this_thread::yield();
+            }
+            assert(uart.read(Uart::Address::RHR) == c);
+
+            uart.write(Uart::Address::THR, c + 1);
+            char echoed = 0;
+            assert(read(client_fd, &echoed, 1) == 1);
+            assert(echoed == c + 1);
+
+            close(client_fd);
+        }
+    }
+
+    rmdir(dir_path);
+    return 0;
+}
+
 /* ------------------------------------------------------------------------------------------------
  * Static Function Implementations
  * --------------------------------------------------------------------------------------------- */
 
-//TODO
+static int connect_to_socket(const std::string& socket_path) {
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    socket_path.copy(address.sun_path, socket_path.size());
+
+    int client_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(client_fd != -1);
+    assert(connect(client_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0);
+    return client_fd;
+}
@@ -0,0 +1,459 @@
+/**
+ * @file    vector.cpp
+ * @brief   Performs unit tests for IRVE's vector.h and vector.cpp
+ *
+ * @copyright
+ *  Copyright (C) 2024 John Jekel\n
+ *  See the LICENSE file at the root of the project for licensing info.
+*/
+
+/* ------------------------------------------------------------------------------------------------
+ * Includes
+ * --------------------------------------------------------------------------------------------- */
+
+#undef NDEBUG//Asserts should work even in release mode for tests
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include "vector.h"
+
+#include "common.h"
+#include "cpu_state.h"
+#include "csr.h"
+#include "decode.h"
+#include "execute.h"
+#include "memory.h"
+#include "memory_map.h"
+#include "rv_trap.h"
+
+using namespace irve::internal;
+
+/* ------------------------------------------------------------------------------------------------
+ * Constants/Defines
+ * --------------------------------------------------------------------------------------------- */
+
+//vtype values
+#define E8M1    0b000'000
+#define E16M1   0b001'000
+#define E32M1   0b010'000
+#define E32M2   0b010'001
+#define E32M8   0b010'011
+#define E16M4   0b001'010
+#define E8MF4   0b000'110
+#define E32MF2  0b010'111
+#define E64M1   0b011'000
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Declarations
+ * --------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief       Set up a hart with the vector unit enabled (mstatus.VS = Initial) and v0 to v15 zeroed.
+*/
+static void enable(CpuState& cpu_state, Csr& CSR);
+
+/**
+ * @brief       Execute an OP-V instruction.
+ * @param[in]   funct6 The funct6 field of the instruction.
+ * @param[in]   vm True if the instruction is unmasked.
+ * @param[in]   vs2 The vs2 field of the instruction.
+ * @param[in]   vs1 The vs1/rs1/imm field of the instruction.
+ * @param[in]   funct3 The funct3 field of the instruction.
+ * @param[in]   vd The vd/rd field of the instruction.
+*/
+static void op_v(CpuState& cpu_state, Csr& CSR, uint8_t funct6, bool vm, uint8_t vs2, uint8_t vs1, uint8_t funct3, uint8_t vd);
+
+/**
+ * @brief       Execute VSETIVLI, setting vl to min(avl, VLMAX) and putting it in x3.
+*/
+static void vsetivli(CpuState& cpu_state, Csr& CSR, uint8_t avl, uint32_t vtype);
+
+/**
+ * @brief       Execute a vector load or store with x1 as the base address (and x2 as the stride).
+ * @param[in]   store True for a store (STORE-FP), false for a load (LOAD-FP).
+ * @param[in]   mop The mop field of the instruction.
+ * @param[in]   vm True if the instruction is unmasked.
+ * @param[in]   umop The lumop/sumop field of the instruction (ignored if strided).
+ * @param[in]   width The width field of the instruction.
+ * @param[in]   vreg The vd/vs3 field of the instruction.
+*/
+static void load_store(CpuState& cpu_state, Memory& memory, Csr& CSR, bool store, uint8_t mop, bool vm, uint8_t umop, uint8_t width, uint8_t vreg);
+
+template<typename E>
+static E get_elem(const CpuState& cpu_state, uint8_t reg, uint32_t i);
+template<typename E>
+static void set_elem(CpuState& cpu_state, uint8_t reg, uint32_t i, E value);
+
+/**
+ * @brief       Check if something raises an exception.
+ * @param[in]   function The code to run.
+ * @param[in]   cause The exception to expect.
+ * @return      True if it raised that exception.
+*/
+template<typename F>
+static bool raises(F function, rv_trap::Cause cause = rv_trap::Cause::ILLEGAL_INSTRUCTION_EXCEPTION);
+
+/* ------------------------------------------------------------------------------------------------
+ * Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+int test_vector_vset() {
+    CpuState cpu_state;
+    Csr CSR;
+    CSR.implicit_write(Csr::Address::MSTATUS, 0);
+
+    //Everything is illegal while mstatus.VS is Off
+    assert(raises([&] { vsetivli(cpu_state, CSR, 4, E32M1); }));
+    assert(raises([&] { CSR.explicit_read(Csr::Address::VL); }));
+    enable(cpu_state, CSR);
+    assert(CSR.explicit_read(Csr::Address::VLENB).u == 16);
+
+    //VSETVLI x3, x1, e8, m1 (vl is clamped to VLMAX)
+    cpu_state.set_r(1, 100);
+    execute::op_v(decode::DecodedInst((E8M1 << 20) | (1 << 15) | (0b111 << 12) | (3 << 7) | 0b1010111), cpu_state, CSR);
+    assert(cpu_state.get_r(3).u == 16);
+    assert(CSR.explicit_read(Csr::Address::VL).u == 16);
+    assert(CSR.explicit_read(Csr::Address::VTYPE).u == E8M1);
+
+    //VSETVLI x3, x0, e32, m8 (as long as possible)
+    execute::op_v(decode::DecodedInst((E32M8 << 20) | (0 << 15) | (0b111 << 12) | (3 << 7) | 0b1010111), cpu_state, CSR);
+    assert(cpu_state.get_r(3).u == 32);
+
+    //VSETVLI x0, x0, e16, m4 (keeps vl, since the ratio of SEW to LMUL is the same)
+    execute::op_v(decode::DecodedInst((E16M4 << 20) | (0b111 << 12) | 0b1010111), cpu_state, CSR);
+    assert(CSR.explicit_read(Csr::Address::VL).u == 32);
+    assert(CSR.explicit_read(Csr::Address::VTYPE).u == E16M4);
+
+    //VSETIVLI
+    vsetivli(cpu_state, CSR, 5, E16M1);
+    assert(cpu_state.get_r(3).u == 5);
+
+    //VSETVL x3, x1, x2 with a fractional LMUL
+    cpu_state.set_r(2, E8MF4);
+    execute::op_v(decode::DecodedInst((0b1000000 << 25) | (2 << 20) | (1 << 15) | (0b111 << 12) | (3 << 7) | 0b1010111), cpu_state, CSR);
+    assert(cpu_state.get_r(3).u == 4);
+
+    //Unsupported vtypes set vill (and vl = 0), which makes everything else illegal
+    vsetivli(cpu_state, CSR, 4, E32MF2);
+    assert(cpu_state.get_r(3).u == 0);
+    assert(CSR.explicit_read(Csr::Address::VTYPE).u == VTYPE_VILL);
+    assert(raises([&] { op_v(cpu_state, CSR, 0b000000, true, 1, 2, 0b000, 3); }));//VADD.VV
+    vsetivli(cpu_state, CSR, 4, E64M1);
+    assert(CSR.explicit_read(Csr::Address::VTYPE).u == VTYPE_VILL);
+    vsetivli(cpu_state, CSR, 4, E32M1 | (1 << 8));//Reserved bits set
+    assert(CSR.explicit_read(Csr::Address::VTYPE).u == VTYPE_VILL);
+    vsetivli(cpu_state, CSR, 4, E32M1);
+    assert(CSR.explicit_read(Csr::Address::VTYPE).u == E32M1);
+
+    //vl and vtype are read-only to software; vstart isn't
+    assert(raises([&] { CSR.explicit_write(Csr::Address::VL, 1); }));
+    CSR.explicit_write(Csr::Address::VSTART, 3);
+    assert(CSR.explicit_read(Csr::Address::VSTART).u == 3);
+    vsetivli(cpu_state, CSR, 4, E32M1);
+    assert(CSR.explicit_read(Csr::Address::VSTART).u == 0);
+
+    //Changing vector state makes it dirty
+    assert((CSR.implicit_read(Csr::Address::MSTATUS).u & (MSTATUS_VS | MSTATUS_SD)) == (MSTATUS_VS | MSTATUS_SD));
+
+    return 0;
+}
+
+int test_vector_arithmetic() {
+    CpuState cpu_state;
+    Csr CSR;
+    enable(cpu_state, CSR);
+
+    //VADD.VV v3, v2, v1
+    vsetivli(cpu_state, CSR, 4, E32M1);
+    for (uint32_t i = 0; i < 4; ++i) {
+        set_elem<uint32_t>(cpu_state, 1, i, i + 1);
+        set_elem<uint32_t>(cpu_state, 2, i, (i + 1) * 10);
+    }
+    op_v(cpu_state, CSR, 0b000000, true, 2, 1, 0b000, 3);
+    assert(get_elem<uint32_t>(cpu_state, 3, 0) == 11);
+    assert(get_elem<uint32_t>(cpu_state, 3, 3) == 44);
+
+    //Tail elements are left alone
+    vsetivli(cpu_state, CSR, 3, E32M1);
+    set_elem<uint32_t>(cpu_state, 3, 3, 0xAAAAAAAA);
+    op_v(cpu_state, CSR, 0b000010, true, 2, 1, 0b000, 3);//VSUB.VV
+    assert(get_elem<uint32_t>(cpu_state, 3, 2) == 27);
+    assert(get_elem<uint32_t>(cpu_state, 3, 3) == 0xAAAAAAAA);
+
+    //As are masked-off elements
+    set_elem<uint8_t>(cpu_state, 0, 0, 0b0101);
+    op_v(cpu_state, CSR, 0b000000, false, 2, 1, 0b000, 3);//VADD.VV with v0.t
+    assert(get_elem<uint32_t>(cpu_state, 3, 0) == 11);
+    assert(get_elem<uint32_t>(cpu_state, 3, 1) == 18);
+    assert(get_elem<uint32_t>(cpu_state, 3, 2) == 33);
+    assert(raises([&] { op_v(cpu_state, CSR, 0b000000, false, 2, 1, 0b000, 0); }));//vd can't be the mask
+
+    //A whole register of bytes, with a scalar and an immediate
+    vsetivli(cpu_state, CSR, 16, E8M1);
+    for (uint32_t i = 0; i < 16; ++i) {
+        set_elem<uint8_t>(cpu_state, 2, i, i);
+    }
+    cpu_state.set_r(1, 1);
+    op_v(cpu_state, CSR, 0b000010, true, 2, 1, 0b100, 3);//VSUB.VX
+    assert(get_elem<uint8_t>(cpu_state, 3, 0) == 0xFF);
+    assert(get_elem<uint8_t>(cpu_state, 3, 15) == 14);
+    op_v(cpu_state, CSR, 0b000011, true, 2, 0b11111, 0b011, 3);//VRSUB.VI (-1)
+    assert(get_elem<uint8_t>(cpu_state, 3, 0) == 0xFF);
+    assert(get_elem<uint8_t>(cpu_state, 3, 15) == 0xF0);
+    op_v(cpu_state, CSR, 0b101001, true, 3, 0b00001, 0b011, 4);//VSRA.VI
+    assert(get_elem<uint8_t>(cpu_state, 4, 15) == 0xF8);
+    op_v(cpu_state, CSR, 0b101000, true, 3, 0b00001, 0b011, 4);//VSRL.VI
+    assert(get_elem<uint8_t>(cpu_state, 4, 15) == 0x78);
+    op_v(cpu_state, CSR, 0b000101, true, 2, 3, 0b000, 4);//VMIN.VV
+    assert(get_elem<uint8_t>(cpu_state, 4, 15) == 0xF0);
+    op_v(cpu_state, CSR, 0b000100, true, 2, 3, 0b000, 4);//VMINU.VV
+    assert(get_elem<uint8_t>(cpu_state, 4, 15) == 15);
+    assert(raises([&] { op_v(cpu_state, CSR, 0b000010, true, 2, 1, 0b011, 3); }));//There is no VSUB.VI
+
+    //Multiplies and divides
+    vsetivli(cpu_state, CSR, 2, E16M1);
+    set_elem<uint16_t>(cpu_state, 1, 0, 300);
+    set_elem<uint16_t>(cpu_state, 1, 1, 0x8000);
+    set_elem<uint16_t>(cpu_state, 2, 0, 300);
+    set_elem<uint16_t>(cpu_state, 2, 1, 0xFFFF);
+    op_v(cpu_state, CSR, 0b100101, true, 2, 1, 0b010, 3);//VMUL.VV
+    assert(get_elem<uint16_t>(cpu_state, 3, 0) == (uint16_t)(300 * 300));
+    assert(get_elem<uint16_t>(cpu_state, 3, 1) == 0x8000);
+    op_v(cpu_state, CSR, 0b100111, true, 2, 1, 0b010, 3);//VMULH.VV
+    assert(get_elem<uint16_t>(cpu_state, 3, 0) == 1);
+    assert(get_elem<uint16_t>(cpu_state, 3, 1) == 0);
+    op_v(cpu_state, CSR, 0b100100, true, 2, 1, 0b010, 3);//VMULHU.VV
+    assert(get_elem<uint16_t>(cpu_state, 3, 1) == 0x7FFF);
+    op_v(cpu_state, CSR, 0b100001, true, 1, 2, 0b010, 3);//VDIV.VV (overflows)
+    assert(get_elem<uint16_t>(cpu_state, 3, 1) == 0x8000);
+    op_v(cpu_state, CSR, 0b100011, true, 1, 2, 0b010, 3);//VREM.VV
+    assert(get_elem<uint16_t>(cpu_state, 3, 0) == 0);
+    assert(get_elem<uint16_t>(cpu_state, 3, 1) == 0);
+    cpu_state.set_r(1, 0);
+    op_v(cpu_state, CSR, 0b100000, true, 1, 1, 0b110, 3);//VDIVU.VX by zero
+    assert(get_elem<uint16_t>(cpu_state, 3, 0) == 0xFFFF);
+    op_v(cpu_state, CSR, 0b100010, true, 1, 1, 0b110, 3);//VREMU.VX by zero
+    assert(get_elem<uint16_t>(cpu_state, 3, 0) == 300);
+    cpu_state.set_r(1, 2);
+    set_elem<uint16_t>(cpu_state, 3, 0, 7);
+    op_v(cpu_state, CSR, 0b101101, true, 2, 1, 0b110, 3);//VMACC.VX (v3 += x1 * v2)
+    assert(get_elem<uint16_t>(cpu_state, 3, 0) == 607);
+    op_v(cpu_state, CSR, 0b101001, true, 2, 1, 0b110, 3);//VMADD.VX (v3 = x1 * v3 + v2)
+    assert(get_elem<uint16_t>(cpu_state, 3, 0) == 1514);
+
+    //VMERGE.VXM and VMV.V.X
+    vsetivli(cpu_state, CSR, 4, E32M1);
+    set_elem<uint8_t>(cpu_state, 0, 0, 0b0110);
+    cpu_state.set_r(1, 0x12345678);
+    op_v(cpu_state, CSR, 0b010111, false, 2, 1, 0b100, 4);
+    assert(get_elem<uint32_t>(cpu_state, 4, 0) == get_elem<uint32_t>(cpu_state, 2, 0));
+    assert(get_elem<uint32_t>(cpu_state, 4, 1) == 0x12345678);
+    assert(get_elem<uint32_t>(cpu_state, 4, 3) == get_elem<uint32_t>(cpu_state, 2, 3));
+    op_v(cpu_state, CSR, 0b010111, true, 0, 1, 0b100, 4);
+    assert(get_elem<uint32_t>(cpu_state, 4, 0) == 0x12345678);
+    assert(get_elem<uint32_t>(cpu_state, 4, 3) == 0x12345678);
+
+    //Register groups must be aligned
+    vsetivli(cpu_state, CSR, 8, E32M2);
+    op_v(cpu_state, CSR, 0b000000, true, 2, 4, 0b000, 6);
+    assert(raises([&] { op_v(cpu_state, CSR, 0b000000, true, 2, 4, 0b000, 7); }));
+    assert(raises([&] { op_v(cpu_state, CSR, 0b000000, true, 3, 4, 0b000, 6); }));
+
+    //Other unsupported cases
+    assert(raises([&] { op_v(cpu_state, CSR, 0b000000, true, 2, 4, 0b001, 6); }));//VFADD.VV
+    assert(raises([&] { op_v(cpu_state, CSR, 0b110000, true, 2, 4, 0b010, 6); }));//VWADDU.VV
+    CSR.explicit_write(Csr::Address::VSTART, 1);
+    assert(raises([&] { op_v(cpu_state, CSR, 0b000000, true, 2, 4, 0b000, 6); }));
+
+    return 0;
+}
+
+int test_vector_mask() {
+    CpuState cpu_state;
+    Csr CSR;
+    enable(cpu_state, CSR);
+    vsetivli(cpu_state, CSR, 4, E32M1);
+    set_elem<uint32_t>(cpu_state, 1, 0, 5);
+    set_elem<uint32_t>(cpu_state, 1, 1, 0xFFFFFFFF);
+    set_elem<uint32_t>(cpu_state, 1, 2, 7);
+    set_elem<uint32_t>(cpu_state, 1, 3, 0);
+
+    //Comparisons only write the first vl mask bits
+    cpu_state.set_r(1, 5);
+    set_elem<uint8_t>(cpu_state, 4, 0, 0xF0);
+    op_v(cpu_state, CSR, 0b011011, true, 1, 1, 0b100, 4);//VMSLT.VX
+    assert(get_elem<uint8_t>(cpu_state, 4, 0) == 0xFA);
+    op_v(cpu_state, CSR, 0b011110, true, 1, 5, 0b011, 5);//VMSGTU.VI
+    assert((get_elem<uint8_t>(cpu_state, 5, 0) & 0xF) == 0b0110);
+    op_v(cpu_state, CSR, 0b011000, true, 1, 1, 0b000, 1);//VMSEQ.VV (overwriting a source)
+    assert((get_elem<uint8_t>(cpu_state, 1, 0) & 0xF) == 0b1111);
+    set_elem<uint32_t>(cpu_state, 1, 0, 5);
+
+    //Mask logical instructions
+    op_v(cpu_state, CSR, 0b011001, true, 4, 5, 0b010, 6);//VMAND.MM
+    assert((get_elem<uint8_t>(cpu_state, 6, 0) & 0xF) == 0b0010);
+    op_v(cpu_state, CSR, 0b011011, true, 4, 5, 0b010, 6);//VMXOR.MM
+    assert((get_elem<uint8_t>(cpu_state, 6, 0) & 0xF) == 0b1100);
+    op_v(cpu_state, CSR, 0b011000, true, 4, 5, 0b010, 6);//VMANDN.MM
+    assert((get_elem<uint8_t>(cpu_state, 6, 0) & 0xF) == 0b1000);
+
+    //VCPOP.M and VFIRST.M
+    op_v(cpu_state, CSR, 0b010000, true, 4, 0b10000, 0b010, 3);
+    assert(cpu_state.get_r(3).u == 2);
+    op_v(cpu_state, CSR, 0b010000, true, 5, 0b10001, 0b010, 3);
+    assert(cpu_state.get_r(3).u == 1);
+    set_elem<uint8_t>(cpu_state, 0, 0, 0b1000);
+    op_v(cpu_state, CSR, 0b010000, false, 5, 0b10001, 0b010, 3);//Masked
+    assert(cpu_state.get_r(3).s == -1);
+
+    //Reductions
+    set_elem<uint32_t>(cpu_state, 8, 0, 100);
+    op_v(cpu_state, CSR, 0b000000, true, 1, 8, 0b010, 7);//VREDSUM.VS
+    assert(get_elem<uint32_t>(cpu_state, 7, 0) == 111);
+    op_v(cpu_state, CSR, 0b000111, true, 1, 8, 0b010, 7);//VREDMAX.VS
+    assert(get_elem<uint32_t>(cpu_state, 7, 0) == 100);
+    op_v(cpu_state, CSR, 0b000110, true, 1, 8, 0b010, 7);//VREDMAXU.VS
+    assert(get_elem<uint32_t>(cpu_state, 7, 0) == 0xFFFFFFFF);
+    op_v(cpu_state, CSR, 0b000000, false, 1, 8, 0b010, 7);//Masked VREDSUM.VS
+    assert(get_elem<uint32_t>(cpu_state, 7, 0) == 100);
+
+    //VID.V, VMV.X.S and VMV.S.X
+    op_v(cpu_state, CSR, 0b010100, true, 0, 0b10001, 0b010, 9);
+    assert(get_elem<uint32_t>(cpu_state, 9, 0) == 0);
+    assert(get_elem<uint32_t>(cpu_state, 9, 3) == 3);
+    op_v(cpu_state, CSR, 0b010000, true, 1, 0, 0b010, 3);
+    assert(cpu_state.get_r(3).u == 5);
+    cpu_state.set_r(1, 0xABCD);
+    op_v(cpu_state, CSR, 0b010000, true, 0, 1, 0b110, 9);
+    assert(get_elem<uint32_t>(cpu_state, 9, 0) == 0xABCD);
+    assert(get_elem<uint32_t>(cpu_state, 9, 1) == 1);
+    vsetivli(cpu_state, CSR, 1, E8M1);
+    set_elem<uint8_t>(cpu_state, 1, 0, 0x80);
+    op_v(cpu_state, CSR, 0b010000, true, 1, 0, 0b010, 3);//Sign extended
+    assert(cpu_state.get_r(3).u == 0xFFFFFF80);
+
+    return 0;
+}
+
+int test_vector_load_store() {
+    CpuState cpu_state;
+    Csr CSR;
+    Memory memory(CSR);
+    enable(cpu_state, CSR);
+    for (uint32_t i = 0; i < 64; i += 4) {
+        memory.store(0x1000 + i, DT_WORD, 0x03020100 + (i * 0x01010101));
+        memory.store(0x2000 + i, DT_WORD, 0);
+    }
+
+    //VLE32.V v1, (x1)
+    vsetivli(cpu_state, CSR, 4, E32M1);
+    cpu_state.set_r(1, 0x1000);
+    load_store(cpu_state, memory, CSR, false, 0b00, true, 0b00000, 0b110, 1);
+    assert(get_elem<uint32_t>(cpu_state, 1, 0) == 0x03020100);
+    assert(get_elem<uint32_t>(cpu_state, 1, 3) == 0x0F0E0D0C);
+    assert(cpu_state.get_pc().u == 4);
+
+    //VLE8.V with LMUL = 1 but SEW = 32 (so EMUL = 1/4)
+    load_store(cpu_state, memory, CSR, false, 0b00, true, 0b00000, 0b000, 2);
+    assert(get_elem<uint8_t>(cpu_state, 2, 3) == 3);
+
+    //VLSE16.V v2, (x1), x2
+    vsetivli(cpu_state, CSR, 3, E16M1);
+    cpu_state.set_r(2, 6);
+    load_store(cpu_state, memory, CSR, false, 0b10, true, 2, 0b101, 2);
+    assert(get_elem<uint16_t>(cpu_state, 2, 0) == 0x0100);
+    assert(get_elem<uint16_t>(cpu_state, 2, 1) == 0x0706);
+    assert(get_elem<uint16_t>(cpu_state, 2, 2) == 0x0D0C);
+
+    //Masked VSE8.V v1, (x1) and VSM.V v0, (x1)
+    vsetivli(cpu_state, CSR, 10, E8M1);
+    cpu_state.set_r(1, 0x2000);
+    set_elem<uint16_t>(cpu_state, 0, 0, 0b10'0000'0101);
+    load_store(cpu_state, memory, CSR, true, 0b00, false, 0b00000, 0b000, 1);
+    assert(memory.load(0x2000, DT_WORD).u == 0x00020000);
+    assert(memory.load(0x2008, DT_WORD).u == 0x00000900);
+    cpu_state.set_r(1, 0x2010);
+    load_store(cpu_state, memory, CSR, true, 0b00, true, 0b01011, 0b000, 0);
+    assert(memory.load(0x2010, DT_WORD).u == 0x00000205);
+
+    //VLM.V v3, (x1)
+    vsetivli(cpu_state, CSR, 16, E32M8);
+    load_store(cpu_state, memory, CSR, false, 0b00, true, 0b01011, 0b000, 3);
+    assert(get_elem<uint16_t>(cpu_state, 3, 0) == 0x0205);
+
+    //Fault-only-first loads trim vl instead of faulting on any element but the first
+    vsetivli(cpu_state, CSR, 4, E32M1);
+    cpu_state.set_r(1, (uint32_t)(MEM_MAP_REGION_END_USER_RAM + 1 - 8));
+    load_store(cpu_state, memory, CSR, false, 0b00, true, 0b10000, 0b110, 4);
+    assert(CSR.explicit_read(Csr::Address::VL).u == 2);
+
+    //Other loads record where the fault happened in vstart
+    vsetivli(cpu_state, CSR, 4, E32M1);
+    assert(raises([&] { load_store(cpu_state, memory, CSR, false, 0b00, true, 0b00000, 0b110, 4); }, rv_trap::Cause::LOAD_ACCESS_FAULT_EXCEPTION));
+    assert(CSR.explicit_read(Csr::Address::VSTART).u == 2);
+    assert(raises([&] { load_store(cpu_state, memory, CSR, true, 0b00, true, 0b00000, 0b110, 4); }, rv_trap::Cause::STORE_OR_AMO_ACCESS_FAULT_EXCEPTION));
+    assert(CSR.explicit_read(Csr::Address::VSTART).u == 2);
+    CSR.explicit_write(Csr::Address::VSTART, 0);
+
+    //Unsupported forms
+    cpu_state.set_r(1, 0x1000);
+    assert(raises([&] { load_store(cpu_state, memory, CSR, false, 0b01, true, 2, 0b110, 4); }));//Indexed
+    assert(raises([&] { load_store(cpu_state, memory, CSR, false, 0b00, true, 0b00000, 0b111, 4); }));//EEW = 64
+    assert(raises([&] { load_store(cpu_state, memory, CSR, false, 0b00, false, 0b00000, 0b110, 0); }));//vd is the mask
+    vsetivli(cpu_state, CSR, 4, E32M2);
+    assert(raises([&] { load_store(cpu_state, memory, CSR, false, 0b00, true, 0b00000, 0b110, 5); }));//Misaligned group
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------------------------------
+ * Static Function Implementations
+ * --------------------------------------------------------------------------------------------- */
+
+static void enable(CpuState& cpu_state, Csr& CSR) {
+    CSR.implicit_write(Csr::Address::MSTATUS, 0b01 << 9);//VS = Initial
+    std::memset(cpu_state.get_v(0), 0, 16 * VLEN_BYTES);
+}
+
+static void op_v(CpuState& cpu_state, Csr& CSR, uint8_t funct6, bool vm, uint8_t vs2, uint8_t vs1, uint8_t funct3, uint8_t vd) {
+    uint32_t raw = (funct6 << 26) | (vm << 25) | (vs2 << 20) | (vs1 << 15) | (funct3 << 12) | (vd << 7) | 0b1010111;
+    execute::op_v(decode::DecodedInst(raw), cpu_state, CSR);
+}
+
+static void vsetivli(CpuState& cpu_state, Csr& CSR, uint8_t avl, uint32_t vtype) {
+    uint32_t raw = (0b11 << 30) | (vtype << 20) | (avl << 15) | (0b111 << 12) | (3 << 7) | 0b1010111;
+    execute::op_v(decode::DecodedInst(raw), cpu_state, CSR);
+}
+
+static void load_store(CpuState& cpu_state, Memory& memory, Csr& CSR, bool store, uint8_t mop, bool vm, uint8_t umop, uint8_t width, uint8_t vreg) {
+    uint8_t rs2 = (mop == 0b00) ? umop : 2;
+    uint32_t raw = (mop << 26) | (vm << 25) | (rs2 << 20) | (1 << 15) | (width << 12) | (vreg << 7);
+    cpu_state.set_pc(0);
+    if (store) {
+        execute::store_fp(decode::DecodedInst(raw | 0b0100111), cpu_state, memory, CSR);
+    } else {
+        execute::load_fp(decode::DecodedInst(raw | 0b0000111), cpu_state, memory, CSR);
+    }
+}
+
+template<typename E>
+static E get_elem(const CpuState& cpu_state, uint8_t reg, uint32_t i) {
+    E value;
+    std::memcpy(&value, cpu_state.get_v(reg) + (i * sizeof(E)), sizeof(E));
+    return value;
+}
+
+template<typename E>
+static void set_elem(CpuState& cpu_state, uint8_t reg, uint32_t i, E value) {
+    std::memcpy(cpu_state.get_v(reg) + (i * sizeof(E)), &value, sizeof(E));
+}
+
+template<typename F>
+static bool raises(F function, rv_trap::Cause cause) {
+    try {
+        function();
+    } catch (const rv_trap::RvException& e) {
+        return e.cause() == cause;
+    }
+    return false;
+}